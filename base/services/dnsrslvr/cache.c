@@ -14,21 +14,275 @@
 static RESOLVER_CACHE DnsCache;
 static BOOL DnsCacheInitialized = FALSE;
 
-#define DnsCacheLock()          do { EnterCriticalSection(&DnsCache.Lock); } while (0)
-#define DnsCacheUnlock()        do { LeaveCriticalSection(&DnsCache.Lock); } while (0)
+#define DnsCacheLockShared()    do { RtlAcquireResourceShared(&DnsCache.Lock, TRUE); } while (0)
+#define DnsCacheLock()          do { RtlAcquireResourceExclusive(&DnsCache.Lock, TRUE); } while (0)
+#define DnsCacheUnlock()        do { RtlReleaseResource(&DnsCache.Lock); } while (0)
+
+static
+ULONG
+DnsIntCacheGetTime(VOID)
+{
+    LARGE_INTEGER SystemTime;
+    ULONG Seconds;
+
+    GetSystemTimeAsFileTime((LPFILETIME)&SystemTime);
+    RtlTimeToSecondsSince1970(&SystemTime, &Seconds);
+
+    return Seconds;
+}
+
+static
+BOOL
+DnsIntCacheMakeKey(
+    _In_ LPCWSTR Name,
+    _Out_writes_(DNS_CACHE_MAX_NAME_LENGTH) LPWSTR Key,
+    _Out_ PULONG Hash)
+{
+    ULONG i;
+
+    /* Names are compared case insensitively, so the key is the lowercased name */
+    *Hash = 0;
+    for (i = 0; Name[i] != UNICODE_NULL; i++)
+    {
+        if (i == DNS_CACHE_MAX_NAME_LENGTH - 1)
+            return FALSE;
+
+        Key[i] = towlower(Name[i]);
+        *Hash = *Hash * 65599 + Key[i];
+    }
+    Key[i] = UNICODE_NULL;
+
+    return TRUE;
+}
+
+static
+PRESOLVER_CACHE_ENTRY
+DnsIntCacheAllocateEntry(
+    _In_ LPCWSTR Name,
+    _In_ WORD wType)
+{
+    PRESOLVER_CACHE_ENTRY CacheEntry;
+    WCHAR szKey[DNS_CACHE_MAX_NAME_LENGTH];
+    ULONG Hash;
+
+    if (!DnsIntCacheMakeKey(Name, szKey, &Hash))
+        return NULL;
+
+    CacheEntry = HeapAlloc(GetProcessHeap(),
+                           HEAP_ZERO_MEMORY,
+                           sizeof(*CacheEntry) + wcslen(szKey) * sizeof(WCHAR));
+    if (!CacheEntry)
+        return NULL;
+
+    /* The caller's reference goes to the cache once the entry is inserted */
+    CacheEntry->RefCount = 1;
+    CacheEntry->Hash = Hash;
+    CacheEntry->wType = wType;
+    wcscpy(CacheEntry->szName, szKey);
+
+    return CacheEntry;
+}
+
+static
+VOID
+DnsIntCacheDereferenceEntry(
+    _In_ PRESOLVER_CACHE_ENTRY CacheEntry)
+{
+    if (InterlockedDecrement(&CacheEntry->RefCount) != 0)
+        return;
+
+    /* Free record */
+    if (CacheEntry->Record)
+        DnsRecordListFree(CacheEntry->Record, DnsFreeRecordList);
+
+    /* Delete us */
+    HeapFree(GetProcessHeap(), 0, CacheEntry);
+}
+
+/* The cache must be locked exclusively */
+static
+VOID
+DnsIntCacheRemoveEntryItem(
+    _In_ PRESOLVER_CACHE_ENTRY CacheEntry)
+{
+    DPRINT("DnsIntCacheRemoveEntryItem(%p)\n", CacheEntry);
+
+    /* Remove the entry from the lists */
+    RemoveEntryList(&CacheEntry->CacheLink);
+    RemoveEntryList(&CacheEntry->HashLink);
+    if (!CacheEntry->bHostsFileEntry)
+    {
+        RemoveEntryList(&CacheEntry->LruLink);
+        RemoveEntryList(&CacheEntry->WheelLink);
+        DnsCache.WireEntries--;
+    }
+
+    /* Lookups still copying the records keep the entry alive */
+    DnsIntCacheDereferenceEntry(CacheEntry);
+}
+
+/* The cache must be locked, shared or exclusive */
+static
+PRESOLVER_CACHE_ENTRY
+DnsIntCacheFindEntry(
+    _In_ LPCWSTR Key,
+    _In_ ULONG Hash,
+    _In_ WORD wType)
+{
+    PRESOLVER_CACHE_ENTRY CacheEntry;
+    PLIST_ENTRY ListHead, NextEntry;
+
+    ListHead = &DnsCache.HashTable[Hash & (DNS_CACHE_HASH_SIZE - 1)];
+    for (NextEntry = ListHead->Flink; NextEntry != ListHead; NextEntry = NextEntry->Flink)
+    {
+        CacheEntry = CONTAINING_RECORD(NextEntry, RESOLVER_CACHE_ENTRY, HashLink);
+
+        if (CacheEntry->Hash == Hash &&
+            CacheEntry->wType == wType &&
+            wcscmp(CacheEntry->szName, Key) == 0)
+        {
+            return CacheEntry;
+        }
+    }
+
+    return NULL;
+}
+
+/* The cache must be locked exclusively */
+static
+VOID
+DnsIntCacheExpireEntries(
+    _In_ ULONG Now)
+{
+    PRESOLVER_CACHE_ENTRY CacheEntry;
+    PLIST_ENTRY ListHead, Entry, NextEntry;
+    ULONG Slots;
+
+    if ((LONG)(Now - DnsCache.WheelTime) <= 0)
+        return;
+
+    /* Visit every slot that went by since the last call, each one at most once */
+    Slots = min(Now - DnsCache.WheelTime, DNS_CACHE_WHEEL_SIZE);
+    while (Slots--)
+    {
+        DnsCache.WheelTime++;
+        ListHead = &DnsCache.Wheel[DnsCache.WheelTime & (DNS_CACHE_WHEEL_SIZE - 1)];
+
+        Entry = ListHead->Flink;
+        while (Entry != ListHead)
+        {
+            NextEntry = Entry->Flink;
+            CacheEntry = CONTAINING_RECORD(Entry, RESOLVER_CACHE_ENTRY, WheelLink);
+
+            /* Entries due in a later round of the wheel stay */
+            if ((LONG)(Now - CacheEntry->ExpireTime) >= 0)
+                DnsIntCacheRemoveEntryItem(CacheEntry);
+
+            Entry = NextEntry;
+        }
+    }
+
+    DnsCache.WheelTime = Now;
+}
+
+/* The cache must be locked exclusively */
+static
+VOID
+DnsIntCacheTrim(VOID)
+{
+    PRESOLVER_CACHE_ENTRY CacheEntry;
+    ULONG Scanned = 0;
+
+    while (DnsCache.WireEntries > DNS_CACHE_MAX_ENTRIES)
+    {
+        CacheEntry = CONTAINING_RECORD(DnsCache.LruList.Flink, RESOLVER_CACHE_ENTRY, LruLink);
+
+        /* Entries looked up since the last pass get a second chance */
+        if (CacheEntry->Referenced && Scanned++ < DnsCache.WireEntries)
+        {
+            CacheEntry->Referenced = FALSE;
+            RemoveEntryList(&CacheEntry->LruLink);
+            InsertTailList(&DnsCache.LruList, &CacheEntry->LruLink);
+            continue;
+        }
+
+        DPRINT("Evicting %S %hu\n", CacheEntry->szName, CacheEntry->wType);
+        DnsIntCacheRemoveEntryItem(CacheEntry);
+    }
+}
+
+static
+VOID
+DnsIntCacheInsertEntry(
+    _In_ PRESOLVER_CACHE_ENTRY CacheEntry,
+    _In_ ULONG Ttl)
+{
+    PRESOLVER_CACHE_ENTRY OldEntry;
+    ULONG Now;
+
+    Now = DnsIntCacheGetTime();
+    CacheEntry->ExpireTime = Now + Ttl;
+
+    /* Lock the cache */
+    DnsCacheLock();
+
+    DnsIntCacheExpireEntries(Now);
+
+    OldEntry = DnsIntCacheFindEntry(CacheEntry->szName, CacheEntry->Hash, CacheEntry->wType);
+    if (OldEntry)
+    {
+        /* The first hosts file entry for a name wins, over the wire as well */
+        if (OldEntry->bHostsFileEntry)
+        {
+            DnsCacheUnlock();
+            DnsIntCacheDereferenceEntry(CacheEntry);
+            return;
+        }
+
+        DnsIntCacheRemoveEntryItem(OldEntry);
+    }
+
+    /* Insert it to our lists */
+    InsertTailList(&DnsCache.RecordList, &CacheEntry->CacheLink);
+    InsertTailList(&DnsCache.HashTable[CacheEntry->Hash & (DNS_CACHE_HASH_SIZE - 1)],
+                   &CacheEntry->HashLink);
+
+    /* Hosts file entries neither expire nor get evicted */
+    if (!CacheEntry->bHostsFileEntry)
+    {
+        InsertTailList(&DnsCache.LruList, &CacheEntry->LruLink);
+        InsertTailList(&DnsCache.Wheel[CacheEntry->ExpireTime & (DNS_CACHE_WHEEL_SIZE - 1)],
+                       &CacheEntry->WheelLink);
+        DnsCache.WireEntries++;
+
+        DnsIntCacheTrim();
+    }
+
+    /* Release the cache */
+    DnsCacheUnlock();
+}
 
 VOID
 DnsIntCacheInitialize(VOID)
 {
+    ULONG i;
+
     DPRINT("DnsIntCacheInitialize()\n");
 
     /* Check if we're initialized */
     if (DnsCacheInitialized)
         return;
 
-    /* Initialize the cache lock and namespace list */
-    InitializeCriticalSection((LPCRITICAL_SECTION)&DnsCache.Lock);
+    /* Initialize the cache lock, the lists and the timer wheel */
+    RtlInitializeResource(&DnsCache.Lock);
     InitializeListHead(&DnsCache.RecordList);
+    InitializeListHead(&DnsCache.LruList);
+    for (i = 0; i < DNS_CACHE_HASH_SIZE; i++)
+        InitializeListHead(&DnsCache.HashTable[i]);
+    for (i = 0; i < DNS_CACHE_WHEEL_SIZE; i++)
+        InitializeListHead(&DnsCache.Wheel[i]);
+    DnsCache.WheelTime = DnsIntCacheGetTime();
+    DnsCache.WireEntries = 0;
     DnsCacheInitialized = TRUE;
 }
 
@@ -46,24 +300,9 @@ DnsIntCacheFree(VOID)
 
     DnsIntCacheFlush(CACHE_FLUSH_ALL);
 
-    DeleteCriticalSection(&DnsCache.Lock);
+    RtlDeleteResource(&DnsCache.Lock);
     DnsCacheInitialized = FALSE;
 }
- 
-VOID
-DnsIntCacheRemoveEntryItem(PRESOLVER_CACHE_ENTRY CacheEntry)
-{
-    DPRINT("DnsIntCacheRemoveEntryItem(%p)\n", CacheEntry);
-
-    /* Remove the entry from the list */
-    RemoveEntryList(&CacheEntry->CacheLink);
- 
-    /* Free record */
-    DnsRecordListFree(CacheEntry->Record, DnsFreeRecordList);
-
-    /* Delete us */
-    HeapFree(GetProcessHeap(), 0, CacheEntry);
-}
 
 DNS_STATUS
 DnsIntCacheFlush(
@@ -106,43 +345,75 @@ DnsIntCacheGetEntryByName(
     LPCWSTR Name,
     WORD wType,
     DWORD dwFlags,
-    PDNS_RECORDW *Record)
+    PDNS_RECORDW *Record,
+    PBOOL pbCached)
 {
-    DNS_STATUS Status = DNS_INFO_NO_RECORDS;
+    DNS_STATUS Status;
     PRESOLVER_CACHE_ENTRY CacheEntry;
-    PLIST_ENTRY NextEntry;
+    PDNS_RECORDW CurrentRecord;
+    WCHAR szKey[DNS_CACHE_MAX_NAME_LENGTH];
+    ULONG Hash, Now;
 
     DPRINT("DnsIntCacheGetEntryByName(%S %hu 0x%lx %p)\n",
            Name, wType, dwFlags, Record);
 
     /* Assume failure */
     *Record = NULL;
+    if (pbCached)
+        *pbCached = FALSE;
 
-    /* Lock the cache */
-    DnsCacheLock();
+    if (!DnsIntCacheMakeKey(Name, szKey, &Hash))
+        return DNS_INFO_NO_RECORDS;
 
-    /* Match the Id with all the entries in the List */
-    NextEntry = DnsCache.RecordList.Flink;
-    while (NextEntry != &DnsCache.RecordList)
-    {
-        /* Get the Current Entry */
-        CacheEntry = CONTAINING_RECORD(NextEntry, RESOLVER_CACHE_ENTRY, CacheLink);
+    Now = DnsIntCacheGetTime();
 
-        /* Check if this is the Catalog Entry ID we want */
-        if (_wcsicmp(CacheEntry->Record->pName, Name) == 0)
-        {
-            /* Copy the entry and return it */
-            *Record = DnsRecordSetCopyEx(CacheEntry->Record, DnsCharSetUnicode, DnsCharSetUnicode);
-            Status = ERROR_SUCCESS;
-            break;
-        }
+    /* Lookups only share the lock, and only while walking the hash chain */
+    DnsCacheLockShared();
 
-        NextEntry = NextEntry->Flink;
+    CacheEntry = DnsIntCacheFindEntry(szKey, Hash, wType);
+    if (CacheEntry && !CacheEntry->bHostsFileEntry &&
+        (LONG)(Now - CacheEntry->ExpireTime) >= 0)
+    {
+        /* Expired, the timer wheel will reclaim it */
+        CacheEntry = NULL;
+    }
+
+    if (CacheEntry)
+    {
+        InterlockedIncrement(&CacheEntry->RefCount);
+        InterlockedExchange(&CacheEntry->Referenced, TRUE);
     }
 
     /* Release the cache */
     DnsCacheUnlock();
 
+    if (!CacheEntry)
+        return DNS_INFO_NO_RECORDS;
+
+    /* Also tells a cached NODATA answer from a miss, both are DNS_INFO_NO_RECORDS */
+    if (pbCached)
+        *pbCached = TRUE;
+
+    if (CacheEntry->Record)
+    {
+        /* Copy the records and hand out the time they have left */
+        *Record = DnsRecordSetCopyEx(CacheEntry->Record, DnsCharSetUnicode, DnsCharSetUnicode);
+        Status = (*Record != NULL) ? ERROR_SUCCESS : ERROR_OUTOFMEMORY;
+
+        if (!CacheEntry->bHostsFileEntry)
+        {
+            for (CurrentRecord = *Record; CurrentRecord; CurrentRecord = CurrentRecord->pNext)
+                CurrentRecord->dwTtl = CacheEntry->ExpireTime - Now;
+        }
+    }
+    else
+    {
+        /* Negative entry, the name or the record type is known not to exist */
+        Status = CacheEntry->Status;
+    }
+
+    DnsIntCacheDereferenceEntry(CacheEntry);
+
     return Status;
 }
 
@@ -151,30 +422,33 @@ DnsIntCacheRemoveEntryByName(LPCWSTR Name)
 {
     BOOL Ret = FALSE;
     PRESOLVER_CACHE_ENTRY CacheEntry;
-    PLIST_ENTRY NextEntry;
+    PLIST_ENTRY ListHead, Entry, NextEntry;
+    WCHAR szKey[DNS_CACHE_MAX_NAME_LENGTH];
+    ULONG Hash;
 
     DPRINT("DnsIntCacheRemoveEntryByName(%S)\n", Name);
 
+    if (!DnsIntCacheMakeKey(Name, szKey, &Hash))
+        return FALSE;
+
     /* Lock the cache */
     DnsCacheLock();
 
-    /* Match the Id with all the entries in the List */
-    NextEntry = DnsCache.RecordList.Flink;
-    while (NextEntry != &DnsCache.RecordList)
+    /* All the record types of a name share its hash chain */
+    ListHead = &DnsCache.HashTable[Hash & (DNS_CACHE_HASH_SIZE - 1)];
+    Entry = ListHead->Flink;
+    while (Entry != ListHead)
     {
-        /* Get the Current Entry */
-        CacheEntry = CONTAINING_RECORD(NextEntry, RESOLVER_CACHE_ENTRY, CacheLink);
+        NextEntry = Entry->Flink;
+        CacheEntry = CONTAINING_RECORD(Entry, RESOLVER_CACHE_ENTRY, HashLink);
 
-        /* Check if this is the Catalog Entry ID we want */
-        if (_wcsicmp(CacheEntry->Record->pName, Name) == 0)
+        if (CacheEntry->Hash == Hash && wcscmp(CacheEntry->szName, szKey) == 0)
         {
-            /* Remove the entry */
             DnsIntCacheRemoveEntryItem(CacheEntry);
             Ret = TRUE;
-            break;
         }
 
-        NextEntry = NextEntry->Flink;
+        Entry = NextEntry;
     }
 
     /* Release the cache */
@@ -189,7 +463,9 @@ DnsIntCacheAddEntry(
     _In_ PDNS_RECORDW Record,
     _In_ BOOL bHostsFileEntry)
 {
-    PRESOLVER_CACHE_ENTRY Entry;
+    PRESOLVER_CACHE_ENTRY CacheEntry;
+    PDNS_RECORDW CurrentRecord;
+    ULONG Ttl = DNS_CACHE_MAX_TTL;
 
     DPRINT("DnsIntCacheAddEntry(%p %u)\n",
            Record, bHostsFileEntry);
@@ -197,22 +473,50 @@ DnsIntCacheAddEntry(
     DPRINT("Name: %S\n", Record->pName);
     DPRINT("TTL: %lu\n", Record->dwTtl);
 
-    /* Lock the cache */
-    DnsCacheLock();
+    /* The set lives as long as its shortest lived record */
+    if (!bHostsFileEntry)
+    {
+        for (CurrentRecord = Record; CurrentRecord; CurrentRecord = CurrentRecord->pNext)
+            Ttl = min(Ttl, CurrentRecord->dwTtl);
+
+        if (Ttl == 0)
+            return;
+    }
 
-    /* Match the Id with all the entries in the List */
-    Entry = (PRESOLVER_CACHE_ENTRY)HeapAlloc(GetProcessHeap(), 0, sizeof(*Entry));
-    if (!Entry)
+    CacheEntry = DnsIntCacheAllocateEntry(Record->pName, Record->wType);
+    if (!CacheEntry)
         return;
 
-    Entry->bHostsFileEntry = bHostsFileEntry;
-    Entry->Record = DnsRecordSetCopyEx(Record, DnsCharSetUnicode, DnsCharSetUnicode);
+    CacheEntry->bHostsFileEntry = bHostsFileEntry;
+    CacheEntry->Status = ERROR_SUCCESS;
+    CacheEntry->Record = DnsRecordSetCopyEx(Record, DnsCharSetUnicode, DnsCharSetUnicode);
+    if (!CacheEntry->Record)
+    {
+        DnsIntCacheDereferenceEntry(CacheEntry);
+        return;
+    }
 
-    /* Insert it to our List */
-    InsertTailList(&DnsCache.RecordList, &Entry->CacheLink);
+    DnsIntCacheInsertEntry(CacheEntry, Ttl);
+}
 
-    /* Release the cache */
-    DnsCacheUnlock();
+VOID
+DnsIntCacheAddNegativeEntry(
+    _In_ LPCWSTR Name,
+    _In_ WORD wType,
+    _In_ DNS_STATUS Status)
+{
+    PRESOLVER_CACHE_ENTRY CacheEntry;
+
+    DPRINT("DnsIntCacheAddNegativeEntry(%S %hu %lu)\n",
+           Name, wType, Status);
+
+    CacheEntry = DnsIntCacheAllocateEntry(Name, wType);
+    if (!CacheEntry)
+        return;
+
+    CacheEntry->Status = Status;
+
+    DnsIntCacheInsertEntry(CacheEntry, DNS_CACHE_NEGATIVE_TTL);
 }
 
 DNS_STATUS
@@ -222,9 +526,13 @@ DnsIntCacheGetEntries(
     PRESOLVER_CACHE_ENTRY CacheEntry;
     PLIST_ENTRY NextEntry;
     PDNS_CACHE_ENTRY pLastEntry = NULL, pNewEntry;
+    DNS_STATUS Status = ERROR_SUCCESS;
+    ULONG Now;
+
+    Now = DnsIntCacheGetTime();
 
     /* Lock the cache */
-    DnsCacheLock();
+    DnsCacheLockShared();
 
     *ppCacheEntries = NULL;
 
@@ -233,6 +541,14 @@ DnsIntCacheGetEntries(
     {
         /* Get the Current Entry */
         CacheEntry = CONTAINING_RECORD(NextEntry, RESOLVER_CACHE_ENTRY, CacheLink);
+        NextEntry = NextEntry->Flink;
+
+        /* Skip negative entries and the ones waiting to be reclaimed */
+        if (!CacheEntry->Record ||
+            (!CacheEntry->bHostsFileEntry && (LONG)(Now - CacheEntry->ExpireTime) >= 0))
+        {
+            continue;
+        }
 
         DPRINT("1 %S %lu\n", CacheEntry->Record->pName, CacheEntry->Record->wType);
         if (CacheEntry->Record->pNext)
@@ -243,13 +559,16 @@ DnsIntCacheGetEntries(
         pNewEntry = midl_user_allocate(sizeof(DNS_CACHE_ENTRY));
         if (pNewEntry == NULL)
         {
-            return ERROR_OUTOFMEMORY;
+            Status = ERROR_OUTOFMEMORY;
+            break;
         }
 
         pNewEntry->pszName = midl_user_allocate((wcslen(CacheEntry->Record->pName) + 1) * sizeof(WCHAR));
         if (pNewEntry->pszName == NULL)
         {
-            return ERROR_OUTOFMEMORY;
+            midl_user_free(pNewEntry);
+            Status = ERROR_OUTOFMEMORY;
+            break;
         }
 
         wcscpy(pNewEntry->pszName, CacheEntry->Record->pName);
@@ -262,12 +581,22 @@ DnsIntCacheGetEntries(
         else
             pLastEntry->pNext = pNewEntry;
         pLastEntry = pNewEntry;
-
-        NextEntry = NextEntry->Flink;
     }
 
     /* Release the cache */
     DnsCacheUnlock();
 
-    return ERROR_SUCCESS;
+    if (Status != ERROR_SUCCESS)
+    {
+        /* Don't leak what was built so far */
+        while (*ppCacheEntries)
+        {
+            pNewEntry = *ppCacheEntries;
+            *ppCacheEntries = pNewEntry->pNext;
+            midl_user_free(pNewEntry->pszName);
+            midl_user_free(pNewEntry);
+        }
+    }
+
+    return Status;
 }
@@ -24,24 +24,45 @@
 
 #include <strsafe.h>
 
+#define DNS_CACHE_HASH_SIZE        1024    /* Power of two */
+#define DNS_CACHE_WHEEL_SIZE       256     /* One second per slot, power of two */
+#define DNS_CACHE_MAX_ENTRIES      4096
+#define DNS_CACHE_MAX_TTL          86400
+#define DNS_CACHE_NEGATIVE_TTL     60
+#define DNS_CACHE_MAX_NAME_LENGTH  256
+
 typedef struct _RESOLVER_CACHE_ENTRY
 {
     LIST_ENTRY CacheLink;
+    LIST_ENTRY HashLink;
+    LIST_ENTRY LruLink;             /* Only for entries that came off the wire */
+    LIST_ENTRY WheelLink;           /* Likewise */
+    LONG RefCount;
+    LONG Referenced;                /* Set by lookups, cleared by the LRU scan */
+    ULONG Hash;
+    ULONG ExpireTime;               /* Seconds since 1970 */
+    WORD wType;
     BOOL bHostsFileEntry;
+    DNS_STATUS Status;              /* Negative entries carry no records */
     PDNS_RECORDW Record;
+    WCHAR szName[ANYSIZE_ARRAY];    /* Lowercased */
 } RESOLVER_CACHE_ENTRY, *PRESOLVER_CACHE_ENTRY;
 
 typedef struct _RESOLVER_CACHE
 {
     LIST_ENTRY RecordList;
-    CRITICAL_SECTION Lock;
+    LIST_ENTRY LruList;
+    LIST_ENTRY HashTable[DNS_CACHE_HASH_SIZE];
+    LIST_ENTRY Wheel[DNS_CACHE_WHEEL_SIZE];
+    ULONG WheelTime;
+    ULONG WireEntries;
+    RTL_RESOURCE Lock;
 } RESOLVER_CACHE, *PRESOLVER_CACHE;
 
 
 /* cache.c */
 
 VOID DnsIntCacheInitialize(VOID);
-VOID DnsIntCacheRemoveEntryItem(PRESOLVER_CACHE_ENTRY CacheEntry);
 VOID DnsIntCacheFree(VOID);
 
 #define CACHE_FLUSH_HOSTS_FILE_ENTRIES     0x00000001
@@ -57,13 +78,20 @@ DnsIntCacheGetEntryByName(
     LPCWSTR Name,
     WORD wType,
     DWORD dwFlags,
-    PDNS_RECORDW *Record);
+    PDNS_RECORDW *Record,
+    PBOOL pbCached);
 
 VOID
 DnsIntCacheAddEntry(
     _In_ PDNS_RECORDW Record,
     _In_ BOOL bHostsFileEntry);
 
+VOID
+DnsIntCacheAddNegativeEntry(
+    _In_ LPCWSTR Name,
+    _In_ WORD wType,
+    _In_ DNS_STATUS Status);
+
 BOOL
 DnsIntCacheRemoveEntryByName(
     _In_ LPCWSTR Name);
@@ -77,14 +77,19 @@ R_ResolverQuery(
     _In_ LPCWSTR pszName,
     _In_ WORD wType,
     _In_ DWORD dwFlags,
+    _In_ DWORD dwServerCount,
+    _In_opt_ IP4_ADDRESS *pServerList,
     _Inout_ DWORD *dwRecords,
     _Out_ DNS_RECORDW **ppResultRecords)
 {
     PDNS_RECORDW Record;
+    PIP4_ARRAY Servers = NULL;
     DNS_STATUS Status = ERROR_SUCCESS;
+    BOOL bCached;
 
-    DPRINT("R_ResolverQuery(%S %S %x %lx %p %p)\n",
-           pszServerName, pszName, wType, dwFlags, dwRecords, ppResultRecords);
+    DPRINT("R_ResolverQuery(%S %S %x %lx %lu %p %p %p)\n",
+           pszServerName, pszName, wType, dwFlags, dwServerCount, pServerList,
+           dwRecords, ppResultRecords);
 
     if (pszName == NULL || wType == 0 || ppResultRecords == NULL)
         return ERROR_INVALID_PARAMETER;
@@ -92,12 +97,25 @@ R_ResolverQuery(
     if ((dwFlags & DNS_QUERY_WIRE_ONLY) != 0 && (dwFlags & DNS_QUERY_NO_WIRE_QUERY) != 0)
         return ERROR_INVALID_PARAMETER;
 
+    if (dwServerCount != 0 && pServerList != NULL)
+    {
+        /* The caller wants its own servers asked instead of the configured ones */
+        Servers = HeapAlloc(GetProcessHeap(), 0,
+                            FIELD_OFFSET(IP4_ARRAY, AddrArray[dwServerCount]));
+        if (Servers == NULL)
+            return ERROR_OUTOFMEMORY;
+
+        Servers->AddrCount = dwServerCount;
+        CopyMemory(Servers->AddrArray, pServerList, dwServerCount * sizeof(IP4_ADDRESS));
+    }
+
     if (dwFlags & DNS_QUERY_WIRE_ONLY)
     {
         DPRINT("DNS query!\n");
         Status = Query_Main(pszName,
                             wType,
                             dwFlags,
+                            Servers,
                             ppResultRecords);
     }
     else if (dwFlags & DNS_QUERY_NO_WIRE_QUERY)
@@ -106,7 +124,8 @@ R_ResolverQuery(
         Status = DnsIntCacheGetEntryByName(pszName,
                                            wType,
                                            dwFlags,
-                                           ppResultRecords);
+                                           ppResultRecords,
+                                           NULL);
     }
     else
     {
@@ -114,19 +133,27 @@ R_ResolverQuery(
         Status = DnsIntCacheGetEntryByName(pszName,
                                            wType,
                                            dwFlags,
-                                           ppResultRecords);
-        if (Status == DNS_INFO_NO_RECORDS)
+                                           ppResultRecords,
+                                           &bCached);
+        if (!bCached)
         {
             DPRINT("DNS query!\n");
             Status = Query_Main(pszName,
                                 wType,
                                 dwFlags,
+                                Servers,
                                 ppResultRecords);
             if (Status == ERROR_SUCCESS)
             {
                 DPRINT("DNS query successful!\n");
                 DnsIntCacheAddEntry(*ppResultRecords, FALSE);
             }
+            else if (Status == DNS_ERROR_RCODE_NAME_ERROR || Status == DNS_INFO_NO_RECORDS)
+            {
+                /* Remember authoritative NXDOMAIN and NODATA answers for a while too.
+                   Anything else, like no servers or a timeout, may be gone on the next try */
+                DnsIntCacheAddNegativeEntry(pszName, wType, Status);
+            }
         }
     }
 
@@ -146,6 +173,9 @@ R_ResolverQuery(
         }
     }
 
+    if (Servers != NULL)
+        HeapFree(GetProcessHeap(), 0, Servers);
+
     DPRINT("R_ResolverQuery result %ld %ld\n", Status, *dwRecords);
 
     return Status;
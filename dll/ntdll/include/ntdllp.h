@@ -8,8 +8,10 @@
 
 #pragma once
 
+/* The hash table starts out static and doubles when the chains get long */
 #define LDR_HASH_TABLE_ENTRIES 32
-#define LDR_GET_HASH_ENTRY(x) (RtlUpcaseUnicodeChar((x)) & (LDR_HASH_TABLE_ENTRIES - 1))
+#define LDR_HASH_TABLE_MAX_ENTRIES 4096
+#define LDR_GET_HASH_ENTRY(x) ((x) & (LdrpHashTableSize - 1))
 
 /* LdrpUpdateLoadCount2 flags */
 #define LDRP_UPDATE_REFCOUNT   0x01
@@ -43,7 +45,9 @@ NTSTATUS
 extern RTL_CRITICAL_SECTION LdrpLoaderLock;
 extern BOOLEAN LdrpInLdrInit;
 extern PVOID LdrpHeap;
-extern LIST_ENTRY LdrpHashTable[LDR_HASH_TABLE_ENTRIES];
+extern LIST_ENTRY LdrpStaticHashTable[LDR_HASH_TABLE_ENTRIES];
+extern PLIST_ENTRY LdrpHashTable;
+extern ULONG LdrpHashTableSize;
 extern BOOLEAN ShowSnaps;
 extern UNICODE_STRING LdrpDefaultPath;
 extern HANDLE LdrpKnownDllObjectDirectory;
@@ -111,6 +115,12 @@ LdrpAllocateDataTableEntry(IN PVOID BaseAddress);
 VOID NTAPI
 LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry);
 
+VOID NTAPI
+LdrpRemoveHashTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry);
+
+ULONG NTAPI
+LdrpHashDllName(IN PCUNICODE_STRING DllName);
+
 NTSTATUS NTAPI
 LdrpLoadDll(IN BOOLEAN Redirected,
             IN PWSTR DllPath OPTIONAL,
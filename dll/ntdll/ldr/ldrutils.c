@@ -17,6 +17,7 @@
 /* GLOBALS *******************************************************************/
 
 PLDR_DATA_TABLE_ENTRY LdrpLoadedDllHandleCache, LdrpGetModuleHandleCache;
+static ULONG LdrpHashTableCount;
 
 BOOLEAN g_ShimsEnabled;
 PVOID g_pShimEngineModule;
@@ -1286,7 +1287,7 @@ SkipCheck:
             /* Remove the DLL from the lists */
             RemoveEntryList(&LdrEntry->InLoadOrderLinks);
             RemoveEntryList(&LdrEntry->InMemoryOrderLinks);
-            RemoveEntryList(&LdrEntry->HashLinks);
+            LdrpRemoveHashTableEntry(LdrEntry);
 
             /* Remove the LDR Entry */
             RtlFreeHeap(LdrpHeap, 0, LdrEntry );
@@ -1480,7 +1481,7 @@ FailRelocate:
                 /* Remove it from the lists */
                 RemoveEntryList(&LdrEntry->InLoadOrderLinks);
                 RemoveEntryList(&LdrEntry->InMemoryOrderLinks);
-                RemoveEntryList(&LdrEntry->HashLinks);
+                LdrpRemoveHashTableEntry(LdrEntry);
 
                 /* Unmap it, clear the entry */
                 NtUnmapViewOfSection(NtCurrentProcess(), ViewBase);
@@ -1577,6 +1578,66 @@ LdrpAllocateDataTableEntry(IN PVOID BaseAddress)
     return LdrEntry;
 }
 
+ULONG
+NTAPI
+LdrpHashDllName(IN PCUNICODE_STRING DllName)
+{
+    ULONG Hash = 0;
+    USHORT i;
+
+    /* Hash the whole name, upcased the same way RtlEqualUnicodeString does */
+    for (i = 0; i < DllName->Length / sizeof(WCHAR); i++)
+    {
+        Hash = Hash * 65599 + RtlUpcaseUnicodeChar(DllName->Buffer[i]);
+    }
+
+    return Hash;
+}
+
+static
+VOID
+LdrpGrowHashTable(VOID)
+{
+    PLIST_ENTRY NewTable, ListHead;
+    PLDR_DATA_TABLE_ENTRY LdrEntry;
+    ULONG NewSize, i, Hash;
+
+    /* The heap only exists once the loader is set up */
+    if (!LdrpHeap) return;
+
+    NewSize = LdrpHashTableSize * 2;
+    NewTable = RtlAllocateHeap(LdrpHeap, 0, NewSize * sizeof(LIST_ENTRY));
+    if (!NewTable) return;
+
+    for (i = 0; i < NewSize; i++)
+    {
+        InitializeListHead(&NewTable[i]);
+    }
+
+    /* Move every entry into its new bucket */
+    for (i = 0; i < LdrpHashTableSize; i++)
+    {
+        ListHead = &LdrpHashTable[i];
+        while (!IsListEmpty(ListHead))
+        {
+            LdrEntry = CONTAINING_RECORD(RemoveHeadList(ListHead),
+                                         LDR_DATA_TABLE_ENTRY,
+                                         HashLinks);
+            Hash = LdrpHashDllName(&LdrEntry->BaseDllName);
+            InsertTailList(&NewTable[Hash & (NewSize - 1)], &LdrEntry->HashLinks);
+        }
+    }
+
+    /* Free the old table, unless it's the static one */
+    if (LdrpHashTable != LdrpStaticHashTable)
+    {
+        RtlFreeHeap(LdrpHeap, 0, LdrpHashTable);
+    }
+
+    LdrpHashTable = NewTable;
+    LdrpHashTableSize = NewSize;
+}
+
 VOID
 NTAPI
 LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
@@ -1584,15 +1645,31 @@ LdrpInsertMemoryTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
     PPEB_LDR_DATA PebData = NtCurrentPeb()->Ldr;
     ULONG i;
 
+    /* Keep the chains short, about two entries on average */
+    if ((LdrpHashTableCount >= LdrpHashTableSize * 2) &&
+        (LdrpHashTableSize < LDR_HASH_TABLE_MAX_ENTRIES))
+    {
+        LdrpGrowHashTable();
+    }
+
     /* Insert into hash table */
-    i = LDR_GET_HASH_ENTRY(LdrEntry->BaseDllName.Buffer[0]);
+    i = LDR_GET_HASH_ENTRY(LdrpHashDllName(&LdrEntry->BaseDllName));
     InsertTailList(&LdrpHashTable[i], &LdrEntry->HashLinks);
+    LdrpHashTableCount++;
 
     /* Insert into other lists */
     InsertTailList(&PebData->InLoadOrderModuleList, &LdrEntry->InLoadOrderLinks);
     InsertTailList(&PebData->InMemoryOrderModuleList, &LdrEntry->InMemoryOrderLinks);
 }
 
+VOID
+NTAPI
+LdrpRemoveHashTableEntry(IN PLDR_DATA_TABLE_ENTRY LdrEntry)
+{
+    RemoveEntryList(&LdrEntry->HashLinks);
+    LdrpHashTableCount--;
+}
+
 VOID
 NTAPI
 LdrpFinalizeAndDeallocateDataTableEntry(IN PLDR_DATA_TABLE_ENTRY Entry)
@@ -2012,7 +2089,7 @@ lookinhash:
         /* FIXME: if we get redirected dll it means that we also get a full path so we need to find its filename for the hash lookup */
 
         /* Get hash index */
-        HashIndex = LDR_GET_HASH_ENTRY(DllName->Buffer[0]);
+        HashIndex = LDR_GET_HASH_ENTRY(LdrpHashDllName(DllName));
 
         /* Traverse that list */
         ListHead = &LdrpHashTable[HashIndex];
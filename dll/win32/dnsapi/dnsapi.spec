@@ -187,5 +187,5 @@
 @ stub NetInfo_IsForUpdate
 @ stub NetInfo_ResetServerPriorities
 @ stub QueryDirectEx
-@ stdcall Query_Main(wstr long long ptr)
+@ stdcall Query_Main(wstr long long ptr ptr)
 @ stub Reg_ReadGlobalsEx
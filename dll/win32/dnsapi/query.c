@@ -475,6 +475,7 @@ DnsQuery_W(LPCWSTR Name,
 {
     DWORD dwRecords = 0;
     PDNS_RECORDW pRecord = NULL;
+    PIP4_ARRAY Servers = Extra;
     size_t NameLen, i;
     DNS_STATUS Status = ERROR_SUCCESS;
 
@@ -526,6 +527,8 @@ DnsQuery_W(LPCWSTR Name,
                                  Name,
                                  Type,
                                  Options,
+                                 Servers ? Servers->AddrCount : 0,
+                                 Servers ? Servers->AddrArray : NULL,
                                  &dwRecords,
                                  (DNS_RECORDW **)QueryResultSet);
         DPRINT("R_ResolverQuery() returned %lu\n", Status);
@@ -654,6 +657,7 @@ WINAPI
 Query_Main(LPCWSTR Name,
            WORD Type,
            DWORD Options,
+           PIP4_ARRAY Servers,
            PDNS_RECORD *QueryResultSet)
 {
     adns_state astate;
@@ -671,6 +675,9 @@ Query_Main(LPCWSTR Name,
     PCHAR HostWithDomainName;
     PCHAR AnsiName;
     size_t NameLen = 0;
+    time_t Now;
+    DNS_STATUS Status;
+    DWORD i;
 
     if (Name == NULL)
         return ERROR_INVALID_PARAMETER;
@@ -750,6 +757,7 @@ Query_Main(LPCWSTR Name,
             (*QueryResultSet)->Flags.S.Section = DnsSectionAnswer;
             (*QueryResultSet)->Flags.S.CharSet = DnsCharSetUnicode;
             (*QueryResultSet)->Data.A.IpAddress = Address;
+            (*QueryResultSet)->dwTtl = 0;
 
             (*QueryResultSet)->pName = (LPSTR)DnsCToW(HostWithDomainName);
 
@@ -771,11 +779,24 @@ Query_Main(LPCWSTR Name,
             RtlFreeHeap(RtlGetProcessHeap(), 0, network_info);
             return DnsIntTranslateAdnsToDNS_STATUS(adns_error);
         }
-        for (pip = &(network_info->DnsServerList); pip; pip = pip->Next)
+        if (Servers && Servers->AddrCount)
+        {
+            /* The caller picked the servers to ask */
+            for (i = 0; i < Servers->AddrCount; i++)
+            {
+                addr.s_addr = Servers->AddrArray[i];
+                if ((addr.s_addr != INADDR_ANY) && (addr.s_addr != INADDR_NONE))
+                    adns_addserver(astate, addr);
+            }
+        }
+        else
         {
-            addr.s_addr = inet_addr(pip->IpAddress.String);
-            if ((addr.s_addr != INADDR_ANY) && (addr.s_addr != INADDR_NONE))
-                adns_addserver(astate, addr);
+            for (pip = &(network_info->DnsServerList); pip; pip = pip->Next)
+            {
+                addr.s_addr = inet_addr(pip->IpAddress.String);
+                if ((addr.s_addr != INADDR_ANY) && (addr.s_addr != INADDR_NONE))
+                    adns_addserver(astate, addr);
+            }
         }
         if (network_info->DomainName[0])
         {
@@ -844,6 +865,10 @@ Query_Main(LPCWSTR Name,
                 (*QueryResultSet)->Flags.S.CharSet = DnsCharSetUnicode;
                 (*QueryResultSet)->Data.A.IpAddress = answer->rrs.addr->addr.inet.sin_addr.s_addr;
 
+                /* adns gives an absolute expiry time, the resolver cache wants the TTL */
+                Now = time(NULL);
+                (*QueryResultSet)->dwTtl = (answer->expires > Now) ? (DWORD)(answer->expires - Now) : 0;
+
                 adns_finish(astate);
 
                 (*QueryResultSet)->pName = (LPSTR)xstrsave(Name);
@@ -853,13 +878,21 @@ Query_Main(LPCWSTR Name,
 
             if (NULL == answer || adns_s_prohibitedcname != answer->status || NULL == answer->cname)
             {
+                /* Tell the authoritative answers apart, the resolver caches those */
+                if (answer && answer->status == adns_s_nxdomain)
+                    Status = DNS_ERROR_RCODE_NAME_ERROR;
+                else if (answer && answer->status == adns_s_nodata)
+                    Status = DNS_INFO_NO_RECORDS;
+                else
+                    Status = ERROR_FILE_NOT_FOUND;
+
                 adns_finish(astate);
 
                 if (CurrentName != AnsiName)
                     RtlFreeHeap(RtlGetProcessHeap(), 0, CurrentName);
 
                 RtlFreeHeap(RtlGetProcessHeap(), 0, AnsiName);
-                return ERROR_FILE_NOT_FOUND;
+                return Status;
             }
 
             if (CurrentName != AnsiName)
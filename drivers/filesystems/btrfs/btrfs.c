@@ -5900,6 +5900,18 @@ static void check_cpu() {
     else
         TRACE("SSE2 is not supported\n");
 }
+#elif defined(__REACTOS__) && defined(_AMD64_)
+static void check_cpu() {
+    int cpuInfo[4];
+
+    __cpuid(cpuInfo, 1);
+
+    if (cpuInfo[2] & (1 << 9)) {
+        TRACE("SSSE3 is supported\n");
+        galois_use_ssse3();
+    } else
+        TRACE("SSSE3 not supported\n");
+}
 #endif
 
 #ifdef _DEBUG
@@ -6196,7 +6208,7 @@ NTSTATUS __stdcall DriverEntry(_In_ PDRIVER_OBJECT DriverObject, _In_ PUNICODE_S
 
     TRACE("DriverEntry\n");
 
-#if !defined(__REACTOS__) && (defined(_X86_) || defined(_AMD64_))
+#if defined(_AMD64_) || (!defined(__REACTOS__) && defined(_X86_))
     check_cpu();
 #endif
 
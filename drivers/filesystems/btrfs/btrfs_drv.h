@@ -1558,9 +1558,13 @@ NTSTATUS zstd_compress(uint8_t* inbuf, uint32_t inlen, uint8_t* outbuf, uint32_t
 // in galois.c
 void galois_double(uint8_t* data, uint32_t len);
 void galois_divpower(uint8_t* data, uint8_t div, uint32_t readlen);
+void galois_recover(uint8_t* dx, uint8_t* pxy, uint8_t* p, uint8_t* q, uint8_t a, uint8_t b, uint32_t len);
 uint8_t gpow2(uint8_t e);
 uint8_t gmul(uint8_t a, uint8_t b);
 uint8_t gdiv(uint8_t a, uint8_t b);
+#ifdef _AMD64_
+void galois_use_ssse3();
+#endif
 
 // in devctrl.c
 
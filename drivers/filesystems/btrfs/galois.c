@@ -15,7 +15,11 @@
  * You should have received a copy of the GNU Lesser General Public Licence
  * along with WinBtrfs.  If not, see <http://www.gnu.org/licenses/>. */
 
+#ifndef GALOIS_HOST_TEST
 #include "btrfs_drv.h"
+#else
+#include "test/galoistest.h"
+#endif
 
 static const uint8_t glog[] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d, 0x3a, 0x74, 0xe8, 0xcd, 0x87, 0x13, 0x26,
                              0x4c, 0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9, 0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0,
@@ -51,21 +55,6 @@ static const uint8_t gilog[] = {0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1a, 0xc6,
                               0xcb, 0x59, 0x5f, 0xb0, 0x9c, 0xa9, 0xa0, 0x51, 0x0b, 0xf5, 0x16, 0xeb, 0x7a, 0x75, 0x2c, 0xd7,
                               0x4f, 0xae, 0xd5, 0xe9, 0xe6, 0xe7, 0xad, 0xe8, 0x74, 0xd6, 0xf4, 0xea, 0xa8, 0x50, 0x58, 0xaf};
 
-// divides the bytes in data by 2^div
-void galois_divpower(uint8_t* data, uint8_t div, uint32_t len) {
-    while (len > 0) {
-        if (data[0] != 0) {
-            if (gilog[data[0]] <= div)
-                data[0] = glog[(gilog[data[0]] + (255 - div)) % 255];
-            else
-                data[0] = glog[(gilog[data[0]] - div) % 255];
-        }
-
-        data++;
-        len--;
-    }
-}
-
 uint8_t gpow2(uint8_t e) {
     return glog[e%255];
 }
@@ -94,48 +83,156 @@ uint8_t gdiv(uint8_t a, uint8_t b) {
 // "The mathematics of RAID-6", by H. Peter Anvin.
 // https://www.kernel.org/pub/linux/kernel/people/hpa/raid6.pdf
 
-#if defined(_AMD64_) || defined(_ARM64_)
 __inline static uint64_t galois_double_mask64(uint64_t v) {
     v &= 0x8080808080808080;
     return (v << 1) - (v >> 7);
 }
-#else
-__inline static uint32_t galois_double_mask32(uint32_t v) {
-    v &= 0x80808080;
-    return (v << 1) - (v >> 7);
+
+__inline static uint64_t galois_double64(uint64_t v) {
+    return ((v << 1) & 0xfefefefefefefefe) ^ (galois_double_mask64(v) & 0x1d1d1d1d1d1d1d1d);
 }
-#endif
 
-void galois_double(uint8_t* data, uint32_t len) {
-    // FIXME - SIMD?
+// multiplies eight bytes at once by c, by adding up the doublings of v for each bit set in c
+__inline static uint64_t galois_multiply64(uint64_t v, uint8_t c) {
+    uint64_t r = 0;
+
+    while (c != 0) {
+        if (c & 1)
+            r ^= v;
 
-#if defined(_AMD64_) || defined(_ARM64_)
-    while (len > sizeof(uint64_t)) {
-        uint64_t v = *((uint64_t*)data), vv;
+        v = galois_double64(v);
+        c >>= 1;
+    }
 
-        vv = (v << 1) & 0xfefefefefefefefe;
-        vv ^= galois_double_mask64(v) & 0x1d1d1d1d1d1d1d1d;
-        *((uint64_t*)data) = vv;
+    return r;
+}
+
+static void galois_double_sw(uint8_t* data, uint32_t len) {
+    while (len >= sizeof(uint64_t)) {
+        *((uint64_t*)data) = galois_double64(*((uint64_t*)data));
 
         data += sizeof(uint64_t);
         len -= sizeof(uint64_t);
     }
-#else
-    while (len > sizeof(uint32_t)) {
-        uint32_t v = *((uint32_t*)data), vv;
 
-        vv = (v << 1) & 0xfefefefe;
-        vv ^= galois_double_mask32(v) & 0x1d1d1d1d;
-        *((uint32_t*)data) = vv;
+    while (len > 0) {
+        data[0] = (data[0] << 1) ^ ((data[0] & 0x80) ? 0x1d : 0);
+        data++;
+        len--;
+    }
+}
+
+static void galois_multiply_sw(uint8_t* data, uint8_t c, uint32_t len) {
+    while (len >= sizeof(uint64_t)) {
+        *((uint64_t*)data) = galois_multiply64(*((uint64_t*)data), c);
 
-        data += sizeof(uint32_t);
-        len -= sizeof(uint32_t);
+        data += sizeof(uint64_t);
+        len -= sizeof(uint64_t);
     }
-#endif
 
     while (len > 0) {
-        data[0] = (data[0] << 1) ^ ((data[0] & 0x80) ? 0x1d : 0);
+        data[0] = gmul(data[0], c);
         data++;
         len--;
     }
 }
+
+static void galois_recover_sw(uint8_t* dx, uint8_t* pxy, uint8_t* p, uint8_t* q, uint8_t a, uint8_t b, uint32_t len) {
+    while (len >= sizeof(uint64_t)) {
+        *((uint64_t*)dx) = galois_multiply64(*((uint64_t*)p) ^ *((uint64_t*)pxy), a) ^
+                           galois_multiply64(*((uint64_t*)q) ^ *((uint64_t*)dx), b);
+
+        dx += sizeof(uint64_t);
+        pxy += sizeof(uint64_t);
+        p += sizeof(uint64_t);
+        q += sizeof(uint64_t);
+        len -= sizeof(uint64_t);
+    }
+
+    while (len > 0) {
+        dx[0] = gmul(a, p[0] ^ pxy[0]) ^ gmul(b, q[0] ^ dx[0]);
+        dx++;
+        pxy++;
+        p++;
+        q++;
+        len--;
+    }
+}
+
+#ifdef _AMD64_
+// in galois-amd64.S, these only handle whole 16-byte blocks
+void __stdcall galois_double_sse2(uint8_t* data, uint32_t len);
+void __stdcall galois_multiply_ssse3(uint8_t* data, const uint8_t* tables, uint32_t len);
+void __stdcall galois_recover_ssse3(uint8_t* dx, uint8_t* pxy, uint8_t* p, uint8_t* q, const uint8_t* tables, uint32_t len);
+
+// Builds the PSHUFB lookup tables for multiplying by c: the products of c with
+// every possible low nibble, followed by those with every possible high nibble.
+static void galois_nibble_tables(uint8_t c, uint8_t* tables) {
+    unsigned int i;
+
+    for (i = 0; i < 16; i++) {
+        tables[i] = gmul(c, (uint8_t)i);
+        tables[16 + i] = gmul(c, (uint8_t)(i << 4));
+    }
+}
+
+static void galois_double_simd(uint8_t* data, uint32_t len) {
+    galois_double_sse2(data, len & ~15);
+    galois_double_sw(data + (len & ~15), len & 15);
+}
+
+static void galois_multiply_simd(uint8_t* data, uint8_t c, uint32_t len) {
+    uint8_t tables[32];
+
+    galois_nibble_tables(c, tables);
+
+    galois_multiply_ssse3(data, tables, len & ~15);
+    galois_multiply_sw(data + (len & ~15), c, len & 15);
+}
+
+static void galois_recover_simd(uint8_t* dx, uint8_t* pxy, uint8_t* p, uint8_t* q, uint8_t a, uint8_t b, uint32_t len) {
+    uint8_t tables[64];
+    uint32_t done = len & ~15;
+
+    galois_nibble_tables(a, tables);
+    galois_nibble_tables(b, tables + 32);
+
+    galois_recover_ssse3(dx, pxy, p, q, tables, done);
+    galois_recover_sw(dx + done, pxy + done, p + done, q + done, a, b, len & 15);
+}
+
+// SSE2 is always there on amd64, and the kernel saves xmm0-xmm5 for us
+static void (*galois_double_func)(uint8_t*, uint32_t) = galois_double_simd;
+#else
+static void (*galois_double_func)(uint8_t*, uint32_t) = galois_double_sw;
+#endif
+
+static void (*galois_multiply_func)(uint8_t*, uint8_t, uint32_t) = galois_multiply_sw;
+static void (*galois_recover_func)(uint8_t*, uint8_t*, uint8_t*, uint8_t*, uint8_t, uint8_t, uint32_t) = galois_recover_sw;
+
+#ifdef _AMD64_
+void galois_use_ssse3() {
+    galois_multiply_func = galois_multiply_simd;
+    galois_recover_func = galois_recover_simd;
+}
+#endif
+
+// multiplies the bytes in data by 2
+void galois_double(uint8_t* data, uint32_t len) {
+    galois_double_func(data, len);
+}
+
+// divides the bytes in data by 2^div
+void galois_divpower(uint8_t* data, uint8_t div, uint32_t len) {
+    if (div % 255 == 0)
+        return;
+
+    galois_multiply_func(data, gpow2(255 - div), len);
+}
+
+// Recovers the first of two missing data stripes from the P and Q parity, i.e.
+// Dx = a(P + Pxy) + b(Q + Qxy). Pxy and Qxy are the parities calculated with the
+// missing stripes taken as zero; dx holds Qxy on entry, and Dx on return.
+void galois_recover(uint8_t* dx, uint8_t* pxy, uint8_t* p, uint8_t* q, uint8_t a, uint8_t b, uint32_t len) {
+    galois_recover_func(dx, pxy, p, q, a, b, len);
+}
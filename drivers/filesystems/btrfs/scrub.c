@@ -2281,7 +2281,6 @@ static void scrub_raid6_stripe(device_extension* Vcb, chunk* c, scrub_context_ra
             uint64_t addr;
             uint32_t len = (RtlCheckBit(&context->is_tree, bad_off1) || RtlCheckBit(&context->is_tree, bad_off2)) ? Vcb->superblock.node_size : Vcb->superblock.sector_size;
             uint8_t gyx, gx, denom, a, b, *p, *q, *pxy, *qxy;
-            uint32_t j;
 
             stripe = parity1 == 0 ? (c->chunk_item->num_stripes - 1) : (parity1 - 1);
 
@@ -2336,14 +2335,7 @@ static void scrub_raid6_stripe(device_extension* Vcb, chunk* c, scrub_context_ra
             pxy = &context->parity_scratch2[i * Vcb->superblock.sector_size];
             qxy = &context->parity_scratch[i * Vcb->superblock.sector_size];
 
-            for (j = 0; j < len; j++) {
-                *qxy = gmul(a, *p ^ *pxy) ^ gmul(b, *q ^ *qxy);
-
-                p++;
-                q++;
-                pxy++;
-                qxy++;
-            }
+            galois_recover(qxy, pxy, p, q, a, b, len);
 
             do_xor(&context->parity_scratch2[i * Vcb->superblock.sector_size], &context->parity_scratch[i * Vcb->superblock.sector_size], len);
             do_xor(&context->parity_scratch2[i * Vcb->superblock.sector_size], &context->stripes[parity1].buf[(num * c->chunk_item->stripe_length) + (i * Vcb->superblock.sector_size)], len);
@@ -0,0 +1,352 @@
+/* This file is part of WinBtrfs.
+ *
+ * WinBtrfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public Licence as published by
+ * the Free Software Foundation, either version 3 of the Licence, or
+ * (at your option) any later version.
+ *
+ * WinBtrfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public Licence for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public Licence
+ * along with WinBtrfs.  If not, see <http://www.gnu.org/licenses/>. */
+
+// Host test for the RAID6 Galois field routines: checks galois.c (and, on
+// amd64, galois-amd64.S) against a plain byte loop, and reports how fast
+// parity generation, two-disk reconstruction and divpower run.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "galoistest.h"
+
+#ifdef _AMD64_
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#define STRIPE_SIZE 0x10000
+#define DATA_STRIPES 4
+#define MAX_TEST_LEN 300
+
+static unsigned int failures = 0;
+static uint32_t seed = 1;
+
+static uint8_t random_byte() {
+    seed = seed * 1103515245 + 12345;
+    return (uint8_t)(seed >> 16);
+}
+
+static void fill_random(uint8_t* data, uint32_t len) {
+    while (len > 0) {
+        *data++ = random_byte();
+        len--;
+    }
+}
+
+// multiplies a and b bit by bit, modulo the RAID6 polynomial 0x11d
+static uint8_t ref_mul(uint8_t a, uint8_t b) {
+    uint8_t r = 0;
+
+    while (b != 0) {
+        if (b & 1)
+            r ^= a;
+
+        a = (uint8_t)((a << 1) ^ ((a & 0x80) ? 0x1d : 0));
+        b >>= 1;
+    }
+
+    return r;
+}
+
+static uint8_t ref_pow2(unsigned int e) {
+    uint8_t r = 1;
+
+    while (e > 0) {
+        r = ref_mul(r, 2);
+        e--;
+    }
+
+    return r;
+}
+
+static void ref_double(uint8_t* data, uint32_t len) {
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        data[i] = ref_mul(data[i], 2);
+    }
+}
+
+static void ref_divpower(uint8_t* data, uint8_t div, uint32_t len) {
+    uint8_t c = ref_pow2((255 - (div % 255)) % 255);
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        data[i] = ref_mul(data[i], c);
+    }
+}
+
+static void ref_recover(uint8_t* dx, uint8_t* pxy, uint8_t* p, uint8_t* q, uint8_t a, uint8_t b, uint32_t len) {
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        dx[i] = ref_mul(a, p[i] ^ pxy[i]) ^ ref_mul(b, q[i] ^ dx[i]);
+    }
+}
+
+static void check(int cond, const char* what, uint32_t len, uint32_t offset) {
+    if (!cond) {
+        if (failures < 20)
+            printf("%s failed for %u bytes at offset %u\n", what, len, offset);
+
+        failures++;
+    }
+}
+
+static void test_tables() {
+    unsigned int a, b;
+
+    for (a = 0; a < 256; a++) {
+        check(gpow2((uint8_t)a) == ref_pow2(a % 255), "gpow2", a, 0);
+
+        for (b = 0; b < 256; b++) {
+            check(gmul((uint8_t)a, (uint8_t)b) == ref_mul((uint8_t)a, (uint8_t)b), "gmul", a, b);
+
+            if (b != 0)
+                check(gmul(gdiv((uint8_t)a, (uint8_t)b), (uint8_t)b) == a, "gdiv", a, b);
+        }
+    }
+}
+
+static void test_routines() {
+    static uint8_t buf[MAX_TEST_LEN + 16], ref[MAX_TEST_LEN + 16];
+    static uint8_t pxy[MAX_TEST_LEN + 16], p[MAX_TEST_LEN + 16], q[MAX_TEST_LEN + 16];
+    uint32_t len, offset;
+    uint8_t a, b, div;
+
+    // every length up to a few blocks, at every alignment
+    for (len = 0; len <= MAX_TEST_LEN; len = (len < 80) ? len + 1 : len + 37) {
+        for (offset = 0; offset < 16; offset++) {
+            fill_random(buf, sizeof(buf));
+            memcpy(ref, buf, sizeof(buf));
+            galois_double(buf + offset, len);
+            ref_double(ref + offset, len);
+            check(memcmp(buf, ref, sizeof(buf)) == 0, "galois_double", len, offset);
+
+            div = random_byte();
+            fill_random(buf, sizeof(buf));
+            memcpy(ref, buf, sizeof(buf));
+            galois_divpower(buf + offset, div, len);
+            ref_divpower(ref + offset, div, len);
+            check(memcmp(buf, ref, sizeof(buf)) == 0, "galois_divpower", len, offset);
+
+            a = random_byte();
+            b = random_byte();
+            fill_random(buf, sizeof(buf));
+            fill_random(pxy, sizeof(pxy));
+            fill_random(p, sizeof(p));
+            fill_random(q, sizeof(q));
+            memcpy(ref, buf, sizeof(buf));
+            galois_recover(buf + offset, pxy + offset, p + offset, q + offset, a, b, len);
+            ref_recover(ref + offset, pxy + offset, p + offset, q + offset, a, b, len);
+            check(memcmp(buf, ref, sizeof(buf)) == 0, "galois_recover", len, offset);
+        }
+    }
+}
+
+// Two missing data stripes are put back from P and Q the way read.c does it,
+// and must come out as they were.
+static void test_reconstruction() {
+    uint8_t* data[DATA_STRIPES];
+    uint8_t* saved[2];
+    uint8_t *p, *q, *pxy, *qxy;
+    uint8_t a, b, denom;
+    uint32_t i, j;
+    unsigned int x = 1, y = 3;
+
+    for (i = 0; i < DATA_STRIPES; i++) {
+        data[i] = malloc(STRIPE_SIZE);
+        fill_random(data[i], STRIPE_SIZE);
+    }
+
+    p = malloc(STRIPE_SIZE);
+    q = malloc(STRIPE_SIZE);
+    pxy = malloc(STRIPE_SIZE);
+    qxy = malloc(STRIPE_SIZE);
+    saved[0] = malloc(STRIPE_SIZE);
+    saved[1] = malloc(STRIPE_SIZE);
+
+    // P and Q, Q = sum of 2^i * D_i
+    memcpy(p, data[DATA_STRIPES - 1], STRIPE_SIZE);
+    memcpy(q, data[DATA_STRIPES - 1], STRIPE_SIZE);
+    for (i = DATA_STRIPES - 1; i > 0; i--) {
+        galois_double(q, STRIPE_SIZE);
+
+        for (j = 0; j < STRIPE_SIZE; j++) {
+            p[j] ^= data[i - 1][j];
+            q[j] ^= data[i - 1][j];
+        }
+    }
+
+    memcpy(saved[0], data[x], STRIPE_SIZE);
+    memcpy(saved[1], data[y], STRIPE_SIZE);
+    memset(data[x], 0, STRIPE_SIZE);
+    memset(data[y], 0, STRIPE_SIZE);
+
+    // Pxy and Qxy with the missing stripes taken as zero
+    memset(pxy, 0, STRIPE_SIZE);
+    memset(qxy, 0, STRIPE_SIZE);
+    for (i = DATA_STRIPES; i > 0; i--) {
+        galois_double(qxy, STRIPE_SIZE);
+
+        for (j = 0; j < STRIPE_SIZE; j++) {
+            pxy[j] ^= data[i - 1][j];
+            qxy[j] ^= data[i - 1][j];
+        }
+    }
+
+    denom = gdiv(1, gpow2((uint8_t)(y - x)) ^ 1);
+    a = gmul(gpow2((uint8_t)(y - x)), denom);
+    b = gmul(gdiv(1, gpow2((uint8_t)x)), denom);
+
+    galois_recover(qxy, pxy, p, q, a, b, STRIPE_SIZE);
+
+    for (j = 0; j < STRIPE_SIZE; j++) {
+        pxy[j] ^= p[j] ^ qxy[j];
+    }
+
+    check(memcmp(qxy, saved[0], STRIPE_SIZE) == 0, "reconstruction of first stripe", STRIPE_SIZE, 0);
+    check(memcmp(pxy, saved[1], STRIPE_SIZE) == 0, "reconstruction of second stripe", STRIPE_SIZE, 0);
+
+    for (i = 0; i < DATA_STRIPES; i++) {
+        free(data[i]);
+    }
+
+    free(p);
+    free(q);
+    free(pxy);
+    free(qxy);
+    free(saved[0]);
+    free(saved[1]);
+}
+
+static double mb_per_sec(unsigned int rounds, uint32_t bytes, clock_t start) {
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (secs <= 0)
+        return 0;
+
+    return (double)rounds * bytes / secs / (1024 * 1024);
+}
+
+static void benchmark(const char* name) {
+    uint8_t* data[DATA_STRIPES];
+    uint8_t *q, *pxy, *p, *dx;
+    unsigned int rounds, i;
+    uint32_t j;
+    clock_t start;
+
+    for (i = 0; i < DATA_STRIPES; i++) {
+        data[i] = malloc(STRIPE_SIZE);
+        fill_random(data[i], STRIPE_SIZE);
+    }
+
+    q = malloc(STRIPE_SIZE);
+    pxy = malloc(STRIPE_SIZE);
+    p = malloc(STRIPE_SIZE);
+    dx = malloc(STRIPE_SIZE);
+    fill_random(pxy, STRIPE_SIZE);
+    fill_random(p, STRIPE_SIZE);
+    fill_random(dx, STRIPE_SIZE);
+
+    // Q parity over all data stripes, as in write.c
+    start = clock();
+    for (rounds = 0; clock() - start < CLOCKS_PER_SEC / 4; rounds++) {
+        memcpy(q, data[DATA_STRIPES - 1], STRIPE_SIZE);
+
+        for (i = DATA_STRIPES - 1; i > 0; i--) {
+            galois_double(q, STRIPE_SIZE);
+
+            for (j = 0; j < STRIPE_SIZE; j++) {
+                q[j] ^= data[i - 1][j];
+            }
+        }
+    }
+    printf("%-8s Q parity:           %8.1f MB/s\n", name, mb_per_sec(rounds, DATA_STRIPES * STRIPE_SIZE, start));
+
+    start = clock();
+    for (rounds = 0; clock() - start < CLOCKS_PER_SEC / 4; rounds++) {
+        galois_recover(dx, pxy, p, q, 0x8e, 0x47, STRIPE_SIZE);
+    }
+    printf("%-8s two-disk recovery:  %8.1f MB/s\n", name, mb_per_sec(rounds, STRIPE_SIZE, start));
+
+    start = clock();
+    for (rounds = 0; clock() - start < CLOCKS_PER_SEC / 4; rounds++) {
+        galois_divpower(dx, 3, STRIPE_SIZE);
+    }
+    printf("%-8s divpower:           %8.1f MB/s\n", name, mb_per_sec(rounds, STRIPE_SIZE, start));
+
+    start = clock();
+    for (rounds = 0; clock() - start < CLOCKS_PER_SEC / 4; rounds++) {
+        ref_recover(dx, pxy, p, q, 0x8e, 0x47, STRIPE_SIZE);
+    }
+    printf("%-8s byte loop recovery: %8.1f MB/s\n", name, mb_per_sec(rounds, STRIPE_SIZE, start));
+
+    for (i = 0; i < DATA_STRIPES; i++) {
+        free(data[i]);
+    }
+
+    free(q);
+    free(pxy);
+    free(p);
+    free(dx);
+}
+
+static void run_tests(const char* name, int bench) {
+    test_routines();
+    test_reconstruction();
+
+    if (bench)
+        benchmark(name);
+}
+
+int main(int argc, char* argv[]) {
+    int bench = argc > 1 && !strcmp(argv[1], "-b");
+#ifdef _AMD64_
+    unsigned int cpu_info[4];
+#endif
+
+    test_tables();
+
+#ifdef _AMD64_
+    // doubling always uses SSE2 on amd64, the rest starts out on 64-bit words
+    run_tests("sse2", bench);
+#else
+    run_tests("word", bench);
+#endif
+
+#ifdef _AMD64_
+#ifdef _MSC_VER
+    __cpuid((int*)cpu_info, 1);
+#else
+    __get_cpuid(1, &cpu_info[0], &cpu_info[1], &cpu_info[2], &cpu_info[3]);
+#endif
+
+    if (cpu_info[2] & (1 << 9)) {
+        galois_use_ssse3();
+        run_tests("ssse3", bench);
+    } else
+        printf("SSSE3 not supported, skipping the SSSE3 routines\n");
+#endif
+
+    printf("galoistest: %u failures\n", failures);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,37 @@
+/* This file is part of WinBtrfs.
+ *
+ * WinBtrfs is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public Licence as published by
+ * the Free Software Foundation, either version 3 of the Licence, or
+ * (at your option) any later version.
+ *
+ * WinBtrfs is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public Licence for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public Licence
+ * along with WinBtrfs.  If not, see <http://www.gnu.org/licenses/>. */
+
+// Stands in for btrfs_drv.h when galois.c is built on the host for galoistest.
+
+#pragma once
+
+#include <stdint.h>
+
+// galois-amd64.S follows the Windows x64 calling convention
+#if defined(_AMD64_) && !defined(_MSC_VER)
+#undef __stdcall
+#define __stdcall __attribute__((ms_abi))
+#endif
+
+// in galois.c
+void galois_double(uint8_t* data, uint32_t len);
+void galois_divpower(uint8_t* data, uint8_t div, uint32_t readlen);
+void galois_recover(uint8_t* dx, uint8_t* pxy, uint8_t* p, uint8_t* q, uint8_t a, uint8_t b, uint32_t len);
+uint8_t gpow2(uint8_t e);
+uint8_t gmul(uint8_t a, uint8_t b);
+uint8_t gdiv(uint8_t a, uint8_t b);
+#ifdef _AMD64_
+void galois_use_ssse3();
+#endif
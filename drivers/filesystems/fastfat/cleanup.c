@@ -70,6 +70,12 @@ VfatCleanupFile(
         pFcb->OpenHandleCount--;
         DeviceExt->OpenHandleCount--;
 
+        /* Nobody can grow the file anymore, give back the clusters held for it */
+        if (pFcb->OpenHandleCount == 0)
+        {
+            ReleaseClusterReservation(DeviceExt, pFcb);
+        }
+
         if (!vfatFCBIsDirectory(pFcb) &&
             FsRtlAreThereCurrentFileLocks(&pFcb->FileLock))
         {
@@ -108,6 +114,7 @@ VfatCleanupFile(
                 pFcb->RFCB.ValidDataLength.QuadPart = 0;
                 pFcb->RFCB.FileSize.QuadPart = 0;
                 pFcb->RFCB.AllocationSize.QuadPart = 0;
+                VfatTruncateClusterMcb(pFcb, 0);
             }
         }
 
@@ -372,7 +372,8 @@ FAT32FindAndMarkAvailableCluster(
 }
 
 /*
- * FUNCTION: Counts free cluster in a FAT12 table
+ * FUNCTION: Counts free clusters in a FAT12 table and fills the free cluster
+ *           map, 32 entries at a time, if there is one
  */
 static
 NTSTATUS
@@ -387,6 +388,8 @@ FAT12CountAvailableClusters(
     LARGE_INTEGER Offset;
     PVOID Context;
     PUSHORT CBlock;
+    PULONG Map;
+    ULONG InUse = 3;
 
     Offset.QuadPart = 0;
     _SEH2_TRY
@@ -400,6 +403,7 @@ FAT12CountAvailableClusters(
     _SEH2_END;
 
     numberofclusters = DeviceExt->FatInfo.NumberOfClusters + 2;
+    Map = DeviceExt->FreeClusterMap.Buffer;
 
     for (i = 2; i < numberofclusters; i++)
     {
@@ -415,7 +419,17 @@ FAT12CountAvailableClusters(
 
         if (Entry == 0)
             ulCount++;
+        else
+            InUse |= 1UL << (i % 32);
+
+        if ((i % 32) == 31)
+        {
+            if (Map) Map[i / 32] = InUse;
+            InUse = 0;
+        }
     }
+    if (Map && (i % 32) != 0)
+        Map[i / 32] = InUse;
 
     CcUnpinData(Context);
     DeviceExt->AvailableClusters = ulCount;
@@ -426,7 +440,8 @@ FAT12CountAvailableClusters(
 
 
 /*
- * FUNCTION: Counts free clusters in a FAT16 table
+ * FUNCTION: Counts free clusters in a FAT16 table and fills the free cluster
+ *           map, 32 entries at a time, if there is one
  */
 static
 NTSTATUS
@@ -442,9 +457,12 @@ FAT16CountAvailableClusters(
     PVOID Context = NULL;
     LARGE_INTEGER Offset;
     ULONG FatLength;
+    PULONG Map;
+    ULONG InUse = 3;
 
     ChunkSize = CACHEPAGESIZE(DeviceExt);
     FatLength = (DeviceExt->FatInfo.NumberOfClusters + 2);
+    Map = DeviceExt->FreeClusterMap.Buffer;
 
     for (i = 2; i < FatLength; )
     {
@@ -466,12 +484,22 @@ FAT16CountAvailableClusters(
         {
             if (*Block == 0)
                 ulCount++;
+            else
+                InUse |= 1UL << (i % 32);
+
+            if ((i % 32) == 31)
+            {
+                if (Map) Map[i / 32] = InUse;
+                InUse = 0;
+            }
             Block++;
             i++;
         }
 
         CcUnpinData(Context);
     }
+    if (Map && (i % 32) != 0)
+        Map[i / 32] = InUse;
 
     DeviceExt->AvailableClusters = ulCount;
     DeviceExt->AvailableClustersValid = TRUE;
@@ -481,7 +509,8 @@ FAT16CountAvailableClusters(
 
 
 /*
- * FUNCTION: Counts free clusters in a FAT32 table
+ * FUNCTION: Counts free clusters in a FAT32 table and fills the free cluster
+ *           map, 32 entries at a time, if there is one
  */
 static
 NTSTATUS
@@ -497,9 +526,12 @@ FAT32CountAvailableClusters(
     PVOID Context = NULL;
     LARGE_INTEGER Offset;
     ULONG FatLength;
+    PULONG Map;
+    ULONG InUse = 3;
 
     ChunkSize = CACHEPAGESIZE(DeviceExt);
     FatLength = (DeviceExt->FatInfo.NumberOfClusters + 2);
+    Map = DeviceExt->FreeClusterMap.Buffer;
 
     for (i = 2; i < FatLength; )
     {
@@ -522,12 +554,22 @@ FAT32CountAvailableClusters(
         {
             if ((*Block & 0x0fffffff) == 0)
                 ulCount++;
+            else
+                InUse |= 1UL << (i % 32);
+
+            if ((i % 32) == 31)
+            {
+                if (Map) Map[i / 32] = InUse;
+                InUse = 0;
+            }
             Block++;
             i++;
         }
 
         CcUnpinData(Context);
     }
+    if (Map && (i % 32) != 0)
+        Map[i / 32] = InUse;
 
     DeviceExt->AvailableClusters = ulCount;
     DeviceExt->AvailableClustersValid = TRUE;
@@ -561,6 +603,47 @@ CountAvailableClusters(
 }
 
 
+/*
+ * FUNCTION: Builds the free cluster map of a newly mounted volume. The volume
+ *           stays usable without it, allocations then scan the FAT instead
+ */
+VOID
+InitializeFreeClusterMap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    ULONG Size;
+    PULONG Buffer;
+    NTSTATUS Status;
+
+    Size = DeviceExt->FatInfo.NumberOfClusters + 2;
+    Buffer = ExAllocatePoolWithTag(PagedPool, ROUND_UP(Size, 32) / 8, TAG_BITMAP);
+    if (Buffer == NULL)
+    {
+        DPRINT1("No free cluster map for %u clusters\n", Size);
+        CountAvailableClusters(DeviceExt, NULL);
+        return;
+    }
+
+    RtlInitializeBitMap(&DeviceExt->FreeClusterMap, Buffer, Size);
+    DeviceExt->AvailableClustersValid = FALSE;
+    Status = CountAvailableClusters(DeviceExt, NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        UninitializeFreeClusterMap(DeviceExt);
+    }
+}
+
+VOID
+UninitializeFreeClusterMap(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    if (DeviceExt->FreeClusterMap.Buffer != NULL)
+    {
+        ExFreePoolWithTag(DeviceExt->FreeClusterMap.Buffer, TAG_BITMAP);
+        DeviceExt->FreeClusterMap.Buffer = NULL;
+    }
+}
+
 /*
  * FUNCTION: Writes a cluster to the FAT12 physical and in-memory tables
  */
@@ -717,10 +800,340 @@ WriteCluster(
         else if (OldValue == 0 && NewValue)
             InterlockedDecrement((PLONG)&DeviceExt->AvailableClusters);
     }
+    if (NT_SUCCESS(Status) && DeviceExt->FreeClusterMap.Buffer != NULL)
+    {
+        if (NewValue == 0)
+            RtlClearBit(&DeviceExt->FreeClusterMap, ClusterToWrite);
+        else
+            RtlSetBit(&DeviceExt->FreeClusterMap, ClusterToWrite);
+    }
     ExReleaseResourceLite(&DeviceExt->FatResource);
     return Status;
 }
 
+/* Number of free runs looked at when searching for the best fitting one */
+#define BEST_FIT_MAX_RUNS 256
+
+/*
+ * FUNCTION: Finds the smallest free run holding Wanted clusters, or the
+ *           largest one if none does. Starts at the last allocation and
+ *           gives up looking after BEST_FIT_MAX_RUNS runs
+ */
+static
+ULONG
+FindFreeClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG Wanted,
+    PULONG RunLength)
+{
+    PRTL_BITMAP Map = &DeviceExt->FreeClusterMap;
+    ULONG From, Limit, Start, Length;
+    ULONG BestStart = 0, BestLength = 0;
+    ULONG j, Runs = 0;
+
+    From = DeviceExt->LastAvailableCluster;
+    Limit = Map->SizeOfBitMap;
+
+    for (j = 0; j < 2; j++)
+    {
+        while (From < Limit && Runs < BEST_FIT_MAX_RUNS)
+        {
+            Length = RtlFindNextForwardRunClear(Map, From, &Start);
+            if (Length == 0 || Start >= Limit)
+                break;
+
+            if (BestLength < Wanted ? Length > BestLength : (Length >= Wanted && Length < BestLength))
+            {
+                BestStart = Start;
+                BestLength = Length;
+                if (Length == Wanted)
+                    goto Done;
+            }
+
+            Runs++;
+            From = Start + Length;
+        }
+
+        Limit = DeviceExt->LastAvailableCluster;
+        From = 2;
+    }
+
+Done:
+    *RunLength = BestLength;
+    return BestStart;
+}
+
+/*
+ * FUNCTION: Frees the clusters chained from FirstCluster and terminates the
+ *           chain at LastCluster again, if it isn't 0
+ */
+static
+VOID
+ReleaseNewClusters(
+    PDEVICE_EXTENSION DeviceExt,
+    ULONG LastCluster,
+    ULONG FirstCluster)
+{
+    ULONG Cluster, NextCluster;
+
+    if (LastCluster != 0)
+    {
+        WriteCluster(DeviceExt, LastCluster, 0xffffffff);
+    }
+
+    for (Cluster = FirstCluster; Cluster != 0 && Cluster != 0xffffffff; Cluster = NextCluster)
+    {
+        if (!NT_SUCCESS(DeviceExt->GetNextCluster(DeviceExt, Cluster, &NextCluster)))
+            NextCluster = 0;
+        WriteCluster(DeviceExt, Cluster, 0);
+    }
+}
+
+/*
+ * A file growing by extensions gets free clusters held back behind its end,
+ * RESERVE_FACTOR times its last extension. They are set in the map but stay
+ * free in the FAT, so other allocations go elsewhere and the next extension
+ * of the file continues its run. The reservation is dropped when the file is
+ * truncated or its last handle goes away, or when the volume runs short.
+ */
+#define RESERVE_FACTOR 8
+#define RESERVE_MAX_CLUSTERS 1024
+
+static
+VOID
+ReleaseReservationLocked(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb)
+{
+    if (Fcb->ReservedCount != 0)
+    {
+        RtlClearBits(&DeviceExt->FreeClusterMap, Fcb->ReservedCluster, Fcb->ReservedCount);
+        RemoveEntryList(&Fcb->ReservationListEntry);
+        Fcb->ReservedCount = 0;
+    }
+}
+
+static
+BOOLEAN
+ReleaseAllReservations(
+    PDEVICE_EXTENSION DeviceExt)
+{
+    PVFATFCB Fcb;
+
+    if (IsListEmpty(&DeviceExt->ReservationList))
+        return FALSE;
+
+    while (!IsListEmpty(&DeviceExt->ReservationList))
+    {
+        Fcb = CONTAINING_RECORD(DeviceExt->ReservationList.Flink, VFATFCB, ReservationListEntry);
+        ReleaseReservationLocked(DeviceExt, Fcb);
+    }
+    return TRUE;
+}
+
+VOID
+ReleaseClusterReservation(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb)
+{
+    if (Fcb->ReservedCount != 0)
+    {
+        ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+        ReleaseReservationLocked(DeviceExt, Fcb);
+        ExReleaseResourceLite(&DeviceExt->FatResource);
+    }
+}
+
+/*
+ * FUNCTION: Allocates clusters from the free cluster map, a whole run at a
+ *           time. A chain is continued right behind its last cluster
+ *           whenever possible, otherwise it goes to the best fitting free
+ *           run. For a growing file, that run must also hold its reservation
+ */
+static
+NTSTATUS
+AllocateFromClusterMap(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG LastCluster,
+    ULONG Count,
+    PULONG FirstCluster)
+{
+    PRTL_BITMAP Map = &DeviceExt->FreeClusterMap;
+    ULONG Previous = LastCluster;
+    ULONG Start, Length, OldValue, i;
+    ULONG Reserve = 0;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    *FirstCluster = 0;
+    if (DeviceExt->AvailableClusters < Count)
+    {
+        return STATUS_DISK_FULL;
+    }
+
+    if (Fcb != NULL && LastCluster != 0)
+    {
+        Reserve = min(Count * RESERVE_FACTOR, RESERVE_MAX_CLUSTERS);
+    }
+
+    while (Count > 0)
+    {
+        Start = Previous + 1;
+        if (Fcb != NULL && Fcb->ReservedCount != 0 && Fcb->ReservedCluster == Start)
+        {
+            /* Take what was held back for this file */
+            Length = min(Fcb->ReservedCount, Count);
+            RtlClearBits(Map, Start, Length);
+            Fcb->ReservedCluster += Length;
+            Fcb->ReservedCount -= Length;
+            if (Fcb->ReservedCount == 0)
+                RemoveEntryList(&Fcb->ReservationListEntry);
+        }
+        else if (Previous != 0 && Start < Map->SizeOfBitMap && !RtlTestBit(Map, Start))
+        {
+            Length = RtlFindNextForwardRunClear(Map, Start, &Start);
+        }
+        else
+        {
+            if (Fcb != NULL)
+                ReleaseReservationLocked(DeviceExt, Fcb);
+
+            Start = FindFreeClusterRun(DeviceExt, Count + Reserve, &Length);
+            if (Start == 0 && ReleaseAllReservations(DeviceExt))
+            {
+                Start = FindFreeClusterRun(DeviceExt, Count + Reserve, &Length);
+            }
+            if (Start == 0)
+            {
+                Status = STATUS_DISK_FULL;
+                break;
+            }
+        }
+        Length = min(Length, Count);
+        DPRINT("Allocating %u clusters at 0x%x\n", Length, Start);
+
+        /* Chain the run up and terminate it */
+        for (i = 0; i < Length; i++)
+        {
+            Status = DeviceExt->WriteCluster(DeviceExt, Start + i,
+                                             i + 1 < Length ? Start + i + 1 : 0xffffffff,
+                                             &OldValue);
+            if (!NT_SUCCESS(Status))
+                break;
+        }
+        if (!NT_SUCCESS(Status))
+        {
+            while (i-- > 0)
+                DeviceExt->WriteCluster(DeviceExt, Start + i, 0, &OldValue);
+            break;
+        }
+
+        RtlSetBits(Map, Start, Length);
+        InterlockedExchangeAdd((PLONG)&DeviceExt->AvailableClusters, -(LONG)Length);
+
+        /* And hook it up to the chain */
+        if (Previous != 0)
+            DeviceExt->WriteCluster(DeviceExt, Previous, Start, &OldValue);
+        if (*FirstCluster == 0)
+            *FirstCluster = Start;
+
+        Previous = Start + Length - 1;
+        Count -= Length;
+    }
+
+    if (!NT_SUCCESS(Status))
+    {
+        ReleaseNewClusters(DeviceExt, LastCluster, *FirstCluster);
+        *FirstCluster = 0;
+        return Status;
+    }
+
+    /* Hold back the free clusters behind a growing file */
+    Start = Previous + 1;
+    if (Reserve != 0 && Fcb->ReservedCount == 0 &&
+        Start < Map->SizeOfBitMap && !RtlTestBit(Map, Start))
+    {
+        Length = RtlFindNextForwardRunClear(Map, Start, &Start);
+        Fcb->ReservedCluster = Start;
+        Fcb->ReservedCount = min(Length, Reserve);
+        RtlSetBits(Map, Fcb->ReservedCluster, Fcb->ReservedCount);
+        InsertTailList(&DeviceExt->ReservationList, &Fcb->ReservationListEntry);
+        Previous += Fcb->ReservedCount;
+    }
+
+    DeviceExt->LastAvailableCluster = Previous + 1 < Map->SizeOfBitMap ? Previous + 1 : 2;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * FUNCTION: Allocates Count clusters behind LastCluster, or as a new chain if
+ *           it is 0. Expects the FAT to be locked exclusively
+ */
+static
+NTSTATUS
+AllocateClustersLocked(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG LastCluster,
+    ULONG Count,
+    PULONG FirstCluster)
+{
+    ULONG Previous, NewCluster, OldValue;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (DeviceExt->FreeClusterMap.Buffer != NULL)
+    {
+        return AllocateFromClusterMap(DeviceExt, Fcb, LastCluster, Count, FirstCluster);
+    }
+
+    /* No map, scan the FAT for each cluster */
+    *FirstCluster = 0;
+    for (Previous = LastCluster; Count > 0; Count--)
+    {
+        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+        if (!NT_SUCCESS(Status))
+        {
+            ReleaseNewClusters(DeviceExt, LastCluster, *FirstCluster);
+            *FirstCluster = 0;
+            return Status;
+        }
+
+        if (Previous != 0)
+            DeviceExt->WriteCluster(DeviceExt, Previous, NewCluster, &OldValue);
+        if (*FirstCluster == 0)
+            *FirstCluster = NewCluster;
+        Previous = NewCluster;
+    }
+
+    return Status;
+}
+
+/*
+ * FUNCTION: Allocates Count clusters and appends them to the chain ending at
+ *           LastCluster, or starts a new chain if LastCluster is 0. Nothing
+ *           is allocated if the volume can't hold all of them. Fcb, if given,
+ *           is the file growing, which gets clusters held back behind it
+ */
+NTSTATUS
+AllocateClusters(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG LastCluster,
+    ULONG Count,
+    PULONG FirstCluster)
+{
+    NTSTATUS Status;
+
+    DPRINT("AllocateClusters(DeviceExt %p, LastCluster %x, Count %u)\n",
+           DeviceExt, LastCluster, Count);
+
+    ExAcquireResourceExclusiveLite(&DeviceExt->FatResource, TRUE);
+    Status = AllocateClustersLocked(DeviceExt, Fcb, LastCluster, Count, FirstCluster);
+    ExReleaseResourceLite(&DeviceExt->FatResource);
+
+    return Status;
+}
+
 /*
  * FUNCTION: Converts the cluster number to a sector number for this physical
  *           device
@@ -786,7 +1199,7 @@ GetNextClusterExtend(
      */
     if (CurrentCluster == 0)
     {
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+        Status = AllocateClustersLocked(DeviceExt, NULL, 0, 1, &NewCluster);
         if (!NT_SUCCESS(Status))
         {
             ExReleaseResourceLite(&DeviceExt->FatResource);
@@ -803,18 +1216,13 @@ GetNextClusterExtend(
     if ((*NextCluster) == 0xFFFFFFFF)
     {
         /* We are after last existing cluster, we must add one to file */
-        /* Firstly, find the next available open allocation unit and
-           mark it as end of file */
-        Status = DeviceExt->FindAndMarkAvailableCluster(DeviceExt, &NewCluster);
+        Status = AllocateClustersLocked(DeviceExt, NULL, CurrentCluster, 1, &NewCluster);
         if (!NT_SUCCESS(Status))
         {
             ExReleaseResourceLite(&DeviceExt->FatResource);
             return Status;
         }
 
-        /* Now, write the AU of the LastCluster with the value of the newly
-           found AU */
-        WriteCluster(DeviceExt, CurrentCluster, NewCluster);
         *NextCluster = NewCluster;
     }
 
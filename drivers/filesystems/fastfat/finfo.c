@@ -1250,36 +1250,16 @@ VfatSetAllocationSizeInformation(
         AllocSizeChanged = TRUE;
         if (FirstCluster == 0)
         {
-            Fcb->LastCluster = Fcb->LastOffset = 0;
-            Status = NextCluster(DeviceExt, FirstCluster, &FirstCluster, TRUE);
+            VfatTruncateClusterMcb(Fcb, 0);
+            Status = AllocateClusters(DeviceExt, vfatFCBIsDirectory(Fcb) ? NULL : Fcb,
+                                      0, (NewSize - 1) / ClusterSize + 1,
+                                      &FirstCluster);
             if (!NT_SUCCESS(Status))
             {
-                DPRINT1("NextCluster failed. Status = %x\n", Status);
+                DPRINT1("AllocateClusters failed. Status = %x\n", Status);
                 return Status;
             }
 
-            if (FirstCluster == 0xffffffff)
-            {
-                return STATUS_DISK_FULL;
-            }
-
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
-            {
-                /* disk is full */
-                NCluster = Cluster = FirstCluster;
-                Status = STATUS_SUCCESS;
-                while (NT_SUCCESS(Status) && Cluster != 0xffffffff && Cluster > 1)
-                {
-                    Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-                    WriteCluster(DeviceExt, Cluster, 0);
-                    Cluster = NCluster;
-                }
-                return STATUS_DISK_FULL;
-            }
-
             if (IsFatX)
             {
                 Fcb->entry.FatX.FirstCluster = FirstCluster;
@@ -1300,25 +1280,13 @@ VfatSetAllocationSizeInformation(
         }
         else
         {
-            if (Fcb->LastCluster > 0)
+            /* The cached runs stay valid, only the chain past them grows */
+            Status = VfatGetClusterRun(DeviceExt, Fcb,
+                                       Fcb->RFCB.AllocationSize.u.LowPart / ClusterSize - 1,
+                                       &Cluster, &NCluster);
+            if (NT_SUCCESS(Status) && Cluster == 0xffffffff)
             {
-                if (Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize == Fcb->LastOffset)
-                {
-                    Cluster = Fcb->LastCluster;
-                    Status = STATUS_SUCCESS;
-                }
-                else
-                {
-                    Status = OffsetToCluster(DeviceExt, Fcb->LastCluster,
-                                             Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize - Fcb->LastOffset,
-                                             &Cluster, FALSE);
-                }
-            }
-            else
-            {
-                Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                         Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize,
-                                         &Cluster, FALSE);
+                Status = STATUS_FILE_CORRUPT_ERROR;
             }
 
             if (!NT_SUCCESS(Status))
@@ -1326,28 +1294,14 @@ VfatSetAllocationSizeInformation(
                 return Status;
             }
 
-            Fcb->LastCluster = Cluster;
-            Fcb->LastOffset = Fcb->RFCB.AllocationSize.u.LowPart - ClusterSize;
-
-            /* FIXME: Check status */
             /* Cluster points now to the last cluster within the chain */
-            Status = OffsetToCluster(DeviceExt, Cluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize) - Fcb->LastOffset,
-                                     &NCluster, TRUE);
-            if (NCluster == 0xffffffff || !NT_SUCCESS(Status))
+            Status = AllocateClusters(DeviceExt, vfatFCBIsDirectory(Fcb) ? NULL : Fcb,
+                                      Cluster, (NewSize - 1) / ClusterSize + 1 -
+                                      Fcb->RFCB.AllocationSize.u.LowPart / ClusterSize,
+                                      &NCluster);
+            if (!NT_SUCCESS(Status))
             {
-                /* disk is full */
-                NCluster = Cluster;
-                Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-                WriteCluster(DeviceExt, Cluster, 0xffffffff);
-                Cluster = NCluster;
-                while (NT_SUCCESS(Status) && Cluster != 0xffffffff && Cluster > 1)
-                {
-                    Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
-                    WriteCluster(DeviceExt, Cluster, 0);
-                    Cluster = NCluster;
-                }
-                return STATUS_DISK_FULL;
+                return Status;
             }
         }
         UpdateFileSize(FileObject, Fcb, NewSize, ClusterSize, vfatVolumeIsFatX(DeviceExt));
@@ -1364,14 +1318,13 @@ VfatSetAllocationSizeInformation(
         DPRINT("Can set file size\n");
 
         AllocSizeChanged = TRUE;
-        /* FIXME: Use the cached cluster/offset better way. */
-        Fcb->LastCluster = Fcb->LastOffset = 0;
+        VfatTruncateClusterMcb(Fcb, ROUND_UP(NewSize, ClusterSize) / ClusterSize);
+        ReleaseClusterReservation(DeviceExt, Fcb);
         UpdateFileSize(FileObject, Fcb, NewSize, ClusterSize, vfatVolumeIsFatX(DeviceExt));
         if (NewSize > 0)
         {
-            Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                     ROUND_DOWN(NewSize - 1, ClusterSize),
-                                     &Cluster, FALSE);
+            Status = VfatGetClusterRun(DeviceExt, Fcb, (NewSize - 1) / ClusterSize,
+                                       &Cluster, &NCluster);
 
             NCluster = Cluster;
             Status = NextCluster(DeviceExt, FirstCluster, &NCluster, FALSE);
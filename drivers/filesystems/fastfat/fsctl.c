@@ -738,8 +738,9 @@ VfatMount(
     _SEH2_END;
 
     DeviceExt->LastAvailableCluster = 2;
-    CountAvailableClusters(DeviceExt, NULL);
     ExInitializeResourceLite(&DeviceExt->FatResource);
+    InitializeListHead(&DeviceExt->ReservationList);
+    InitializeFreeClusterMap(DeviceExt);
 
     InitializeListHead(&DeviceExt->FcbListHead);
 
@@ -830,6 +831,8 @@ ByeBye:
             ExFreePoolWithTag(DeviceExt->SpareVPB, TAG_VPB);
         if (DeviceExt && DeviceExt->Statistics)
             ExFreePoolWithTag(DeviceExt->Statistics, TAG_STATS);
+        if (DeviceExt)
+            UninitializeFreeClusterMap(DeviceExt);
         if (DeviceObject)
             IoDeleteDevice(DeviceObject);
     }
@@ -16,7 +16,7 @@
 #include <debug.h>
 
 /*
- * Uncomment to enable strict verification of cluster/offset pair
+ * Uncomment to enable strict verification of cluster run
  * caching. If this option is enabled you lose all the benefits of
  * the caching and the read/write operations will actually be
  * slower. It's meant only for debugging!!!
@@ -113,6 +113,144 @@ OffsetToCluster(
    }
 }
 
+/*
+ * Return the disk cluster backing the given cluster of the file and the
+ * number of clusters which follow it contiguously on disk. Runs are cached
+ * in the FCB, so only the part of the chain not seen yet is walked.
+ * Cluster is 0xffffffff if the file cluster is past the end of the chain.
+ */
+NTSTATUS
+VfatGetClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FileCluster,
+    PULONG Cluster,
+    PULONG RunLength)
+{
+    LONGLONG Lbn, Count;
+    ULONG AllocatedClusters;
+    ULONG CurrentCluster;
+    ULONG RunStart, RunCluster, RunCount;
+    NTSTATUS Status;
+
+    ASSERT(vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry) != 1);
+
+    AllocatedClusters = Fcb->RFCB.AllocationSize.u.LowPart / DeviceExt->FatInfo.BytesPerCluster;
+    if (FileCluster >= AllocatedClusters)
+    {
+        *Cluster = 0xffffffff;
+        *RunLength = 0;
+        return STATUS_SUCCESS;
+    }
+
+Retry:
+    ExAcquireFastMutex(&Fcb->McbMutex);
+    RunStart = Fcb->McbClusters;
+    if (FileCluster < RunStart)
+    {
+        FsRtlLookupLargeMcbEntry(&Fcb->ClusterMcb, FileCluster, &Lbn, &Count, NULL, NULL, NULL);
+        ExReleaseFastMutex(&Fcb->McbMutex);
+
+        *Cluster = (ULONG)Lbn;
+        *RunLength = (ULONG)Count;
+        goto Found;
+    }
+    if (RunStart > 0)
+    {
+        FsRtlLookupLastLargeMcbEntry(&Fcb->ClusterMcb, &Count, &Lbn);
+    }
+    ExReleaseFastMutex(&Fcb->McbMutex);
+
+    /* Continue the walk where the cached part of the chain ends */
+    if (RunStart > 0)
+    {
+        Status = GetNextCluster(DeviceExt, (ULONG)Lbn, &CurrentCluster);
+        if (!NT_SUCCESS(Status))
+            return Status;
+    }
+    else
+    {
+        CurrentCluster = vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry);
+    }
+
+    while (RunStart < AllocatedClusters && CurrentCluster != 0xffffffff && CurrentCluster > 1)
+    {
+        RunCluster = CurrentCluster;
+        RunCount = 0;
+        for (;;)
+        {
+            RunCount++;
+            if (RunStart + RunCount >= AllocatedClusters)
+                break;
+            Status = GetNextCluster(DeviceExt, CurrentCluster, &CurrentCluster);
+            if (!NT_SUCCESS(Status))
+                return Status;
+            if (CurrentCluster != RunCluster + RunCount)
+                break;
+        }
+
+        /* Someone else extended or truncated the map meanwhile, start over */
+        ExAcquireFastMutex(&Fcb->McbMutex);
+        if (Fcb->McbClusters != RunStart)
+        {
+            ExReleaseFastMutex(&Fcb->McbMutex);
+            goto Retry;
+        }
+        if (!FsRtlAddLargeMcbEntry(&Fcb->ClusterMcb, RunStart, RunCluster, RunCount))
+        {
+            ExReleaseFastMutex(&Fcb->McbMutex);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+        Fcb->McbClusters = RunStart + RunCount;
+        ExReleaseFastMutex(&Fcb->McbMutex);
+
+        if (FileCluster < RunStart + RunCount)
+        {
+            *Cluster = RunCluster + (FileCluster - RunStart);
+            *RunLength = RunCount - (FileCluster - RunStart);
+            goto Found;
+        }
+        RunStart += RunCount;
+    }
+
+    /* The chain is shorter than the allocation size */
+    *Cluster = 0xffffffff;
+    *RunLength = 0;
+    return STATUS_SUCCESS;
+
+Found:
+#ifdef DEBUG_VERIFY_OFFSET_CACHING
+    /* DEBUG VERIFICATION */
+    {
+        ULONG CorrectCluster;
+        OffsetToCluster(DeviceExt, vfatDirEntryGetFirstCluster(DeviceExt, &Fcb->entry),
+                        FileCluster * DeviceExt->FatInfo.BytesPerCluster,
+                        &CorrectCluster, FALSE);
+        if (CorrectCluster != *Cluster)
+            KeBugCheck(FAT_FILE_SYSTEM);
+    }
+#endif
+    return STATUS_SUCCESS;
+}
+
+/*
+ * Forget the cached runs past the given number of file clusters, must be
+ * called before the allocated clusters change.
+ */
+VOID
+VfatTruncateClusterMcb(
+    PVFATFCB Fcb,
+    ULONG FileClusters)
+{
+    ExAcquireFastMutex(&Fcb->McbMutex);
+    if (Fcb->McbClusters > FileClusters)
+    {
+        FsRtlTruncateLargeMcb(&Fcb->ClusterMcb, FileClusters);
+        Fcb->McbClusters = FileClusters;
+    }
+    ExReleaseFastMutex(&Fcb->McbMutex);
+}
+
 /*
  * FUNCTION: Reads data from a file
  */
@@ -124,20 +262,16 @@ VfatReadFileData(
     LARGE_INTEGER ReadOffset,
     PULONG LengthRead)
 {
-    ULONG CurrentCluster;
     ULONG FirstCluster;
     ULONG StartCluster;
     ULONG ClusterCount;
     LARGE_INTEGER StartOffset;
     PDEVICE_EXTENSION DeviceExt;
-    BOOLEAN First = TRUE;
     PVFATFCB Fcb;
     NTSTATUS Status;
     ULONG BytesDone;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -194,8 +328,7 @@ VfatReadFileData(
     }
 
     /* Find the first cluster */
-    FirstCluster =
-    CurrentCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
+    FirstCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
 
     if (FirstCluster == 1)
     {
@@ -215,87 +348,25 @@ VfatReadFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    /* Find the cluster to start the read from */
-    if (LastCluster > 0 && ReadOffset.u.LowPart >= LastOffset)
-    {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
-#ifdef DEBUG_VERIFY_OFFSET_CACHING
-        /* DEBUG VERIFICATION */
-        {
-            ULONG CorrectCluster;
-            OffsetToCluster(DeviceExt, FirstCluster,
-                            ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
-                            &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
-                KeBugCheck(FAT_FILE_SYSTEM);
-        }
-#endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
-
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (ReadOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
     KeInitializeEvent(&IrpContext->Event, NotificationEvent, FALSE);
     IrpContext->RefCount = 1;
+    Status = STATUS_SUCCESS;
 
-    while (Length > 0 && CurrentCluster != 0xffffffff)
+    /* Issue one disk request per contiguous run of clusters */
+    while (Length > 0)
     {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        Status = VfatGetClusterRun(DeviceExt, Fcb, ReadOffset.u.LowPart / BytesPerCluster,
+                                   &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (ReadOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += ReadOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            break;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
 
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(ReadOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector +
+                               ReadOffset.u.LowPart % BytesPerCluster;
+        BytesDone = (ULONG)min((ULONGLONG)Length,
+                               (ULONGLONG)ClusterCount * BytesPerCluster - ReadOffset.u.LowPart % BytesPerCluster);
+        DPRINT("start %08x, count %u\n", StartCluster, ClusterCount);
 
         /* Fire up the read command */
         Status = VfatReadDiskPartial (IrpContext, &StartOffset, BytesDone, *LengthRead, FALSE);
@@ -339,18 +410,14 @@ VfatWriteFileData(
     PVFATFCB Fcb;
     ULONG Count;
     ULONG FirstCluster;
-    ULONG CurrentCluster;
     ULONG BytesDone;
     ULONG StartCluster;
     ULONG ClusterCount;
     NTSTATUS Status = STATUS_SUCCESS;
-    BOOLEAN First = TRUE;
     ULONG BytesPerSector;
     ULONG BytesPerCluster;
     LARGE_INTEGER StartOffset;
     ULONG BufferOffset;
-    ULONG LastCluster;
-    ULONG LastOffset;
 
     /* PRECONDITION */
     ASSERT(IrpContext);
@@ -415,8 +482,7 @@ VfatWriteFileData(
     /*
      * Find the first cluster
      */
-    FirstCluster =
-    CurrentCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
+    FirstCluster = vfatDirEntryGetFirstCluster (DeviceExt, &Fcb->entry);
 
     if (FirstCluster == 1)
     {
@@ -428,89 +494,24 @@ VfatWriteFileData(
         return Status;
     }
 
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    LastCluster = Fcb->LastCluster;
-    LastOffset = Fcb->LastOffset;
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
-    /*
-     * Find the cluster to start the write from
-     */
-    if (LastCluster > 0 && WriteOffset.u.LowPart >= LastOffset)
-    {
-        Status = OffsetToCluster(DeviceExt, LastCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) -
-                                 LastOffset,
-                                 &CurrentCluster, FALSE);
-#ifdef DEBUG_VERIFY_OFFSET_CACHING
-        /* DEBUG VERIFICATION */
-        {
-            ULONG CorrectCluster;
-            OffsetToCluster(DeviceExt, FirstCluster,
-                            ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
-                            &CorrectCluster, FALSE);
-            if (CorrectCluster != CurrentCluster)
-                KeBugCheck(FAT_FILE_SYSTEM);
-        }
-#endif
-    }
-    else
-    {
-        Status = OffsetToCluster(DeviceExt, FirstCluster,
-                                 ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster),
-                                 &CurrentCluster, FALSE);
-    }
-
-    if (!NT_SUCCESS(Status))
-    {
-        return Status;
-    }
-
-    ExAcquireFastMutex(&Fcb->LastMutex);
-    Fcb->LastCluster = CurrentCluster;
-    Fcb->LastOffset = ROUND_DOWN (WriteOffset.u.LowPart, BytesPerCluster);
-    ExReleaseFastMutex(&Fcb->LastMutex);
-
     IrpContext->RefCount = 1;
     BufferOffset = 0;
 
-    while (Length > 0 && CurrentCluster != 0xffffffff)
+    /* Issue one disk request per contiguous run of clusters */
+    while (Length > 0)
     {
-        StartCluster = CurrentCluster;
-        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector;
-        BytesDone = 0;
-        ClusterCount = 0;
-
-        do
+        Status = VfatGetClusterRun(DeviceExt, Fcb, WriteOffset.u.LowPart / BytesPerCluster,
+                                   &StartCluster, &ClusterCount);
+        if (!NT_SUCCESS(Status) || StartCluster == 0xffffffff)
         {
-            ClusterCount++;
-            if (First)
-            {
-                BytesDone =  min (Length, BytesPerCluster - (WriteOffset.u.LowPart % BytesPerCluster));
-                StartOffset.QuadPart += WriteOffset.u.LowPart % BytesPerCluster;
-                First = FALSE;
-            }
-            else
-            {
-                if (Length - BytesDone > BytesPerCluster)
-                {
-                    BytesDone += BytesPerCluster;
-                }
-                else
-                {
-                    BytesDone = Length;
-                }
-            }
-            Status = NextCluster(DeviceExt, FirstCluster, &CurrentCluster, FALSE);
+            break;
         }
-        while (StartCluster + ClusterCount == CurrentCluster && NT_SUCCESS(Status) && Length > BytesDone);
-        DPRINT("start %08x, next %08x, count %u\n",
-               StartCluster, CurrentCluster, ClusterCount);
-
-        ExAcquireFastMutex(&Fcb->LastMutex);
-        Fcb->LastCluster = StartCluster + (ClusterCount - 1);
-        Fcb->LastOffset = ROUND_DOWN(WriteOffset.u.LowPart, BytesPerCluster) + (ClusterCount - 1) * BytesPerCluster;
-        ExReleaseFastMutex(&Fcb->LastMutex);
+
+        StartOffset.QuadPart = ClusterToSector(DeviceExt, StartCluster) * BytesPerSector +
+                               WriteOffset.u.LowPart % BytesPerCluster;
+        BytesDone = (ULONG)min((ULONGLONG)Length,
+                               (ULONGLONG)ClusterCount * BytesPerCluster - WriteOffset.u.LowPart % BytesPerCluster);
+        DPRINT("start %08x, count %u\n", StartCluster, ClusterCount);
 
         // Fire up the write command
         Status = VfatWriteDiskPartial (IrpContext, &StartOffset, BytesDone, BufferOffset, FALSE);
@@ -325,6 +325,10 @@ typedef struct DEVICE_EXTENSION
     ULONG LastAvailableCluster;
     ULONG AvailableClusters;
     BOOLEAN AvailableClustersValid;
+    /* In-memory copy of the FAT allocation state, a set bit is a used cluster */
+    RTL_BITMAP FreeClusterMap;
+    /* FCBs holding back clusters behind their end */
+    LIST_ENTRY ReservationList;
     ULONG Flags;
     struct _VFATFCB *VolumeFcb;
     struct _VFATFCB *RootFcb;
@@ -520,13 +524,19 @@ typedef struct _VFATFCB
     FILE_LOCK FileLock;
 
     /*
-     * Optimization: caching of last read/write cluster+offset pair. Can't
-     * be in VFATCCB because it must be reset everytime the allocated clusters
-     * change.
+     * Optimization: cache of the cluster chain, file cluster -> disk cluster,
+     * filled lazily in runs of contiguous clusters. Clusters [0, McbClusters)
+     * are mapped. Can't be in VFATCCB because it must be truncated everytime
+     * the allocated clusters change.
      */
-    FAST_MUTEX LastMutex;
-    ULONG LastCluster;
-    ULONG LastOffset;
+    FAST_MUTEX McbMutex;
+    LARGE_MCB ClusterMcb;
+    ULONG McbClusters;
+
+    /* Free clusters held back behind the end of a growing file */
+    LIST_ENTRY ReservationListEntry;
+    ULONG ReservedCluster;
+    ULONG ReservedCount;
 
     struct _VFAT_CLOSE_CONTEXT * CloseContext;
 } VFATFCB, *PVFATFCB;
@@ -553,6 +563,7 @@ typedef struct _VFATCCB
 #define TAG_NAME 'ntaF'
 #define TAG_SEARCH 'LtaF'
 #define TAG_DIRENT 'DtaF'
+#define TAG_BITMAP 'BtaF'
 
 #define ENTRIES_PER_SECTOR (BLOCKSIZE / sizeof(FATDirEntry))
 
@@ -925,6 +936,27 @@ CountAvailableClusters(
     PDEVICE_EXTENSION DeviceExt,
     PLARGE_INTEGER Clusters);
 
+VOID
+InitializeFreeClusterMap(
+    PDEVICE_EXTENSION DeviceExt);
+
+VOID
+UninitializeFreeClusterMap(
+    PDEVICE_EXTENSION DeviceExt);
+
+NTSTATUS
+AllocateClusters(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG LastCluster,
+    ULONG Count,
+    PULONG FirstCluster);
+
+VOID
+ReleaseClusterReservation(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb);
+
 NTSTATUS
 WriteCluster(
     PDEVICE_EXTENSION DeviceExt,
@@ -1202,6 +1234,19 @@ NextCluster(
     PULONG CurrentCluster,
     BOOLEAN Extend);
 
+NTSTATUS
+VfatGetClusterRun(
+    PDEVICE_EXTENSION DeviceExt,
+    PVFATFCB Fcb,
+    ULONG FileCluster,
+    PULONG Cluster,
+    PULONG RunLength);
+
+VOID
+VfatTruncateClusterMcb(
+    PVFATFCB Fcb,
+    ULONG FileClusters);
+
 /* shutdown.c */
 
 DRIVER_DISPATCH
@@ -276,6 +276,7 @@ NtfsGetVolumeData(PDEVICE_OBJECT DeviceObject,
 
     ExInitializeNPagedLookasideList(&DeviceExt->FileRecLookasideList,
                                     NULL, NULL, 0, NtfsInfo->BytesPerFileRecord, TAG_FILE_REC, 0);
+    InitializeFileRecordCache(DeviceExt);
 
     DeviceExt->MasterFileTable = ExAllocateFromNPagedLookasideList(&DeviceExt->FileRecLookasideList);
     if (DeviceExt->MasterFileTable == NULL)
@@ -371,6 +372,7 @@ NtfsGetVolumeData(PDEVICE_OBJECT DeviceObject,
     if (VolumeFcb == NULL)
     {
         DPRINT1("Failed allocating volume FCB\n");
+        PurgeFileRecordCache(DeviceExt);
         ExFreeToNPagedLookasideList(&DeviceExt->FileRecLookasideList, VolumeRecord);
         ExFreeToNPagedLookasideList(&DeviceExt->FileRecLookasideList, DeviceExt->MasterFileTable);
         ExDeleteNPagedLookasideList(&DeviceExt->FileRecLookasideList);
@@ -565,7 +567,10 @@ ByeBye:
             ExFreePool(Ccb);
 
         if (Lookaside)
+        {
+            PurgeFileRecordCache(Vcb);
             ExDeleteNPagedLookasideList(&Vcb->FileRecLookasideList);
+        }
 
         if (NewDeviceObject)
             IoDeleteDevice(NewDeviceObject);
@@ -63,29 +63,9 @@ PrepareAttributeContext(PNTFS_ATTR_RECORD AttrRecord)
 
     if (AttrRecord->IsNonResident)
     {
-        LONGLONG DataRunOffset;
-        ULONGLONG DataRunLength;
         ULONGLONG NextVBN = 0;
         PUCHAR DataRun = (PUCHAR)((ULONG_PTR)Context->pRecord + Context->pRecord->NonResident.MappingPairsOffset);
 
-        Context->CacheRun = DataRun;
-        Context->CacheRunOffset = 0;
-        Context->CacheRun = DecodeRun(Context->CacheRun, &DataRunOffset, &DataRunLength);
-        Context->CacheRunLength = DataRunLength;
-        if (DataRunOffset != -1)
-        {
-            /* Normal run. */
-            Context->CacheRunStartLCN =
-            Context->CacheRunLastLCN = DataRunOffset;
-        }
-        else
-        {
-            /* Sparse run. */
-            Context->CacheRunStartLCN = -1;
-            Context->CacheRunLastLCN = 0;
-        }
-        Context->CacheRunCurrentOffset = 0;
-
         // Convert the data runs to a map control block
         if (!NT_SUCCESS(ConvertDataRunsToLargeMCB(DataRun, &Context->DataRunsMCB, &NextVBN)))
         {
@@ -1068,18 +1048,12 @@ ReadAttribute(PDEVICE_EXTENSION Vcb,
               PCHAR Buffer,
               ULONG Length)
 {
-    ULONGLONG LastLCN;
-    PUCHAR DataRun;
-    LONGLONG DataRunOffset;
-    ULONGLONG DataRunLength;
     LONGLONG DataRunStartLCN;
-    ULONGLONG CurrentOffset;
+    LONGLONG DataRunLength;
+    ULONG ClusterOffset;
     ULONG ReadLength;
     ULONG AlreadyRead;
     NTSTATUS Status;
-    
-    //TEMPTEMP
-    PUCHAR TempBuffer;
 
     if (!Context->pRecord->IsNonResident)
     {
@@ -1102,169 +1076,51 @@ ReadAttribute(PDEVICE_EXTENSION Vcb,
      */
 
     /*
-     * I. Find the corresponding start data run.
+     * The data runs were decoded into DataRunsMCB when the context was
+     * prepared, so each run is a single lookup. Sparse runs are holes in it.
      */
 
     AlreadyRead = 0;
 
-    // FIXME: Cache seems to be non-working. Disable it for now
-    //if(Context->CacheRunOffset <= Offset && Offset < Context->CacheRunOffset + Context->CacheRunLength * Volume->ClusterSize)
-    if (0)
-    {
-        DataRun = Context->CacheRun;
-        LastLCN = Context->CacheRunLastLCN;
-        DataRunStartLCN = Context->CacheRunStartLCN;
-        DataRunLength = Context->CacheRunLength;
-        CurrentOffset = Context->CacheRunCurrentOffset;
-    }
-    else
+    while (Length > 0)
     {
-        //TEMPTEMP
-        ULONG UsedBufferSize;
-        TempBuffer = ExAllocatePoolWithTag(NonPagedPool, Vcb->NtfsInfo.BytesPerFileRecord, TAG_NTFS);
-        if (TempBuffer == NULL)
+        ClusterOffset = (ULONG)(Offset % Vcb->NtfsInfo.BytesPerCluster);
+
+        if (!FsRtlLookupLargeMcbEntry(&Context->DataRunsMCB,
+                                      Offset / Vcb->NtfsInfo.BytesPerCluster,
+                                      &DataRunStartLCN,
+                                      &DataRunLength,
+                                      NULL,
+                                      NULL,
+                                      NULL))
         {
-            return STATUS_INSUFFICIENT_RESOURCES;
+            /* Past the last data run. */
+            break;
         }
 
-        LastLCN = 0;
-        CurrentOffset = 0;
-
-        // This will be rewritten in the next iteration to just use the DataRuns MCB directly
-        ConvertLargeMCBToDataRuns(&Context->DataRunsMCB,
-                                  TempBuffer,
-                                  Vcb->NtfsInfo.BytesPerFileRecord,
-                                  &UsedBufferSize);
-
-        DataRun = TempBuffer;
-
-        while (1)
+        ReadLength = (ULONG)min((ULONGLONG)DataRunLength * Vcb->NtfsInfo.BytesPerCluster - ClusterOffset, Length);
+        if (DataRunStartLCN == -1)
         {
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != -1)
-            {
-                /* Normal data run. */
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-            {
-                /* Sparse data run. */
-                DataRunStartLCN = -1;
-            }
-
-            if (Offset >= CurrentOffset &&
-                Offset < CurrentOffset + (DataRunLength * Vcb->NtfsInfo.BytesPerCluster))
-            {
+            /* Sparse data run. */
+            RtlZeroMemory(Buffer, ReadLength);
+        }
+        else
+        {
+            Status = NtfsReadDisk(Vcb->StorageDevice,
+                                  DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + ClusterOffset,
+                                  ReadLength,
+                                  Vcb->NtfsInfo.BytesPerSector,
+                                  (PVOID)Buffer,
+                                  FALSE);
+            if (!NT_SUCCESS(Status))
                 break;
-            }
-
-            if (*DataRun == 0)
-            {
-                ExFreePoolWithTag(TempBuffer, TAG_NTFS);
-                return AlreadyRead;
-            }
-
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
         }
-    }
-
-    /*
-     * II. Go through the run list and read the data
-     */
 
-    ReadLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset), Length);
-    if (DataRunStartLCN == -1)
-    {
-        RtlZeroMemory(Buffer, ReadLength);
-        Status = STATUS_SUCCESS;
-    }
-    else
-    {
-        Status = NtfsReadDisk(Vcb->StorageDevice,
-                              DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + Offset - CurrentOffset,
-                              ReadLength,
-                              Vcb->NtfsInfo.BytesPerSector,
-                              (PVOID)Buffer,
-                              FALSE);
-    }
-    if (NT_SUCCESS(Status))
-    {
+        Offset += ReadLength;
         Length -= ReadLength;
         Buffer += ReadLength;
         AlreadyRead += ReadLength;
-
-        if (ReadLength == DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset))
-        {
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != (ULONGLONG)-1)
-            {
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-                DataRunStartLCN = -1;
-        }
-
-        while (Length > 0)
-        {
-            ReadLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster, Length);
-            if (DataRunStartLCN == -1)
-                RtlZeroMemory(Buffer, ReadLength);
-            else
-            {
-                Status = NtfsReadDisk(Vcb->StorageDevice,
-                                      DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster,
-                                      ReadLength,
-                                      Vcb->NtfsInfo.BytesPerSector,
-                                      (PVOID)Buffer,
-                                      FALSE);
-                if (!NT_SUCCESS(Status))
-                    break;
-            }
-
-            Length -= ReadLength;
-            Buffer += ReadLength;
-            AlreadyRead += ReadLength;
-
-            /* We finished this request, but there still data in this data run. */
-            if (Length == 0 && ReadLength != DataRunLength * Vcb->NtfsInfo.BytesPerCluster)
-                break;
-
-            /*
-             * Go to next run in the list.
-             */
-
-            if (*DataRun == 0)
-                break;
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != -1)
-            {
-                /* Normal data run. */
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-            {
-                /* Sparse data run. */
-                DataRunStartLCN = -1;
-            }
-        } /* while */
-
-    } /* if Disk */
-
-    // TEMPTEMP
-    if (Context->pRecord->IsNonResident)
-        ExFreePoolWithTag(TempBuffer, TAG_NTFS);
-
-    Context->CacheRun = DataRun;
-    Context->CacheRunOffset = Offset + AlreadyRead;
-    Context->CacheRunStartLCN = DataRunStartLCN;
-    Context->CacheRunLength = DataRunLength;
-    Context->CacheRunLastLCN = LastLCN;
-    Context->CacheRunCurrentOffset = CurrentOffset;
+    }
 
     return AlreadyRead;
 }
@@ -1320,21 +1176,13 @@ WriteAttribute(PDEVICE_EXTENSION Vcb,
                PULONG RealLengthWritten,
                PFILE_RECORD_HEADER FileRecord)
 {
-    ULONGLONG LastLCN;
-    PUCHAR DataRun;
-    LONGLONG DataRunOffset;
-    ULONGLONG DataRunLength;
     LONGLONG DataRunStartLCN;
-    ULONGLONG CurrentOffset;
+    LONGLONG DataRunLength;
+    ULONG ClusterOffset;
     ULONG WriteLength;
     NTSTATUS Status;
     PUCHAR SourceBuffer = Buffer;
-    LONGLONG StartingOffset;
     BOOLEAN FileRecordAllocated = FALSE;
-    
-    //TEMPTEMP
-    PUCHAR TempBuffer;
-        
 
     DPRINT("WriteAttribute(%p, %p, %I64u, %p, %lu, %p, %p)\n", Vcb, Context, Offset, Buffer, Length, RealLengthWritten, FileRecord);
 
@@ -1422,209 +1270,220 @@ WriteAttribute(PDEVICE_EXTENSION Vcb,
     }
 
     // This is a non-resident attribute.
+    // The data runs were decoded into DataRunsMCB when the context was prepared,
+    // so we look up each run we're writing to directly.
 
-    // I. Find the corresponding start data run.	
+    Status = STATUS_SUCCESS;
 
-    // FIXME: Cache seems to be non-working. Disable it for now
-    //if(Context->CacheRunOffset <= Offset && Offset < Context->CacheRunOffset + Context->CacheRunLength * Volume->ClusterSize)
-    /*if (0)
-    {
-    DataRun = Context->CacheRun;
-    LastLCN = Context->CacheRunLastLCN;
-    DataRunStartLCN = Context->CacheRunStartLCN;
-    DataRunLength = Context->CacheRunLength;
-    CurrentOffset = Context->CacheRunCurrentOffset;
-    }
-    else*/
+    while (Length > 0)
     {
-        ULONG UsedBufferSize;
-        LastLCN = 0;
-        CurrentOffset = 0;  
+        ClusterOffset = (ULONG)(Offset % Vcb->NtfsInfo.BytesPerCluster);
 
-        // This will be rewritten in the next iteration to just use the DataRuns MCB directly
-        TempBuffer = ExAllocatePoolWithTag(NonPagedPool, Vcb->NtfsInfo.BytesPerFileRecord, TAG_NTFS);
-        if (TempBuffer == NULL)
+        if (!FsRtlLookupLargeMcbEntry(&Context->DataRunsMCB,
+                                      Offset / Vcb->NtfsInfo.BytesPerCluster,
+                                      &DataRunStartLCN,
+                                      &DataRunLength,
+                                      NULL,
+                                      NULL,
+                                      NULL))
         {
-            return STATUS_INSUFFICIENT_RESOURCES;
+            // We reached the last assigned cluster
+            // TODO: assign new clusters to the end of the file. 
+            // (Presently, this code will rarely be reached, the write will usually have already failed by now)
+            // [We can reach here by creating a new file record when the MFT isn't large enough]
+            DPRINT1("FIXME: Master File Table needs to be enlarged.\n");
+            Status = STATUS_END_OF_FILE;
+            break;
         }
 
-        ConvertLargeMCBToDataRuns(&Context->DataRunsMCB,
-                                  TempBuffer,
-                                  Vcb->NtfsInfo.BytesPerFileRecord,
-                                  &UsedBufferSize);
+        // Are we dealing with a sparse data run?
+        if (DataRunStartLCN == -1)
+        {
+            // We can't support writing to sparse files yet
+            // (it may require increasing the allocation size).
+            DPRINT1("FIXME: Writing to sparse files is not supported yet!\n");
+            Status = STATUS_NOT_IMPLEMENTED;
+            break;
+        }
 
-        DataRun = TempBuffer;
+        // Make sure we don't write past the end of the current data run
+        WriteLength = (ULONG)min((ULONGLONG)DataRunLength * Vcb->NtfsInfo.BytesPerCluster - ClusterOffset, Length);
+
+        // Write the data to the disk
+        Status = NtfsWriteDisk(Vcb->StorageDevice,
+                               DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + ClusterOffset,
+                               WriteLength,
+                               Vcb->NtfsInfo.BytesPerSector,
+                               (PVOID)SourceBuffer);
+        if (!NT_SUCCESS(Status))
+            break;
 
-        while (1)
-        {
-            DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-            if (DataRunOffset != -1)
-            {
-                // Normal data run. 
-                // DPRINT1("Writing to normal data run, LastLCN %I64u DataRunOffset %I64d\n", LastLCN, DataRunOffset);
-                DataRunStartLCN = LastLCN + DataRunOffset;
-                LastLCN = DataRunStartLCN;
-            }
-            else
-            {
-                // Sparse data run. We can't support writing to sparse files yet 
-                // (it may require increasing the allocation size).
-                DataRunStartLCN = -1;
-                DPRINT1("FIXME: Writing to sparse files is not supported yet!\n");
-                Status = STATUS_NOT_IMPLEMENTED;
-                goto Cleanup;
-            }
+        Offset += WriteLength;
+        Length -= WriteLength;
+        SourceBuffer += WriteLength;
+        *RealLengthWritten += WriteLength;
+    }
 
-            // Have we reached the data run we're trying to write to?
-            if (Offset >= CurrentOffset &&
-                Offset < CurrentOffset + (DataRunLength * Vcb->NtfsInfo.BytesPerCluster))
-            {
-                break;
-            }
+    return Status;
+}
 
-            if (*DataRun == 0)
-            {
-                // We reached the last assigned cluster
-                // TODO: assign new clusters to the end of the file. 
-                // (Presently, this code will rarely be reached, the write will usually have already failed by now)
-                // [We can reach here by creating a new file record when the MFT isn't large enough]
-                DPRINT1("FIXME: Master File Table needs to be enlarged.\n");
-                Status = STATUS_END_OF_FILE;
-                goto Cleanup;
-            }
+/**
+* @name InitializeFileRecordCache
+* @implemented
+*
+* Sets up the per-volume cache of fixed-up file records used by ReadFileRecord().
+*
+* @param Vcb
+* Pointer to the DEVICE_EXTENSION of the volume being mounted.
+*/
+VOID
+InitializeFileRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    ExInitializeFastMutex(&Vcb->FileRecCacheLock);
+    InitializeListHead(&Vcb->FileRecCacheList);
+    Vcb->FileRecCacheCount = 0;
+    Vcb->FileRecCacheGeneration = 0;
+}
 
-            CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-        }
-    }
+/**
+* @name PurgeFileRecordCache
+* @implemented
+*
+* Frees every file record held in the cache of the given volume.
+* Only called when mounting the volume fails: the driver has no
+* dismount path, the records of a mounted volume stay cached.
+*
+* @param Vcb
+* Pointer to the DEVICE_EXTENSION of the volume.
+*/
+VOID
+PurgeFileRecordCache(PDEVICE_EXTENSION Vcb)
+{
+    PLIST_ENTRY ListEntry;
 
-    // II. Go through the run list and write the data
+    ExAcquireFastMutex(&Vcb->FileRecCacheLock);
 
-    /* REVIEWME -- As adapted from NtfsReadAttribute():
-    We seem to be making a special case for the first applicable data run, but I'm not sure why.
-    Does it have something to do with (not) caching? Is this strategy equally applicable to writing? */
+    while (!IsListEmpty(&Vcb->FileRecCacheList))
+    {
+        ListEntry = RemoveHeadList(&Vcb->FileRecCacheList);
+        ExFreePoolWithTag(CONTAINING_RECORD(ListEntry, FILE_RECORD_CACHE_ENTRY, ListEntry), TAG_FILE_REC);
+    }
 
-    WriteLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset), Length);
+    Vcb->FileRecCacheCount = 0;
+    Vcb->FileRecCacheGeneration++;
 
-    StartingOffset = DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster + Offset - CurrentOffset;
+    ExReleaseFastMutex(&Vcb->FileRecCacheLock);
+}
 
-    // Write the data to the disk
-    Status = NtfsWriteDisk(Vcb->StorageDevice,
-                           StartingOffset,
-                           WriteLength,
-                           Vcb->NtfsInfo.BytesPerSector,
-                           (PVOID)SourceBuffer);
+static
+BOOLEAN
+LookupFileRecordCache(PDEVICE_EXTENSION Vcb,
+                      ULONGLONG MftIndex,
+                      PFILE_RECORD_HEADER FileRecord,
+                      PULONG Generation)
+{
+    PLIST_ENTRY ListEntry;
+    PFILE_RECORD_CACHE_ENTRY Entry;
 
-    // Did the write fail?
-    if (!NT_SUCCESS(Status))
+    ExAcquireFastMutex(&Vcb->FileRecCacheLock);
+
+    for (ListEntry = Vcb->FileRecCacheList.Flink;
+         ListEntry != &Vcb->FileRecCacheList;
+         ListEntry = ListEntry->Flink)
     {
-        Context->CacheRun = DataRun;
-        Context->CacheRunOffset = Offset;
-        Context->CacheRunStartLCN = DataRunStartLCN;
-        Context->CacheRunLength = DataRunLength;
-        Context->CacheRunLastLCN = LastLCN;
-        Context->CacheRunCurrentOffset = CurrentOffset;
+        Entry = CONTAINING_RECORD(ListEntry, FILE_RECORD_CACHE_ENTRY, ListEntry);
+        if (Entry->MftIndex == MftIndex)
+        {
+            // Move it to the front, the list is kept in most recently used order
+            RemoveEntryList(&Entry->ListEntry);
+            InsertHeadList(&Vcb->FileRecCacheList, &Entry->ListEntry);
 
-        goto Cleanup;
+            RtlCopyMemory(FileRecord, Entry + 1, Vcb->NtfsInfo.BytesPerFileRecord);
+
+            ExReleaseFastMutex(&Vcb->FileRecCacheLock);
+            return TRUE;
+        }
     }
 
-    Length -= WriteLength;
-    SourceBuffer += WriteLength;
-    *RealLengthWritten += WriteLength;
+    // Remember which version of the cache the caller is about to read against
+    *Generation = Vcb->FileRecCacheGeneration;
 
-    // Did we write to the end of the data run?
-    if (WriteLength == DataRunLength * Vcb->NtfsInfo.BytesPerCluster - (Offset - CurrentOffset))
-    {
-        // Advance to the next data run
-        CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-        DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
+    ExReleaseFastMutex(&Vcb->FileRecCacheLock);
+    return FALSE;
+}
 
-        if (DataRunOffset != (ULONGLONG)-1)
-        {
-            DataRunStartLCN = LastLCN + DataRunOffset;
-            LastLCN = DataRunStartLCN;
-        }
-        else
-            DataRunStartLCN = -1;
+static
+VOID
+InsertFileRecordCache(PDEVICE_EXTENSION Vcb,
+                      ULONGLONG MftIndex,
+                      PFILE_RECORD_HEADER FileRecord,
+                      ULONG Generation)
+{
+    PFILE_RECORD_CACHE_ENTRY Entry;
+
+    ExAcquireFastMutex(&Vcb->FileRecCacheLock);
+
+    // If the record was updated while we were reading it, our copy may be stale
+    if (Generation != Vcb->FileRecCacheGeneration)
+    {
+        ExReleaseFastMutex(&Vcb->FileRecCacheLock);
+        return;
     }
 
-    // Do we have more data to write?
-    while (Length > 0)
+    if (Vcb->FileRecCacheCount < NTFS_FILE_RECORD_CACHE_SIZE)
     {
-        // Make sure we don't write past the end of the current data run
-        WriteLength = (ULONG)min(DataRunLength * Vcb->NtfsInfo.BytesPerCluster, Length);
-        
-        // Are we dealing with a sparse data run?
-        if (DataRunStartLCN == -1)
-        {
-            DPRINT1("FIXME: Don't know how to write to sparse files yet! (DataRunStartLCN == -1)\n");
-            Status = STATUS_NOT_IMPLEMENTED;
-            goto Cleanup;
-        }
-        else
+        Entry = ExAllocatePoolWithTag(NonPagedPool,
+                                      sizeof(FILE_RECORD_CACHE_ENTRY) + Vcb->NtfsInfo.BytesPerFileRecord,
+                                      TAG_FILE_REC);
+        if (Entry == NULL)
         {
-            // write the data to the disk
-            Status = NtfsWriteDisk(Vcb->StorageDevice,
-                                   DataRunStartLCN * Vcb->NtfsInfo.BytesPerCluster,
-                                   WriteLength,
-                                   Vcb->NtfsInfo.BytesPerSector,
-                                   (PVOID)SourceBuffer);
-            if (!NT_SUCCESS(Status))
-                break;
+            ExReleaseFastMutex(&Vcb->FileRecCacheLock);
+            return;
         }
 
-        Length -= WriteLength;
-        SourceBuffer += WriteLength;
-        *RealLengthWritten += WriteLength;
+        Vcb->FileRecCacheCount++;
+    }
+    else
+    {
+        // Recycle the least recently used entry
+        Entry = CONTAINING_RECORD(RemoveTailList(&Vcb->FileRecCacheList), FILE_RECORD_CACHE_ENTRY, ListEntry);
+    }
 
-        // We finished this request, but there's still data in this data run. 
-        if (Length == 0 && WriteLength != DataRunLength * Vcb->NtfsInfo.BytesPerCluster)
-            break;
+    Entry->MftIndex = MftIndex;
+    RtlCopyMemory(Entry + 1, FileRecord, Vcb->NtfsInfo.BytesPerFileRecord);
+    InsertHeadList(&Vcb->FileRecCacheList, &Entry->ListEntry);
 
-        // Go to next run in the list.
+    ExReleaseFastMutex(&Vcb->FileRecCacheLock);
+}
 
-        if (*DataRun == 0)
-        {
-            // that was the last run
-            if (Length > 0)
-            {
-                // Failed sanity check.
-                DPRINT1("Encountered EOF before expected!\n");
-                Status = STATUS_END_OF_FILE;
-                goto Cleanup;
-            }
+static
+VOID
+InvalidateFileRecordCache(PDEVICE_EXTENSION Vcb,
+                          ULONGLONG MftIndex)
+{
+    PLIST_ENTRY ListEntry;
+    PFILE_RECORD_CACHE_ENTRY Entry;
 
-            break;
-        }
+    ExAcquireFastMutex(&Vcb->FileRecCacheLock);
 
-        // Advance to the next data run
-        CurrentOffset += DataRunLength * Vcb->NtfsInfo.BytesPerCluster;
-        DataRun = DecodeRun(DataRun, &DataRunOffset, &DataRunLength);
-        if (DataRunOffset != -1)
-        {
-            // Normal data run.
-            DataRunStartLCN = LastLCN + DataRunOffset;
-            LastLCN = DataRunStartLCN;
-        }
-        else
+    for (ListEntry = Vcb->FileRecCacheList.Flink;
+         ListEntry != &Vcb->FileRecCacheList;
+         ListEntry = ListEntry->Flink)
+    {
+        Entry = CONTAINING_RECORD(ListEntry, FILE_RECORD_CACHE_ENTRY, ListEntry);
+        if (Entry->MftIndex == MftIndex)
         {
-            // Sparse data run. 
-            DataRunStartLCN = -1;
+            RemoveEntryList(&Entry->ListEntry);
+            ExFreePoolWithTag(Entry, TAG_FILE_REC);
+            Vcb->FileRecCacheCount--;
+            break;
         }
-    } // end while (Length > 0) [more data to write]
-
-    Context->CacheRun = DataRun;
-    Context->CacheRunOffset = Offset + *RealLengthWritten;
-    Context->CacheRunStartLCN = DataRunStartLCN;
-    Context->CacheRunLength = DataRunLength;
-    Context->CacheRunLastLCN = LastLCN;
-    Context->CacheRunCurrentOffset = CurrentOffset;
+    }
 
-Cleanup:
-    // TEMPTEMP
-    if (Context->pRecord->IsNonResident)
-        ExFreePoolWithTag(TempBuffer, TAG_NTFS);
+    // Make sure no reader in flight caches what it read before this update
+    Vcb->FileRecCacheGeneration++;
 
-    return Status;
+    ExReleaseFastMutex(&Vcb->FileRecCacheLock);
 }
 
 NTSTATUS
@@ -1633,9 +1492,14 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
                PFILE_RECORD_HEADER file)
 {
     ULONGLONG BytesRead;
+    ULONG Generation;
+    NTSTATUS Status;
 
     DPRINT("ReadFileRecord(%p, %I64x, %p)\n", Vcb, index, file);
 
+    if (LookupFileRecordCache(Vcb, index, file, &Generation))
+        return STATUS_SUCCESS;
+
     BytesRead = ReadAttribute(Vcb, Vcb->MFTContext, index * Vcb->NtfsInfo.BytesPerFileRecord, (PCHAR)file, Vcb->NtfsInfo.BytesPerFileRecord);
     if (BytesRead != Vcb->NtfsInfo.BytesPerFileRecord)
     {
@@ -1645,7 +1509,11 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
 
     /* Apply update sequence array fixups. */
     DPRINT("Sequence number: %u\n", file->SequenceNumber);
-    return FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    Status = FixupUpdateSequenceArray(Vcb, &file->Ntfs);
+    if (NT_SUCCESS(Status))
+        InsertFileRecordCache(Vcb, index, file, Generation);
+
+    return Status;
 }
 
 
@@ -1954,6 +1822,10 @@ UpdateFileRecord(PDEVICE_EXTENSION Vcb,
         DPRINT1("UpdateFileRecord failed: %lu written, %lu expected\n", BytesWritten, Vcb->NtfsInfo.BytesPerFileRecord);
     }
 
+    // Drop the cached copy, whether or not the write succeeded. This has to happen
+    // after the write, so a reader racing with it can't cache what was on disk before.
+    InvalidateFileRecordCache(Vcb, MftIndex);
+
     // remove the fixup array (so the file record pointer can still be used)
     FixupUpdateSequenceArray(Vcb, &FileRecord->Ntfs);
 
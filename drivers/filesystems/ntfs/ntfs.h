@@ -118,6 +118,11 @@ typedef struct
 
     NPAGED_LOOKASIDE_LIST FileRecLookasideList;
 
+    FAST_MUTEX FileRecCacheLock;
+    LIST_ENTRY FileRecCacheList;
+    ULONG FileRecCacheCount;
+    ULONG FileRecCacheGeneration;
+
     ULONG MftDataOffset;
     ULONG Flags;
     ULONG OpenHandleCount;
@@ -126,6 +131,9 @@ typedef struct
 
 #define VCB_VOLUME_LOCKED       0x0001
 
+/* Maximum number of fixed-up file records kept in the per-volume cache */
+#define NTFS_FILE_RECORD_CACHE_SIZE 128
+
 typedef struct
 {
     NTFSIDENTIFIER Identifier;
@@ -265,6 +273,13 @@ typedef struct _FILE_RECORD_HEADER
 #define FRH_UNKNOWN1  0x0004    /* Don't know */
 #define FRH_UNKNOWN2  0x0008    /* Don't know */
 
+/* Entry of the per-volume file record cache, followed by the fixed-up record */
+typedef struct _FILE_RECORD_CACHE_ENTRY
+{
+    LIST_ENTRY ListEntry;
+    ULONGLONG MftIndex;
+} FILE_RECORD_CACHE_ENTRY, *PFILE_RECORD_CACHE_ENTRY;
+
 typedef struct
 {
     ULONG        Type;
@@ -489,12 +504,6 @@ typedef struct
 
 typedef struct _NTFS_ATTR_CONTEXT
 {
-    PUCHAR            CacheRun;
-    ULONGLONG            CacheRunOffset;
-    LONGLONG            CacheRunStartLCN;
-    ULONGLONG            CacheRunLength;
-    LONGLONG            CacheRunLastLCN;
-    ULONGLONG            CacheRunCurrentOffset;
     LARGE_MCB           DataRunsMCB;
     ULONGLONG           FileMFTIndex;
     ULONGLONG           FileOwnerMFTIndex; /* If attribute list attribute, reference the original file */
@@ -1111,6 +1120,12 @@ ReadFileRecord(PDEVICE_EXTENSION Vcb,
                ULONGLONG index,
                PFILE_RECORD_HEADER file);
 
+VOID
+InitializeFileRecordCache(PDEVICE_EXTENSION Vcb);
+
+VOID
+PurgeFileRecordCache(PDEVICE_EXTENSION Vcb);
+
 NTSTATUS
 UpdateIndexEntryFileNameSize(PDEVICE_EXTENSION Vcb,
                              PFILE_RECORD_HEADER MftRecord,
@@ -0,0 +1,53 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS TCP/IP protocol driver
+ * FILE:        include/fibtrie.h
+ * PURPOSE:     Longest prefix match index for the forward information base
+ */
+
+#pragma once
+
+#define FIB_TRIE_NO_NODE (-1)
+
+/* Route handed to the trie builder */
+typedef struct _FIB_TRIE_ROUTE {
+    ULONG Prefix;                 /* Network address, host order */
+    UCHAR Length;                 /* Number of significant bits in Prefix */
+    UINT Metric;                  /* Cost of this route */
+    PVOID Context;                /* Returned by lookups, usually a FIB entry */
+} FIB_TRIE_ROUTE, *PFIB_TRIE_ROUTE;
+
+/* Node of a path-compressed binary (Patricia) trie */
+typedef struct _FIB_TRIE_NODE {
+    ULONG Key;                    /* Prefix bits, host order, zero past Length */
+    UCHAR Length;                 /* Number of significant bits in Key */
+    LONG Child[2];                /* Index of the child nodes, or FIB_TRIE_NO_NODE */
+    ULONG FirstRoute;             /* Index of the first route for this prefix */
+    ULONG RouteCount;             /* Number of routes, zero for branch nodes */
+} FIB_TRIE_NODE, *PFIB_TRIE_NODE;
+
+/* Immutable trie snapshot. Readers may use it without holding any lock */
+typedef struct _FIB_TRIE {
+    LIST_ENTRY ListEntry;         /* Entry on the retire list */
+    LONG Root;                    /* Index of the root node */
+    ULONG NodeCount;              /* Number of nodes in use */
+    ULONG RouteCount;             /* Number of routes */
+    PVOID *Routes;                /* Route contexts, grouped by node, cheapest first */
+    FIB_TRIE_NODE Nodes[ANYSIZE_ARRAY];
+} FIB_TRIE, *PFIB_TRIE;
+
+typedef BOOLEAN (*PFIB_TRIE_USABLE_ROUTINE)(PVOID Context);
+
+PFIB_TRIE FibTrieBuild(
+    PFIB_TRIE_ROUTE Routes,
+    ULONG RouteCount);
+
+VOID FibTrieFree(
+    PFIB_TRIE Trie);
+
+PVOID FibTrieLookup(
+    PFIB_TRIE Trie,
+    ULONG Address,
+    PFIB_TRIE_USABLE_ROUTINE IsUsable);
+
+/* EOF */
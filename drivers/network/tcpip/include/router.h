@@ -8,6 +8,7 @@
 #pragma once
 
 #include <neighbor.h>
+#include <fibtrie.h>
 
 
 /* Forward Information Base Entry */
@@ -45,6 +46,8 @@ NTSTATUS RouterShutdown(
 
 VOID RouterRemoveRoutesForInterface(PIP_INTERFACE Interface);
 
+VOID RouterRetireNeighbor(PNEIGHBOR_CACHE_ENTRY NCE);
+
 UINT CountFIBs(PIP_INTERFACE IF);
 
 UINT CopyFIBs( PIP_INTERFACE IF, PFIB_ENTRY Target );
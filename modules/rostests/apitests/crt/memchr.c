@@ -0,0 +1,89 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for memchr
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define BUFFER_SIZE     512
+
+static unsigned char Buffer[BUFFER_SIZE];
+
+static
+void
+Test_Search(void)
+{
+    size_t Count, Offset, Position;
+    int Failures = 0;
+    void *Result, *Expected;
+
+    for (Count = 0; Count < 200; Count++)
+    {
+        for (Offset = 0; Offset < 16; Offset++)
+        {
+            /* The byte in every position, and just outside the range */
+            for (Position = 0; Position <= Count; Position++)
+            {
+                memset(Buffer, 0x11, BUFFER_SIZE);
+                Buffer[Offset + Position] = 0xAB;
+                Buffer[Offset + Count + 1] = 0xAB;
+
+                Expected = (Position < Count) ? &Buffer[Offset + Position] : NULL;
+                Result = memchr(Buffer + Offset, 0xAB, Count);
+                if (Result != Expected)
+                {
+                    if (Failures++ == 0)
+                        ok(0, "memchr of %lu bytes at offset %lu found %p instead of %p\n",
+                           (ULONG)Count, (ULONG)Offset, Result, Expected);
+                }
+            }
+        }
+    }
+
+    ok(Failures == 0, "memchr failed %d times\n", Failures);
+
+    /* The value is converted to unsigned char */
+    memset(Buffer, 0, BUFFER_SIZE);
+    Buffer[100] = 0xFF;
+    Buffer[200] = 0xAB;
+    ok_ptr(memchr(Buffer + 1, -1, BUFFER_SIZE - 1), &Buffer[100]);
+    ok_ptr(memchr(Buffer + 1, 0x1AB, BUFFER_SIZE - 1), &Buffer[200]);
+    ok_ptr(memchr(Buffer + 1, 0, BUFFER_SIZE - 1), &Buffer[1]);
+    ok_ptr(memchr(Buffer, 0xAB, 0), NULL);
+}
+
+static
+void
+Test_PageEnd(void)
+{
+    SYSTEM_INFO SystemInfo;
+    unsigned char *Page;
+    DWORD OldProtect;
+    size_t Count;
+
+    /* A buffer that ends right before an inaccessible page must not be read past */
+    GetSystemInfo(&SystemInfo);
+    Page = VirtualAlloc(NULL, 2 * SystemInfo.dwPageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(Page != NULL, "VirtualAlloc failed with %lu\n", GetLastError());
+    if (!Page) return;
+    ok(VirtualProtect(Page + SystemInfo.dwPageSize, SystemInfo.dwPageSize, PAGE_NOACCESS, &OldProtect),
+       "VirtualProtect failed with %lu\n", GetLastError());
+
+    memset(Page, 0x11, SystemInfo.dwPageSize);
+    for (Count = 1; Count < 64; Count++)
+    {
+        ok_ptr(memchr(Page + SystemInfo.dwPageSize - Count, 0xAB, Count), NULL);
+    }
+
+    VirtualFree(Page, 0, MEM_RELEASE);
+}
+
+START_TEST(memchr)
+{
+    Test_Search();
+    Test_PageEnd();
+}
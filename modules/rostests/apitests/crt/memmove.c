@@ -0,0 +1,163 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test and benchmark for memmove and memcpy
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_SIZE     8192
+#define BENCH_SIZE      (1024 * 1024)
+#define BENCH_ROUNDS    256
+#define BENCH_SMALL     (4 * 1024 * 1024)
+
+typedef void *(__cdecl *PFN_MEMMOVE)(void *, const void *, size_t);
+
+static unsigned char Buffer[BUFFER_SIZE];
+static unsigned char Expected[BUFFER_SIZE];
+
+static
+void
+FillBuffers(void)
+{
+    size_t i;
+
+    for (i = 0; i < BUFFER_SIZE; i++)
+        Buffer[i] = Expected[i] = (unsigned char)((i * 7) ^ (i >> 8));
+}
+
+/* This goes through volatile, so the compiler can't turn it into a call to what is tested */
+static
+void
+ReferenceMove(size_t Dest, size_t Src, size_t Count)
+{
+    volatile unsigned char *Bytes = Expected;
+    size_t i;
+
+    if (Dest <= Src)
+    {
+        for (i = 0; i < Count; i++)
+            Bytes[Dest + i] = Bytes[Src + i];
+    }
+    else
+    {
+        for (i = Count; i > 0; i--)
+            Bytes[Dest + i - 1] = Bytes[Src + i - 1];
+    }
+}
+
+static
+size_t
+NextCount(size_t Count)
+{
+    /* Every small size, then steps across the switch to the bulk paths */
+    return (Count < 80) ? Count + 1 : Count + 331;
+}
+
+static
+void
+Test_Move(PFN_MEMMOVE pfn, const char *Name, int Overlap)
+{
+    size_t Count, Src, Dest, SrcBase;
+    int Delta, Failures = 0;
+    void *Result;
+
+    /* Without overlap the source stays below the destination range */
+    SrcBase = Overlap ? 1024 : 16;
+
+    for (Count = 0; Count < 4000; Count = NextCount(Count))
+    {
+        for (Src = 0; Src < 16; Src++)
+        {
+            for (Delta = -17; Delta <= 17; Delta++)
+            {
+                if (Overlap)
+                    Dest = SrcBase + Src + Delta;
+                else
+                    Dest = 4096 + 32 + Delta;
+
+                FillBuffers();
+                Result = pfn(Buffer + Dest, Buffer + SrcBase + Src, Count);
+                ReferenceMove(Dest, SrcBase + Src, Count);
+
+                if (Result != Buffer + Dest)
+                {
+                    if (Failures++ == 0)
+                        ok(0, "%s returned %p instead of %p\n", Name, Result, Buffer + Dest);
+                }
+                else if (memcmp(Buffer, Expected, BUFFER_SIZE) != 0)
+                {
+                    if (Failures++ == 0)
+                        ok(0, "%s of %lu bytes from offset %lu to %lu is wrong\n",
+                           Name, (ULONG)Count, (ULONG)(SrcBase + Src), (ULONG)Dest);
+                }
+            }
+        }
+    }
+
+    ok(Failures == 0, "%s failed %d times\n", Name, Failures);
+}
+
+static
+ULONG
+TimeMove(PFN_MEMMOVE pfn, unsigned char *Dest, unsigned char *Src, size_t Count, ULONG Rounds)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < Rounds; i++)
+        pfn(Dest, Src, Count);
+
+    QueryPerformanceCounter(&End);
+    return (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+}
+
+static
+void
+Benchmark(void)
+{
+    unsigned char *Src, *Dest;
+
+    Src = malloc(BENCH_SIZE + 64);
+    Dest = malloc(BENCH_SIZE + 64);
+    ok(Src != NULL && Dest != NULL, "Out of memory\n");
+    if (!Src || !Dest)
+    {
+        free(Src);
+        free(Dest);
+        return;
+    }
+
+    memset(Src, 0x55, BENCH_SIZE + 64);
+    memset(Dest, 0xAA, BENCH_SIZE + 64);
+
+    trace("memcpy of %d KB, %d times, aligned: %lu us\n",
+          BENCH_SIZE / 1024, BENCH_ROUNDS,
+          TimeMove(memcpy, Dest, Src, BENCH_SIZE, BENCH_ROUNDS));
+    trace("memcpy of %d KB, %d times, misaligned: %lu us\n",
+          BENCH_SIZE / 1024, BENCH_ROUNDS,
+          TimeMove(memcpy, Dest + 3, Src + 1, BENCH_SIZE, BENCH_ROUNDS));
+    trace("memmove of %d KB, %d times, overlapping: %lu us\n",
+          BENCH_SIZE / 1024, BENCH_ROUNDS,
+          TimeMove(memmove, Src + 40, Src, BENCH_SIZE, BENCH_ROUNDS));
+    trace("memcpy of 64 bytes, %d times: %lu us\n",
+          BENCH_SMALL, TimeMove(memcpy, Dest + 5, Src, 64, BENCH_SMALL));
+
+    free(Src);
+    free(Dest);
+}
+
+START_TEST(memmove)
+{
+    Test_Move(memmove, "memmove", 1);
+    Test_Move(memmove, "memmove", 0);
+    Test_Move(memcpy, "memcpy", 0);
+    Benchmark();
+}
@@ -0,0 +1,104 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test and benchmark for memset
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUFFER_SIZE     8192
+#define BENCH_SIZE      (1024 * 1024)
+#define BENCH_ROUNDS    256
+
+static unsigned char Buffer[BUFFER_SIZE];
+
+static
+void
+Test_Fill(int Value)
+{
+    size_t Count, Offset, i;
+    int Failures = 0;
+    void *Result;
+
+    for (Count = 0; Count < 6000; Count = (Count < 80) ? Count + 1 : Count + 331)
+    {
+        for (Offset = 16; Offset < 32; Offset++)
+        {
+            for (i = 0; i < BUFFER_SIZE; i++)
+                Buffer[i] = (unsigned char)~i;
+
+            Result = memset(Buffer + Offset, Value, Count);
+            if (Result != Buffer + Offset)
+            {
+                if (Failures++ == 0)
+                    ok(0, "memset returned %p instead of %p\n", Result, Buffer + Offset);
+                continue;
+            }
+
+            /* Only the low byte of the value is used, and nothing around the range is touched */
+            for (i = 0; i < BUFFER_SIZE; i++)
+            {
+                unsigned char Byte = (i >= Offset && i < Offset + Count) ? (unsigned char)Value : (unsigned char)~i;
+                if (Buffer[i] != Byte)
+                {
+                    if (Failures++ == 0)
+                        ok(0, "memset(0x%x) of %lu bytes at offset %lu is wrong at %lu\n",
+                           Value, (ULONG)Count, (ULONG)Offset, (ULONG)i);
+                    break;
+                }
+            }
+        }
+    }
+
+    ok(Failures == 0, "memset(0x%x) failed %d times\n", Value, Failures);
+}
+
+static
+ULONG
+TimeFill(unsigned char *Dest, size_t Count, ULONG Rounds)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < Rounds; i++)
+        memset(Dest, (int)i, Count);
+
+    QueryPerformanceCounter(&End);
+    return (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+}
+
+static
+void
+Benchmark(void)
+{
+    unsigned char *Dest;
+
+    Dest = malloc(BENCH_SIZE + 64);
+    ok(Dest != NULL, "Out of memory\n");
+    if (!Dest) return;
+
+    trace("memset of %d KB, %d times, aligned: %lu us\n",
+          BENCH_SIZE / 1024, BENCH_ROUNDS,
+          TimeFill(Dest, BENCH_SIZE, BENCH_ROUNDS));
+    trace("memset of %d KB, %d times, misaligned: %lu us\n",
+          BENCH_SIZE / 1024, BENCH_ROUNDS,
+          TimeFill(Dest + 3, BENCH_SIZE, BENCH_ROUNDS));
+
+    free(Dest);
+}
+
+START_TEST(memset)
+{
+    Test_Fill(0);
+    Test_Fill(0x5A);
+    Test_Fill(0x1A5);
+    Test_Fill(-1);
+    Benchmark();
+}
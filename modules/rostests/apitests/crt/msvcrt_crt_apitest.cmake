@@ -1120,13 +1120,13 @@ list(APPEND SOURCE_MSVCRT
     mbstowcs.c
 #    mbstowcs_s Not exported in 2k3 Sp1
     mbtowc.c
-#    memchr.c
+    memchr.c
 #    memcmp.c
 #    memcpy.c
 #    memcpy_s.c memmove_s
-#    memmove.c
+    memmove.c
 #    memmove_s.c
-#    memset.c
+    memset.c
 #    mktime.c
 #    modf.c
 #    perror.c
@@ -1233,7 +1233,7 @@ list(APPEND SOURCE_MSVCRT
 #    wcscpy_s.c
 #    wcscspn.c
 #    wcsftime.c
-#    wcslen.c
+    wcslen.c
 #    wcsncat.c
 #    wcsncat_s.c
 #    wcsncmp.c
@@ -8,6 +8,7 @@
 #include <apitest.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <tchar.h>
 #include <pseh/pseh2.h>
 #include <ntstatus.h>
@@ -63,9 +64,53 @@ Test_strlen(PFN_STRLEN pstrlen)
 #endif
 }
 
+static
+void
+Test_strlen_Lengths(PFN_STRLEN pstrlen)
+{
+    static char Buffer[1024 + 16];
+    SYSTEM_INFO SystemInfo;
+    size_t Length, Offset;
+    int Failures = 0;
+    DWORD OldProtect;
+    char *Page;
+
+    for (Offset = 0; Offset < 16; Offset++)
+    {
+        for (Length = 0; Length < 1000; Length = (Length < 80) ? Length + 1 : Length + 97)
+        {
+            memset(Buffer, 'a', sizeof(Buffer));
+            Buffer[Offset + Length] = 0;
+            if (pstrlen(Buffer + Offset) != Length)
+            {
+                if (Failures++ == 0)
+                    ok(0, "strlen at offset %u returned %u instead of %u\n",
+                       (int)Offset, (int)pstrlen(Buffer + Offset), (int)Length);
+            }
+        }
+    }
+    ok(Failures == 0, "strlen failed %d times\n", Failures);
+
+    /* A string that ends right before an inaccessible page must not be read past */
+    GetSystemInfo(&SystemInfo);
+    Page = VirtualAlloc(NULL, 2 * SystemInfo.dwPageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(Page != NULL, "VirtualAlloc failed with %lu\n", GetLastError());
+    if (!Page) return;
+    ok(VirtualProtect(Page + SystemInfo.dwPageSize, SystemInfo.dwPageSize, PAGE_NOACCESS, &OldProtect),
+       "VirtualProtect failed with %lu\n", GetLastError());
+    memset(Page, 'a', SystemInfo.dwPageSize);
+    Page[SystemInfo.dwPageSize - 1] = 0;
+    for (Length = 0; Length < 32; Length++)
+    {
+        ok_int((int)pstrlen(Page + SystemInfo.dwPageSize - 1 - Length), (int)Length);
+    }
+    VirtualFree(Page, 0, MEM_RELEASE);
+}
+
 START_TEST(strlen)
 {
     Test_strlen(strlen);
+    Test_strlen_Lengths(strlen);
 #ifdef __GNUC__
     Test_strlen(GCC_builtin_strlen);
 #endif // __GNUC__
@@ -0,0 +1,84 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for wcslen
+ */
+
+#include <apitest.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define BUFFER_SIZE     1024
+
+static
+void
+Test_Lengths(void)
+{
+    static unsigned char Bytes[BUFFER_SIZE * sizeof(wchar_t) + 16];
+    size_t Length, Offset, i;
+    wchar_t *String;
+    int Failures = 0;
+
+    /* Odd offsets give misaligned strings, which need to work too */
+    for (Offset = 0; Offset < 16; Offset++)
+    {
+        String = (wchar_t *)(Bytes + Offset);
+        for (Length = 0; Length < BUFFER_SIZE - 1; Length = (Length < 80) ? Length + 1 : Length + 97)
+        {
+            for (i = 0; i < Length; i++)
+                String[i] = (wchar_t)(0x4100 + i);
+            String[Length] = 0;
+            String[Length + 1] = L'x';
+
+            if (wcslen(String) != Length)
+            {
+                if (Failures++ == 0)
+                    ok(0, "wcslen at offset %lu returned %lu instead of %lu\n",
+                       (ULONG)Offset, (ULONG)wcslen(String), (ULONG)Length);
+            }
+        }
+    }
+
+    ok(Failures == 0, "wcslen failed %d times\n", Failures);
+
+    /* Characters with a zero byte are not the terminator */
+    ok_size_t(wcslen(L"\x0100\x0041\x4100"), 3);
+    ok_size_t(wcslen(L""), 0);
+}
+
+static
+void
+Test_PageEnd(void)
+{
+    SYSTEM_INFO SystemInfo;
+    unsigned char *Page;
+    wchar_t *String;
+    DWORD OldProtect;
+    size_t Length, i;
+
+    /* A string that ends right before an inaccessible page must not be read past */
+    GetSystemInfo(&SystemInfo);
+    Page = VirtualAlloc(NULL, 2 * SystemInfo.dwPageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(Page != NULL, "VirtualAlloc failed with %lu\n", GetLastError());
+    if (!Page) return;
+    ok(VirtualProtect(Page + SystemInfo.dwPageSize, SystemInfo.dwPageSize, PAGE_NOACCESS, &OldProtect),
+       "VirtualProtect failed with %lu\n", GetLastError());
+
+    for (Length = 0; Length < 32; Length++)
+    {
+        String = (wchar_t *)(Page + SystemInfo.dwPageSize) - Length - 1;
+        for (i = 0; i < Length; i++)
+            String[i] = L'a';
+        String[Length] = 0;
+        ok_size_t(wcslen(String), Length);
+    }
+
+    VirtualFree(Page, 0, MEM_RELEASE);
+}
+
+START_TEST(wcslen)
+{
+    Test_Lengths();
+    Test_PageEnd();
+}
@@ -0,0 +1,246 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test for the DNS resolver cache
+ */
+
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <stdio.h>
+#include <windns.h>
+#include <windns_undoc.h>
+#include <apitest.h>
+#include <strsafe.h>
+
+#define RESPONDER_ADDRESS   0x0200007f /* 127.0.0.2 in network order */
+
+static SOCKET ResponderSocket = INVALID_SOCKET;
+static LONG ResponderQueries;
+
+/* Wire queries go to the responder, whatever DNS server is configured */
+static IP4_ARRAY ResponderServers = { 1, { 0x0100007f } }; /* 127.0.0.1 in network order */
+
+static
+USHORT
+GetUShort(const BYTE *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static
+VOID
+PutUShort(BYTE *p, USHORT Value)
+{
+    p[0] = (BYTE)(Value >> 8);
+    p[1] = (BYTE)Value;
+}
+
+/*
+ * A stand-in DNS server. It answers A queries for "ttl<N>-..." names with
+ * RESPONDER_ADDRESS and a TTL of N seconds, and "nx-..." names with NXDOMAIN.
+ */
+static
+DWORD
+WINAPI
+ResponderThread(LPVOID lpParameter)
+{
+    BYTE Packet[512];
+    SOCKADDR_IN From;
+    INT FromLen, Length, Offset, Ttl;
+    BOOL NxDomain;
+
+    for (;;)
+    {
+        FromLen = sizeof(From);
+        Length = recvfrom(ResponderSocket, (char *)Packet, sizeof(Packet), 0, (SOCKADDR *)&From, &FromLen);
+        if (Length == SOCKET_ERROR)
+            break;
+
+        /* One question, a plain name and room for the answer */
+        if (Length < 12 || GetUShort(Packet + 4) != 1)
+            continue;
+
+        Offset = 12;
+        while (Offset < Length && Packet[Offset] != 0 && Packet[Offset] < 64)
+            Offset += Packet[Offset] + 1;
+        Offset += 5;
+        if (Offset > Length || Offset + 16 > sizeof(Packet))
+            continue;
+
+        InterlockedIncrement(&ResponderQueries);
+
+        NxDomain = (Packet[12] > 3 && memcmp(Packet + 13, "nx-", 3) == 0);
+        Ttl = (Packet[12] > 4 && memcmp(Packet + 13, "ttl", 3) == 0) ? atoi((char *)Packet + 16) : 0;
+
+        /* Response, recursion desired and available */
+        PutUShort(Packet + 2, NxDomain ? 0x8183 : 0x8180);
+        PutUShort(Packet + 6, NxDomain ? 0 : 1);
+        PutUShort(Packet + 8, 0);
+        PutUShort(Packet + 10, 0);
+
+        if (!NxDomain)
+        {
+            /* Name pointer to the question, type A, class IN, TTL, 4 bytes of address */
+            PutUShort(Packet + Offset, 0xc00c);
+            PutUShort(Packet + Offset + 2, DNS_TYPE_A);
+            PutUShort(Packet + Offset + 4, 1);
+            PutUShort(Packet + Offset + 6, 0);
+            PutUShort(Packet + Offset + 8, (USHORT)Ttl);
+            PutUShort(Packet + Offset + 10, sizeof(IP4_ADDRESS));
+            *(IP4_ADDRESS UNALIGNED *)(Packet + Offset + 12) = RESPONDER_ADDRESS;
+            Offset += 16;
+        }
+
+        sendto(ResponderSocket, (char *)Packet, Offset, 0, (SOCKADDR *)&From, FromLen);
+    }
+
+    return 0;
+}
+
+static
+HANDLE
+StartResponder(VOID)
+{
+    SOCKADDR_IN Address;
+    HANDLE hThread;
+
+    ResponderSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (ResponderSocket == INVALID_SOCKET)
+        return NULL;
+
+    ZeroMemory(&Address, sizeof(Address));
+    Address.sin_family = AF_INET;
+    Address.sin_port = htons(53);
+    Address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(ResponderSocket, (SOCKADDR *)&Address, sizeof(Address)) == SOCKET_ERROR)
+    {
+        closesocket(ResponderSocket);
+        return NULL;
+    }
+
+    hThread = CreateThread(NULL, 0, ResponderThread, NULL, 0, NULL);
+    if (!hThread)
+        closesocket(ResponderSocket);
+
+    return hThread;
+}
+
+static
+DNS_STATUS
+Query(PCWSTR Name, WORD Type, DWORD Options, PIP4_ARRAY Servers, IP4_ADDRESS *Address)
+{
+    DNS_STATUS Status;
+    PDNS_RECORD Record = NULL;
+
+    Status = DnsQuery_W(Name, Type, Options, Servers, &Record, NULL);
+    if (Status == ERROR_SUCCESS)
+    {
+        ok(Record != NULL, "No record for %S\n", Name);
+        if (Record && Address)
+            *Address = Record->Data.A.IpAddress;
+        DnsRecordListFree(Record, DnsFreeRecordList);
+    }
+
+    return Status;
+}
+
+static
+VOID
+TestHostsFileEntries(VOID)
+{
+    IP4_ADDRESS Address = 0;
+
+    /* localhost always comes from the hosts file */
+    ok_long(Query(L"localhost", DNS_TYPE_A, DNS_QUERY_NO_WIRE_QUERY, NULL, &Address), ERROR_SUCCESS);
+    ok_hex(Address, htonl(INADDR_LOOPBACK));
+
+    /* Lookups ignore the case of the name */
+    Address = 0;
+    ok_long(Query(L"LocalHost", DNS_TYPE_A, DNS_QUERY_NO_WIRE_QUERY, NULL, &Address), ERROR_SUCCESS);
+    ok_hex(Address, htonl(INADDR_LOOPBACK));
+
+    /* But not the type of the record */
+    ok(Query(L"localhost", DNS_TYPE_MX, DNS_QUERY_NO_WIRE_QUERY, NULL, NULL) != ERROR_SUCCESS,
+       "Got an MX record for localhost\n");
+    ok(Query(L"localhost", DNS_TYPE_TEXT, DNS_QUERY_NO_WIRE_QUERY, NULL, NULL) != ERROR_SUCCESS,
+       "Got a TXT record for localhost\n");
+}
+
+static
+VOID
+TestWireEntries(VOID)
+{
+    WCHAR szName[64], szUpperName[64];
+    IP4_ADDRESS Address = 0;
+    LONG Queries;
+
+    /* A fresh name every run, so nothing is left over in the cache */
+    StringCchPrintfW(szName, _countof(szName), L"ttl2-%lu.dnscache.test", GetTickCount());
+    StringCchCopyW(szUpperName, _countof(szUpperName), szName);
+    _wcsupr(szUpperName);
+
+    ok_long(Query(szName, DNS_TYPE_A, DNS_QUERY_NO_WIRE_QUERY, &ResponderServers, NULL), DNS_INFO_NO_RECORDS);
+
+    Queries = ResponderQueries;
+    ok_long(Query(szName, DNS_TYPE_A, DNS_QUERY_STANDARD, &ResponderServers, &Address), ERROR_SUCCESS);
+    ok_hex(Address, RESPONDER_ADDRESS);
+    ok_long(ResponderQueries, Queries + 1);
+
+    /* Served from the cache, whatever the case */
+    Address = 0;
+    ok_long(Query(szName, DNS_TYPE_A, DNS_QUERY_STANDARD, &ResponderServers, &Address), ERROR_SUCCESS);
+    ok_hex(Address, RESPONDER_ADDRESS);
+    ok_long(Query(szName, DNS_TYPE_A, DNS_QUERY_NO_WIRE_QUERY, &ResponderServers, NULL), ERROR_SUCCESS);
+    ok_long(Query(szUpperName, DNS_TYPE_A, DNS_QUERY_NO_WIRE_QUERY, &ResponderServers, NULL), ERROR_SUCCESS);
+    ok_long(ResponderQueries, Queries + 1);
+
+    /* Gone once the TTL ran out */
+    Sleep(3000);
+    ok_long(Query(szName, DNS_TYPE_A, DNS_QUERY_NO_WIRE_QUERY, &ResponderServers, NULL), DNS_INFO_NO_RECORDS);
+    ok_long(Query(szName, DNS_TYPE_A, DNS_QUERY_STANDARD, &ResponderServers, NULL), ERROR_SUCCESS);
+    ok_long(ResponderQueries, Queries + 2);
+
+    /* Names that don't exist are remembered as well */
+    StringCchPrintfW(szName, _countof(szName), L"nx-%lu.dnscache.test", GetTickCount());
+    Queries = ResponderQueries;
+    ok(Query(szName, DNS_TYPE_A, DNS_QUERY_STANDARD, &ResponderServers, NULL) != ERROR_SUCCESS, "%S resolved\n", szName);
+    ok(ResponderQueries > Queries, "%S was not asked for\n", szName);
+
+    /* The search list may have asked more than once, but a second lookup doesn't ask at all */
+    Queries = ResponderQueries;
+    ok(Query(szName, DNS_TYPE_A, DNS_QUERY_STANDARD, &ResponderServers, NULL) != ERROR_SUCCESS, "%S resolved\n", szName);
+    ok_long(ResponderQueries, Queries);
+
+    /* Flushing forgets them all */
+    ok(DnsFlushResolverCache(), "DnsFlushResolverCache failed\n");
+    ok(Query(szName, DNS_TYPE_A, DNS_QUERY_STANDARD, &ResponderServers, NULL) != ERROR_SUCCESS, "%S resolved\n", szName);
+    ok(ResponderQueries > Queries, "%S was not asked for after the flush\n", szName);
+
+    /* Hosts file entries survive a flush */
+    ok_long(Query(L"localhost", DNS_TYPE_A, DNS_QUERY_NO_WIRE_QUERY, NULL, NULL), ERROR_SUCCESS);
+}
+
+START_TEST(DnsCache)
+{
+    WSADATA WsaData;
+    HANDLE hThread;
+
+    TestHostsFileEntries();
+
+    ok_int(WSAStartup(MAKEWORD(2, 2), &WsaData), 0);
+
+    hThread = StartResponder();
+    if (!hThread)
+    {
+        skip("Can't listen on 127.0.0.1:53\n");
+        WSACleanup();
+        return;
+    }
+
+    TestWireEntries();
+
+    closesocket(ResponderSocket);
+    WaitForSingleObject(hThread, INFINITE);
+    CloseHandle(hThread);
+    WSACleanup();
+}
@@ -1,10 +1,12 @@
 #define STANDALONE
 #include <apitest.h>
 
+extern void func_DnsCache(void);
 extern void func_DnsQuery(void);
 
 const struct test winetest_testlist[] =
 {
+    { "DnsCache", func_DnsCache },
     { "DnsQuery", func_DnsQuery },
     { 0, 0 }
 };
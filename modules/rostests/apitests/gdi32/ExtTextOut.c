@@ -0,0 +1,141 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test and benchmark for ExtTextOut and the glyph cache
+ */
+
+#include "precomp.h"
+
+#define BITMAP_WIDTH    640
+#define BITMAP_HEIGHT   48
+#define BENCH_LINES     500
+
+static const WCHAR s_szText[] =
+    L"The quick brown fox jumps over the lazy dog 0123456789 !\"#$%&'()*+,-./";
+
+static const PCWSTR s_FaceNames[] =
+{
+    L"Tahoma",
+    L"Courier New",
+    L"Times New Roman",
+    L"Arial",
+    L"Lucida Console",
+};
+
+static const INT s_Heights[] = { -11, -13, -16, -20 };
+
+static HFONT
+CreateTestFont(PCWSTR FaceName, INT Height)
+{
+    LOGFONTW lf;
+
+    ZeroMemory(&lf, sizeof(lf));
+    lf.lfHeight = Height;
+    lf.lfCharSet = DEFAULT_CHARSET;
+    lf.lfQuality = ANTIALIASED_QUALITY;
+    StringCchCopyW(lf.lfFaceName, _countof(lf.lfFaceName), FaceName);
+    return CreateFontIndirectW(&lf);
+}
+
+static void
+DrawLine(HDC hDC, HFONT hFont)
+{
+    HGDIOBJ hFontOld;
+    RECT rc = { 0, 0, BITMAP_WIDTH, BITMAP_HEIGHT };
+
+    hFontOld = SelectObject(hDC, hFont);
+    ExtTextOutW(hDC, 0, 0, ETO_OPAQUE, &rc, s_szText, _countof(s_szText) - 1, NULL);
+    SelectObject(hDC, hFontOld);
+}
+
+START_TEST(ExtTextOut)
+{
+    HDC hDC;
+    HBITMAP hbm;
+    HGDIOBJ hbmOld;
+    PBYTE pvBits, pvFirst;
+    BITMAPINFO bmi;
+    HFONT hFonts[_countof(s_FaceNames) * _countof(s_Heights)];
+    UINT i, j, cFonts = 0;
+    SIZE_T cbBits = BITMAP_WIDTH * BITMAP_HEIGHT * 4;
+    LARGE_INTEGER Frequency, Start, End;
+    double Seconds;
+
+    hDC = CreateCompatibleDC(NULL);
+    ok(hDC != NULL, "CreateCompatibleDC failed\n");
+    if (!hDC)
+        return;
+
+    ZeroMemory(&bmi, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = BITMAP_WIDTH;
+    bmi.bmiHeader.biHeight = -BITMAP_HEIGHT;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    hbm = CreateDIBSection(hDC, &bmi, DIB_RGB_COLORS, (PVOID*)&pvBits, NULL, 0);
+    ok(hbm != NULL, "CreateDIBSection failed\n");
+    if (!hbm)
+    {
+        DeleteDC(hDC);
+        return;
+    }
+    hbmOld = SelectObject(hDC, hbm);
+
+    pvFirst = HeapAlloc(GetProcessHeap(), 0, cbBits * _countof(hFonts));
+    ok(pvFirst != NULL, "HeapAlloc failed\n");
+    if (!pvFirst)
+        goto Cleanup;
+
+    for (i = 0; i < _countof(s_FaceNames); i++)
+    {
+        for (j = 0; j < _countof(s_Heights); j++)
+        {
+            hFonts[cFonts] = CreateTestFont(s_FaceNames[i], s_Heights[j]);
+            ok(hFonts[cFonts] != NULL, "CreateFontIndirectW failed for %S\n", s_FaceNames[i]);
+            if (hFonts[cFonts])
+                cFonts++;
+        }
+    }
+
+    /* First pass fills the glyph cache, remember what it drew */
+    for (i = 0; i < cFonts; i++)
+    {
+        DrawLine(hDC, hFonts[i]);
+        GdiFlush();
+        CopyMemory(pvFirst + i * cbBits, pvBits, cbBits);
+    }
+
+    /* Glyphs coming from the cache must look exactly like freshly rendered ones */
+    for (i = 0; i < cFonts; i++)
+    {
+        DrawLine(hDC, hFonts[(i * 7) % cFonts]);
+        GdiFlush();
+        ok(memcmp(pvBits, pvFirst + ((i * 7) % cFonts) * cbBits, cbBits) == 0,
+           "Font %u drew differently the second time\n", (i * 7) % cFonts);
+    }
+
+    /* Interleave all fonts, the way a text-heavy window would */
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BENCH_LINES; i++)
+    {
+        DrawLine(hDC, hFonts[i % cFonts]);
+    }
+    GdiFlush();
+    QueryPerformanceCounter(&End);
+
+    Seconds = (double)(End.QuadPart - Start.QuadPart) / Frequency.QuadPart;
+    trace("%u lines in %u fonts: %.3f s, %.0f glyphs/s\n",
+          BENCH_LINES, cFonts, Seconds,
+          Seconds > 0 ? BENCH_LINES * (_countof(s_szText) - 1) / Seconds : 0.0);
+
+    HeapFree(GetProcessHeap(), 0, pvFirst);
+
+Cleanup:
+    for (i = 0; i < cFonts; i++)
+        DeleteObject(hFonts[i]);
+    SelectObject(hDC, hbmOld);
+    DeleteObject(hbm);
+    DeleteDC(hDC);
+}
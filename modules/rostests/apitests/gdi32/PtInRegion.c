@@ -0,0 +1,166 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test and benchmark for PtInRegion, RectInRegion and region operations
+ */
+
+#include "precomp.h"
+
+#define GRID_SIZE       64
+#define CELL_SIZE       8
+#define QUERY_COUNT     200000
+
+/* A checkerboard of GRID_SIZE x GRID_SIZE cells, GRID_SIZE * GRID_SIZE / 2 rectangles */
+static
+HRGN
+CreateCheckerboardRgn(INT xOffset)
+{
+    HRGN hrgn, hrgnCell;
+    INT x, y;
+
+    hrgn = CreateRectRgn(0, 0, 0, 0);
+    hrgnCell = CreateRectRgn(0, 0, 0, 0);
+    for (y = 0; y < GRID_SIZE; y++)
+    {
+        for (x = (y + xOffset) & 1; x < GRID_SIZE; x += 2)
+        {
+            SetRectRgn(hrgnCell, x * CELL_SIZE, y * CELL_SIZE,
+                       (x + 1) * CELL_SIZE, (y + 1) * CELL_SIZE);
+            CombineRgn(hrgn, hrgn, hrgnCell, RGN_OR);
+        }
+    }
+    DeleteObject(hrgnCell);
+
+    return hrgn;
+}
+
+static
+BOOL
+IsBlackCell(INT x, INT y)
+{
+    if ((x < 0) || (y < 0) || (x >= GRID_SIZE * CELL_SIZE) || (y >= GRID_SIZE * CELL_SIZE))
+        return FALSE;
+
+    return (((x / CELL_SIZE) + (y / CELL_SIZE)) & 1) == 0;
+}
+
+static
+VOID
+Test_Queries(HRGN hrgn)
+{
+    INT x, y;
+    RECT rc;
+    BOOL bMismatch = FALSE;
+
+    /* Every pixel of the board, plus a border around it */
+    for (y = -2; y < GRID_SIZE * CELL_SIZE + 2 && !bMismatch; y++)
+    {
+        for (x = -2; x < GRID_SIZE * CELL_SIZE + 2; x++)
+        {
+            if (PtInRegion(hrgn, x, y) != IsBlackCell(x, y))
+            {
+                ok(0, "PtInRegion(%d, %d) returned %d\n", x, y, !IsBlackCell(x, y));
+                bMismatch = TRUE;
+                break;
+            }
+        }
+    }
+
+    /* A rect inside a white cell misses, one crossing into a black cell hits */
+    SetRect(&rc, CELL_SIZE + 1, 1, 2 * CELL_SIZE - 1, CELL_SIZE - 1);
+    ok_int(RectInRegion(hrgn, &rc), FALSE);
+    SetRect(&rc, CELL_SIZE + 1, 1, 2 * CELL_SIZE + 1, CELL_SIZE - 1);
+    ok_int(RectInRegion(hrgn, &rc), TRUE);
+    SetRect(&rc, CELL_SIZE + 1, CELL_SIZE - 1, 2 * CELL_SIZE - 1, CELL_SIZE + 1);
+    ok_int(RectInRegion(hrgn, &rc), TRUE);
+
+    /* Touching edges do not count, unordered rects do */
+    SetRect(&rc, GRID_SIZE * CELL_SIZE, 0, GRID_SIZE * CELL_SIZE + 10, 10);
+    ok_int(RectInRegion(hrgn, &rc), FALSE);
+    SetRect(&rc, 2 * CELL_SIZE - 1, CELL_SIZE - 1, 2 * CELL_SIZE + 1, CELL_SIZE + 1);
+    ok_int(RectInRegion(hrgn, &rc), TRUE);
+    SetRect(&rc, 2 * CELL_SIZE + 1, CELL_SIZE + 1, 2 * CELL_SIZE - 1, CELL_SIZE - 1);
+    ok_int(RectInRegion(hrgn, &rc), TRUE);
+}
+
+static
+VOID
+Benchmark(HRGN hrgnBlack, HRGN hrgnWhite)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    HRGN hrgn;
+    INT i, iRet;
+    RECT rc;
+    ULONG cHits = 0;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < QUERY_COUNT; i++)
+    {
+        cHits += PtInRegion(hrgnBlack, (i * 7) % (GRID_SIZE * CELL_SIZE), (i * 13) % (GRID_SIZE * CELL_SIZE));
+    }
+    QueryPerformanceCounter(&End);
+    trace("%d PtInRegion calls: %lu us (%lu hits)\n", QUERY_COUNT,
+          (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart), cHits);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < QUERY_COUNT; i++)
+    {
+        SetRect(&rc, (i * 7) % (GRID_SIZE * CELL_SIZE), (i * 13) % (GRID_SIZE * CELL_SIZE), 0, 0);
+        rc.right = rc.left + 3;
+        rc.bottom = rc.top + 3;
+        cHits += RectInRegion(hrgnBlack, &rc);
+    }
+    QueryPerformanceCounter(&End);
+    trace("%d RectInRegion calls: %lu us\n", QUERY_COUNT,
+          (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart));
+
+    hrgn = CreateRectRgn(0, 0, 0, 0);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < 100; i++)
+    {
+        iRet = CombineRgn(hrgn, hrgnBlack, hrgnWhite, RGN_OR);
+    }
+    QueryPerformanceCounter(&End);
+    ok_int(iRet, SIMPLEREGION);
+    trace("100 unions of %d rectangle regions: %lu us\n", GRID_SIZE * GRID_SIZE / 2,
+          (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart));
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < 100; i++)
+    {
+        iRet = CombineRgn(hrgn, hrgn, hrgnWhite, RGN_DIFF);
+        CombineRgn(hrgn, hrgn, hrgnWhite, RGN_OR);
+    }
+    QueryPerformanceCounter(&End);
+    ok_int(iRet, COMPLEXREGION);
+    trace("100 subtract/union rounds of %d rectangle regions: %lu us\n", GRID_SIZE * GRID_SIZE / 2,
+          (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart));
+
+    ok_int(CombineRgn(hrgn, hrgn, hrgnWhite, RGN_DIFF), COMPLEXREGION);
+    ok_int(EqualRgn(hrgn, hrgnBlack), TRUE);
+
+    DeleteObject(hrgn);
+}
+
+START_TEST(PtInRegion)
+{
+    HRGN hrgnBlack, hrgnWhite;
+
+    hrgnBlack = CreateCheckerboardRgn(0);
+    hrgnWhite = CreateCheckerboardRgn(1);
+    ok(hrgnBlack != NULL && hrgnWhite != NULL, "CreateCheckerboardRgn failed\n");
+    if (!hrgnBlack || !hrgnWhite)
+        return;
+
+    ok_int(GetRegionData(hrgnBlack, 0, NULL),
+           sizeof(RGNDATAHEADER) + GRID_SIZE * GRID_SIZE / 2 * sizeof(RECT));
+
+    Test_Queries(hrgnBlack);
+    Benchmark(hrgnBlack, hrgnWhite);
+
+    DeleteObject(hrgnBlack);
+    DeleteObject(hrgnWhite);
+}
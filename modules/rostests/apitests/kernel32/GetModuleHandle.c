@@ -0,0 +1,209 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test and benchmark for GetModuleHandle with many loaded modules
+ */
+
+#include "precomp.h"
+#include <ndk/umfuncs.h>
+
+#define LOOKUP_COUNT    100000
+
+/* Enough copies for the loader hash table to grow from 32 to 128 buckets */
+#define COPY_COUNT      150
+
+static const PCWSTR s_ModuleNames[] =
+{
+    L"advapi32.dll",
+    L"comctl32.dll",
+    L"comdlg32.dll",
+    L"crypt32.dll",
+    L"gdi32.dll",
+    L"imm32.dll",
+    L"msvcrt.dll",
+    L"ole32.dll",
+    L"oleaut32.dll",
+    L"rpcrt4.dll",
+    L"secur32.dll",
+    L"setupapi.dll",
+    L"shell32.dll",
+    L"shlwapi.dll",
+    L"user32.dll",
+    L"userenv.dll",
+    L"uxtheme.dll",
+    L"version.dll",
+    L"winmm.dll",
+    L"ws2_32.dll",
+};
+
+static ULONG
+CountLoadedModules(VOID)
+{
+    PLIST_ENTRY ListHead, Entry;
+    ULONG Count = 0;
+
+    ListHead = &NtCurrentPeb()->Ldr->InLoadOrderModuleList;
+    for (Entry = ListHead->Flink; Entry != ListHead; Entry = Entry->Flink)
+        Count++;
+
+    return Count;
+}
+
+/* Load enough copies of a DLL to make the loader resize its hash table,
+ * then look every module up and unload them again */
+static void
+Test_ManyModules(void)
+{
+    static HMODULE hCopies[COPY_COUNT];
+    WCHAR szSource[MAX_PATH], szTempPath[MAX_PATH];
+    static WCHAR szCopies[COPY_COUNT][MAX_PATH];
+    UNICODE_STRING DllName;
+    PVOID DllHandle;
+    NTSTATUS Status;
+    HMODULE hKernel32;
+    ULONG i, Count;
+
+    GetSystemDirectoryW(szSource, _countof(szSource));
+    StringCchCatW(szSource, _countof(szSource), L"\\version.dll");
+    GetTempPathW(_countof(szTempPath), szTempPath);
+
+    for (i = 0; i < COPY_COUNT; i++)
+    {
+        StringCchPrintfW(szCopies[i], _countof(szCopies[i]), L"%sldrhash%03lu.dll", szTempPath, i);
+        if (!CopyFileW(szSource, szCopies[i], FALSE))
+        {
+            skip("CopyFileW(%S) failed with %lu\n", szCopies[i], GetLastError());
+            szCopies[i][0] = UNICODE_NULL;
+            continue;
+        }
+
+        hCopies[i] = LoadLibraryW(szCopies[i]);
+        ok(hCopies[i] != NULL, "LoadLibraryW(%S) failed with %lu\n", szCopies[i], GetLastError());
+    }
+
+    Count = CountLoadedModules();
+    ok(Count > 128, "Only %lu modules are loaded\n", Count);
+
+    /* Every copy is still found after the table was resized */
+    hKernel32 = GetModuleHandleW(L"kernel32.dll");
+    ok(hKernel32 != NULL, "kernel32.dll not found\n");
+    for (i = 0; i < COPY_COUNT; i++)
+    {
+        if (!hCopies[i])
+            continue;
+
+        ok(GetModuleHandleW(wcsrchr(szCopies[i], L'\\') + 1) == hCopies[i],
+           "GetModuleHandleW(%S) did not find the module\n", szCopies[i]);
+        ok(GetModuleHandleW(szCopies[i]) == hCopies[i],
+           "GetModuleHandleW(%S) did not find the module\n", szCopies[i]);
+    }
+
+    /* Unload every other copy through the loader directly */
+    for (i = 0; i < COPY_COUNT; i += 2)
+    {
+        if (!hCopies[i])
+            continue;
+
+        Status = LdrUnloadDll(hCopies[i]);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        ok(GetModuleHandleW(szCopies[i]) == NULL, "%S is still loaded\n", szCopies[i]);
+        hCopies[i] = NULL;
+    }
+
+    /* The remaining ones are still there, under any case */
+    for (i = 1; i < COPY_COUNT; i += 2)
+    {
+        if (!hCopies[i])
+            continue;
+
+        _wcsupr(szCopies[i]);
+        RtlInitUnicodeString(&DllName, wcsrchr(szCopies[i], L'\\') + 1);
+        Status = LdrGetDllHandle(NULL, NULL, &DllName, &DllHandle);
+        ok_ntstatus(Status, STATUS_SUCCESS);
+        ok(DllHandle == hCopies[i], "LdrGetDllHandle(%wZ) returned %p\n", &DllName, DllHandle);
+    }
+    ok(GetModuleHandleW(L"kernel32.dll") == hKernel32, "kernel32.dll not found\n");
+
+    for (i = 0; i < COPY_COUNT; i++)
+    {
+        if (hCopies[i])
+        {
+            ok(FreeLibrary(hCopies[i]), "FreeLibrary(%S) failed with %lu\n", szCopies[i], GetLastError());
+            ok(GetModuleHandleW(szCopies[i]) == NULL, "%S is still loaded\n", szCopies[i]);
+        }
+
+        if (szCopies[i][0])
+            DeleteFileW(szCopies[i]);
+    }
+}
+
+START_TEST(GetModuleHandle)
+{
+    HMODULE hModules[_countof(s_ModuleNames)];
+    LARGE_INTEGER Frequency, Start, End;
+    WCHAR szUpper[MAX_PATH];
+    HMODULE hModule;
+    ULONG i, cMisses = 0;
+
+    for (i = 0; i < _countof(s_ModuleNames); i++)
+    {
+        hModules[i] = LoadLibraryW(s_ModuleNames[i]);
+        ok(hModules[i] != NULL, "LoadLibraryW(%S) failed with %lu\n", s_ModuleNames[i], GetLastError());
+    }
+
+    /* Lookups are case insensitive and must find the very same module */
+    for (i = 0; i < _countof(s_ModuleNames); i++)
+    {
+        if (!hModules[i])
+            continue;
+
+        ok(GetModuleHandleW(s_ModuleNames[i]) == hModules[i],
+           "GetModuleHandleW(%S) returned %p\n", s_ModuleNames[i], GetModuleHandleW(s_ModuleNames[i]));
+
+        StringCchCopyW(szUpper, _countof(szUpper), s_ModuleNames[i]);
+        _wcsupr(szUpper);
+        ok(GetModuleHandleW(szUpper) == hModules[i],
+           "GetModuleHandleW(%S) returned %p\n", szUpper, GetModuleHandleW(szUpper));
+
+        /* Loading it again only takes a reference */
+        ok(LoadLibraryW(szUpper) == hModules[i], "LoadLibraryW(%S) loaded a second copy\n", szUpper);
+        FreeLibrary(hModules[i]);
+    }
+
+    /* Names sharing a first letter with loaded modules are not found */
+    SetLastError(0xdeadbeef);
+    ok(GetModuleHandleW(L"shell33.dll") == NULL, "shell33.dll found\n");
+    ok_err(ERROR_MOD_NOT_FOUND);
+    ok(GetModuleHandleW(L"s.dll") == NULL, "s.dll found\n");
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < LOOKUP_COUNT; i++)
+    {
+        hModule = GetModuleHandleW(s_ModuleNames[(i * 7) % _countof(s_ModuleNames)]);
+        if (!hModule)
+            cMisses++;
+    }
+    QueryPerformanceCounter(&End);
+    trace("%d GetModuleHandleW calls: %lu us (%lu misses)\n", LOOKUP_COUNT,
+          (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart), cMisses);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < LOOKUP_COUNT / 10; i++)
+    {
+        hModule = LoadLibraryW(s_ModuleNames[(i * 7) % _countof(s_ModuleNames)]);
+        if (hModule)
+            FreeLibrary(hModule);
+    }
+    QueryPerformanceCounter(&End);
+    trace("%d LoadLibraryW/FreeLibrary pairs: %lu us\n", LOOKUP_COUNT / 10,
+          (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart));
+
+    for (i = 0; i < _countof(s_ModuleNames); i++)
+    {
+        if (hModules[i])
+            FreeLibrary(hModules[i]);
+    }
+
+    Test_ManyModules();
+}
@@ -0,0 +1,269 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Tests and benchmark for GetQueuedCompletionStatusEx and
+ *              SetFileCompletionNotificationModes
+ */
+
+#include "precomp.h"
+
+#define BATCH_SIZE      64
+#define BENCH_PACKETS   8192
+
+typedef BOOL (WINAPI *PGET_QUEUED_COMPLETION_STATUS_EX)(HANDLE, LPOVERLAPPED_ENTRY, ULONG, PULONG, DWORD, BOOL);
+typedef BOOL (WINAPI *PSET_FILE_COMPLETION_NOTIFICATION_MODES)(HANDLE, UCHAR);
+
+static PGET_QUEUED_COMPLETION_STATUS_EX pGetQueuedCompletionStatusEx;
+static PSET_FILE_COMPLETION_NOTIFICATION_MODES pSetFileCompletionNotificationModes;
+
+#ifndef FILE_SKIP_COMPLETION_PORT_ON_SUCCESS
+#define FILE_SKIP_COMPLETION_PORT_ON_SUCCESS 0x1
+#define FILE_SKIP_SET_EVENT_ON_HANDLE        0x2
+#endif
+
+static
+VOID
+WINAPI
+ApcRoutine(ULONG_PTR Parameter)
+{
+    *(PBOOL)Parameter = TRUE;
+}
+
+static
+VOID
+TestBatch(VOID)
+{
+    OVERLAPPED_ENTRY Entries[BATCH_SIZE];
+    HANDLE Port;
+    ULONG i, Removed;
+    BOOL Ret, ApcCalled;
+
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    ok(Port != NULL, "CreateIoCompletionPort failed, error %lu\n", GetLastError());
+    if (!Port)
+        return;
+
+    /* Nothing queued */
+    Removed = 0xdeadbeef;
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 0, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_TIMEOUT, "GetLastError() = %lu\n", GetLastError());
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 0, &Removed, 0, FALSE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "GetLastError() = %lu\n", GetLastError());
+
+    /* Everything that is queued comes back in one call, in order */
+    for (i = 0; i < 10; i++)
+        PostQueuedCompletionStatus(Port, i * 100, i + 1, (LPOVERLAPPED)(ULONG_PTR)(i * 16));
+
+    RtlFillMemory(Entries, sizeof(Entries), 0x55);
+    Removed = 0xdeadbeef;
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 0, FALSE);
+    ok(Ret == TRUE, "Ret = %d, error %lu\n", Ret, GetLastError());
+    ok(Removed == 10, "Removed = %lu\n", Removed);
+    for (i = 0; i < min(Removed, 10); i++)
+    {
+        ok(Entries[i].lpCompletionKey == i + 1, "Entry %lu: key %lu\n", i, (ULONG)Entries[i].lpCompletionKey);
+        ok(Entries[i].lpOverlapped == (LPOVERLAPPED)(ULONG_PTR)(i * 16), "Entry %lu: overlapped %p\n", i, Entries[i].lpOverlapped);
+        ok(Entries[i].Internal == 0, "Entry %lu: status 0x%lx\n", i, (ULONG)Entries[i].Internal);
+        ok(Entries[i].dwNumberOfBytesTransferred == i * 100, "Entry %lu: bytes %lu\n", i, Entries[i].dwNumberOfBytesTransferred);
+    }
+    ok(Entries[10].lpCompletionKey == (ULONG_PTR)0x5555555555555555ULL, "Entry 10 was written\n");
+
+    /* No more than asked for */
+    for (i = 0; i < 5; i++)
+        PostQueuedCompletionStatus(Port, 0, i, NULL);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, 3, &Removed, 0, FALSE);
+    ok(Ret == TRUE, "Ret = %d, error %lu\n", Ret, GetLastError());
+    ok(Removed == 3, "Removed = %lu\n", Removed);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 0, FALSE);
+    ok(Ret == TRUE, "Ret = %d, error %lu\n", Ret, GetLastError());
+    ok(Removed == 2, "Removed = %lu\n", Removed);
+    ok(Entries[0].lpCompletionKey == 3, "Key = %lu\n", (ULONG)Entries[0].lpCompletionKey);
+
+    /* An alertable wait is broken by a user APC */
+    ApcCalled = FALSE;
+    QueueUserAPC(ApcRoutine, GetCurrentThread(), (ULONG_PTR)&ApcCalled);
+    Removed = 0xdeadbeef;
+    SetLastError(0xdeadbeef);
+    Ret = pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 1000, TRUE);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == WAIT_IO_COMPLETION, "GetLastError() = %lu\n", GetLastError());
+    ok(Removed == 0, "Removed = %lu\n", Removed);
+    ok(ApcCalled == TRUE, "APC was not called\n");
+
+    CloseHandle(Port);
+}
+
+static
+VOID
+TestSkipOnSuccess(VOID)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    OVERLAPPED Overlapped;
+    OVERLAPPED_ENTRY Entry;
+    HANDLE File, Port;
+    CHAR Buffer[512];
+    DWORD Written;
+    ULONG Removed;
+    BOOL Ret;
+
+    GetTempPathW(RTL_NUMBER_OF(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"iocp", 0, FileName);
+    File = CreateFileW(FileName,
+                       GENERIC_READ | GENERIC_WRITE,
+                       0,
+                       NULL,
+                       CREATE_ALWAYS,
+                       FILE_FLAG_OVERLAPPED | FILE_FLAG_DELETE_ON_CLOSE,
+                       NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFile failed, error %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    Port = CreateIoCompletionPort(File, NULL, 0x1234, 1);
+    ok(Port != NULL, "CreateIoCompletionPort failed, error %lu\n", GetLastError());
+    if (!Port)
+    {
+        CloseHandle(File);
+        return;
+    }
+
+    SetLastError(0xdeadbeef);
+    Ret = pSetFileCompletionNotificationModes(File, 0x4);
+    ok(Ret == FALSE, "Ret = %d\n", Ret);
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "GetLastError() = %lu\n", GetLastError());
+
+    Ret = pSetFileCompletionNotificationModes(File, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS |
+                                                    FILE_SKIP_SET_EVENT_ON_HANDLE);
+    ok(Ret == TRUE, "SetFileCompletionNotificationModes failed, error %lu\n", GetLastError());
+
+    RtlFillMemory(Buffer, sizeof(Buffer), 'A');
+    RtlZeroMemory(&Overlapped, sizeof(Overlapped));
+    Ret = WriteFile(File, Buffer, sizeof(Buffer), &Written, &Overlapped);
+    if (!Ret && GetLastError() == ERROR_IO_PENDING)
+    {
+        /* Went asynchronous, so the packet must still be queued */
+        Ret = pGetQueuedCompletionStatusEx(Port, &Entry, 1, &Removed, 5000, FALSE);
+        ok(Ret == TRUE, "Ret = %d, error %lu\n", Ret, GetLastError());
+        ok(Removed == 1, "Removed = %lu\n", Removed);
+        ok(Entry.lpOverlapped == &Overlapped, "lpOverlapped = %p\n", Entry.lpOverlapped);
+    }
+    else
+    {
+        ok(Ret == TRUE, "WriteFile failed, error %lu\n", GetLastError());
+        ok(Written == sizeof(Buffer), "Written = %lu\n", Written);
+
+        /* Completed inline, nothing may be queued */
+        SetLastError(0xdeadbeef);
+        Ret = pGetQueuedCompletionStatusEx(Port, &Entry, 1, &Removed, 0, FALSE);
+        ok(Ret == FALSE, "Ret = %d, a packet was queued for %p\n", Ret, Entry.lpOverlapped);
+        ok(GetLastError() == WAIT_TIMEOUT, "GetLastError() = %lu\n", GetLastError());
+    }
+
+    /* Anything that went asynchronous is still queued */
+    RtlZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.Offset = 0x100000;
+    Ret = ReadFile(File, Buffer, sizeof(Buffer), NULL, &Overlapped);
+    ok(Ret == FALSE, "ReadFile succeeded\n");
+    if (GetLastError() == ERROR_IO_PENDING)
+    {
+        Ret = pGetQueuedCompletionStatusEx(Port, &Entry, 1, &Removed, 5000, FALSE);
+        ok(Ret == TRUE, "Ret = %d, error %lu\n", Ret, GetLastError());
+        ok(Entry.lpOverlapped == &Overlapped, "lpOverlapped = %p\n", Entry.lpOverlapped);
+        ok(Entry.lpCompletionKey == 0x1234, "Key = %lu\n", (ULONG)Entry.lpCompletionKey);
+    }
+
+    CloseHandle(Port);
+    CloseHandle(File);
+}
+
+/*
+ * Every completion costs one system call to queue it. Dequeuing them one at a
+ * time doubles that, a batch of N brings it down to 1 + 1/N.
+ */
+static
+VOID
+Benchmark(VOID)
+{
+    OVERLAPPED_ENTRY Entries[BATCH_SIZE];
+    LARGE_INTEGER Frequency, Start, End;
+    LPOVERLAPPED Overlapped;
+    ULONG_PTR Key;
+    DWORD Bytes;
+    HANDLE Port;
+    ULONG i, Calls, Removed, Completed;
+    BOOL Ret;
+
+    Port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    if (!Port)
+    {
+        skip("CreateIoCompletionPort failed, error %lu\n", GetLastError());
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* One packet per call */
+    for (i = 0; i < BENCH_PACKETS; i++)
+        PostQueuedCompletionStatus(Port, 0, i, NULL);
+    Calls = Completed = 0;
+    QueryPerformanceCounter(&Start);
+    do
+    {
+        Ret = GetQueuedCompletionStatus(Port, &Bytes, &Key, &Overlapped, 0);
+        Calls++;
+        if (Ret)
+            Completed++;
+    } while (Ret);
+    QueryPerformanceCounter(&End);
+    ok(Completed == BENCH_PACKETS, "Completed = %lu\n", Completed);
+    trace("GetQueuedCompletionStatus:   %lu dequeue calls, %lu.%02lu syscalls/completion, %I64u us\n",
+          Calls, (BENCH_PACKETS + Calls) / BENCH_PACKETS, (BENCH_PACKETS + Calls) % BENCH_PACKETS * 100 / BENCH_PACKETS,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+
+    /* A full batch per call */
+    for (i = 0; i < BENCH_PACKETS; i++)
+        PostQueuedCompletionStatus(Port, 0, i, NULL);
+    Calls = Completed = 0;
+    QueryPerformanceCounter(&Start);
+    do
+    {
+        Ret = pGetQueuedCompletionStatusEx(Port, Entries, BATCH_SIZE, &Removed, 0, FALSE);
+        Calls++;
+        if (Ret)
+            Completed += Removed;
+    } while (Ret);
+    QueryPerformanceCounter(&End);
+    ok(Completed == BENCH_PACKETS, "Completed = %lu\n", Completed);
+    ok(Calls <= BENCH_PACKETS / BATCH_SIZE + 1, "Calls = %lu\n", Calls);
+    trace("GetQueuedCompletionStatusEx: %lu dequeue calls, %lu.%02lu syscalls/completion, %I64u us\n",
+          Calls, (BENCH_PACKETS + Calls) / BENCH_PACKETS, (BENCH_PACKETS + Calls) % BENCH_PACKETS * 100 / BENCH_PACKETS,
+          (End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+
+    CloseHandle(Port);
+}
+
+START_TEST(GetQueuedCompletionStatusEx)
+{
+    HMODULE Kernel32 = GetModuleHandleW(L"kernel32.dll");
+
+    pGetQueuedCompletionStatusEx = (PVOID)GetProcAddress(Kernel32, "GetQueuedCompletionStatusEx");
+    pSetFileCompletionNotificationModes = (PVOID)GetProcAddress(Kernel32, "SetFileCompletionNotificationModes");
+    if (!pGetQueuedCompletionStatusEx)
+    {
+        skip("GetQueuedCompletionStatusEx is not available\n");
+        return;
+    }
+
+    TestBatch();
+    if (pSetFileCompletionNotificationModes)
+        TestSkipOnSuccess();
+    else
+        skip("SetFileCompletionNotificationModes is not available\n");
+    Benchmark();
+}
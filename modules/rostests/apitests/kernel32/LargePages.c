@@ -0,0 +1,167 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test and benchmark for large page allocations
+ */
+
+#include "precomp.h"
+
+#include <ndk/setypes.h>
+
+#define BENCH_SIZE      (64 * 1024 * 1024)
+#define BENCH_ACCESSES  (8 * 1024 * 1024)
+
+static
+VOID
+TestAllocation(SIZE_T LargePage)
+{
+    MEMORY_BASIC_INFORMATION Info;
+    PULONG_PTR Buffer;
+    SIZE_T i, Count;
+    BOOLEAN Mismatch = FALSE;
+
+    /* Only whole large pages can be allocated */
+    SetLastError(0xdeadbeef);
+    Buffer = VirtualAlloc(NULL, LargePage / 2, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    ok_ptr(Buffer, NULL);
+    ok_err(ERROR_INVALID_PARAMETER);
+
+    /* And they have to be committed right away */
+    SetLastError(0xdeadbeef);
+    Buffer = VirtualAlloc(NULL, LargePage, MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+    ok_ptr(Buffer, NULL);
+    ok_err(ERROR_INVALID_PARAMETER);
+
+    SetLastError(0xdeadbeef);
+    Buffer = VirtualAlloc(NULL, 2 * LargePage, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (!Buffer && GetLastError() == ERROR_NO_SYSTEM_RESOURCES)
+    {
+        skip("Not enough contiguous memory for large pages\n");
+        return;
+    }
+    ok(Buffer != NULL, "VirtualAlloc failed with %lu\n", GetLastError());
+    if (!Buffer) return;
+    ok(((ULONG_PTR)Buffer & (LargePage - 1)) == 0, "Buffer %p is not large page aligned\n", Buffer);
+
+    /* The whole range is one committed region */
+    ok_size_t(VirtualQuery(Buffer, &Info, sizeof(Info)), sizeof(Info));
+    ok_ptr(Info.BaseAddress, Buffer);
+    ok_ptr(Info.AllocationBase, Buffer);
+    ok_size_t(Info.RegionSize, 2 * LargePage);
+    ok_hex(Info.State, MEM_COMMIT);
+    ok_hex(Info.Protect, PAGE_READWRITE);
+    ok_hex(Info.Type, MEM_PRIVATE);
+
+    /* Fresh memory must be zeroed, then it must keep what is written to it */
+    Count = 2 * LargePage / sizeof(ULONG_PTR);
+    for (i = 0; i < Count; i++)
+    {
+        if (Buffer[i] != 0)
+        {
+            ok(0, "Buffer not zeroed at offset %lu\n", (ULONG)(i * sizeof(ULONG_PTR)));
+            break;
+        }
+    }
+    for (i = 0; i < Count; i++)
+        Buffer[i] = i;
+    for (i = 0; i < Count && !Mismatch; i++)
+    {
+        if (Buffer[i] != i)
+        {
+            ok(0, "Buffer overwritten at offset %lu\n", (ULONG)(i * sizeof(ULONG_PTR)));
+            Mismatch = TRUE;
+        }
+    }
+
+    /* Large pages can only be released as a whole */
+    ok(!VirtualFree(Buffer, LargePage, MEM_DECOMMIT), "Decommitted part of a large page allocation\n");
+    ok(!VirtualFree(Buffer, LargePage, MEM_RELEASE), "Released part of a large page allocation\n");
+    ok(VirtualFree(Buffer, 0, MEM_RELEASE), "VirtualFree failed with %lu\n", GetLastError());
+    ok_size_t(VirtualQuery(Buffer, &Info, sizeof(Info)), sizeof(Info));
+    ok_hex(Info.State, MEM_FREE);
+}
+
+static
+ULONG
+RandomAccess(PUCHAR Buffer, SIZE_T PageSize)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i, Seed = 0x12345678;
+    SIZE_T Offset;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    /* Hit a different small page almost every time, so the TLB is what counts */
+    for (i = 0; i < BENCH_ACCESSES; i++)
+    {
+        Offset = (RtlRandom(&Seed) % (BENCH_SIZE / PageSize)) * PageSize + (i % PageSize);
+        Buffer[Offset]++;
+    }
+
+    QueryPerformanceCounter(&End);
+    return (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+}
+
+static
+VOID
+Benchmark(VOID)
+{
+    SYSTEM_INFO SystemInfo;
+    PUCHAR Buffer;
+
+    GetSystemInfo(&SystemInfo);
+
+    /* Touch everything first, so only the translations are measured */
+    Buffer = VirtualAlloc(NULL, BENCH_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(Buffer != NULL, "VirtualAlloc failed with %lu\n", GetLastError());
+    if (!Buffer) return;
+    FillMemory(Buffer, BENCH_SIZE, 0x55);
+    trace("%d random accesses over %d MB, small pages: %lu us\n",
+          BENCH_ACCESSES, BENCH_SIZE / (1024 * 1024),
+          RandomAccess(Buffer, SystemInfo.dwPageSize));
+    ok(VirtualFree(Buffer, 0, MEM_RELEASE), "VirtualFree failed with %lu\n", GetLastError());
+
+    Buffer = VirtualAlloc(NULL, BENCH_SIZE, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+    if (!Buffer)
+    {
+        skip("No %d MB of large pages (error %lu)\n", BENCH_SIZE / (1024 * 1024), GetLastError());
+        return;
+    }
+    FillMemory(Buffer, BENCH_SIZE, 0x55);
+    trace("%d random accesses over %d MB, large pages: %lu us\n",
+          BENCH_ACCESSES, BENCH_SIZE / (1024 * 1024),
+          RandomAccess(Buffer, SystemInfo.dwPageSize));
+    ok(VirtualFree(Buffer, 0, MEM_RELEASE), "VirtualFree failed with %lu\n", GetLastError());
+}
+
+START_TEST(LargePages)
+{
+    SIZE_T LargePage;
+    BOOLEAN WasEnabled;
+    NTSTATUS Status;
+
+    /* This is what a single PDE maps */
+    LargePage = GetLargePageMinimum();
+    ok(LargePage == 0 || LargePage == 2 * 1024 * 1024 || LargePage == 4 * 1024 * 1024,
+       "Unexpected large page size %Iu\n", LargePage);
+    if (!LargePage)
+    {
+        skip("No large page support\n");
+        return;
+    }
+
+    /* Every large page allocation needs the lock memory privilege */
+    Status = RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, TRUE, FALSE, &WasEnabled);
+    if (!NT_SUCCESS(Status))
+    {
+        skip("SeLockMemoryPrivilege is not held (0x%lx)\n", Status);
+        return;
+    }
+
+    TestAllocation(LargePage);
+    Benchmark();
+
+    if (!WasEnabled)
+        RtlAdjustPrivilege(SE_LOCK_MEMORY_PRIVILEGE, FALSE, FALSE, &WasEnabled);
+}
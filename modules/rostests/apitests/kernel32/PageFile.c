@@ -0,0 +1,111 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Stress test paging a buffer larger than RAM out and in
+ */
+
+#include "precomp.h"
+
+/* Keep some commit and address space for everything else */
+#define SPARE_SIZE  (64 * 1024 * 1024)
+
+static
+ULONG_PTR
+Pattern(SIZE_T Index, ULONG_PTR Seed)
+{
+    return (ULONG_PTR)Index * 0x9E3779B1 ^ Seed;
+}
+
+static
+VOID
+FillPages(PULONG_PTR Buffer, SIZE_T FirstPage, SIZE_T PageCount, SIZE_T Stride, ULONG_PTR Seed)
+{
+    SIZE_T Page, i, Index;
+    const SIZE_T PerPage = PAGE_SIZE / sizeof(ULONG_PTR);
+
+    for (Page = FirstPage; Page < PageCount; Page += Stride)
+    {
+        Index = Page * PerPage;
+        for (i = 0; i < PerPage; i++, Index++)
+            Buffer[Index] = Pattern(Index, Seed);
+    }
+}
+
+/* Seeds[Page % 2] is what each page was last filled with */
+static
+SIZE_T
+CheckPages(PULONG_PTR Buffer, SIZE_T PageCount, BOOL Backwards, const ULONG_PTR Seeds[2])
+{
+    SIZE_T n, Page, i, Index, BadPages = 0;
+    const SIZE_T PerPage = PAGE_SIZE / sizeof(ULONG_PTR);
+
+    for (n = 0; n < PageCount; n++)
+    {
+        Page = Backwards ? PageCount - 1 - n : n;
+        Index = Page * PerPage;
+        for (i = 0; i < PerPage; i++, Index++)
+        {
+            if (Buffer[Index] != Pattern(Index, Seeds[Page % 2]))
+            {
+                if (BadPages++ < 5)
+                {
+                    ok(0, "Page %Iu offset %Iu: got 0x%Ix, expected 0x%Ix\n",
+                       Page, i * sizeof(ULONG_PTR), Buffer[Index], Pattern(Index, Seeds[Page % 2]));
+                }
+                break;
+            }
+        }
+    }
+
+    return BadPages;
+}
+
+START_TEST(PageFile)
+{
+    MEMORYSTATUSEX Status;
+    ULONGLONG Size;
+    PULONG_PTR Buffer;
+    SIZE_T PageCount;
+    ULONG_PTR Seeds[2];
+
+    Status.dwLength = sizeof(Status);
+    ok(GlobalMemoryStatusEx(&Status), "GlobalMemoryStatusEx failed with %lu\n", GetLastError());
+
+    /* A quarter more than there is RAM, so it can't all be resident */
+    Size = Status.ullTotalPhys + Status.ullTotalPhys / 4;
+    Size = (Size + PAGE_SIZE - 1) & ~(ULONGLONG)(PAGE_SIZE - 1);
+    if (Size + SPARE_SIZE > Status.ullAvailVirtual)
+    {
+        skip("%I64u MB of RAM don't fit in the address space\n", Status.ullTotalPhys >> 20);
+        return;
+    }
+    if (Size + SPARE_SIZE > Status.ullAvailPageFile)
+    {
+        skip("Only %I64u MB can be committed, %I64u MB needed\n",
+             Status.ullAvailPageFile >> 20, (Size + SPARE_SIZE) >> 20);
+        return;
+    }
+
+    Buffer = VirtualAlloc(NULL, (SIZE_T)Size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    ok(Buffer != NULL, "VirtualAlloc(%I64u MB) failed with %lu\n", Size >> 20, GetLastError());
+    if (!Buffer)
+        return;
+    PageCount = (SIZE_T)(Size / PAGE_SIZE);
+    trace("Paging through %Iu pages\n", PageCount);
+
+    /* Writing the whole buffer pages its beginning out again */
+    Seeds[0] = Seeds[1] = 0x5A5A5A5A;
+    FillPages(Buffer, 0, PageCount, 1, Seeds[0]);
+
+    /* Page it in in order, which is what the read-ahead is good at, and backwards */
+    ok_size_t(CheckPages(Buffer, PageCount, FALSE, Seeds), 0);
+    ok_size_t(CheckPages(Buffer, PageCount, TRUE, Seeds), 0);
+
+    /* Rewrite every other page, so paged out slots get reused and written out of order */
+    Seeds[1] = 0xA5A5A5A5;
+    FillPages(Buffer, 1, PageCount, 2, Seeds[1]);
+    ok_size_t(CheckPages(Buffer, PageCount, FALSE, Seeds), 0);
+    ok_size_t(CheckPages(Buffer, PageCount, TRUE, Seeds), 0);
+
+    ok(VirtualFree(Buffer, 0, MEM_RELEASE), "VirtualFree failed with %lu\n", GetLastError());
+}
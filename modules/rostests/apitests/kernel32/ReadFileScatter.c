@@ -0,0 +1,304 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Tests and benchmark for ReadFileScatter and WriteFileGather
+ */
+
+#include "precomp.h"
+
+#define SEGMENT_COUNT   16
+#define BENCH_PAGES     256
+#define BENCH_LOOPS     16
+
+static SYSTEM_INFO SystemInfo;
+static WCHAR FileName[MAX_PATH];
+
+static
+HANDLE
+CreateTestFile(DWORD Flags)
+{
+    return CreateFileW(FileName,
+                       GENERIC_READ | GENERIC_WRITE,
+                       FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL,
+                       OPEN_ALWAYS,
+                       FILE_ATTRIBUTE_NORMAL | Flags,
+                       NULL);
+}
+
+/* Wait for an overlapped operation, whether it completed inline or not */
+static
+BOOL
+WaitForIo(HANDLE File, LPOVERLAPPED Overlapped, BOOL Result, PDWORD Transferred)
+{
+    *Transferred = 0;
+    if (!Result && GetLastError() != ERROR_IO_PENDING)
+        return FALSE;
+    return GetOverlappedResult(File, Overlapped, Transferred, TRUE);
+}
+
+/* Point the segments at every other page, in reverse order */
+static
+VOID
+BuildSegments(PFILE_SEGMENT_ELEMENT Segments, PUCHAR Buffer, ULONG Count)
+{
+    ULONG i;
+
+    for (i = 0; i < Count; i++)
+        Segments[i].Buffer = Buffer + (Count - 1 - i) * 2 * SystemInfo.dwPageSize;
+    Segments[Count].Buffer = NULL;
+}
+
+static
+VOID
+TestReadWrite(PUCHAR Buffer)
+{
+    FILE_SEGMENT_ELEMENT Segments[SEGMENT_COUNT + 1];
+    ULONG PageSize = SystemInfo.dwPageSize;
+    ULONG Length = SEGMENT_COUNT * PageSize;
+    OVERLAPPED Overlapped;
+    HANDLE File, Port;
+    PUCHAR Contiguous;
+    DWORD Transferred;
+    ULONG_PTR Key;
+    LPOVERLAPPED Completed;
+    ULONG i;
+    BOOL Ret;
+
+    Contiguous = VirtualAlloc(NULL, Length, MEM_COMMIT, PAGE_READWRITE);
+    if (!Contiguous)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    File = CreateTestFile(FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFile failed, error %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+    {
+        VirtualFree(Contiguous, 0, MEM_RELEASE);
+        return;
+    }
+
+    /* Tag every segment page with its index */
+    BuildSegments(Segments, Buffer, SEGMENT_COUNT);
+    for (i = 0; i < SEGMENT_COUNT; i++)
+        memset(Segments[i].Buffer, 0x10 + i, PageSize);
+
+    /* Gather write, completion signaled through the event */
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    Ret = WriteFileGather(File, Segments, Length, NULL, &Overlapped);
+    Ret = WaitForIo(File, &Overlapped, Ret, &Transferred);
+    ok(Ret, "WriteFileGather failed, error %lu\n", GetLastError());
+    ok(Transferred == Length, "Transferred = %lu\n", Transferred);
+    ok(WaitForSingleObject(Overlapped.hEvent, 0) == WAIT_OBJECT_0, "Event not signaled\n");
+
+    /* The file must contain the segments in array order */
+    Ret = ReadFile(File, Contiguous, Length, NULL, &Overlapped);
+    Ret = WaitForIo(File, &Overlapped, Ret, &Transferred);
+    ok(Ret, "ReadFile failed, error %lu\n", GetLastError());
+    ok(Transferred == Length, "Transferred = %lu\n", Transferred);
+    for (i = 0; i < SEGMENT_COUNT; i++)
+    {
+        ok(Contiguous[i * PageSize] == 0x10 + i && Contiguous[(i + 1) * PageSize - 1] == 0x10 + i,
+           "Page %lu: got 0x%x\n", i, Contiguous[i * PageSize]);
+    }
+
+    /* Scatter it back into cleared pages, starting at the second page of the file */
+    for (i = 0; i < SEGMENT_COUNT; i++)
+        memset(Segments[i].Buffer, 0, PageSize);
+    Overlapped.Offset = PageSize;
+    Ret = ReadFileScatter(File, Segments, Length - PageSize, NULL, &Overlapped);
+    Ret = WaitForIo(File, &Overlapped, Ret, &Transferred);
+    ok(Ret, "ReadFileScatter failed, error %lu\n", GetLastError());
+    ok(Transferred == Length - PageSize, "Transferred = %lu\n", Transferred);
+    for (i = 0; i < SEGMENT_COUNT - 1; i++)
+    {
+        ok(((PUCHAR)Segments[i].Buffer)[0] == 0x11 + i &&
+           ((PUCHAR)Segments[i].Buffer)[PageSize - 1] == 0x11 + i,
+           "Segment %lu: got 0x%x\n", i, ((PUCHAR)Segments[i].Buffer)[0]);
+    }
+    ok(((PUCHAR)Segments[i].Buffer)[0] == 0, "Last segment was written to\n");
+
+    /* A length that is not sector aligned is rejected */
+    Overlapped.Offset = 0;
+    SetLastError(0xdeadbeef);
+    Ret = ReadFileScatter(File, Segments, PageSize - 1, NULL, &Overlapped);
+    ok(!Ret, "ReadFileScatter succeeded\n");
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "Error = %lu\n", GetLastError());
+
+    /* So is a segment that is not page aligned */
+    Segments[1].Buffer = (PUCHAR)Segments[1].Buffer + 512;
+    SetLastError(0xdeadbeef);
+    Ret = ReadFileScatter(File, Segments, 2 * PageSize, NULL, &Overlapped);
+    ok(!Ret, "ReadFileScatter succeeded\n");
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "Error = %lu\n", GetLastError());
+    BuildSegments(Segments, Buffer, SEGMENT_COUNT);
+
+    /* Once bound to a completion port, completions are queued there */
+    Port = CreateIoCompletionPort(File, NULL, 0x5c47, 0);
+    ok(Port != NULL, "CreateIoCompletionPort failed, error %lu\n", GetLastError());
+    if (Port)
+    {
+        CloseHandle(Overlapped.hEvent);
+        ZeroMemory(&Overlapped, sizeof(Overlapped));
+        Ret = ReadFileScatter(File, Segments, Length, NULL, &Overlapped);
+        if (!Ret)
+            ok(GetLastError() == ERROR_IO_PENDING, "ReadFileScatter failed, error %lu\n", GetLastError());
+
+        Transferred = 0;
+        Key = 0;
+        Completed = NULL;
+        Ret = GetQueuedCompletionStatus(Port, &Transferred, &Key, &Completed, 5000);
+        ok(Ret, "GetQueuedCompletionStatus failed, error %lu\n", GetLastError());
+        ok(Completed == &Overlapped, "Completed = %p, expected %p\n", Completed, &Overlapped);
+        ok(Key == 0x5c47, "Key = 0x%lx\n", (ULONG)Key);
+        ok(Transferred == Length, "Transferred = %lu\n", Transferred);
+        ok(((PUCHAR)Segments[SEGMENT_COUNT - 1].Buffer)[0] == 0x10 + SEGMENT_COUNT - 1, "Wrong data\n");
+
+        CloseHandle(Port);
+    }
+    else
+    {
+        CloseHandle(Overlapped.hEvent);
+    }
+
+    CloseHandle(File);
+    VirtualFree(Contiguous, 0, MEM_RELEASE);
+}
+
+static
+VOID
+TestBuffered(PUCHAR Buffer)
+{
+    FILE_SEGMENT_ELEMENT Segments[2];
+    OVERLAPPED Overlapped;
+    HANDLE File;
+    BOOL Ret;
+
+    File = CreateTestFile(FILE_FLAG_OVERLAPPED);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFile failed, error %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    /* Scatter/gather needs non-cached I/O */
+    BuildSegments(Segments, Buffer, 1);
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    SetLastError(0xdeadbeef);
+    Ret = ReadFileScatter(File, Segments, SystemInfo.dwPageSize, NULL, &Overlapped);
+    ok(!Ret, "ReadFileScatter succeeded\n");
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "Error = %lu\n", GetLastError());
+
+    SetLastError(0xdeadbeef);
+    Ret = WriteFileGather(File, Segments, SystemInfo.dwPageSize, NULL, &Overlapped);
+    ok(!Ret, "WriteFileGather succeeded\n");
+    ok(GetLastError() == ERROR_INVALID_PARAMETER, "Error = %lu\n", GetLastError());
+
+    CloseHandle(File);
+}
+
+/* One scattered read of the whole range against one read per page */
+static
+VOID
+Benchmark(VOID)
+{
+    PFILE_SEGMENT_ELEMENT Segments;
+    ULONG PageSize = SystemInfo.dwPageSize;
+    ULONG Length = BENCH_PAGES * PageSize;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG ScatterTicks, PageTicks;
+    OVERLAPPED Overlapped;
+    DWORD Transferred;
+    PUCHAR Buffer;
+    HANDLE File;
+    ULONG i, j;
+    BOOL Ret = TRUE;
+
+    Buffer = VirtualAlloc(NULL, 2 * Length, MEM_COMMIT, PAGE_READWRITE);
+    Segments = HeapAlloc(GetProcessHeap(), 0, (BENCH_PAGES + 1) * sizeof(*Segments));
+    File = CreateTestFile(FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED);
+    if (!Buffer || !Segments || File == INVALID_HANDLE_VALUE)
+    {
+        skip("Cannot set up the benchmark\n");
+        goto Cleanup;
+    }
+
+    BuildSegments(Segments, Buffer, BENCH_PAGES);
+    ZeroMemory(&Overlapped, sizeof(Overlapped));
+    Overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    Ret = WriteFileGather(File, Segments, Length, NULL, &Overlapped);
+    Ret = WaitForIo(File, &Overlapped, Ret, &Transferred);
+    ok(Ret && Transferred == Length, "WriteFileGather failed, error %lu\n", GetLastError());
+
+    QueryPerformanceFrequency(&Frequency);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BENCH_LOOPS && Ret; i++)
+    {
+        Ret = ReadFileScatter(File, Segments, Length, NULL, &Overlapped);
+        Ret = WaitForIo(File, &Overlapped, Ret, &Transferred);
+    }
+    QueryPerformanceCounter(&End);
+    ok(Ret, "ReadFileScatter failed, error %lu\n", GetLastError());
+    ScatterTicks = max(End.QuadPart - Start.QuadPart, 1);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BENCH_LOOPS && Ret; i++)
+    {
+        for (j = 0; j < BENCH_PAGES && Ret; j++)
+        {
+            Overlapped.Offset = j * PageSize;
+            Ret = ReadFile(File, Segments[j].Buffer, PageSize, NULL, &Overlapped);
+            Ret = WaitForIo(File, &Overlapped, Ret, &Transferred);
+        }
+    }
+    QueryPerformanceCounter(&End);
+    ok(Ret, "ReadFile failed, error %lu\n", GetLastError());
+    PageTicks = max(End.QuadPart - Start.QuadPart, 1);
+
+    trace("%lu pages: scatter %I64u KB/s, per page reads %I64u KB/s\n",
+          (ULONG)BENCH_PAGES,
+          (ULONGLONG)BENCH_LOOPS * Length * Frequency.QuadPart / ScatterTicks / 1024,
+          (ULONGLONG)BENCH_LOOPS * Length * Frequency.QuadPart / PageTicks / 1024);
+
+    CloseHandle(Overlapped.hEvent);
+
+Cleanup:
+    if (File != INVALID_HANDLE_VALUE)
+        CloseHandle(File);
+    if (Segments)
+        HeapFree(GetProcessHeap(), 0, Segments);
+    if (Buffer)
+        VirtualFree(Buffer, 0, MEM_RELEASE);
+}
+
+START_TEST(ReadFileScatter)
+{
+    WCHAR TempPath[MAX_PATH];
+    PUCHAR Buffer;
+
+    GetSystemInfo(&SystemInfo);
+
+    if (!GetTempPathW(RTL_NUMBER_OF(TempPath), TempPath) ||
+        !GetTempFileNameW(TempPath, L"rfs", 0, FileName))
+    {
+        skip("No temporary file, error %lu\n", GetLastError());
+        return;
+    }
+
+    Buffer = VirtualAlloc(NULL, 2 * SEGMENT_COUNT * SystemInfo.dwPageSize, MEM_COMMIT, PAGE_READWRITE);
+    if (!Buffer)
+    {
+        skip("Out of memory\n");
+        DeleteFileW(FileName);
+        return;
+    }
+
+    TestReadWrite(Buffer);
+    TestBuffered(Buffer);
+    Benchmark();
+
+    VirtualFree(Buffer, 0, MEM_RELEASE);
+    DeleteFileW(FileName);
+}
@@ -0,0 +1,266 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Round trip tests and benchmark for LZNT1 RtlCompressBuffer
+ */
+
+#include "precomp.h"
+
+#define BENCH_SIZE  (1024 * 1024)
+#define BENCH_LOOPS 4
+
+static PUCHAR WorkSpace;
+static ULONG RandomSeed;
+
+static
+ULONG
+Random(VOID)
+{
+    RandomSeed = RandomSeed * 1664525 + 1013904223;
+    return RandomSeed >> 8;
+}
+
+static
+VOID
+FillRandom(PUCHAR Buffer, ULONG Size, ULONG Range)
+{
+    ULONG i;
+
+    for (i = 0; i < Size; i++)
+        Buffer[i] = (UCHAR)(Random() % Range);
+}
+
+/* Something that looks like a text file */
+static
+VOID
+FillText(PUCHAR Buffer, ULONG Size)
+{
+    static const PCSTR Words[] = { "the ", "quick ", "brown ", "fox ", "jumps ", "over ",
+                                   "lazy ", "dog ", "ReactOS ", "kernel ", "\r\n",
+                                   "compression ", "NTSTATUS ", "return ", "Status;" };
+    ULONG i, Length;
+    PCSTR Word;
+
+    for (i = 0; i < Size; i += Length)
+    {
+        Word = Words[Random() % RTL_NUMBER_OF(Words)];
+        Length = min((ULONG)strlen(Word), Size - i);
+        RtlCopyMemory(Buffer + i, Word, Length);
+    }
+}
+
+/* Worst case: every 4K chunk stored uncompressed, with its header */
+static
+ULONG
+MaxCompressedSize(ULONG Size)
+{
+    return Size + (Size + 0xFFF) / 0x1000 * sizeof(USHORT);
+}
+
+static
+VOID
+RoundTrip(PCSTR Name, USHORT Engine, PUCHAR Data, ULONG Size, PULONG CompressedSize)
+{
+    PUCHAR Compressed, Decompressed;
+    ULONG MaxSize = MaxCompressedSize(Size);
+    ULONG FinalSize, DecompressedSize;
+    NTSTATUS Status;
+
+    *CompressedSize = 0;
+
+    Compressed = HeapAlloc(GetProcessHeap(), 0, MaxSize);
+    Decompressed = HeapAlloc(GetProcessHeap(), 0, Size + 1);
+    if (!Compressed || !Decompressed)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    FinalSize = 0xdeadbeef;
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1 | Engine, Data, Size,
+                               Compressed, MaxSize, 0x1000, &FinalSize, WorkSpace);
+    ok(Status == STATUS_SUCCESS, "%s, %lu bytes, engine %x: Status = 0x%lx\n", Name, Size, Engine, Status);
+    if (Status != STATUS_SUCCESS)
+        goto Cleanup;
+    ok(FinalSize <= MaxSize, "%s, %lu bytes, engine %x: FinalSize = %lu\n", Name, Size, Engine, FinalSize);
+
+    DecompressedSize = 0xdeadbeef;
+    Decompressed[Size] = 0x55;
+    Status = RtlDecompressBuffer(COMPRESSION_FORMAT_LZNT1, Decompressed, Size,
+                                 Compressed, FinalSize, &DecompressedSize);
+    ok(Status == STATUS_SUCCESS, "%s, %lu bytes, engine %x: Status = 0x%lx\n", Name, Size, Engine, Status);
+    ok(DecompressedSize == Size, "%s, %lu bytes, engine %x: DecompressedSize = %lu\n", Name, Size, Engine, DecompressedSize);
+    ok(RtlEqualMemory(Decompressed, Data, Size), "%s, %lu bytes, engine %x: data mismatch\n", Name, Size, Engine);
+    ok(Decompressed[Size] == 0x55, "%s, %lu bytes, engine %x: buffer overrun\n", Name, Size, Engine);
+
+    *CompressedSize = FinalSize;
+
+Cleanup:
+    if (Compressed)
+        HeapFree(GetProcessHeap(), 0, Compressed);
+    if (Decompressed)
+        HeapFree(GetProcessHeap(), 0, Decompressed);
+}
+
+static
+VOID
+TestSizes(VOID)
+{
+    static const ULONG Sizes[] = { 1, 2, 3, 4, 17, 0xFFF, 0x1000, 0x1001, 0x2345, 0x10000 };
+    PUCHAR Data;
+    ULONG i, CompressedSize;
+
+    Data = HeapAlloc(GetProcessHeap(), 0, 0x10000);
+    if (!Data)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    for (i = 0; i < RTL_NUMBER_OF(Sizes); i++)
+    {
+        RandomSeed = i;
+
+        RtlZeroMemory(Data, Sizes[i]);
+        RoundTrip("zeros", COMPRESSION_ENGINE_STANDARD, Data, Sizes[i], &CompressedSize);
+        RoundTrip("zeros", COMPRESSION_ENGINE_MAXIMUM, Data, Sizes[i], &CompressedSize);
+        if (Sizes[i] >= 0x1000)
+            ok(CompressedSize < Sizes[i] / 16, "%lu zeros compressed to %lu bytes\n", Sizes[i], CompressedSize);
+
+        /* Few distinct bytes: lots of short matches at all distances */
+        FillRandom(Data, Sizes[i], 4);
+        RoundTrip("4 symbols", COMPRESSION_ENGINE_STANDARD, Data, Sizes[i], &CompressedSize);
+        RoundTrip("4 symbols", COMPRESSION_ENGINE_MAXIMUM, Data, Sizes[i], &CompressedSize);
+
+        /* Incompressible, must be stored */
+        FillRandom(Data, Sizes[i], 256);
+        RoundTrip("random", COMPRESSION_ENGINE_STANDARD, Data, Sizes[i], &CompressedSize);
+        ok(CompressedSize == MaxCompressedSize(Sizes[i]), "%lu random bytes compressed to %lu bytes\n", Sizes[i], CompressedSize);
+        RoundTrip("random", COMPRESSION_ENGINE_MAXIMUM, Data, Sizes[i], &CompressedSize);
+        ok(CompressedSize == MaxCompressedSize(Sizes[i]), "%lu random bytes compressed to %lu bytes\n", Sizes[i], CompressedSize);
+    }
+
+    HeapFree(GetProcessHeap(), 0, Data);
+}
+
+static
+VOID
+TestErrors(VOID)
+{
+    UCHAR Data[0x1000], Compressed[0x1100];
+    ULONG FinalSize;
+    NTSTATUS Status;
+
+    FillText(Data, sizeof(Data));
+
+    /* Fits only when compressed */
+    FinalSize = 0xdeadbeef;
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1, Data, sizeof(Data),
+                               Compressed, sizeof(Data) / 2, 0x1000, &FinalSize, WorkSpace);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    ok(FinalSize < sizeof(Data) / 2, "FinalSize = %lu\n", FinalSize);
+
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1, Data, sizeof(Data),
+                               Compressed, 16, 0x1000, &FinalSize, WorkSpace);
+    ok(Status == STATUS_BUFFER_TOO_SMALL, "Status = 0x%lx\n", Status);
+
+    FillRandom(Data, sizeof(Data), 256);
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1, Data, sizeof(Data),
+                               Compressed, sizeof(Data), 0x1000, &FinalSize, WorkSpace);
+    ok(Status == STATUS_BUFFER_TOO_SMALL, "Status = 0x%lx\n", Status);
+
+    Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_HIBER, Data, sizeof(Data),
+                               Compressed, sizeof(Compressed), 0x1000, &FinalSize, WorkSpace);
+    ok(Status == STATUS_NOT_SUPPORTED, "Status = 0x%lx\n", Status);
+}
+
+static
+VOID
+Benchmark(PCSTR Name, PUCHAR Data)
+{
+    static const USHORT Engines[] = { COMPRESSION_ENGINE_STANDARD, COMPRESSION_ENGINE_MAXIMUM };
+    LARGE_INTEGER Frequency, Start, End;
+    PUCHAR Compressed;
+    ULONG i, j, FinalSize, MaxSize = MaxCompressedSize(BENCH_SIZE);
+    ULONG CompressedSize[RTL_NUMBER_OF(Engines)];
+    ULONGLONG Ticks;
+    NTSTATUS Status;
+
+    Compressed = HeapAlloc(GetProcessHeap(), 0, MaxSize);
+    if (!Compressed)
+    {
+        skip("Out of memory\n");
+        return;
+    }
+
+    QueryPerformanceFrequency(&Frequency);
+
+    for (i = 0; i < RTL_NUMBER_OF(Engines); i++)
+    {
+        RoundTrip(Name, Engines[i], Data, BENCH_SIZE, &CompressedSize[i]);
+
+        Status = STATUS_SUCCESS;
+        QueryPerformanceCounter(&Start);
+        for (j = 0; j < BENCH_LOOPS && Status == STATUS_SUCCESS; j++)
+        {
+            Status = RtlCompressBuffer(COMPRESSION_FORMAT_LZNT1 | Engines[i], Data, BENCH_SIZE,
+                                       Compressed, MaxSize, 0x1000, &FinalSize, WorkSpace);
+        }
+        QueryPerformanceCounter(&End);
+        ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+
+        Ticks = max(End.QuadPart - Start.QuadPart, 1);
+        trace("%-8s %s: %lu -> %lu bytes (%lu%%), %I64u KB/s\n",
+              Name, Engines[i] == COMPRESSION_ENGINE_MAXIMUM ? "maximum " : "standard",
+              (ULONG)BENCH_SIZE, CompressedSize[i], (ULONG)(CompressedSize[i] * 100ULL / BENCH_SIZE),
+              (ULONGLONG)BENCH_LOOPS * BENCH_SIZE * Frequency.QuadPart / Ticks / 1024);
+    }
+
+    /* The maximum engine must not be worse than the standard one */
+    ok(CompressedSize[1] <= CompressedSize[0], "%s: maximum %lu, standard %lu\n",
+       Name, CompressedSize[1], CompressedSize[0]);
+
+    HeapFree(GetProcessHeap(), 0, Compressed);
+}
+
+START_TEST(RtlCompressBuffer)
+{
+    ULONG BufferWorkSpaceSize, FragmentWorkSpaceSize;
+    ULONG MaximumWorkSpaceSize;
+    PUCHAR Data;
+    NTSTATUS Status;
+
+    Status = RtlGetCompressionWorkSpaceSize(COMPRESSION_FORMAT_LZNT1,
+                                            &BufferWorkSpaceSize,
+                                            &FragmentWorkSpaceSize);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    Status = RtlGetCompressionWorkSpaceSize(COMPRESSION_FORMAT_LZNT1 | COMPRESSION_ENGINE_MAXIMUM,
+                                            &MaximumWorkSpaceSize,
+                                            &FragmentWorkSpaceSize);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+
+    WorkSpace = HeapAlloc(GetProcessHeap(), 0, max(BufferWorkSpaceSize, MaximumWorkSpaceSize));
+    Data = HeapAlloc(GetProcessHeap(), 0, BENCH_SIZE);
+    if (!WorkSpace || !Data)
+    {
+        skip("Out of memory\n");
+        goto Cleanup;
+    }
+
+    TestSizes();
+    TestErrors();
+
+    RandomSeed = 0;
+    RtlZeroMemory(Data, BENCH_SIZE);
+    Benchmark("zeros", Data);
+    FillText(Data, BENCH_SIZE);
+    Benchmark("text", Data);
+    FillRandom(Data, BENCH_SIZE, 256);
+    Benchmark("random", Data);
+
+Cleanup:
+    if (Data)
+        HeapFree(GetProcessHeap(), 0, Data);
+    if (WorkSpace)
+        HeapFree(GetProcessHeap(), 0, WorkSpace);
+}
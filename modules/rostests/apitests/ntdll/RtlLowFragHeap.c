@@ -0,0 +1,250 @@
+/*
+ * PROJECT:         ReactOS api tests
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Test and benchmark for the low fragmentation heap
+ */
+
+#include "precomp.h"
+
+#define BLOCK_COUNT     2000
+#define THREAD_COUNT    4
+#define THREAD_ROUNDS   200
+#define THREAD_BLOCKS   256
+
+static
+ULONG
+QueryFrontEnd(PVOID Heap)
+{
+    ULONG FrontEnd = MAXULONG;
+    NTSTATUS Status;
+
+    Status = RtlQueryHeapInformation(Heap, HeapCompatibilityInformation,
+                                     &FrontEnd, sizeof(FrontEnd), NULL);
+    ok_ntstatus(Status, STATUS_SUCCESS);
+    return FrontEnd;
+}
+
+static
+NTSTATUS
+EnableLowFragHeap(PVOID Heap)
+{
+    ULONG FrontEnd = 2;
+
+    return RtlSetHeapInformation(Heap, HeapCompatibilityInformation,
+                                 &FrontEnd, sizeof(FrontEnd));
+}
+
+static
+VOID
+TestActivation(VOID)
+{
+    PVOID Heap, Blocks[BLOCK_COUNT];
+    ULONG i;
+
+    /* Asked for explicitly */
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap) return;
+    ok_hex(QueryFrontEnd(Heap), 0);
+    ok_ntstatus(EnableLowFragHeap(Heap), STATUS_SUCCESS);
+    ok_hex(QueryFrontEnd(Heap), 2);
+    ok_ntstatus(EnableLowFragHeap(Heap), STATUS_SUCCESS);
+    ok_hex(QueryFrontEnd(Heap), 2);
+    RtlDestroyHeap(Heap);
+
+    /* Not for heaps without serialization */
+    Heap = RtlCreateHeap(HEAP_GROWABLE | HEAP_NO_SERIALIZE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap) return;
+    ok(!NT_SUCCESS(EnableLowFragHeap(Heap)), "Enabled the LFH on a HEAP_NO_SERIALIZE heap\n");
+    ok_hex(QueryFrontEnd(Heap), 0);
+    RtlDestroyHeap(Heap);
+
+    /* Turned on by itself once a heap is busy with small blocks */
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap) return;
+    for (i = 0; i < BLOCK_COUNT; i++)
+        Blocks[i] = RtlAllocateHeap(Heap, 0, 32);
+    ok_hex(QueryFrontEnd(Heap), 2);
+    for (i = 0; i < BLOCK_COUNT; i++)
+        ok(RtlFreeHeap(Heap, 0, Blocks[i]), "RtlFreeHeap failed for block %lu\n", i);
+    RtlDestroyHeap(Heap);
+}
+
+static
+VOID
+TestBlocks(VOID)
+{
+    PVOID Heap, Blocks[BLOCK_COUNT], NewBlock;
+    SIZE_T Size;
+    ULONG i, j;
+    PUCHAR Bytes;
+    BOOLEAN Mismatch = FALSE;
+
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap) return;
+    ok_ntstatus(EnableLowFragHeap(Heap), STATUS_SUCCESS);
+
+    /* Many blocks of every small size, each with its own pattern */
+    for (i = 0; i < BLOCK_COUNT; i++)
+    {
+        Size = i % 900 + 1;
+        Blocks[i] = RtlAllocateHeap(Heap, (i & 1) ? HEAP_ZERO_MEMORY : 0, Size);
+        ok(Blocks[i] != NULL, "Allocation of %lu bytes failed\n", (ULONG)Size);
+        if (!Blocks[i]) continue;
+
+        ok_size_t(RtlSizeHeap(Heap, 0, Blocks[i]), Size);
+        if (i & 1)
+        {
+            Bytes = Blocks[i];
+            for (j = 0; j < Size; j++)
+            {
+                if (Bytes[j] != 0)
+                {
+                    ok(0, "Block %lu not zeroed at offset %lu\n", i, j);
+                    break;
+                }
+            }
+        }
+        RtlFillMemory(Blocks[i], Size, (UCHAR)i);
+    }
+
+    for (i = 0; i < BLOCK_COUNT && !Mismatch; i++)
+    {
+        if (!Blocks[i]) continue;
+        Size = i % 900 + 1;
+        Bytes = Blocks[i];
+        for (j = 0; j < Size; j++)
+        {
+            if (Bytes[j] != (UCHAR)i)
+            {
+                ok(0, "Block %lu overwritten at offset %lu\n", i, j);
+                Mismatch = TRUE;
+                break;
+            }
+        }
+    }
+
+    ok(RtlValidateHeap(Heap, 0, NULL), "RtlValidateHeap failed\n");
+
+    /* Growing keeps the contents and zeroes the new part when asked to */
+    for (i = 0; i < 64; i++)
+    {
+        if (!Blocks[i]) continue;
+        Size = i % 900 + 1;
+        NewBlock = RtlReAllocateHeap(Heap, HEAP_ZERO_MEMORY, Blocks[i], Size + 100);
+        ok(NewBlock != NULL, "Reallocation of block %lu failed\n", i);
+        if (!NewBlock) continue;
+        Blocks[i] = NewBlock;
+        ok_size_t(RtlSizeHeap(Heap, 0, NewBlock), Size + 100);
+        Bytes = NewBlock;
+        ok(Bytes[0] == (UCHAR)i && Bytes[Size - 1] == (UCHAR)i, "Block %lu lost its contents\n", i);
+        ok(Bytes[Size] == 0 && Bytes[Size + 99] == 0, "Block %lu was not zeroed\n", i);
+    }
+
+    /* Shrinking within the same size keeps the block */
+    NewBlock = RtlReAllocateHeap(Heap, 0, Blocks[100], 99);
+    ok(NewBlock == Blocks[100], "Block moved from %p to %p\n", Blocks[100], NewBlock);
+    if (NewBlock)
+    {
+        Blocks[100] = NewBlock;
+        ok_size_t(RtlSizeHeap(Heap, 0, NewBlock), 99);
+    }
+
+    for (i = 0; i < BLOCK_COUNT; i++)
+    {
+        if (Blocks[i])
+            ok(RtlFreeHeap(Heap, 0, Blocks[i]), "RtlFreeHeap failed for block %lu\n", i);
+    }
+
+    ok(RtlValidateHeap(Heap, 0, NULL), "RtlValidateHeap failed\n");
+    RtlDestroyHeap(Heap);
+}
+
+static
+DWORD
+WINAPI
+AllocThread(LPVOID lpParameter)
+{
+    PVOID Heap = lpParameter;
+    PVOID Blocks[THREAD_BLOCKS];
+    ULONG Round, i, Seed = GetCurrentThreadId();
+
+    for (Round = 0; Round < THREAD_ROUNDS; Round++)
+    {
+        for (i = 0; i < THREAD_BLOCKS; i++)
+        {
+            Blocks[i] = RtlAllocateHeap(Heap, 0, RtlRandom(&Seed) % 256 + 1);
+            if (Blocks[i]) *(PUCHAR)Blocks[i] = (UCHAR)i;
+        }
+
+        /* Free in a different order than the blocks were allocated */
+        for (i = 0; i < THREAD_BLOCKS; i++)
+            RtlFreeHeap(Heap, 0, Blocks[(i * 7) % THREAD_BLOCKS]);
+    }
+
+    return 0;
+}
+
+static
+ULONG
+RunThreads(PVOID Heap)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    HANDLE Threads[THREAD_COUNT];
+    ULONG i;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (i = 0; i < THREAD_COUNT; i++)
+    {
+        Threads[i] = CreateThread(NULL, 0, AllocThread, Heap, 0, NULL);
+        ok(Threads[i] != NULL, "CreateThread failed with %lu\n", GetLastError());
+    }
+
+    for (i = 0; i < THREAD_COUNT; i++)
+    {
+        if (!Threads[i]) continue;
+        WaitForSingleObject(Threads[i], INFINITE);
+        CloseHandle(Threads[i]);
+    }
+
+    QueryPerformanceCounter(&End);
+    return (ULONG)((End.QuadPart - Start.QuadPart) * 1000000 / Frequency.QuadPart);
+}
+
+static
+VOID
+Benchmark(VOID)
+{
+    PVOID Heap;
+
+    /* A heap that can't grow never gets an LFH */
+    Heap = RtlCreateHeap(0, NULL, 16 * 1024 * 1024, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap) return;
+    trace("%d threads, %d allocations each, backend heap: %lu us\n",
+          THREAD_COUNT, THREAD_ROUNDS * THREAD_BLOCKS,
+          RunThreads(Heap));
+    RtlDestroyHeap(Heap);
+
+    Heap = RtlCreateHeap(HEAP_GROWABLE, NULL, 0, 0, NULL, NULL);
+    ok(Heap != NULL, "RtlCreateHeap failed\n");
+    if (!Heap) return;
+    ok_ntstatus(EnableLowFragHeap(Heap), STATUS_SUCCESS);
+    trace("%d threads, %d allocations each, low fragmentation heap: %lu us\n",
+          THREAD_COUNT, THREAD_ROUNDS * THREAD_BLOCKS,
+          RunThreads(Heap));
+    ok(RtlValidateHeap(Heap, 0, NULL), "RtlValidateHeap failed\n");
+    RtlDestroyHeap(Heap);
+}
+
+START_TEST(RtlLowFragHeap)
+{
+    TestActivation();
+    TestBlocks();
+    Benchmark();
+}
@@ -0,0 +1,222 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Tests for RtlWaitOnAddress and lock contention benchmark
+ */
+
+#include "precomp.h"
+
+#define BENCH_THREADS       4
+#define BENCH_ITERATIONS    100000
+#define PINGPONG_ROUNDS     10000
+
+static NTSTATUS (NTAPI *pRtlWaitOnAddress)(const volatile VOID *, PVOID, SIZE_T, PLARGE_INTEGER);
+static VOID (NTAPI *pRtlWakeAddressAll)(PVOID);
+static VOID (NTAPI *pRtlWakeAddressSingle)(PVOID);
+static VOID (NTAPI *pRtlAcquireSRWLockExclusive)(PRTL_SRWLOCK);
+static VOID (NTAPI *pRtlReleaseSRWLockExclusive)(PRTL_SRWLOCK);
+static NTSTATUS (NTAPI *pRtlSleepConditionVariableSRW)(PRTL_CONDITION_VARIABLE, PRTL_SRWLOCK, PLARGE_INTEGER, ULONG);
+static VOID (NTAPI *pRtlWakeConditionVariable)(PRTL_CONDITION_VARIABLE);
+
+static volatile LONG WaitValue;
+static volatile LONG WokenCount;
+
+static
+DWORD
+WINAPI
+WaitThread(PVOID Parameter)
+{
+    LONG Compare = 0;
+
+    while (WaitValue == Compare)
+        pRtlWaitOnAddress(&WaitValue, &Compare, sizeof(Compare), NULL);
+    InterlockedIncrement(&WokenCount);
+    return 0;
+}
+
+static
+VOID
+TestWaitWake(VOID)
+{
+    HANDLE Threads[4];
+    LARGE_INTEGER Timeout;
+    LONG Compare;
+    USHORT Short = 5, ShortCompare = 5;
+    NTSTATUS Status;
+    DWORD Start, Result;
+    ULONG i;
+
+    /* Returns right away when the value differs */
+    WaitValue = 1;
+    Compare = 0;
+    Timeout.QuadPart = -5000 * 10000LL;
+    Start = GetTickCount();
+    Status = pRtlWaitOnAddress(&WaitValue, &Compare, sizeof(Compare), &Timeout);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    ok(GetTickCount() - Start < 1000, "Waited for %lu ms\n", GetTickCount() - Start);
+
+    /* Times out when nobody wakes us */
+    Compare = 1;
+    Timeout.QuadPart = -100 * 10000LL;
+    Status = pRtlWaitOnAddress(&WaitValue, &Compare, sizeof(Compare), &Timeout);
+    ok(Status == STATUS_TIMEOUT, "Status = 0x%lx\n", Status);
+    Timeout.QuadPart = 0;
+    Status = pRtlWaitOnAddress(&WaitValue, &Compare, sizeof(Compare), &Timeout);
+    ok(Status == STATUS_TIMEOUT, "Status = 0x%lx\n", Status);
+
+    Timeout.QuadPart = -100 * 10000LL;
+    Status = pRtlWaitOnAddress(&Short, &ShortCompare, sizeof(Short), &Timeout);
+    ok(Status == STATUS_TIMEOUT, "Status = 0x%lx\n", Status);
+
+    /* Waking an address nobody waits on does nothing */
+    pRtlWakeAddressSingle((PVOID)&WaitValue);
+    pRtlWakeAddressAll((PVOID)&WaitValue);
+
+    /* Wake the waiters one by one, then all at once */
+    WaitValue = 0;
+    WokenCount = 0;
+    for (i = 0; i < RTL_NUMBER_OF(Threads); i++)
+        Threads[i] = CreateThread(NULL, 0, WaitThread, NULL, 0, NULL);
+    Sleep(200);
+    ok(WokenCount == 0, "WokenCount = %ld\n", WokenCount);
+
+    /* A wake without a change is spurious, the waiter goes back to sleep */
+    pRtlWakeAddressSingle((PVOID)&WaitValue);
+    Sleep(100);
+    ok(WokenCount == 0, "WokenCount = %ld\n", WokenCount);
+
+    WaitValue = 1;
+    pRtlWakeAddressSingle((PVOID)&WaitValue);
+    Sleep(200);
+    ok(WokenCount == 1, "WokenCount = %ld\n", WokenCount);
+
+    pRtlWakeAddressAll((PVOID)&WaitValue);
+    Result = WaitForMultipleObjects(RTL_NUMBER_OF(Threads), Threads, TRUE, 5000);
+    ok(Result == WAIT_OBJECT_0, "Result = %lu\n", Result);
+    ok(WokenCount == RTL_NUMBER_OF(Threads), "WokenCount = %ld\n", WokenCount);
+
+    for (i = 0; i < RTL_NUMBER_OF(Threads); i++)
+        CloseHandle(Threads[i]);
+}
+
+static RTL_SRWLOCK BenchLock;
+static RTL_CONDITION_VARIABLE BenchCondition;
+static volatile LONG BenchCounter;
+static LONG PingPongTurn;
+
+static
+DWORD
+WINAPI
+ContentionThread(PVOID Parameter)
+{
+    ULONG i;
+
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        pRtlAcquireSRWLockExclusive(&BenchLock);
+        BenchCounter++;
+        pRtlReleaseSRWLockExclusive(&BenchLock);
+    }
+
+    return 0;
+}
+
+static
+DWORD
+WINAPI
+PingPongThread(PVOID Parameter)
+{
+    LONG Self = (LONG)(ULONG_PTR)Parameter;
+    ULONG i;
+
+    pRtlAcquireSRWLockExclusive(&BenchLock);
+    for (i = 0; i < PINGPONG_ROUNDS; i++)
+    {
+        while (PingPongTurn != Self)
+            pRtlSleepConditionVariableSRW(&BenchCondition, &BenchLock, NULL, 0);
+        PingPongTurn = !Self;
+        pRtlWakeConditionVariable(&BenchCondition);
+    }
+    pRtlReleaseSRWLockExclusive(&BenchLock);
+
+    return 0;
+}
+
+static
+VOID
+Benchmark(VOID)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    HANDLE Threads[BENCH_THREADS];
+    ULONGLONG Ticks;
+    ULONG i;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* Many threads hammering on one lock */
+    RtlZeroMemory(&BenchLock, sizeof(BenchLock));
+    BenchCounter = 0;
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BENCH_THREADS; i++)
+        Threads[i] = CreateThread(NULL, 0, ContentionThread, NULL, 0, NULL);
+    WaitForMultipleObjects(BENCH_THREADS, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+    for (i = 0; i < BENCH_THREADS; i++)
+        CloseHandle(Threads[i]);
+
+    ok(BenchCounter == BENCH_THREADS * BENCH_ITERATIONS, "BenchCounter = %ld\n", BenchCounter);
+    Ticks = max(End.QuadPart - Start.QuadPart, 1);
+    trace("SRW lock, %u threads: %I64u acquisitions/s\n", BENCH_THREADS,
+          (ULONGLONG)BENCH_THREADS * BENCH_ITERATIONS * Frequency.QuadPart / Ticks);
+
+    /* Two threads handing a condition back and forth, every round is a handoff */
+    RtlZeroMemory(&BenchCondition, sizeof(BenchCondition));
+    PingPongTurn = 0;
+    QueryPerformanceCounter(&Start);
+    Threads[0] = CreateThread(NULL, 0, PingPongThread, (PVOID)0, 0, NULL);
+    Threads[1] = CreateThread(NULL, 0, PingPongThread, (PVOID)1, 0, NULL);
+    WaitForMultipleObjects(2, Threads, TRUE, INFINITE);
+    QueryPerformanceCounter(&End);
+    CloseHandle(Threads[0]);
+    CloseHandle(Threads[1]);
+
+    Ticks = max(End.QuadPart - Start.QuadPart, 1);
+    trace("Condition variable ping pong: %I64u handoffs/s\n",
+          (ULONGLONG)2 * PINGPONG_ROUNDS * Frequency.QuadPart / Ticks);
+}
+
+START_TEST(RtlWaitOnAddress)
+{
+    HMODULE Module;
+
+    /* ReactOS exports the Vista functions from a separate DLL */
+    Module = LoadLibraryW(L"ntdll_vista.dll");
+    if (!Module)
+        Module = GetModuleHandleW(L"ntdll.dll");
+
+    pRtlWaitOnAddress = (PVOID)GetProcAddress(Module, "RtlWaitOnAddress");
+    pRtlWakeAddressAll = (PVOID)GetProcAddress(Module, "RtlWakeAddressAll");
+    pRtlWakeAddressSingle = (PVOID)GetProcAddress(Module, "RtlWakeAddressSingle");
+    pRtlAcquireSRWLockExclusive = (PVOID)GetProcAddress(Module, "RtlAcquireSRWLockExclusive");
+    pRtlReleaseSRWLockExclusive = (PVOID)GetProcAddress(Module, "RtlReleaseSRWLockExclusive");
+    pRtlSleepConditionVariableSRW = (PVOID)GetProcAddress(Module, "RtlSleepConditionVariableSRW");
+    pRtlWakeConditionVariable = (PVOID)GetProcAddress(Module, "RtlWakeConditionVariable");
+
+    if (!pRtlWaitOnAddress || !pRtlWakeAddressAll || !pRtlWakeAddressSingle)
+    {
+        skip("RtlWaitOnAddress not available\n");
+    }
+    else
+    {
+        TestWaitWake();
+    }
+
+    if (!pRtlAcquireSRWLockExclusive || !pRtlReleaseSRWLockExclusive ||
+        !pRtlSleepConditionVariableSRW || !pRtlWakeConditionVariable)
+    {
+        skip("SRW locks not available\n");
+        return;
+    }
+
+    Benchmark();
+}
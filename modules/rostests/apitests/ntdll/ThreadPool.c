@@ -0,0 +1,502 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Tests and benchmark for the native thread pool
+ */
+
+#include "precomp.h"
+
+#define BENCH_ITEMS     20000
+#define LATENCY_LOOPS   1000
+
+typedef VOID (NTAPI *PTEST_IO_CALLBACK)(PTP_CALLBACK_INSTANCE, PVOID, PVOID, PIO_STATUS_BLOCK, PTP_IO);
+
+static NTSTATUS (NTAPI *pTpAllocCleanupGroup)(PTP_CLEANUP_GROUP *);
+static NTSTATUS (NTAPI *pTpAllocIoCompletion)(PTP_IO *, HANDLE, PTEST_IO_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static NTSTATUS (NTAPI *pTpAllocPool)(PTP_POOL *, PVOID);
+static NTSTATUS (NTAPI *pTpAllocTimer)(PTP_TIMER *, PTP_TIMER_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static NTSTATUS (NTAPI *pTpAllocWait)(PTP_WAIT *, PTP_WAIT_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static NTSTATUS (NTAPI *pTpAllocWork)(PTP_WORK *, PTP_WORK_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (NTAPI *pTpCallbackSetEventOnCompletion)(PTP_CALLBACK_INSTANCE, HANDLE);
+static VOID (NTAPI *pTpCancelAsyncIoOperation)(PTP_IO);
+static ULONG (NTAPI *pTpIsTimerSet)(PTP_TIMER);
+static VOID (NTAPI *pTpPostWork)(PTP_WORK);
+static VOID (NTAPI *pTpReleaseCleanupGroup)(PTP_CLEANUP_GROUP);
+static VOID (NTAPI *pTpReleaseCleanupGroupMembers)(PTP_CLEANUP_GROUP, BOOLEAN, PVOID);
+static VOID (NTAPI *pTpReleaseIoCompletion)(PTP_IO);
+static VOID (NTAPI *pTpReleasePool)(PTP_POOL);
+static VOID (NTAPI *pTpReleaseTimer)(PTP_TIMER);
+static VOID (NTAPI *pTpReleaseWait)(PTP_WAIT);
+static VOID (NTAPI *pTpReleaseWork)(PTP_WORK);
+static VOID (NTAPI *pTpSetPoolMaxThreads)(PTP_POOL, ULONG);
+static VOID (NTAPI *pTpSetTimer)(PTP_TIMER, PLARGE_INTEGER, ULONG, ULONG);
+static VOID (NTAPI *pTpSetWait)(PTP_WAIT, HANDLE, PLARGE_INTEGER);
+static NTSTATUS (NTAPI *pTpSimpleTryPost)(PTP_SIMPLE_CALLBACK, PVOID, PTP_CALLBACK_ENVIRON);
+static VOID (NTAPI *pTpStartAsyncIoOperation)(PTP_IO);
+static VOID (NTAPI *pTpWaitForIoCompletion)(PTP_IO, BOOLEAN);
+static VOID (NTAPI *pTpWaitForTimer)(PTP_TIMER, BOOLEAN);
+static VOID (NTAPI *pTpWaitForWait)(PTP_WAIT, BOOLEAN);
+static VOID (NTAPI *pTpWaitForWork)(PTP_WORK, BOOLEAN);
+
+static volatile LONG CallbackCount;
+static LONG CallbackTarget;
+static HANDLE DoneEvent;
+static HANDLE BlockEvent;
+static volatile LONG CancelCount;
+
+static
+VOID
+InitEnvironment(PTP_CALLBACK_ENVIRON Environment)
+{
+    RtlZeroMemory(Environment, sizeof(*Environment));
+    Environment->Version = 1;
+}
+
+static
+VOID
+NTAPI
+CountCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context)
+{
+    if (InterlockedIncrement(&CallbackCount) == CallbackTarget)
+        SetEvent(DoneEvent);
+}
+
+static
+VOID
+NTAPI
+WorkCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work)
+{
+    ok(Context == (PVOID)0x1234, "Context = %p\n", Context);
+    if (BlockEvent)
+        WaitForSingleObject(BlockEvent, INFINITE);
+    InterlockedIncrement(&CallbackCount);
+}
+
+static
+VOID
+TestWork(VOID)
+{
+    PTP_WORK Work;
+    NTSTATUS Status;
+    ULONG i;
+
+    Status = pTpAllocWork(&Work, WorkCallback, (PVOID)0x1234, NULL);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    /* Every post runs the callback once */
+    CallbackCount = 0;
+    for (i = 0; i < 100; i++)
+        pTpPostWork(Work);
+    pTpWaitForWork(Work, FALSE);
+    ok(CallbackCount == 100, "CallbackCount = %ld\n", CallbackCount);
+
+    /* Posts that did not start yet can be canceled */
+    CallbackCount = 0;
+    BlockEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    pTpPostWork(Work);
+    Sleep(100);
+    for (i = 0; i < 100; i++)
+        pTpPostWork(Work);
+    SetEvent(BlockEvent);
+    pTpWaitForWork(Work, TRUE);
+    ok(CallbackCount >= 1 && CallbackCount < 101, "CallbackCount = %ld\n", CallbackCount);
+    CloseHandle(BlockEvent);
+    BlockEvent = NULL;
+
+    pTpReleaseWork(Work);
+}
+
+static
+VOID
+NTAPI
+TimerCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer)
+{
+    if (InterlockedIncrement(&CallbackCount) == CallbackTarget)
+        pTpCallbackSetEventOnCompletion(Instance, DoneEvent);
+}
+
+static
+VOID
+TestTimer(VOID)
+{
+    LARGE_INTEGER DueTime;
+    PTP_TIMER Timer;
+    NTSTATUS Status;
+    DWORD Start, Elapsed, Result;
+
+    Status = pTpAllocTimer(&Timer, TimerCallback, NULL, NULL);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    if (!NT_SUCCESS(Status))
+        return;
+
+    ok(!pTpIsTimerSet(Timer), "Timer is set\n");
+
+    /* One shot, relative */
+    CallbackCount = 0;
+    CallbackTarget = 1;
+    ResetEvent(DoneEvent);
+    DueTime.QuadPart = -100 * 10000LL;
+    Start = GetTickCount();
+    pTpSetTimer(Timer, &DueTime, 0, 0);
+    ok(pTpIsTimerSet(Timer), "Timer is not set\n");
+    Result = WaitForSingleObject(DoneEvent, 5000);
+    Elapsed = GetTickCount() - Start;
+    ok(Result == WAIT_OBJECT_0, "Result = %lu\n", Result);
+    ok(Elapsed >= 80, "Timer fired after %lu ms\n", Elapsed);
+    pTpWaitForTimer(Timer, FALSE);
+    ok(CallbackCount == 1, "CallbackCount = %ld\n", CallbackCount);
+
+    /* Periodic, until disarmed */
+    CallbackCount = 0;
+    CallbackTarget = 5;
+    ResetEvent(DoneEvent);
+    DueTime.QuadPart = 0;
+    pTpSetTimer(Timer, &DueTime, 20, 10);
+    Result = WaitForSingleObject(DoneEvent, 5000);
+    ok(Result == WAIT_OBJECT_0, "Result = %lu\n", Result);
+    ok(pTpIsTimerSet(Timer), "Timer is not set\n");
+    pTpSetTimer(Timer, NULL, 0, 0);
+    ok(!pTpIsTimerSet(Timer), "Timer is set\n");
+    pTpWaitForTimer(Timer, TRUE);
+    CallbackTarget = CallbackCount;
+    Sleep(100);
+    ok(CallbackCount == CallbackTarget, "Timer fired after being disarmed\n");
+
+    pTpReleaseTimer(Timer);
+}
+
+static
+VOID
+NTAPI
+WaitCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WAIT Wait, TP_WAIT_RESULT WaitResult)
+{
+    *(TP_WAIT_RESULT *)Context = WaitResult;
+    if (InterlockedIncrement(&CallbackCount) == CallbackTarget)
+        SetEvent(DoneEvent);
+}
+
+static
+VOID
+TestWait(VOID)
+{
+    TP_WAIT_RESULT Results[100];
+    HANDLE Events[100];
+    PTP_WAIT Waits[100];
+    LARGE_INTEGER Timeout;
+    NTSTATUS Status;
+    DWORD Result;
+    ULONG i;
+
+    /* More waits than a single wait thread handles */
+    for (i = 0; i < RTL_NUMBER_OF(Waits); i++)
+    {
+        Events[i] = CreateEventW(NULL, FALSE, FALSE, NULL);
+        Results[i] = 0xdeadbeef;
+        Status = pTpAllocWait(&Waits[i], WaitCallback, &Results[i], NULL);
+        ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+        if (!NT_SUCCESS(Status))
+            return;
+    }
+
+    CallbackCount = 0;
+    CallbackTarget = RTL_NUMBER_OF(Waits);
+    ResetEvent(DoneEvent);
+    Timeout.QuadPart = -200 * 10000LL;
+    for (i = 0; i < RTL_NUMBER_OF(Waits); i++)
+        pTpSetWait(Waits[i], Events[i], (i & 1) ? &Timeout : NULL);
+
+    /* Signal the even ones, let the odd ones time out */
+    for (i = 0; i < RTL_NUMBER_OF(Waits); i += 2)
+        SetEvent(Events[i]);
+
+    Result = WaitForSingleObject(DoneEvent, 5000);
+    ok(Result == WAIT_OBJECT_0, "Result = %lu, %ld callbacks\n", Result, CallbackCount);
+
+    for (i = 0; i < RTL_NUMBER_OF(Waits); i++)
+    {
+        pTpWaitForWait(Waits[i], FALSE);
+        ok(Results[i] == ((i & 1) ? WAIT_TIMEOUT : WAIT_OBJECT_0), "Wait %lu: Result = %lu\n", i, Results[i]);
+    }
+
+    /* A disarmed wait does not fire */
+    CallbackCount = 0;
+    pTpSetWait(Waits[0], Events[0], NULL);
+    pTpSetWait(Waits[0], NULL, NULL);
+    SetEvent(Events[0]);
+    Sleep(100);
+    ok(CallbackCount == 0, "CallbackCount = %ld\n", CallbackCount);
+
+    for (i = 0; i < RTL_NUMBER_OF(Waits); i++)
+    {
+        pTpReleaseWait(Waits[i]);
+        CloseHandle(Events[i]);
+    }
+}
+
+static
+VOID
+NTAPI
+IoCallback(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PVOID ApcContext, PIO_STATUS_BLOCK IoStatusBlock, PTP_IO Io)
+{
+    ok(Context == (PVOID)0x5678, "Context = %p\n", Context);
+    ok(IoStatusBlock->Status == STATUS_SUCCESS, "Status = 0x%lx\n", IoStatusBlock->Status);
+    ok(IoStatusBlock->Information == 512, "Information = %lu\n", (ULONG)IoStatusBlock->Information);
+    InterlockedIncrement(&CallbackCount);
+}
+
+static
+VOID
+TestIo(VOID)
+{
+    WCHAR TempPath[MAX_PATH], FileName[MAX_PATH];
+    OVERLAPPED Overlapped[4];
+    UCHAR Buffer[512];
+    HANDLE File;
+    PTP_IO Io;
+    NTSTATUS Status;
+    ULONG i;
+
+    GetTempPathW(RTL_NUMBER_OF(TempPath), TempPath);
+    GetTempFileNameW(TempPath, L"tpo", 0, FileName);
+    File = CreateFileW(FileName, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                       FILE_FLAG_OVERLAPPED | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    ok(File != INVALID_HANDLE_VALUE, "CreateFileW failed: %lu\n", GetLastError());
+    if (File == INVALID_HANDLE_VALUE)
+        return;
+
+    Status = pTpAllocIoCompletion(&Io, File, IoCallback, (PVOID)0x5678, NULL);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    if (!NT_SUCCESS(Status))
+    {
+        CloseHandle(File);
+        return;
+    }
+
+    CallbackCount = 0;
+    RtlFillMemory(Buffer, sizeof(Buffer), 0x55);
+    RtlZeroMemory(Overlapped, sizeof(Overlapped));
+    for (i = 0; i < RTL_NUMBER_OF(Overlapped); i++)
+    {
+        Overlapped[i].Offset = i * sizeof(Buffer);
+        pTpStartAsyncIoOperation(Io);
+        if (!WriteFile(File, Buffer, sizeof(Buffer), NULL, &Overlapped[i]) &&
+            GetLastError() != ERROR_IO_PENDING)
+        {
+            ok(0, "WriteFile failed: %lu\n", GetLastError());
+            pTpCancelAsyncIoOperation(Io);
+        }
+    }
+
+    /* Synchronous completions are queued too */
+    pTpWaitForIoCompletion(Io, FALSE);
+    ok(CallbackCount == RTL_NUMBER_OF(Overlapped), "CallbackCount = %ld\n", CallbackCount);
+
+    pTpReleaseIoCompletion(Io);
+    CloseHandle(File);
+}
+
+static
+VOID
+NTAPI
+CancelCallback(PVOID ObjectContext, PVOID CleanupContext)
+{
+    ok(CleanupContext == (PVOID)0x9abc, "CleanupContext = %p\n", CleanupContext);
+    InterlockedIncrement(&CancelCount);
+}
+
+static
+VOID
+TestCleanupGroup(VOID)
+{
+    TP_CALLBACK_ENVIRON Environment;
+    PTP_CLEANUP_GROUP Group;
+    LARGE_INTEGER DueTime;
+    PTP_POOL Pool;
+    PTP_WORK Work;
+    PTP_TIMER Timer;
+    NTSTATUS Status;
+    ULONG i;
+
+    Status = pTpAllocPool(&Pool, NULL);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    if (!NT_SUCCESS(Status))
+        return;
+    pTpSetPoolMaxThreads(Pool, 1);
+
+    Status = pTpAllocCleanupGroup(&Group);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    if (!NT_SUCCESS(Status))
+    {
+        pTpReleasePool(Pool);
+        return;
+    }
+
+    InitEnvironment(&Environment);
+    Environment.Pool = Pool;
+    Environment.CleanupGroup = Group;
+    Environment.CleanupGroupCancelCallback = CancelCallback;
+
+    /* Waiting for the members runs everything that was posted */
+    CallbackCount = 0;
+    CallbackTarget = 0;
+    Status = pTpAllocWork(&Work, WorkCallback, (PVOID)0x1234, &Environment);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    for (i = 0; i < 50; i++)
+    {
+        pTpPostWork(Work);
+        pTpSimpleTryPost(CountCallback, NULL, &Environment);
+    }
+    pTpReleaseCleanupGroupMembers(Group, FALSE, NULL);
+    ok(CallbackCount == 100, "CallbackCount = %ld\n", CallbackCount);
+
+    /* Canceling calls the cancel callback for the members and disarms the timers */
+    CallbackCount = 0;
+    CancelCount = 0;
+    BlockEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    Status = pTpAllocWork(&Work, WorkCallback, (PVOID)0x1234, &Environment);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    Status = pTpAllocTimer(&Timer, TimerCallback, NULL, &Environment);
+    ok(Status == STATUS_SUCCESS, "Status = 0x%lx\n", Status);
+    DueTime.QuadPart = -10000 * 10000LL;
+    pTpSetTimer(Timer, &DueTime, 0, 0);
+    for (i = 0; i < 10; i++)
+        pTpPostWork(Work);
+    Sleep(100);
+    SetEvent(BlockEvent);
+    pTpReleaseCleanupGroupMembers(Group, TRUE, (PVOID)0x9abc);
+    ok(CallbackCount >= 1 && CallbackCount < 10, "CallbackCount = %ld\n", CallbackCount);
+    ok(CancelCount == 2, "CancelCount = %ld\n", CancelCount);
+    CloseHandle(BlockEvent);
+    BlockEvent = NULL;
+
+    pTpReleaseCleanupGroup(Group);
+    pTpReleasePool(Pool);
+}
+
+static
+DWORD
+WINAPI
+CountWorkItem(PVOID Context)
+{
+    CountCallback(NULL, Context);
+    return 0;
+}
+
+static
+VOID
+Benchmark(VOID)
+{
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG PoolTicks, WorkItemTicks;
+    ULONG i;
+
+    QueryPerformanceFrequency(&Frequency);
+
+    /* Throughput: many small callbacks */
+    CallbackCount = 0;
+    CallbackTarget = BENCH_ITEMS;
+    ResetEvent(DoneEvent);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BENCH_ITEMS; i++)
+        pTpSimpleTryPost(CountCallback, NULL, NULL);
+    WaitForSingleObject(DoneEvent, INFINITE);
+    QueryPerformanceCounter(&End);
+    PoolTicks = max(End.QuadPart - Start.QuadPart, 1);
+
+    CallbackCount = 0;
+    ResetEvent(DoneEvent);
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < BENCH_ITEMS; i++)
+        QueueUserWorkItem(CountWorkItem, NULL, WT_EXECUTEDEFAULT);
+    WaitForSingleObject(DoneEvent, INFINITE);
+    QueryPerformanceCounter(&End);
+    WorkItemTicks = max(End.QuadPart - Start.QuadPart, 1);
+
+    trace("Throughput: TpSimpleTryPost %I64u/s, QueueUserWorkItem %I64u/s\n",
+          (ULONGLONG)BENCH_ITEMS * Frequency.QuadPart / PoolTicks,
+          (ULONGLONG)BENCH_ITEMS * Frequency.QuadPart / WorkItemTicks);
+
+    /* Latency: one callback at a time, round trip through an event */
+    CallbackTarget = 1;
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < LATENCY_LOOPS; i++)
+    {
+        CallbackCount = 0;
+        pTpSimpleTryPost(CountCallback, NULL, NULL);
+        WaitForSingleObject(DoneEvent, INFINITE);
+    }
+    QueryPerformanceCounter(&End);
+    PoolTicks = max(End.QuadPart - Start.QuadPart, 1);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < LATENCY_LOOPS; i++)
+    {
+        CallbackCount = 0;
+        QueueUserWorkItem(CountWorkItem, NULL, WT_EXECUTEDEFAULT);
+        WaitForSingleObject(DoneEvent, INFINITE);
+    }
+    QueryPerformanceCounter(&End);
+    WorkItemTicks = max(End.QuadPart - Start.QuadPart, 1);
+
+    trace("Latency: TpSimpleTryPost %I64u us, QueueUserWorkItem %I64u us\n",
+          PoolTicks * 1000000 / Frequency.QuadPart / LATENCY_LOOPS,
+          WorkItemTicks * 1000000 / Frequency.QuadPart / LATENCY_LOOPS);
+}
+
+#define LOAD_FUNCTION(Name) \
+    p##Name = (PVOID)GetProcAddress(Module, #Name); \
+    if (!p##Name) \
+    { \
+        skip("%s not available\n", #Name); \
+        return; \
+    }
+
+START_TEST(ThreadPool)
+{
+    HMODULE Module;
+
+    /* ReactOS exports the Vista functions from a separate DLL */
+    Module = LoadLibraryW(L"ntdll_vista.dll");
+    if (!Module)
+        Module = GetModuleHandleW(L"ntdll.dll");
+
+    LOAD_FUNCTION(TpAllocCleanupGroup);
+    LOAD_FUNCTION(TpAllocIoCompletion);
+    LOAD_FUNCTION(TpAllocPool);
+    LOAD_FUNCTION(TpAllocTimer);
+    LOAD_FUNCTION(TpAllocWait);
+    LOAD_FUNCTION(TpAllocWork);
+    LOAD_FUNCTION(TpCallbackSetEventOnCompletion);
+    LOAD_FUNCTION(TpCancelAsyncIoOperation);
+    LOAD_FUNCTION(TpIsTimerSet);
+    LOAD_FUNCTION(TpPostWork);
+    LOAD_FUNCTION(TpReleaseCleanupGroup);
+    LOAD_FUNCTION(TpReleaseCleanupGroupMembers);
+    LOAD_FUNCTION(TpReleaseIoCompletion);
+    LOAD_FUNCTION(TpReleasePool);
+    LOAD_FUNCTION(TpReleaseTimer);
+    LOAD_FUNCTION(TpReleaseWait);
+    LOAD_FUNCTION(TpReleaseWork);
+    LOAD_FUNCTION(TpSetPoolMaxThreads);
+    LOAD_FUNCTION(TpSetTimer);
+    LOAD_FUNCTION(TpSetWait);
+    LOAD_FUNCTION(TpSimpleTryPost);
+    LOAD_FUNCTION(TpStartAsyncIoOperation);
+    LOAD_FUNCTION(TpWaitForIoCompletion);
+    LOAD_FUNCTION(TpWaitForTimer);
+    LOAD_FUNCTION(TpWaitForWait);
+    LOAD_FUNCTION(TpWaitForWork);
+
+    DoneEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+
+    TestWork();
+    TestTimer();
+    TestWait();
+    TestIo();
+    TestCleanupGroup();
+    Benchmark();
+
+    CloseHandle(DoneEvent);
+}
@@ -0,0 +1,231 @@
+/*
+ * PROJECT:     ReactOS API Tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Unit Tests and benchmark for the tcpip FIB lookup trie
+ */
+
+#include <apitest.h>
+
+#define UNIT_TEST
+#include <fibtrie.h>
+
+/* Kernel definitions (mock) */
+#ifndef ASSERT
+#define ASSERT(x) ok((x), "Assertion failed: %s\n", #x)
+#endif
+
+#define FIB_TAG 'BIF '
+#define NonPagedPool 0
+
+static
+PVOID
+ExAllocatePoolWithTag(ULONG PoolType, SIZE_T NumberOfBytes, ULONG Tag)
+{
+    PVOID *Mem;
+
+    Mem = HeapAlloc(GetProcessHeap(), 0, NumberOfBytes + 2 * sizeof(PVOID));
+    if (!Mem)
+        return NULL;
+    Mem[0] = (PVOID)NumberOfBytes;
+    Mem[1] = (PVOID)(ULONG_PTR)Tag;
+    return Mem + 2;
+}
+
+static
+VOID
+ExFreePoolWithTag(PVOID MemPtr, ULONG Tag)
+{
+    PVOID *Mem = MemPtr;
+
+    Mem -= 2;
+    ok(Mem[1] == (PVOID)(ULONG_PTR)Tag, "Tag is %lx, expected %p\n", Tag, Mem[1]);
+    HeapFree(GetProcessHeap(), 0, Mem);
+}
+
+#include "../../../../sdk/lib/drivers/ip/network/fibtrie.c"
+
+#define MAX_ROUTES 4096
+#define LOOKUP_COUNT 100000
+
+static FIB_TRIE_ROUTE Routes[MAX_ROUTES];
+static BOOLEAN Usable[MAX_ROUTES];
+static ULONG RandomSeed;
+
+static
+ULONG
+Random(VOID)
+{
+    RandomSeed = RandomSeed * 1664525 + 1013904223;
+    return RandomSeed;
+}
+
+static
+BOOLEAN
+IsUsable(PVOID Context)
+{
+    return Usable[(PFIB_TRIE_ROUTE)Context - Routes];
+}
+
+/* What the trie is supposed to find, the slow way */
+static
+PVOID
+LinearLookup(ULONG RouteCount, ULONG Address, BOOLEAN CheckUsable)
+{
+    PFIB_TRIE_ROUTE Best = NULL, BestUsable = NULL;
+    ULONG i;
+
+    for (i = 0; i < RouteCount; i++)
+    {
+        if ((Address ^ Routes[i].Prefix) & FibTrieMask(Routes[i].Length))
+            continue;
+
+        if (!Best || Routes[i].Length > Best->Length ||
+            (Routes[i].Length == Best->Length && Routes[i].Metric < Best->Metric))
+        {
+            Best = &Routes[i];
+        }
+
+        if (CheckUsable && Usable[i] &&
+            (!BestUsable || Routes[i].Length > BestUsable->Length ||
+             (Routes[i].Length == BestUsable->Length && Routes[i].Metric < BestUsable->Metric)))
+        {
+            BestUsable = &Routes[i];
+        }
+    }
+
+    return BestUsable ? BestUsable : Best;
+}
+
+static
+VOID
+AddRoute(ULONG Index, ULONG Prefix, UCHAR Length, UINT Metric)
+{
+    Routes[Index].Prefix = Prefix;
+    Routes[Index].Length = Length;
+    Routes[Index].Metric = Metric;
+    Routes[Index].Context = &Routes[Index];
+    Usable[Index] = TRUE;
+}
+
+static
+VOID
+TestBasic(VOID)
+{
+    PFIB_TRIE Trie;
+
+    /* No routes at all */
+    Trie = FibTrieBuild(Routes, 0);
+    ok(Trie != NULL, "FibTrieBuild failed\n");
+    if (!Trie)
+        return;
+    ok(FibTrieLookup(Trie, 0x0A000001, NULL) == NULL, "Found a route in an empty trie\n");
+    FibTrieFree(Trie);
+
+    AddRoute(0, 0x00000000, 0, 10);     /* 0.0.0.0/0 */
+    AddRoute(1, 0x0A000000, 8, 10);     /* 10.0.0.0/8 */
+    AddRoute(2, 0x0A010000, 16, 10);    /* 10.1.0.0/16 */
+    AddRoute(3, 0x0A010203, 32, 10);    /* 10.1.2.3/32 */
+    AddRoute(4, 0x0A010000, 16, 5);     /* 10.1.0.0/16, cheaper */
+    AddRoute(5, 0xC0A80000, 16, 10);    /* 192.168.0.0/16 */
+    AddRoute(6, 0x0A01FFFF, 16, 10);    /* Host bits set, same as 10.1.0.0/16 */
+
+    Trie = FibTrieBuild(Routes, 7);
+    ok(Trie != NULL, "FibTrieBuild failed\n");
+    if (!Trie)
+        return;
+
+    ok(FibTrieLookup(Trie, 0x0B000001, NULL) == &Routes[0], "Expected the default route\n");
+    ok(FibTrieLookup(Trie, 0x0A020304, NULL) == &Routes[1], "Expected 10.0.0.0/8\n");
+    ok(FibTrieLookup(Trie, 0x0A010204, NULL) == &Routes[4], "Expected the cheapest 10.1.0.0/16\n");
+    ok(FibTrieLookup(Trie, 0x0A010203, NULL) == &Routes[3], "Expected 10.1.2.3/32\n");
+    ok(FibTrieLookup(Trie, 0xC0A80101, NULL) == &Routes[5], "Expected 192.168.0.0/16\n");
+
+    /* Unusable routes are skipped, unless nothing else matches */
+    Usable[3] = FALSE;
+    Usable[4] = FALSE;
+    ok(FibTrieLookup(Trie, 0x0A010203, IsUsable) == &Routes[2], "Expected the usable 10.1.0.0/16\n");
+    Usable[0] = Usable[1] = Usable[2] = Usable[6] = FALSE;
+    ok(FibTrieLookup(Trie, 0x0A010203, IsUsable) == &Routes[3], "Expected the longest match\n");
+
+    FibTrieFree(Trie);
+}
+
+static
+VOID
+TestRandom(ULONG RouteCount)
+{
+    PFIB_TRIE Trie;
+    ULONG i, Address, Mismatches = 0;
+    ULONG Addresses[64];
+    PVOID Found, Expected;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG TrieTime, LinearTime;
+    volatile PVOID Sink;
+
+    RandomSeed = RouteCount;
+
+    /* Cluster the routes so that prefixes nest, like real tables do */
+    for (i = 0; i < RouteCount; i++)
+    {
+        AddRoute(i,
+                 Random() & 0xC0FFFFFF,
+                 (UCHAR)(i % 8 == 0 ? Random() % 8 : 8 + Random() % 25),
+                 Random() % 4);
+        Usable[i] = (Random() % 4) != 0;
+        if (i < RTL_NUMBER_OF(Addresses))
+            Addresses[i] = Routes[i].Prefix;
+    }
+
+    Trie = FibTrieBuild(Routes, RouteCount);
+    ok(Trie != NULL, "FibTrieBuild failed\n");
+    if (!Trie)
+        return;
+    ok(Trie->NodeCount <= 2 * RouteCount, "%lu nodes for %lu routes\n", Trie->NodeCount, RouteCount);
+
+    for (i = 0; i < LOOKUP_COUNT / 10; i++)
+    {
+        /* Mix addresses close to the routes with random ones */
+        Address = (i & 1) ? Random() : Routes[Random() % RouteCount].Prefix ^ (Random() & 0xFF);
+
+        Found = FibTrieLookup(Trie, Address, NULL);
+        Expected = LinearLookup(RouteCount, Address, FALSE);
+        if (Found != Expected)
+            Mismatches++;
+
+        Found = FibTrieLookup(Trie, Address, IsUsable);
+        Expected = LinearLookup(RouteCount, Address, TRUE);
+        if (Found != Expected)
+            Mismatches++;
+    }
+    ok(Mismatches == 0, "%lu routes: %lu mismatches\n", RouteCount, Mismatches);
+
+    /* Compare the lookup cost with the old linear scan */
+    QueryPerformanceFrequency(&Frequency);
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < LOOKUP_COUNT; i++)
+        Sink = FibTrieLookup(Trie, Addresses[i % min(RouteCount, RTL_NUMBER_OF(Addresses))] + i, IsUsable);
+    QueryPerformanceCounter(&End);
+    TrieTime = (End.QuadPart - Start.QuadPart) * 1000000000ULL / Frequency.QuadPart / LOOKUP_COUNT;
+
+    QueryPerformanceCounter(&Start);
+    for (i = 0; i < LOOKUP_COUNT / 10; i++)
+        Sink = LinearLookup(RouteCount, Addresses[i % min(RouteCount, RTL_NUMBER_OF(Addresses))] + i, TRUE);
+    QueryPerformanceCounter(&End);
+    LinearTime = (End.QuadPart - Start.QuadPart) * 1000000000ULL / Frequency.QuadPart / (LOOKUP_COUNT / 10);
+
+    trace("%4lu routes, %5lu nodes: trie %I64u ns/lookup, linear scan %I64u ns/lookup\n",
+          RouteCount, Trie->NodeCount, TrieTime, LinearTime);
+
+    FibTrieFree(Trie);
+}
+
+START_TEST(FibTrie)
+{
+    ULONG RouteCount;
+
+    TestBasic();
+
+    for (RouteCount = 1; RouteCount <= MAX_ROUTES; RouteCount *= 4)
+        TestRandom(RouteCount);
+}
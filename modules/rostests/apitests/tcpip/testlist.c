@@ -0,0 +1,10 @@
+#define STANDALONE
+#include <apitest.h>
+
+extern void func_FibTrie(void);
+
+const struct test winetest_testlist[] =
+{
+    { "FibTrie", func_FibTrie },
+    { 0, 0 }
+};
@@ -0,0 +1,228 @@
+/*
+ * PROJECT:     ReactOS kernel-mode tests
+ * LICENSE:     LGPL-2.1-or-later (https://spdx.org/licenses/LGPL-2.1-or-later)
+ * PURPOSE:     Kernel-Mode Test Suite FAT cluster allocation test
+ */
+
+#include <kmt_test.h>
+
+#define CHUNK_SIZE          (64 * 1024)
+#define SEQUENTIAL_CHUNKS   128
+#define INTERLEAVED_CHUNKS  64
+#define MAX_EXTENTS         512
+
+static PVOID Chunk;
+
+static
+HANDLE
+CreateTestFile(
+    _In_ PCWSTR Name)
+{
+    NTSTATUS Status;
+    HANDLE Handle;
+    UNICODE_STRING FileName;
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatus;
+
+    RtlInitUnicodeString(&FileName, Name);
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+    Status = ZwCreateFile(&Handle,
+                          GENERIC_WRITE | SYNCHRONIZE | DELETE,
+                          &ObjectAttributes,
+                          &IoStatus,
+                          NULL,
+                          FILE_ATTRIBUTE_NORMAL,
+                          0,
+                          FILE_SUPERSEDE,
+                          FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE |
+                          FILE_WRITE_THROUGH | FILE_DELETE_ON_CLOSE,
+                          NULL,
+                          0);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return NULL;
+
+    return Handle;
+}
+
+static
+BOOLEAN
+AppendChunk(
+    _In_ HANDLE Handle)
+{
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    LARGE_INTEGER Offset;
+
+    Offset.u.LowPart = FILE_WRITE_TO_END_OF_FILE;
+    Offset.u.HighPart = -1;
+    Status = ZwWriteFile(Handle, NULL, NULL, NULL, &IoStatus, Chunk, CHUNK_SIZE, &Offset, NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    return NT_SUCCESS(Status);
+}
+
+static
+ULONG
+CountExtents(
+    _In_ HANDLE Handle)
+{
+    NTSTATUS Status;
+    IO_STATUS_BLOCK IoStatus;
+    STARTING_VCN_INPUT_BUFFER StartingVcn;
+    PRETRIEVAL_POINTERS_BUFFER Pointers;
+    ULONG Size, Extents;
+
+    Size = FIELD_OFFSET(RETRIEVAL_POINTERS_BUFFER, Extents[MAX_EXTENTS]);
+    Pointers = ExAllocatePoolWithTag(PagedPool, Size, 'tFmK');
+    if (skip(Pointers != NULL, "No memory for %lu extents\n", MAX_EXTENTS))
+        return 0;
+
+    StartingVcn.StartingVcn.QuadPart = 0;
+    Status = ZwFsControlFile(Handle,
+                             NULL,
+                             NULL,
+                             NULL,
+                             &IoStatus,
+                             FSCTL_GET_RETRIEVAL_POINTERS,
+                             &StartingVcn,
+                             sizeof(StartingVcn),
+                             Pointers,
+                             Size);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    Extents = NT_SUCCESS(Status) ? Pointers->ExtentCount : 0;
+
+    ExFreePoolWithTag(Pointers, 'tFmK');
+    return Extents;
+}
+
+static
+VOID
+TestSequential(VOID)
+{
+    HANDLE Handle;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONGLONG Ticks;
+    ULONG i, Extents;
+
+    Handle = CreateTestFile(L"\\SystemRoot\\kmtest_fat1.tmp");
+    if (!Handle)
+        return;
+
+    Start = KeQueryPerformanceCounter(&Frequency);
+    for (i = 0; i < SEQUENTIAL_CHUNKS; i++)
+    {
+        if (!AppendChunk(Handle))
+            break;
+    }
+    End = KeQueryPerformanceCounter(NULL);
+
+    Ticks = max(End.QuadPart - Start.QuadPart, 1);
+    trace("Sequential write: %I64u KB/s\n",
+          (ULONGLONG)i * (CHUNK_SIZE / 1024) * Frequency.QuadPart / Ticks);
+
+    Extents = CountExtents(Handle);
+    trace("Sequential write: %lu extents for %lu chunks\n", Extents, i);
+    ok(Extents != 0 && Extents <= SEQUENTIAL_CHUNKS / 4,
+       "%lu extents for %lu chunks\n", Extents, i);
+
+    ZwClose(Handle);
+}
+
+static
+VOID
+TestInterleaved(VOID)
+{
+    HANDLE Handles[2];
+    ULONG i, Extents;
+
+    /* Two files growing side by side should not end up interleaved on disk */
+    Handles[0] = CreateTestFile(L"\\SystemRoot\\kmtest_fat2.tmp");
+    Handles[1] = CreateTestFile(L"\\SystemRoot\\kmtest_fat3.tmp");
+    if (Handles[0] && Handles[1])
+    {
+        for (i = 0; i < INTERLEAVED_CHUNKS; i++)
+        {
+            if (!AppendChunk(Handles[0]) || !AppendChunk(Handles[1]))
+                break;
+        }
+
+        for (i = 0; i < RTL_NUMBER_OF(Handles); i++)
+        {
+            Extents = CountExtents(Handles[i]);
+            trace("Interleaved write, file %lu: %lu extents for %lu chunks\n",
+                  i, Extents, INTERLEAVED_CHUNKS);
+            ok(Extents != 0 && Extents <= INTERLEAVED_CHUNKS / 2,
+               "%lu extents for %lu chunks\n", Extents, INTERLEAVED_CHUNKS);
+        }
+    }
+
+    if (Handles[0]) ZwClose(Handles[0]);
+    if (Handles[1]) ZwClose(Handles[1]);
+}
+
+static
+BOOLEAN
+IsFatVolume(VOID)
+{
+    NTSTATUS Status;
+    HANDLE Handle;
+    UNICODE_STRING FileName = RTL_CONSTANT_STRING(L"\\SystemRoot");
+    OBJECT_ATTRIBUTES ObjectAttributes;
+    IO_STATUS_BLOCK IoStatus;
+    struct
+    {
+        FILE_FS_ATTRIBUTE_INFORMATION Info;
+        WCHAR Buffer[16];
+    } Attributes;
+    UNICODE_STRING Name, Fat = RTL_CONSTANT_STRING(L"FAT");
+
+    InitializeObjectAttributes(&ObjectAttributes,
+                               &FileName,
+                               OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+    Status = ZwOpenFile(&Handle,
+                        FILE_READ_ATTRIBUTES | SYNCHRONIZE,
+                        &ObjectAttributes,
+                        &IoStatus,
+                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                        FILE_SYNCHRONOUS_IO_NONALERT | FILE_DIRECTORY_FILE);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return FALSE;
+
+    Status = ZwQueryVolumeInformationFile(Handle,
+                                          &IoStatus,
+                                          &Attributes,
+                                          sizeof(Attributes),
+                                          FileFsAttributeInformation);
+    ZwClose(Handle);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+    if (!NT_SUCCESS(Status))
+        return FALSE;
+
+    Name.Buffer = Attributes.Info.FileSystemName;
+    Name.Length = Name.MaximumLength = (USHORT)Attributes.Info.FileSystemNameLength;
+    trace("System volume is %wZ\n", &Name);
+    return RtlPrefixUnicodeString(&Fat, &Name, TRUE);
+}
+
+START_TEST(FatAllocation)
+{
+    if (skip(IsFatVolume(), "System volume is not FAT\n"))
+        return;
+
+    Chunk = ExAllocatePoolWithTag(PagedPool, CHUNK_SIZE, 'tFmK');
+    if (skip(Chunk != NULL, "No memory for the write buffer\n"))
+        return;
+    RtlFillMemory(Chunk, CHUNK_SIZE, 0x5a);
+
+    TestSequential();
+    TestInterleaved();
+
+    ExFreePoolWithTag(Chunk, 'tFmK');
+}
@@ -0,0 +1,136 @@
+/*
+ * PROJECT:     ReactOS kernel-mode tests
+ * LICENSE:     LGPL-2.1+ (https://spdx.org/licenses/LGPL-2.1+)
+ * PURPOSE:     Kernel-Mode Test Suite multiprocessor dispatcher test
+ */
+
+#include <kmt_test.h>
+
+#define NDEBUG
+#include <debug.h>
+
+#define MAX_WORKERS 32
+#define WORK_ITERATIONS 20000000UL
+
+typedef struct _SCHED_WORKER
+{
+    KEVENT *StartEvent;
+    ULONG Iterations;
+    volatile ULONG Result;
+    KAFFINITY ProcessorsSeen;
+} SCHED_WORKER, *PSCHED_WORKER;
+
+static
+VOID
+NTAPI
+WorkerThread(
+    _In_ PVOID Context)
+{
+    PSCHED_WORKER Worker = Context;
+    NTSTATUS Status;
+    ULONG i;
+    ULONG Value = 1;
+
+    Status = KeWaitForSingleObject(Worker->StartEvent, Executive, KernelMode, FALSE, NULL);
+    ok_eq_hex(Status, STATUS_SUCCESS);
+
+    /* Burn CPU, remembering every processor we were dispatched on */
+    for (i = 0; i < Worker->Iterations; i++)
+    {
+        Value = Value * 1664525 + 1013904223;
+        if ((i & 0xFFFF) == 0)
+            Worker->ProcessorsSeen |= (KAFFINITY)1 << KeGetCurrentProcessorNumber();
+    }
+    Worker->Result = Value;
+}
+
+static
+ULONG
+CountProcessors(
+    _In_ KAFFINITY Set)
+{
+    ULONG Count = 0;
+
+    while (Set)
+    {
+        Set &= Set - 1;
+        Count++;
+    }
+    return Count;
+}
+
+static
+ULONGLONG
+RunWorkers(
+    _In_ ULONG WorkerCount,
+    _Out_ PKAFFINITY ProcessorsUsed)
+{
+    SCHED_WORKER Workers[MAX_WORKERS];
+    PKTHREAD Threads[MAX_WORKERS];
+    KEVENT StartEvent;
+    LARGE_INTEGER Frequency, Start, End;
+    ULONG i;
+
+    KeInitializeEvent(&StartEvent, NotificationEvent, FALSE);
+
+    for (i = 0; i < WorkerCount; i++)
+    {
+        Workers[i].StartEvent = &StartEvent;
+        Workers[i].Iterations = WORK_ITERATIONS;
+        Workers[i].Result = 0;
+        Workers[i].ProcessorsSeen = 0;
+        Threads[i] = KmtStartThread(WorkerThread, &Workers[i]);
+    }
+
+    /* Release everyone at once and wait for them to finish */
+    Start = KeQueryPerformanceCounter(&Frequency);
+    KeSetEvent(&StartEvent, IO_NO_INCREMENT, FALSE);
+    *ProcessorsUsed = 0;
+    for (i = 0; i < WorkerCount; i++)
+    {
+        KmtFinishThread(Threads[i], NULL);
+        ok(Workers[i].Result != 0, "[%lu] Worker %lu did not run\n", WorkerCount, i);
+        *ProcessorsUsed |= Workers[i].ProcessorsSeen;
+    }
+    End = KeQueryPerformanceCounter(NULL);
+
+    /* Return the elapsed time in microseconds */
+    return (End.QuadPart - Start.QuadPart) * 1000000ULL / Frequency.QuadPart;
+}
+
+START_TEST(KeScheduler)
+{
+    ULONG ProcessorCount;
+    ULONG WorkerCount;
+    ULONGLONG Elapsed, BaseElapsed = 0;
+    ULONGLONG Throughput;
+    KAFFINITY ProcessorsUsed;
+
+    ProcessorCount = min(KeNumberProcessors, MAX_WORKERS);
+    trace("Running on %lu processor(s)\n", ProcessorCount);
+    if (skip(ProcessorCount > 1, "Need more than one processor to check scaling\n"))
+        return;
+
+    /* Run one CPU-bound worker per processor, growing the worker count */
+    for (WorkerCount = 1; WorkerCount <= ProcessorCount; WorkerCount++)
+    {
+        Elapsed = RunWorkers(WorkerCount, &ProcessorsUsed);
+        if (Elapsed == 0)
+            Elapsed = 1;
+        if (WorkerCount == 1)
+            BaseElapsed = Elapsed;
+
+        /* Work items per second, in units of the single worker run */
+        Throughput = WorkerCount * BaseElapsed * 100 / Elapsed;
+        trace("%lu worker(s): %I64u us, %lu processor(s) used, throughput %I64u%%\n",
+              WorkerCount, Elapsed, CountProcessors(ProcessorsUsed), Throughput);
+
+        /* With enough idle processors, the workers must spread out */
+        if (WorkerCount > 1)
+        {
+            ok(CountProcessors(ProcessorsUsed) > 1,
+               "[%lu] Workers only ran on processor set 0x%lx\n",
+               WorkerCount, (ULONG)ProcessorsUsed);
+        }
+    }
+}
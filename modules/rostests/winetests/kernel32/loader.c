@@ -3681,6 +3681,10 @@ static ULONG hash_basename(const WCHAR *basename)
                             NtCurrentTeb()->Peb->OSMajorVersion);
     ULONG hash = 0;
 
+#ifdef __REACTOS__
+    /* ReactOS hashes the whole name like Windows 8, whatever version it reports */
+    version = 0x0602;
+#endif
     if (version >= 0x0602)
     {
         for (; *basename; basename++)
@@ -3705,6 +3709,19 @@ static void test_HashLinks(void)
     LIST_ENTRY *hash_map, *entry, *mark;
     LDR_MODULE *module;
     BOOL found;
+#ifdef __REACTOS__
+    ULONG count = 0;
+
+    /* The table has 32 buckets until more than 64 modules are loaded, then it grows */
+    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
+    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
+        count++;
+    if (count > 64)
+    {
+        skip("%lu modules loaded, the hash table may have grown\n", count);
+        return;
+    }
+#endif
 
     entry = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
     entry = entry->Flink;
@@ -20,6 +20,9 @@ MM_SYSTEMSIZE CcCapturedSystemSize;
 
 static ULONG BugCheckFileId = 0x4 << 16;
 
+/* Largest read ahead window, per private cache map */
+#define CC_MAX_READ_AHEAD (4 * VACB_MAPPING_GRANULARITY)
+
 /* FUNCTIONS *****************************************************************/
 
 CODE_SEG("INIT")
@@ -150,8 +153,41 @@ CcRemapBcb (
     return 0;
 }
 
+/* First window of a sequential stream: a few times the request,
+ * so that small reads quickly get a useful window
+ */
+static
+ULONG
+CcpInitialReadAheadSize(
+    IN ULONG Length)
+{
+    ULONG Size;
+
+    for (Size = PAGE_SIZE; Size < Length && Size < CC_MAX_READ_AHEAD; Size <<= 1);
+
+    if (Size <= CC_MAX_READ_AHEAD / 32)
+        return Size * 4;
+    if (Size <= CC_MAX_READ_AHEAD / 4)
+        return Size * 2;
+    return CC_MAX_READ_AHEAD;
+}
+
+/* Each time the stream goes on, the window grows, fast while it is small */
+static
+ULONG
+CcpNextReadAheadSize(
+    IN ULONG Size)
+{
+    if (Size < CC_MAX_READ_AHEAD / 16)
+        Size *= 4;
+    else
+        Size *= 2;
+
+    return min(Size, CC_MAX_READ_AHEAD);
+}
+
 /*
- * @unimplemented
+ * @implemented
  */
 VOID
 NTAPI
@@ -162,9 +198,12 @@ CcScheduleReadAhead (
 	)
 {
     KIRQL OldIrql;
-    LARGE_INTEGER NewOffset;
+    LONGLONG ReaderStart, ReaderEnd, Stride;
+    LONGLONG WindowStart, WindowEnd, NewOffset, NewEnd;
+    ULONG WindowLength, NewLength, Granularity;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
     PPRIVATE_CACHE_MAP PrivateCacheMap;
+    PWORK_QUEUE_ENTRY WorkItem;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     PrivateCacheMap = FileObject->PrivateCacheMap;
@@ -176,82 +215,175 @@ CcScheduleReadAhead (
         return;
     }
 
-    /* Round read length with read ahead mask */
-    Length = ROUND_UP(Length, PrivateCacheMap->ReadAheadMask + 1);
-    /* Compute the offset we'll reach */
-    NewOffset.QuadPart = FileOffset->QuadPart + Length;
+    Granularity = PrivateCacheMap->ReadAheadMask + 1;
+    ReaderStart = FileOffset->QuadPart;
+    ReaderEnd = ReaderStart + Length;
 
     /* Lock read ahead spin lock */
     KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
-    /* Easy case: the file is sequentially read */
-    if (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY))
+
+    /* The worker reads what is in ReadAheadOffset/Length when it starts,
+     * don't change it under its feet. The next read will get us back here.
+     */
+    if (PrivateCacheMap->Flags.ReadAheadActive)
+    {
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* ReadAheadOffset[1]/Length[1] is the last window we read ahead,
+     * ReadAheadOffset[0]/Length[0] is only used for strided reads.
+     * FileOffset2/BeyondLastByte2 is the previous read, and
+     * FileOffset1/BeyondLastByte1 the one before.
+     */
+    WindowStart = PrivateCacheMap->ReadAheadOffset[1].QuadPart;
+    WindowLength = PrivateCacheMap->ReadAheadLength[1];
+    WindowEnd = WindowStart + WindowLength;
+    Stride = ReaderStart - PrivateCacheMap->FileOffset2.QuadPart;
+    PrivateCacheMap->ReadAheadLength[0] = 0;
+
+    /* Going forward, right after the previous read */
+    if (ReaderStart >= PrivateCacheMap->FileOffset2.QuadPart &&
+        (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY) ||
+         ReaderStart <= ROUND_UP(PrivateCacheMap->BeyondLastByte2.QuadPart, Granularity)))
     {
-        /* If we went backward, this is no go! */
-        if (NewOffset.QuadPart < PrivateCacheMap->ReadAheadOffset[1].QuadPart)
+        if (WindowLength != 0 && ReaderEnd < WindowEnd && ReaderEnd + WindowLength >= WindowStart)
         {
-            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            return;
+            /* More than half a window is already read ahead of us */
+            if (WindowEnd - ReaderEnd > WindowLength / 2)
+            {
+                KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+                return;
+            }
+
+            /* Read the next window while this one is consumed */
+            NewOffset = WindowEnd;
+            NewLength = CcpNextReadAheadSize(WindowLength);
+        }
+        else if (WindowLength != 0 && ReaderStart <= WindowEnd && ReaderEnd >= WindowEnd)
+        {
+            /* The reader caught up with us, the window is too small */
+            NewOffset = ReaderEnd;
+            NewLength = CcpNextReadAheadSize(WindowLength);
+        }
+        else
+        {
+            /* New stream */
+            NewOffset = ReaderEnd;
+            NewLength = CcpInitialReadAheadSize(Length);
+            if (BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY))
+            {
+                NewLength = CC_MAX_READ_AHEAD;
+            }
         }
-
-        /* FIXME: hackish, but will do the job for now */
-        PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-        PrivateCacheMap->ReadAheadLength[1] = Length;
     }
-    /* Other cases: try to find some logic in that mess... */
-    else
+    /* Going backward, right before the previous read */
+    else if (PrivateCacheMap->BeyondLastByte2.QuadPart != 0 &&
+             !BooleanFlagOn(FileObject->Flags, FO_SEQUENTIAL_ONLY) &&
+             ReaderEnd <= PrivateCacheMap->FileOffset2.QuadPart &&
+             ReaderEnd + Granularity > PrivateCacheMap->FileOffset2.QuadPart)
     {
-        /* Let's check if we always read the same way (like going down in the file)
-         * and pretend it's enough for now
-         */
-        if (PrivateCacheMap->FileOffset2.QuadPart >= PrivateCacheMap->FileOffset1.QuadPart &&
-            FileOffset->QuadPart >= PrivateCacheMap->FileOffset2.QuadPart)
+        if (WindowLength != 0 && ReaderStart > WindowStart && ReaderStart <= WindowEnd + WindowLength)
+        {
+            if (ReaderStart - WindowStart > WindowLength / 2)
+            {
+                KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+                return;
+            }
+
+            NewEnd = WindowStart;
+            NewLength = CcpNextReadAheadSize(WindowLength);
+        }
+        else if (WindowLength != 0 && ReaderStart <= WindowStart && ReaderEnd >= WindowStart)
         {
-            /* FIXME: hackish, but will do the job for now */
-            PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset.QuadPart;
-            PrivateCacheMap->ReadAheadLength[1] = Length;
+            NewEnd = ReaderStart;
+            NewLength = CcpNextReadAheadSize(WindowLength);
         }
         else
         {
-            /* FIXME: handle the other cases */
-            KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
-            UNIMPLEMENTED_ONCE;
-            return;
+            NewEnd = ReaderStart;
+            NewLength = CcpInitialReadAheadSize(Length);
         }
+
+        NewOffset = max(NewEnd - (LONGLONG)NewLength, 0);
+        NewLength = (ULONG)(NewEnd - NewOffset);
     }
+    /* Same distance between the last three reads, in either direction:
+     * read the next two records
+     */
+    else if (PrivateCacheMap->BeyondLastByte1.QuadPart != 0 &&
+             Stride == PrivateCacheMap->FileOffset2.QuadPart - PrivateCacheMap->FileOffset1.QuadPart &&
+             (Stride > (LONGLONG)Length || -Stride > (LONGLONG)Length))
+    {
+        NewLength = min(ROUND_UP(Length, Granularity), CC_MAX_READ_AHEAD);
+        NewOffset = ReaderStart + 2 * Stride;
 
-    /* If read ahead isn't active yet */
-    if (!PrivateCacheMap->Flags.ReadAheadActive)
+        if (ReaderStart + Stride >= 0)
+        {
+            NewEnd = ROUND_UP(ReaderStart + Stride + NewLength, Granularity);
+            PrivateCacheMap->ReadAheadOffset[0].QuadPart = ROUND_DOWN(ReaderStart + Stride, Granularity);
+            PrivateCacheMap->ReadAheadLength[0] = (ULONG)(NewEnd - PrivateCacheMap->ReadAheadOffset[0].QuadPart);
+        }
+        if (NewOffset < 0)
+        {
+            NewLength = 0;
+            NewOffset = 0;
+        }
+    }
+    /* No pattern: forget about the windows */
+    else
     {
-        PWORK_QUEUE_ENTRY WorkItem;
+        PrivateCacheMap->ReadAheadLength[1] = 0;
+        KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
+
+    /* Round the window with read ahead mask */
+    NewEnd = ROUND_UP(NewOffset + NewLength, Granularity);
+    NewOffset = ROUND_DOWN(NewOffset, Granularity);
+    PrivateCacheMap->ReadAheadOffset[1].QuadPart = NewOffset;
+    PrivateCacheMap->ReadAheadLength[1] = (NewLength != 0 ? (ULONG)(NewEnd - NewOffset) : 0);
 
-        /* It's active now!
-         * Be careful with the mask, you don't want to mess with node code
-         */
-        InterlockedOr((volatile long *)&PrivateCacheMap->UlongFlags, PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
+    /* Nothing to read before the beginning or past the end of the file */
+    if ((PrivateCacheMap->ReadAheadLength[1] == 0 ||
+         NewOffset >= SharedCacheMap->FileSize.QuadPart) &&
+        PrivateCacheMap->ReadAheadLength[0] == 0)
+    {
         KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
+        return;
+    }
 
-        /* Get a work item */
-        WorkItem = ExAllocateFromNPagedLookasideList(&CcTwilightLookasideList);
-        if (WorkItem != NULL)
-        {
-            /* Reference our FO so that it doesn't go in between */
-            ObReferenceObject(FileObject);
+    /* It's active now!
+     * Be careful with the mask, you don't want to mess with node code
+     */
+    InterlockedOr((volatile long *)&PrivateCacheMap->UlongFlags, PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
+    KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
 
-            /* We want to do read ahead! */
-            WorkItem->Function = ReadAhead;
-            WorkItem->Parameters.Read.FileObject = FileObject;
+    /* Get a work item */
+    WorkItem = ExAllocateFromNPagedLookasideList(&CcTwilightLookasideList);
+    if (WorkItem != NULL)
+    {
+        /* Reference our FO so that it doesn't go in between */
+        ObReferenceObject(FileObject);
 
-            /* Queue in the read ahead dedicated queue */
-            CcPostWorkQueue(WorkItem, &CcExpressWorkQueue);
+        /* We want to do read ahead! */
+        WorkItem->Function = ReadAhead;
+        WorkItem->Parameters.Read.FileObject = FileObject;
 
-            return;
-        }
+        /* Queue in the read ahead dedicated queue */
+        CcPostWorkQueue(WorkItem, &CcExpressWorkQueue);
 
-        /* Fail path: lock again, and revert read ahead active */
-        KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
-        InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
+        return;
     }
 
+    /* Fail path: lock again, and revert read ahead active.
+     * Forget the window too, it was never read.
+     */
+    KeAcquireSpinLock(&PrivateCacheMap->ReadAheadSpinLock, &OldIrql);
+    InterlockedAnd((volatile long *)&PrivateCacheMap->UlongFlags, ~PRIVATE_CACHE_MAP_READ_AHEAD_ACTIVE);
+    PrivateCacheMap->ReadAheadLength[0] = 0;
+    PrivateCacheMap->ReadAheadLength[1] = 0;
+
     /* Done (fail) */
     KeReleaseSpinLock(&PrivateCacheMap->ReadAheadSpinLock, OldIrql);
 }
@@ -50,6 +50,19 @@ ULONG CcFastReadResourceMiss;
 ULONG CcDataPages = 0;
 ULONG CcDataFlushes = 0;
 
+/* Counters:
+ * - Number of copy reads that could wait
+ * - Number of those that had to read data from the disk
+ * - Number of copy reads that couldn't wait
+ * - Number of those that failed because data wasn't in the cache
+ * - Number of views read from the disk by read ahead
+ */
+ULONG CcCopyReadWait = 0;
+ULONG CcCopyReadWaitMiss = 0;
+ULONG CcCopyReadNoWait = 0;
+ULONG CcCopyReadNoWaitMiss = 0;
+ULONG CcReadAheadIos = 0;
+
 /* FUNCTIONS *****************************************************************/
 
 VOID
@@ -268,42 +281,45 @@ CcCopyData (
     ULONG BytesCopied;
     KIRQL OldIrql;
     PROS_SHARED_CACHE_MAP SharedCacheMap;
-    PLIST_ENTRY ListEntry;
     PROS_VACB Vacb;
     ULONG PartialLength;
     PVOID BaseAddress;
     BOOLEAN Valid;
+    BOOLEAN Missed;
     PPRIVATE_CACHE_MAP PrivateCacheMap;
 
     SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
     PrivateCacheMap = FileObject->PrivateCacheMap;
     CurrentOffset = FileOffset;
     BytesCopied = 0;
+    Missed = FALSE;
+
+    if (Operation == CcOperationRead)
+    {
+        if (Wait)
+            ++CcCopyReadWait;
+        else
+            ++CcCopyReadNoWait;
+    }
 
     if (!Wait)
     {
         /* test if the requested data is available */
         KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &OldIrql);
         /* FIXME: this loop doesn't take into account areas that don't have
-         * a VACB in the list yet */
-        ListEntry = SharedCacheMap->CacheMapVacbListHead.Flink;
-        while (ListEntry != &SharedCacheMap->CacheMapVacbListHead)
+         * a VACB yet */
+        for (Vacb = CcRosVacbIndexNext(SharedCacheMap, ROUND_DOWN(CurrentOffset, VACB_MAPPING_GRANULARITY));
+             Vacb != NULL && Vacb->FileOffset.QuadPart < CurrentOffset + Length;
+             Vacb = CcRosVacbIndexNext(SharedCacheMap, Vacb->FileOffset.QuadPart + VACB_MAPPING_GRANULARITY))
         {
-            Vacb = CONTAINING_RECORD(ListEntry,
-                                     ROS_VACB,
-                                     CacheMapVacbListEntry);
-            ListEntry = ListEntry->Flink;
-            if (!Vacb->Valid &&
-                DoRangesIntersect(Vacb->FileOffset.QuadPart,
-                                  VACB_MAPPING_GRANULARITY,
-                                  CurrentOffset, Length))
+            if (!Vacb->Valid)
             {
                 KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
                 /* data not available */
+                if (Operation == CcOperationRead)
+                    ++CcCopyReadNoWaitMiss;
                 return FALSE;
             }
-            if (Vacb->FileOffset.QuadPart >= CurrentOffset + Length)
-                break;
         }
         KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, OldIrql);
     }
@@ -322,6 +338,7 @@ CcCopyData (
             ExRaiseStatus(Status);
         if (!Valid)
         {
+            Missed = TRUE;
             Status = CcReadVirtualAddress(Vacb);
             if (!NT_SUCCESS(Status))
             {
@@ -362,6 +379,7 @@ CcCopyData (
             (Operation == CcOperationRead ||
              PartialLength < VACB_MAPPING_GRANULARITY))
         {
+            Missed = TRUE;
             Status = CcReadVirtualAddress(Vacb);
             if (!NT_SUCCESS(Status))
             {
@@ -387,11 +405,15 @@ CcCopyData (
     /* If that was a successful sync read operation, let's handle read ahead */
     if (Operation == CcOperationRead && Length == 0 && Wait)
     {
-        /* If file isn't random access and next read may get us cross VACB boundary,
-         * schedule next read
+        if (Missed)
+        {
+            ++CcCopyReadWaitMiss;
+        }
+
+        /* Unless the file is random access, let the read ahead engine
+         * look at the access pattern, it decides whether to read ahead
          */
-        if (!BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS) &&
-            (CurrentOffset - 1) / VACB_MAPPING_GRANULARITY != (CurrentOffset + BytesCopied - 1) / VACB_MAPPING_GRANULARITY)
+        if (!BooleanFlagOn(FileObject->Flags, FO_RANDOM_ACCESS))
         {
             CcScheduleReadAhead(FileObject, (PLARGE_INTEGER)&FileOffset, BytesCopied);
         }
@@ -482,65 +504,23 @@ CcPostDeferredWrites(VOID)
     }
 }
 
-VOID
-CcPerformReadAhead(
-    IN PFILE_OBJECT FileObject)
+static
+NTSTATUS
+CcReadAheadRange(
+    IN PROS_SHARED_CACHE_MAP SharedCacheMap,
+    IN LONGLONG CurrentOffset,
+    IN ULONG Length)
 {
     NTSTATUS Status;
-    LONGLONG CurrentOffset;
-    KIRQL OldIrql;
-    PROS_SHARED_CACHE_MAP SharedCacheMap;
     PROS_VACB Vacb;
     ULONG PartialLength;
     PVOID BaseAddress;
     BOOLEAN Valid;
-    ULONG Length;
-    PPRIVATE_CACHE_MAP PrivateCacheMap;
-    BOOLEAN Locked;
-
-    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
-
-    /* Critical:
-     * PrivateCacheMap might disappear in-between if the handle
-     * to the file is closed (private is attached to the handle not to
-     * the file), so we need to lock the master lock while we deal with
-     * it. It won't disappear without attempting to lock such lock.
-     */
-    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-    PrivateCacheMap = FileObject->PrivateCacheMap;
-    /* If the handle was closed since the read ahead was scheduled, just quit */
-    if (PrivateCacheMap == NULL)
-    {
-        KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
-        ObDereferenceObject(FileObject);
-        return;
-    }
-    /* Otherwise, extract read offset and length and release private map */
-    else
-    {
-        KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
-        CurrentOffset = PrivateCacheMap->ReadAheadOffset[1].QuadPart;
-        Length = PrivateCacheMap->ReadAheadLength[1];
-        KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
-    }
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
-
-    /* Time to go! */
-    DPRINT("Doing ReadAhead for %p\n", FileObject);
-    /* Lock the file, first */
-    if (!SharedCacheMap->Callbacks->AcquireForReadAhead(SharedCacheMap->LazyWriteContext, FALSE))
-    {
-        Locked = FALSE;
-        goto Clear;
-    }
-
-    /* Remember it's locked */
-    Locked = TRUE;
 
     /* Don't read past the end of the file */
-    if (CurrentOffset >= SharedCacheMap->FileSize.QuadPart)
+    if (CurrentOffset < 0 || CurrentOffset >= SharedCacheMap->FileSize.QuadPart)
     {
-        goto Clear;
+        return STATUS_SUCCESS;
     }
     if (CurrentOffset + Length > SharedCacheMap->FileSize.QuadPart)
     {
@@ -551,10 +531,9 @@ CcPerformReadAhead(
      * difference that we don't copy data back to an user-backed buffer
      * We just bring data into Cc
      */
-    PartialLength = CurrentOffset % VACB_MAPPING_GRANULARITY;
-    if (PartialLength != 0)
+    while (Length > 0)
     {
-        PartialLength = min(Length, VACB_MAPPING_GRANULARITY - PartialLength);
+        PartialLength = min(Length, VACB_MAPPING_GRANULARITY - CurrentOffset % VACB_MAPPING_GRANULARITY);
         Status = CcRosRequestVacb(SharedCacheMap,
                                   ROUND_DOWN(CurrentOffset,
                                              VACB_MAPPING_GRANULARITY),
@@ -564,17 +543,18 @@ CcPerformReadAhead(
         if (!NT_SUCCESS(Status))
         {
             DPRINT1("Failed to request VACB: %lx!\n", Status);
-            goto Clear;
+            return Status;
         }
 
         if (!Valid)
         {
+            ++CcReadAheadIos;
             Status = CcReadVirtualAddress(Vacb);
             if (!NT_SUCCESS(Status))
             {
                 CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
                 DPRINT1("Failed to read data: %lx!\n", Status);
-                goto Clear;
+                return Status;
             }
         }
 
@@ -584,36 +564,72 @@ CcPerformReadAhead(
         CurrentOffset += PartialLength;
     }
 
-    while (Length > 0)
+    return STATUS_SUCCESS;
+}
+
+VOID
+CcPerformReadAhead(
+    IN PFILE_OBJECT FileObject)
+{
+    LONGLONG Offset[2];
+    ULONG Length[2];
+    KIRQL OldIrql;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PPRIVATE_CACHE_MAP PrivateCacheMap;
+    BOOLEAN Locked;
+    ULONG i;
+
+    SharedCacheMap = FileObject->SectionObjectPointer->SharedCacheMap;
+
+    /* Critical:
+     * PrivateCacheMap might disappear in-between if the handle
+     * to the file is closed (private is attached to the handle not to
+     * the file), so we need to lock the master lock while we deal with
+     * it. It won't disappear without attempting to lock such lock.
+     */
+    OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
+    PrivateCacheMap = FileObject->PrivateCacheMap;
+    /* If the handle was closed since the read ahead was scheduled, just quit */
+    if (PrivateCacheMap == NULL)
     {
-        ASSERT(CurrentOffset % VACB_MAPPING_GRANULARITY == 0);
-        PartialLength = min(VACB_MAPPING_GRANULARITY, Length);
-        Status = CcRosRequestVacb(SharedCacheMap,
-                                  CurrentOffset,
-                                  &BaseAddress,
-                                  &Valid,
-                                  &Vacb);
-        if (!NT_SUCCESS(Status))
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
+        ObDereferenceObject(FileObject);
+        return;
+    }
+    /* Otherwise, extract read offsets and lengths and release private map
+     * (See CcScheduleReadAhead for how both ranges are used)
+     */
+    else
+    {
+        KeAcquireSpinLockAtDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
+        for (i = 0; i < 2; i++)
         {
-            DPRINT1("Failed to request VACB: %lx!\n", Status);
-            goto Clear;
+            Offset[i] = PrivateCacheMap->ReadAheadOffset[i].QuadPart;
+            Length[i] = PrivateCacheMap->ReadAheadLength[i];
         }
+        KeReleaseSpinLockFromDpcLevel(&PrivateCacheMap->ReadAheadSpinLock);
+    }
+    KeReleaseQueuedSpinLock(LockQueueMasterLock, OldIrql);
 
-        if (!Valid)
-        {
-            Status = CcReadVirtualAddress(Vacb);
-            if (!NT_SUCCESS(Status))
-            {
-                CcRosReleaseVacb(SharedCacheMap, Vacb, FALSE, FALSE, FALSE);
-                DPRINT1("Failed to read data: %lx!\n", Status);
-                goto Clear;
-            }
-        }
+    /* Time to go! */
+    DPRINT("Doing ReadAhead for %p\n", FileObject);
+    /* Lock the file, first */
+    if (!SharedCacheMap->Callbacks->AcquireForReadAhead(SharedCacheMap->LazyWriteContext, FALSE))
+    {
+        Locked = FALSE;
+        goto Clear;
+    }
 
-        CcRosReleaseVacb(SharedCacheMap, Vacb, TRUE, FALSE, FALSE);
+    /* Remember it's locked */
+    Locked = TRUE;
 
-        Length -= PartialLength;
-        CurrentOffset += PartialLength;
+    for (i = 0; i < 2; i++)
+    {
+        if (Length[i] != 0 &&
+            !NT_SUCCESS(CcReadAheadRange(SharedCacheMap, Offset[i], Length[i])))
+        {
+            break;
+        }
     }
 
 Clear:
@@ -168,7 +168,6 @@ CcPurgeCacheSection (
     LONGLONG EndOffset;
     LIST_ENTRY FreeList;
     KIRQL OldIrql;
-    PLIST_ENTRY ListEntry;
     PROS_VACB Vacb;
     LONGLONG ViewEnd;
     BOOLEAN Success;
@@ -203,19 +202,13 @@ CcPurgeCacheSection (
 
     OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    ListEntry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (ListEntry != &SharedCacheMap->CacheMapVacbListHead)
+    /* Skip VACBs outside the range, or only partially in range */
+    for (Vacb = CcRosVacbIndexNext(SharedCacheMap, StartOffset);
+         Vacb != NULL;
+         Vacb = CcRosVacbIndexNext(SharedCacheMap, Vacb->FileOffset.QuadPart + VACB_MAPPING_GRANULARITY))
     {
         ULONG Refs;
 
-        Vacb = CONTAINING_RECORD(ListEntry, ROS_VACB, CacheMapVacbListEntry);
-        ListEntry = ListEntry->Flink;
-
-        /* Skip VACBs outside the range, or only partially in range */
-        if (Vacb->FileOffset.QuadPart < StartOffset)
-        {
-            continue;
-        }
         ViewEnd = min(Vacb->FileOffset.QuadPart + VACB_MAPPING_GRANULARITY,
                       SharedCacheMap->SectionSize.QuadPart);
         if (ViewEnd >= EndOffset)
@@ -243,6 +236,7 @@ CcPurgeCacheSection (
             CcRosUnmarkDirtyVacb(Vacb, FALSE);
         }
         RemoveEntryList(&Vacb->CacheMapVacbListEntry);
+        CcRosVacbIndexRemove(Vacb);
         InsertHeadList(&FreeList, &Vacb->CacheMapVacbListEntry);
     }
     KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
@@ -45,9 +45,21 @@ CcpFindBcb(
     PINTERNAL_BCB Bcb;
     BOOLEAN Found = FALSE;
     PLIST_ENTRY NextEntry;
+    PROS_VACB Vacb;
+
+    /* A BCB never crosses a view, so only the BCBs of the view
+     * containing FileOffset can match. They all reference the VACB,
+     * which keeps it in the index as long as there is one */
+    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    Vacb = CcRosVacbIndexLookup(SharedCacheMap, FileOffset->QuadPart);
+    if (Vacb == NULL)
+    {
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        return NULL;
+    }
 
-    for (NextEntry = SharedCacheMap->BcbList.Flink;
-         NextEntry != &SharedCacheMap->BcbList;
+    for (NextEntry = Vacb->BcbList.Flink;
+         NextEntry != &Vacb->BcbList;
          NextEntry = NextEntry->Flink)
     {
         Bcb = CONTAINING_RECORD(NextEntry, INTERNAL_BCB, BcbEntry);
@@ -63,6 +75,7 @@ CcpFindBcb(
             }
         }
     }
+    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
     return (Found ? Bcb : NULL);
 }
@@ -286,7 +299,7 @@ CcpGetAppropriateBcb(
             ASSERT(Result);
         }
 
-        InsertTailList(&SharedCacheMap->BcbList, &iBcb->BcbEntry);
+        InsertTailList(&Vacb->BcbList, &iBcb->BcbEntry);
         KeReleaseSpinLock(&SharedCacheMap->BcbSpinLock, OldIrql);
     }
 
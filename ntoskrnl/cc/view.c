@@ -109,6 +109,230 @@ ULONG CcRosVacbGetRefCount_(PROS_VACB vacb, PCSTR file, INT line)
 
 /* FUNCTIONS *****************************************************************/
 
+#define VACB_LEVEL_INDEX(View, Height) \
+    ((ULONG)((View) >> ((Height) * VACB_LEVEL_SHIFT)) & (VACB_LEVEL_SIZE - 1))
+
+static
+BOOLEAN
+CcRosVacbIndexCovers(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    ULONGLONG View)
+{
+    return SharedCacheMap->VacbIndex != NULL &&
+           View < (1ULL << (SharedCacheMap->VacbIndexDepth * VACB_LEVEL_SHIFT));
+}
+
+static
+PROS_VACB_LEVEL
+CcRosAllocateVacbLevel(VOID)
+{
+    PROS_VACB_LEVEL Level;
+
+    Level = ExAllocatePoolWithTag(NonPagedPool, sizeof(*Level), TAG_VACB);
+    if (Level != NULL)
+    {
+        RtlZeroMemory(Level, sizeof(*Level));
+    }
+
+    return Level;
+}
+
+static
+VOID
+CcRosFreeVacbLevel(
+    PROS_VACB_LEVEL Level,
+    ULONG Height)
+{
+    ULONG i;
+
+    if (Height > 0)
+    {
+        for (i = 0; i < VACB_LEVEL_SIZE; i++)
+        {
+            if (Level->Entries[i] != NULL)
+            {
+                CcRosFreeVacbLevel(Level->Entries[i], Height - 1);
+            }
+        }
+    }
+    else
+    {
+        ASSERT(Level->ActiveEntries == 0);
+    }
+
+    ExFreePoolWithTag(Level, TAG_VACB);
+}
+
+/* Caller must hold the CacheMapLock */
+PROS_VACB
+CcRosVacbIndexLookup(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    ULONGLONG View = FileOffset / VACB_MAPPING_GRANULARITY;
+    PROS_VACB_LEVEL Level;
+    ULONG Height;
+
+    if (FileOffset < 0 || !CcRosVacbIndexCovers(SharedCacheMap, View))
+        return NULL;
+
+    Level = SharedCacheMap->VacbIndex;
+    for (Height = SharedCacheMap->VacbIndexDepth - 1; Height > 0; Height--)
+    {
+        Level = Level->Entries[VACB_LEVEL_INDEX(View, Height)];
+        if (Level == NULL)
+            return NULL;
+    }
+
+    return Level->Entries[VACB_LEVEL_INDEX(View, 0)];
+}
+
+static
+PROS_VACB
+CcRosVacbIndexNextInLevel(
+    PROS_VACB_LEVEL Level,
+    ULONG Height,
+    ULONGLONG View)
+{
+    PROS_VACB Vacb;
+    ULONG Index;
+
+    /* Only the first entry we look at is partially before View,
+     * the subtrees after it have to be searched from their start */
+    for (Index = VACB_LEVEL_INDEX(View, Height); Index < VACB_LEVEL_SIZE; Index++, View = 0)
+    {
+        if (Level->Entries[Index] == NULL)
+            continue;
+
+        if (Height == 0)
+            return Level->Entries[Index];
+
+        Vacb = CcRosVacbIndexNextInLevel(Level->Entries[Index], Height - 1, View);
+        if (Vacb != NULL)
+            return Vacb;
+    }
+
+    return NULL;
+}
+
+/* Returns the VACB with the lowest FileOffset >= FileOffset, if any.
+ * Caller must hold the CacheMapLock */
+PROS_VACB
+CcRosVacbIndexNext(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset)
+{
+    ULONGLONG View;
+
+    if (FileOffset < 0)
+        FileOffset = 0;
+
+    View = (FileOffset + VACB_MAPPING_GRANULARITY - 1) / VACB_MAPPING_GRANULARITY;
+    if (!CcRosVacbIndexCovers(SharedCacheMap, View))
+        return NULL;
+
+    return CcRosVacbIndexNextInLevel(SharedCacheMap->VacbIndex,
+                                     SharedCacheMap->VacbIndexDepth - 1,
+                                     View);
+}
+
+/* Caller must hold the CacheMapLock */
+static
+NTSTATUS
+CcRosVacbIndexInsert(
+    PROS_VACB Vacb)
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap = Vacb->SharedCacheMap;
+    ULONGLONG View = Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY;
+    PROS_VACB_LEVEL Level, Child;
+    ULONG Height, Index;
+
+    /* Add levels on top until the view number fits */
+    while (!CcRosVacbIndexCovers(SharedCacheMap, View))
+    {
+        ASSERT(SharedCacheMap->VacbIndexDepth < VACB_INDEX_MAX_DEPTH);
+
+        Level = CcRosAllocateVacbLevel();
+        if (Level == NULL)
+            return STATUS_INSUFFICIENT_RESOURCES;
+
+        if (SharedCacheMap->VacbIndex != NULL)
+        {
+            Level->Entries[0] = SharedCacheMap->VacbIndex;
+            Level->ActiveEntries = 1;
+        }
+        SharedCacheMap->VacbIndex = Level;
+        SharedCacheMap->VacbIndexDepth++;
+    }
+
+    Level = SharedCacheMap->VacbIndex;
+    for (Height = SharedCacheMap->VacbIndexDepth - 1; Height > 0; Height--)
+    {
+        Index = VACB_LEVEL_INDEX(View, Height);
+        Child = Level->Entries[Index];
+        if (Child == NULL)
+        {
+            /* Levels left empty by a failure here are freed with the cache map */
+            Child = CcRosAllocateVacbLevel();
+            if (Child == NULL)
+                return STATUS_INSUFFICIENT_RESOURCES;
+
+            Level->Entries[Index] = Child;
+            Level->ActiveEntries++;
+        }
+        Level = Child;
+    }
+
+    Index = VACB_LEVEL_INDEX(View, 0);
+    ASSERT(Level->Entries[Index] == NULL);
+    Level->Entries[Index] = Vacb;
+    Level->ActiveEntries++;
+
+    return STATUS_SUCCESS;
+}
+
+/* Caller must hold the CacheMapLock */
+VOID
+CcRosVacbIndexRemove(
+    PROS_VACB Vacb)
+{
+    PROS_SHARED_CACHE_MAP SharedCacheMap = Vacb->SharedCacheMap;
+    ULONGLONG View = Vacb->FileOffset.QuadPart / VACB_MAPPING_GRANULARITY;
+    PROS_VACB_LEVEL Path[VACB_INDEX_MAX_DEPTH];
+    PROS_VACB_LEVEL Level;
+    ULONG Height;
+
+    ASSERT(CcRosVacbIndexCovers(SharedCacheMap, View));
+
+    Level = SharedCacheMap->VacbIndex;
+    for (Height = SharedCacheMap->VacbIndexDepth - 1; Height > 0; Height--)
+    {
+        Path[Height] = Level;
+        Level = Level->Entries[VACB_LEVEL_INDEX(View, Height)];
+        ASSERT(Level != NULL);
+    }
+
+    ASSERT(Level->Entries[VACB_LEVEL_INDEX(View, 0)] == Vacb);
+    Level->Entries[VACB_LEVEL_INDEX(View, 0)] = NULL;
+
+    /* Free the levels that became empty, up to the root if needed */
+    Height = 0;
+    while (--Level->ActiveEntries == 0)
+    {
+        ExFreePoolWithTag(Level, TAG_VACB);
+
+        if (++Height == SharedCacheMap->VacbIndexDepth)
+        {
+            SharedCacheMap->VacbIndex = NULL;
+            SharedCacheMap->VacbIndexDepth = 0;
+            break;
+        }
+
+        Level = Path[Height];
+        Level->Entries[VACB_LEVEL_INDEX(View, Height)] = NULL;
+    }
+}
+
 VOID
 NTAPI
 CcRosTraceCacheMap (
@@ -364,6 +588,7 @@ retry:
             ASSERT(Refs == 1);
 
             RemoveEntryList(&current->CacheMapVacbListEntry);
+            CcRosVacbIndexRemove(current);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
             InsertHeadList(&FreeList, &current->CacheMapVacbListEntry);
@@ -459,7 +684,6 @@ CcRosLookupVacb (
     PROS_SHARED_CACHE_MAP SharedCacheMap,
     LONGLONG FileOffset)
 {
-    PLIST_ENTRY current_entry;
     PROS_VACB current;
     KIRQL oldIrql;
 
@@ -468,33 +692,19 @@ CcRosLookupVacb (
     DPRINT("CcRosLookupVacb(SharedCacheMap 0x%p, FileOffset %I64u)\n",
            SharedCacheMap, FileOffset);
 
-    oldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
-    KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
+    /* The index and the VACB references are protected by the CacheMapLock,
+     * no need for the master lock here */
+    KeAcquireSpinLock(&SharedCacheMap->CacheMapLock, &oldIrql);
 
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    current = CcRosVacbIndexLookup(SharedCacheMap, FileOffset);
+    if (current != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
-            return current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        CcRosVacbIncRefCount(current);
     }
 
-    KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
-    KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+    KeReleaseSpinLock(&SharedCacheMap->CacheMapLock, oldIrql);
 
-    return NULL;
+    return current;
 }
 
 VOID
@@ -734,6 +944,7 @@ CcRosFreeUnusedVacb (
 
             /* Reset and move to free list */
             RemoveEntryList(&current->CacheMapVacbListEntry);
+            CcRosVacbIndexRemove(current);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
             InsertHeadList(&FreeList, &current->CacheMapVacbListEntry);
@@ -783,8 +994,7 @@ CcRosCreateVacb (
     PROS_VACB *Vacb)
 {
     PROS_VACB current;
-    PROS_VACB previous;
-    PLIST_ENTRY current_entry;
+    PROS_VACB existing;
     NTSTATUS Status;
     KIRQL oldIrql;
     ULONG Refs;
@@ -818,6 +1028,7 @@ CcRosCreateVacb (
     InitializeListHead(&current->CacheMapVacbListEntry);
     InitializeListHead(&current->DirtyVacbListEntry);
     InitializeListHead(&current->VacbLruListEntry);
+    InitializeListHead(&current->BcbList);
 
     CcRosVacbIncRefCount(current);
 
@@ -853,56 +1064,43 @@ Retry:
      * our newly created VACB and return the existing one.
      */
     KeAcquireSpinLockAtDpcLevel(&SharedCacheMap->CacheMapLock);
-    current_entry = SharedCacheMap->CacheMapVacbListHead.Flink;
-    previous = NULL;
-    while (current_entry != &SharedCacheMap->CacheMapVacbListHead)
+    existing = CcRosVacbIndexLookup(SharedCacheMap, FileOffset);
+    if (existing != NULL)
     {
-        current = CONTAINING_RECORD(current_entry,
-                                    ROS_VACB,
-                                    CacheMapVacbListEntry);
-        if (IsPointInRange(current->FileOffset.QuadPart,
-                           VACB_MAPPING_GRANULARITY,
-                           FileOffset))
-        {
-            CcRosVacbIncRefCount(current);
-            KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        CcRosVacbIncRefCount(existing);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 #if DBG
-            if (SharedCacheMap->Trace)
-            {
-                DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
-                        SharedCacheMap,
-                        (*Vacb),
-                        current);
-            }
+        if (SharedCacheMap->Trace)
+        {
+            DPRINT1("CacheMap 0x%p: deleting newly created VACB 0x%p ( found existing one 0x%p )\n",
+                    SharedCacheMap,
+                    current,
+                    existing);
+        }
 #endif
-            KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
 
-            Refs = CcRosVacbDecRefCount(*Vacb);
-            ASSERT(Refs == 0);
+        Refs = CcRosVacbDecRefCount(current);
+        ASSERT(Refs == 0);
 
-            *Vacb = current;
-            return STATUS_SUCCESS;
-        }
-        if (current->FileOffset.QuadPart < FileOffset)
-        {
-            ASSERT(previous == NULL ||
-                   previous->FileOffset.QuadPart < current->FileOffset.QuadPart);
-            previous = current;
-        }
-        if (current->FileOffset.QuadPart > FileOffset)
-            break;
-        current_entry = current_entry->Flink;
+        *Vacb = existing;
+        return STATUS_SUCCESS;
     }
+
     /* There was no existing VACB. */
-    current = *Vacb;
-    if (previous)
-    {
-        InsertHeadList(&previous->CacheMapVacbListEntry, &current->CacheMapVacbListEntry);
-    }
-    else
+    Status = CcRosVacbIndexInsert(current);
+    if (!NT_SUCCESS(Status))
     {
-        InsertHeadList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
+        KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
+        KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
+
+        Refs = CcRosVacbDecRefCount(current);
+        ASSERT(Refs == 0);
+
+        *Vacb = NULL;
+        return Status;
     }
+    InsertTailList(&SharedCacheMap->CacheMapVacbListHead, &current->CacheMapVacbListEntry);
     KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
     InsertTailList(&VacbLruListHead, &current->VacbLruListEntry);
     KeReleaseQueuedSpinLock(LockQueueMasterLock, oldIrql);
@@ -1075,6 +1273,7 @@ CcRosInternalFreeVacb (
     ASSERT(IsListEmpty(&Vacb->CacheMapVacbListEntry));
     ASSERT(IsListEmpty(&Vacb->DirtyVacbListEntry));
     ASSERT(IsListEmpty(&Vacb->VacbLruListEntry));
+    ASSERT(IsListEmpty(&Vacb->BcbList));
     RtlFillMemory(Vacb, sizeof(*Vacb), 0xfd);
     ExFreeToNPagedLookasideList(&VacbLookasideList, Vacb);
     return STATUS_SUCCESS;
@@ -1189,9 +1388,10 @@ CcRosDeleteFileCache (
         while (!IsListEmpty(&SharedCacheMap->CacheMapVacbListHead))
         {
             current_entry = RemoveTailList(&SharedCacheMap->CacheMapVacbListHead);
+            current = CONTAINING_RECORD(current_entry, ROS_VACB, CacheMapVacbListEntry);
+            CcRosVacbIndexRemove(current);
             KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
-            current = CONTAINING_RECORD(current_entry, ROS_VACB, CacheMapVacbListEntry);
             RemoveEntryList(&current->VacbLruListEntry);
             InitializeListHead(&current->VacbLruListEntry);
             if (current->Dirty)
@@ -1214,6 +1414,13 @@ CcRosDeleteFileCache (
 #if DBG
         SharedCacheMap->Trace = FALSE;
 #endif
+        /* Only levels left behind by a failed insertion can remain */
+        if (SharedCacheMap->VacbIndex != NULL)
+        {
+            CcRosFreeVacbLevel(SharedCacheMap->VacbIndex, SharedCacheMap->VacbIndexDepth - 1);
+            SharedCacheMap->VacbIndex = NULL;
+            SharedCacheMap->VacbIndexDepth = 0;
+        }
         KeReleaseSpinLockFromDpcLevel(&SharedCacheMap->CacheMapLock);
 
         KeReleaseQueuedSpinLock(LockQueueMasterLock, *OldIrql);
@@ -1436,7 +1643,6 @@ CcRosInitializeFileCache (
         InitializeListHead(&SharedCacheMap->PrivateList);
         KeInitializeSpinLock(&SharedCacheMap->CacheMapLock);
         InitializeListHead(&SharedCacheMap->CacheMapVacbListHead);
-        InitializeListHead(&SharedCacheMap->BcbList);
     }
 
     OldIrql = KeAcquireQueuedSpinLock(LockQueueMasterLock);
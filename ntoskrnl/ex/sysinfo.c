@@ -787,16 +787,16 @@ QSI_DEF(SystemPerformanceInformation)
     Spi->CcPinReadWait = CcPinReadWait;
     Spi->CcPinReadNoWaitMiss = 0; /* FIXME */
     Spi->CcPinReadWaitMiss = 0; /* FIXME */
-    Spi->CcCopyReadNoWait = 0; /* FIXME */
-    Spi->CcCopyReadWait = 0; /* FIXME */
-    Spi->CcCopyReadNoWaitMiss = 0; /* FIXME */
-    Spi->CcCopyReadWaitMiss = 0; /* FIXME */
+    Spi->CcCopyReadNoWait = CcCopyReadNoWait;
+    Spi->CcCopyReadWait = CcCopyReadWait;
+    Spi->CcCopyReadNoWaitMiss = CcCopyReadNoWaitMiss;
+    Spi->CcCopyReadWaitMiss = CcCopyReadWaitMiss;
 
     Spi->CcMdlReadNoWait = 0; /* FIXME */
     Spi->CcMdlReadWait = 0; /* FIXME */
     Spi->CcMdlReadNoWaitMiss = 0; /* FIXME */
     Spi->CcMdlReadWaitMiss = 0; /* FIXME */
-    Spi->CcReadAheadIos = 0; /* FIXME */
+    Spi->CcReadAheadIos = CcReadAheadIos;
     Spi->CcLazyWriteIos = CcLazyWriteIos;
     Spi->CcLazyWritePages = CcLazyWritePages;
     Spi->CcDataFlushes = CcDataFlushes;
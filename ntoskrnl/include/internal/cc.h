@@ -65,6 +65,11 @@ extern ULONG CcPinReadNoWait;
 extern ULONG CcPinMappedDataCount;
 extern ULONG CcDataPages;
 extern ULONG CcDataFlushes;
+extern ULONG CcCopyReadWait;
+extern ULONG CcCopyReadWaitMiss;
+extern ULONG CcCopyReadNoWait;
+extern ULONG CcCopyReadNoWaitMiss;
+extern ULONG CcReadAheadIos;
 
 typedef struct _PF_SCENARIO_ID
 {
@@ -167,13 +172,26 @@ typedef struct _PFSN_PREFETCHER_GLOBALS
     LONG ActivePrefetches;
 } PFSN_PREFETCHER_GLOBALS, *PPFSN_PREFETCHER_GLOBALS;
 
+/* The VACB index is a sparse tree of VACB_LEVEL_SIZE wide levels, keyed by
+ * view number (file offset / VACB_MAPPING_GRANULARITY). The leaves point to
+ * the VACBs, the other levels to the next level down. Empty levels are freed.
+ */
+#define VACB_LEVEL_SHIFT 7
+#define VACB_LEVEL_SIZE (1 << VACB_LEVEL_SHIFT)
+#define VACB_INDEX_MAX_DEPTH ((63 + VACB_LEVEL_SHIFT - 1) / VACB_LEVEL_SHIFT)
+
+typedef struct _ROS_VACB_LEVEL
+{
+    ULONG ActiveEntries;
+    PVOID Entries[VACB_LEVEL_SIZE];
+} ROS_VACB_LEVEL, *PROS_VACB_LEVEL;
+
 typedef struct _ROS_SHARED_CACHE_MAP
 {
     CSHORT NodeTypeCode;
     CSHORT NodeByteSize;
     ULONG OpenCount;
     LARGE_INTEGER FileSize;
-    LIST_ENTRY BcbList;
     LARGE_INTEGER SectionSize;
     PFILE_OBJECT FileObject;
     ULONG DirtyPages;
@@ -188,6 +206,9 @@ typedef struct _ROS_SHARED_CACHE_MAP
 
     /* ROS specific */
     LIST_ENTRY CacheMapVacbListHead;
+    /* View number -> VACB, protected by CacheMapLock */
+    PROS_VACB_LEVEL VacbIndex;
+    ULONG VacbIndexDepth;
     BOOLEAN PinAccess;
     KSPIN_LOCK CacheMapLock;
 #if DBG
@@ -223,6 +244,8 @@ typedef struct _ROS_VACB
     volatile ULONG ReferenceCount;
     /* Pointer to the shared cache map for the file which this view maps data for. */
     PROS_SHARED_CACHE_MAP SharedCacheMap;
+    /* BCBs for data in this view, protected by the shared cache map BcbSpinLock. */
+    LIST_ENTRY BcbList;
     /* Pointer to the next VACB in a chain. */
 } ROS_VACB, *PROS_VACB;
 
@@ -357,6 +380,23 @@ CcRosLookupVacb(
     LONGLONG FileOffset
 );
 
+PROS_VACB
+CcRosVacbIndexLookup(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset
+);
+
+PROS_VACB
+CcRosVacbIndexNext(
+    PROS_SHARED_CACHE_MAP SharedCacheMap,
+    LONGLONG FileOffset
+);
+
+VOID
+CcRosVacbIndexRemove(
+    PROS_VACB Vacb
+);
+
 VOID
 NTAPI
 CcInitCacheZeroPage(VOID);
@@ -160,3 +160,15 @@ IopValidateOpenPacket(IN POPEN_PACKET OpenPacket)
     /* Good packet */
     return TRUE;
 }
+
+FORCEINLINE
+BOOLEAN
+IopSkipCompletionPort(IN PFILE_OBJECT FileObject,
+                      IN NTSTATUS Status)
+{
+    /*
+     * With FILE_SKIP_COMPLETION_PORT_ON_SUCCESS, an I/O that succeeded without
+     * returning STATUS_PENDING is not queued, the caller got the result inline
+     */
+    return ((FileObject->Flags & FO_SKIP_COMPLETION_PORT) && NT_SUCCESS(Status));
+}
@@ -645,6 +645,20 @@ KiInsertQueue(
     BOOLEAN Head
 );
 
+/* Only declared by the Vista headers */
+#if (NTDDI_VERSION < NTDDI_VISTA)
+ULONG
+NTAPI
+KeRemoveQueueEx(
+    IN PKQUEUE Queue,
+    IN KPROCESSOR_MODE WaitMode,
+    IN BOOLEAN Alertable,
+    IN PLARGE_INTEGER Timeout OPTIONAL,
+    OUT PLIST_ENTRY *EntryArray,
+    IN ULONG Count
+);
+#endif
+
 VOID
 NTAPI
 KiTimerExpiration(
@@ -1235,7 +1235,7 @@ KxSetTimerForThreadWait(IN PKTIMER Timer,
     }                                                                       \
                                                                             \
     /* Set wait settings */                                                 \
-    Thread->Alertable = FALSE;                                              \
+    Thread->Alertable = Alertable;                                          \
     Thread->WaitMode = WaitMode;                                            \
     Thread->WaitReason = WrQueue;                                           \
                                                                             \
@@ -1355,9 +1355,13 @@ KxQueueReadyThread(IN PKTHREAD Thread,
     ASSERT(Thread->State == Running);
     ASSERT(Thread->NextProcessor == Prcb->Number);
 
-    /* Check if this thread is allowed to run in this CPU */
+    /*
+     * Check if this thread is allowed to run in this CPU, and that there is
+     * no idle CPU which could pick it up right away instead.
+     */
 #ifdef CONFIG_SMP
-    if ((Thread->Affinity) & (Prcb->SetMember))
+    if (((Thread->Affinity) & (Prcb->SetMember)) &&
+        !((Thread->Affinity) & KiIdleSummary))
 #else
     if (TRUE)
 #endif
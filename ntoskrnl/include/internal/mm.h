@@ -440,6 +440,7 @@ typedef struct _MMPAGING_FILE
     PFILE_OBJECT FileObject;
     UNICODE_STRING PageFileName;
     PRTL_BITMAP Bitmap;
+    ULONG HintSetBit;
     HANDLE FileHandle;
 }
 MMPAGING_FILE, *PMMPAGING_FILE;
@@ -657,6 +658,14 @@ VOID
 NTAPI
 MmShowOutOfSpaceMessagePagingFile(VOID);
 
+VOID
+NTAPI
+MmBeginClusteredSwapWrites(VOID);
+
+VOID
+NTAPI
+MmEndClusteredSwapWrites(VOID);
+
 NTSTATUS
 NTAPI
 MiReadPageFile(
@@ -20,6 +20,12 @@
 volatile LONG IoPageReadIrpAllocationFailure = 0;
 volatile LONG IoPageReadNonPagefileIrpAllocationFailure = 0;
 
+/* Added in 2003 SP2, but only the Vista headers know about it */
+#if (NTDDI_VERSION < NTDDI_VISTA)
+#define FileIoCompletionNotificationInformation \
+    ((FILE_INFORMATION_CLASS)(FileShortNameInformation + 1))
+#endif
+
 /* PRIVATE FUNCTIONS *********************************************************/
 
 VOID
@@ -445,7 +451,8 @@ IopDeviceFsIoControl(IN HANDLE DeviceHandle,
                 }
 
                 /* Set completion if required */
-                if (CompletionInfo.Port != NULL && UserApcContext != NULL)
+                if (CompletionInfo.Port != NULL && UserApcContext != NULL &&
+                    !IopSkipCompletionPort(FileObject, KernelIosb.Status))
                 {
                     if (!NT_SUCCESS(IoSetIoCompletion(CompletionInfo.Port,
                                                       CompletionInfo.Key,
@@ -1134,6 +1141,378 @@ IopGetDriverPathInformation(IN PFILE_OBJECT FileObject,
     return STATUS_SUCCESS;
 }
 
+static
+NTSTATUS
+IopReadWriteFileSegments(IN HANDLE FileHandle,
+                         IN HANDLE Event OPTIONAL,
+                         IN PIO_APC_ROUTINE ApcRoutine OPTIONAL,
+                         IN PVOID ApcContext OPTIONAL,
+                         OUT PIO_STATUS_BLOCK IoStatusBlock,
+                         IN FILE_SEGMENT_ELEMENT SegmentArray[],
+                         IN ULONG Length,
+                         IN PLARGE_INTEGER ByteOffset OPTIONAL,
+                         IN PULONG Key OPTIONAL,
+                         IN BOOLEAN Write)
+{
+    NTSTATUS Status;
+    PFILE_OBJECT FileObject;
+    PIRP Irp;
+    PDEVICE_OBJECT DeviceObject;
+    PIO_STACK_LOCATION StackPtr;
+    KPROCESSOR_MODE PreviousMode = KeGetPreviousMode();
+    PKEVENT EventObject = NULL;
+    LARGE_INTEGER CapturedByteOffset;
+    ULONG CapturedKey = 0;
+    BOOLEAN Synchronous = FALSE;
+    ULONG PageCount, LockedPages = 0;
+    PVOID Address;
+    PMDL Mdl = NULL;
+    PPFN_NUMBER MdlPages;
+    PFN_NUMBER PageMdlBuffer[(sizeof(MDL) / sizeof(PFN_NUMBER)) + 1];
+    PMDL PageMdl = (PMDL)PageMdlBuffer;
+
+    PAGED_CODE();
+    CapturedByteOffset.QuadPart = 0;
+    IOTRACE(IO_API_DEBUG, "FileHandle: %p\n", FileHandle);
+
+    /* Every segment describes one page of the transfer */
+    PageCount = BYTES_TO_PAGES(Length);
+
+    /* Get File Object */
+    Status = ObReferenceObjectByHandle(FileHandle,
+                                       Write ? FILE_WRITE_DATA : FILE_READ_DATA,
+                                       IoFileObjectType,
+                                       PreviousMode,
+                                       (PVOID*)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Get the device object */
+    DeviceObject = IoGetRelatedDeviceObject(FileObject);
+
+    /*
+     * The segments are handed down to the device as a single MDL, so this only
+     * works for non-cached I/O and for drivers that do not expect a system buffer
+     */
+    if (!(FileObject->Flags & FO_NO_INTERMEDIATE_BUFFERING) ||
+        (DeviceObject->Flags & DO_BUFFERED_IO))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Fail if Length is not sector size aligned */
+    if ((DeviceObject->SectorSize != 0) &&
+        (Length % DeviceObject->SectorSize != 0))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Validate User-Mode Buffers */
+    if (PreviousMode != KernelMode)
+    {
+        _SEH2_TRY
+        {
+            /* Probe the status block */
+            ProbeForWriteIoStatusBlock(IoStatusBlock);
+
+            /* Probe the segment array, the pages themselves get probed when locked */
+            ProbeForRead(SegmentArray,
+                         PageCount * sizeof(FILE_SEGMENT_ELEMENT),
+                         TYPE_ALIGNMENT(FILE_SEGMENT_ELEMENT));
+
+            /* Check if we got a byte offset */
+            if (ByteOffset)
+            {
+                /* Capture and probe it */
+                CapturedByteOffset = ProbeForReadLargeInteger(ByteOffset);
+            }
+
+            /* Capture and probe the key */
+            if (Key) CapturedKey = ProbeForReadUlong(Key);
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Release the file object and return the exception code */
+            ObDereferenceObject(FileObject);
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+    else
+    {
+        /* Kernel mode: capture directly */
+        if (ByteOffset) CapturedByteOffset = *ByteOffset;
+        if (Key) CapturedKey = *Key;
+    }
+
+    /* Check for invalid offset */
+    if ((CapturedByteOffset.QuadPart < 0) && (CapturedByteOffset.QuadPart != -2))
+    {
+        /* -2 is FILE_USE_FILE_POINTER_POSITION */
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Fail if ByteOffset is not sector size aligned */
+    if (ByteOffset &&
+        (CapturedByteOffset.QuadPart >= 0) &&
+        (DeviceObject->SectorSize != 0) &&
+        (CapturedByteOffset.QuadPart % DeviceObject->SectorSize != 0))
+    {
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Check for event */
+    if (Event)
+    {
+        /* Reference it */
+        Status = ObReferenceObjectByHandle(Event,
+                                           EVENT_MODIFY_STATE,
+                                           ExEventObjectType,
+                                           PreviousMode,
+                                           (PVOID*)&EventObject,
+                                           NULL);
+        if (!NT_SUCCESS(Status))
+        {
+            /* Fail */
+            ObDereferenceObject(FileObject);
+            return Status;
+        }
+
+        /* Otherwise reset the event */
+        KeClearEvent(EventObject);
+    }
+
+    /* Check if we should use Sync IO or not */
+    if (FileObject->Flags & FO_SYNCHRONOUS_IO)
+    {
+        /* Lock the file object */
+        Status = IopLockFileObject(FileObject, PreviousMode);
+        if (Status != STATUS_SUCCESS)
+        {
+            if (EventObject) ObDereferenceObject(EventObject);
+            ObDereferenceObject(FileObject);
+            return Status;
+        }
+
+        /* Check if we don't have a byte offset available */
+        if (!(ByteOffset) ||
+            ((CapturedByteOffset.u.LowPart == FILE_USE_FILE_POINTER_POSITION) &&
+             (CapturedByteOffset.u.HighPart == -1)))
+        {
+            /* Use the Current Byte Offset instead */
+            CapturedByteOffset = FileObject->CurrentByteOffset;
+        }
+
+        /* Remember we are sync */
+        Synchronous = TRUE;
+    }
+    else if (!ByteOffset)
+    {
+        /* Otherwise, this was async I/O without a byte offset, so fail */
+        if (EventObject) ObDereferenceObject(EventObject);
+        ObDereferenceObject(FileObject);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    /* Clear the File Object's event */
+    KeClearEvent(&FileObject->Event);
+
+    /* Allocate the IRP */
+    Irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+    if (!Irp) return IopCleanupFailedIrp(FileObject, EventObject, NULL);
+
+    /* Set the IRP */
+    Irp->Tail.Overlay.OriginalFileObject = FileObject;
+    Irp->Tail.Overlay.Thread = PsGetCurrentThread();
+    Irp->RequestorMode = PreviousMode;
+    Irp->Overlay.AsynchronousParameters.UserApcRoutine = ApcRoutine;
+    Irp->Overlay.AsynchronousParameters.UserApcContext = ApcContext;
+    Irp->UserIosb = IoStatusBlock;
+    Irp->UserEvent = EventObject;
+    Irp->PendingReturned = FALSE;
+    Irp->Cancel = FALSE;
+    Irp->CancelRoutine = NULL;
+    Irp->AssociatedIrp.SystemBuffer = NULL;
+    Irp->MdlAddress = NULL;
+
+    /* There is no contiguous buffer, only the MDL describes the segments */
+    Irp->UserBuffer = NULL;
+
+    /* Set the Stack Data */
+    StackPtr = IoGetNextIrpStackLocation(Irp);
+    StackPtr->FileObject = FileObject;
+    if (Write)
+    {
+        StackPtr->MajorFunction = IRP_MJ_WRITE;
+        StackPtr->Parameters.Write.Key = CapturedKey;
+        StackPtr->Parameters.Write.Length = Length;
+        StackPtr->Parameters.Write.ByteOffset = CapturedByteOffset;
+    }
+    else
+    {
+        StackPtr->MajorFunction = IRP_MJ_READ;
+        StackPtr->Parameters.Read.Key = CapturedKey;
+        StackPtr->Parameters.Read.Length = Length;
+        StackPtr->Parameters.Read.ByteOffset = CapturedByteOffset;
+    }
+
+    /* Check if we have a buffer length */
+    if (PageCount)
+    {
+        _SEH2_TRY
+        {
+            /*
+             * Allocate an MDL big enough for the whole transfer, then lock the
+             * segments one page at a time and gather their PFNs into it, so that
+             * the driver sees them as a single virtually contiguous buffer
+             */
+            Mdl = IoAllocateMdl((PVOID)SegmentArray[0].Buffer, Length, FALSE, TRUE, Irp);
+            if (!Mdl)
+                ExRaiseStatus(STATUS_INSUFFICIENT_RESOURCES);
+            MdlPages = MmGetMdlPfnArray(Mdl);
+
+            while (LockedPages < PageCount)
+            {
+                /* Segments must be page aligned */
+                Address = (PVOID)SegmentArray[LockedPages].Buffer;
+                if (BYTE_OFFSET(Address) != 0)
+                    ExRaiseStatus(STATUS_INVALID_PARAMETER);
+
+                MmInitializeMdl(PageMdl,
+                                Address,
+                                min(Length - (LockedPages << PAGE_SHIFT), PAGE_SIZE));
+                MmProbeAndLockPages(PageMdl,
+                                    PreviousMode,
+                                    Write ? IoReadAccess : IoWriteAccess);
+
+                /* Don't mix user and kernel pages, their lock accounting differs */
+                if (LockedPages == 0)
+                {
+                    Mdl->Process = PageMdl->Process;
+                }
+                else if (PageMdl->Process != Mdl->Process)
+                {
+                    MmUnlockPages(PageMdl);
+                    ExRaiseStatus(STATUS_INVALID_PARAMETER);
+                }
+
+                /* The page lock now belongs to the transfer MDL */
+                Mdl->MdlFlags |= PageMdl->MdlFlags & (MDL_WRITE_OPERATION | MDL_IO_SPACE);
+                MdlPages[LockedPages++] = *MmGetMdlPfnArray(PageMdl);
+            }
+
+            Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+        }
+        _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+        {
+            /* Unlock what we got so far */
+            if (LockedPages)
+            {
+                Mdl->ByteCount = LockedPages << PAGE_SHIFT;
+                Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+                MmUnlockPages(Mdl);
+            }
+
+            /* Clean up and return the exception code */
+            IopCleanupAfterException(FileObject, Irp, EventObject, NULL);
+            _SEH2_YIELD(return _SEH2_GetExceptionCode());
+        }
+        _SEH2_END;
+    }
+
+    /* Now set the deferred I/O flags */
+    Irp->Flags = (Write ? IRP_WRITE_OPERATION : IRP_READ_OPERATION) | IRP_DEFER_IO_COMPLETION;
+
+    /* Perform the call */
+    return IopPerformSynchronousRequest(DeviceObject,
+                                        Irp,
+                                        FileObject,
+                                        TRUE,
+                                        PreviousMode,
+                                        Synchronous,
+                                        Write ? IopWriteTransfer : IopReadTransfer);
+}
+
+static
+NTSTATUS
+IopSetIoCompletionNotification(IN HANDLE FileHandle,
+                               OUT PIO_STATUS_BLOCK IoStatusBlock,
+                               IN PVOID FileInformation,
+                               IN ULONG Length,
+                               IN KPROCESSOR_MODE PreviousMode)
+{
+    PFILE_OBJECT FileObject;
+    NTSTATUS Status;
+    ULONG Flags, FileFlags = 0;
+
+    /* Validate the length */
+    if (Length < sizeof(FILE_IO_COMPLETION_NOTIFICATION_INFORMATION))
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    _SEH2_TRY
+    {
+        if (PreviousMode != KernelMode)
+        {
+            /* Probe the I/O Status block and the information */
+            ProbeForWriteIoStatusBlock(IoStatusBlock);
+            ProbeForRead(FileInformation, Length, sizeof(ULONG));
+        }
+
+        /* Capture the flags */
+        Flags = ((PFILE_IO_COMPLETION_NOTIFICATION_INFORMATION)FileInformation)->Flags;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Return the exception code */
+        _SEH2_YIELD(return _SEH2_GetExceptionCode());
+    }
+    _SEH2_END;
+
+    /* Check what the caller wants to skip */
+    if (Flags & ~(FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (Flags & FILE_SKIP_COMPLETION_PORT_ON_SUCCESS) FileFlags |= FO_SKIP_COMPLETION_PORT;
+    if (Flags & FILE_SKIP_SET_EVENT_ON_HANDLE) FileFlags |= FO_SKIP_SET_EVENT;
+
+    /* Reference the Handle */
+    Status = ObReferenceObjectByHandle(FileHandle,
+                                       0,
+                                       IoFileObjectType,
+                                       PreviousMode,
+                                       (PVOID *)&FileObject,
+                                       NULL);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /*
+     * This only changes how the I/O manager completes requests, so there is no
+     * need to bother the driver. The modes cannot be turned off once set.
+     */
+    InterlockedOr((PLONG)&FileObject->Flags, FileFlags);
+    ObDereferenceObject(FileObject);
+
+    _SEH2_TRY
+    {
+        /* Fill out the I/O Status Block */
+        IoStatusBlock->Information = 0;
+        IoStatusBlock->Status = STATUS_SUCCESS;
+    }
+    _SEH2_EXCEPT(EXCEPTION_EXECUTE_HANDLER)
+    {
+        /* Ignore, the change is done already */
+    }
+    _SEH2_END;
+
+    return STATUS_SUCCESS;
+}
+
 /* PUBLIC FUNCTIONS **********************************************************/
 
 /*
@@ -1876,7 +2255,8 @@ NtLockFile(IN HANDLE FileHandle,
             }
 
             /* Set completion if required */
-            if (FileObject->CompletionContext != NULL && ApcContext != NULL)
+            if (FileObject->CompletionContext != NULL && ApcContext != NULL &&
+                !IopSkipCompletionPort(FileObject, KernelIosb.Status))
             {
                 if (!NT_SUCCESS(IoSetIoCompletion(FileObject->CompletionContext->Port,
                                                   FileObject->CompletionContext->Key,
@@ -3030,7 +3410,7 @@ NtReadFile(IN HANDLE FileHandle,
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS
 NTAPI
@@ -3044,8 +3424,16 @@ NtReadFileScatter(IN HANDLE FileHandle,
                   IN PLARGE_INTEGER  ByteOffset,
                   IN PULONG Key OPTIONAL)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    return IopReadWriteFileSegments(FileHandle,
+                                    Event,
+                                    UserApcRoutine,
+                                    UserApcContext,
+                                    UserIoStatusBlock,
+                                    BufferDescription,
+                                    BufferLength,
+                                    ByteOffset,
+                                    Key,
+                                    FALSE);
 }
 
 /*
@@ -3093,6 +3481,16 @@ NtSetInformationFile(IN HANDLE FileHandle,
     PAGED_CODE();
     IOTRACE(IO_API_DEBUG, "FileHandle: %p\n", FileHandle);
 
+    /* Completion notification modes only concern the I/O manager */
+    if (FileInformationClass == FileIoCompletionNotificationInformation)
+    {
+        return IopSetIoCompletionNotification(FileHandle,
+                                              IoStatusBlock,
+                                              FileInformation,
+                                              Length,
+                                              PreviousMode);
+    }
+
     /* Check if we're called from user mode */
     if (PreviousMode != KernelMode)
     {
@@ -4097,6 +4495,9 @@ NtWriteFile(IN HANDLE FileHandle,
                                         IopWriteTransfer);
 }
 
+/*
+ * @implemented
+ */
 NTSTATUS
 NTAPI
 NtWriteFileGather(IN HANDLE FileHandle,
@@ -4109,8 +4510,16 @@ NtWriteFileGather(IN HANDLE FileHandle,
                   IN PLARGE_INTEGER ByteOffset,
                   IN PULONG Key OPTIONAL)
 {
-    UNIMPLEMENTED;
-    return STATUS_NOT_IMPLEMENTED;
+    return IopReadWriteFileSegments(FileHandle,
+                                    Event,
+                                    UserApcRoutine,
+                                    UserApcContext,
+                                    UserIoStatusBlock,
+                                    BufferDescription,
+                                    BufferLength,
+                                    ByteOffset,
+                                    Key,
+                                    TRUE);
 }
 
 /*
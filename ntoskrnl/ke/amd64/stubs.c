@@ -195,6 +195,17 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* Check if we should look for ready threads on other CPUs */
+        if ((Prcb->IdleSchedule) && !(Prcb->NextThread))
+        {
+            /* Do it with interrupts enabled, since it spins on PRCB locks */
+            _enable();
+            KiIdleSchedule(Prcb);
+            _disable();
+        }
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
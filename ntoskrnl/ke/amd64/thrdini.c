@@ -145,6 +145,9 @@ KiSwapContextResume(
     PKIPCR Pcr = (PKIPCR)KeGetPcr();
     PKPROCESS OldProcess, NewProcess;
 
+    /* We are off the old thread's stack, other CPUs may switch to it now */
+    OldThread->SwapBusy = FALSE;
+
     /* Setup ring 0 stack pointer */
     Pcr->TssBase->Rsp0 = (ULONG64)NewThread->InitialStack; // FIXME: NPX save area?
     Pcr->Prcb.RspBase = Pcr->TssBase->Rsp0;
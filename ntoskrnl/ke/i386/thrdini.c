@@ -294,6 +294,17 @@ KiIdleLoop(VOID)
             KiRetireDpcList(Prcb);
         }
 
+#ifdef CONFIG_SMP
+        /* Check if we should look for ready threads on other CPUs */
+        if ((Prcb->IdleSchedule) && !(Prcb->NextThread))
+        {
+            /* Do it with interrupts enabled, since it spins on PRCB locks */
+            _enable();
+            KiIdleSchedule(Prcb);
+            _disable();
+        }
+#endif
+
         /* Check if a new thread is scheduled for execution */
         if (Prcb->NextThread)
         {
@@ -334,6 +345,9 @@ KiSwapContextExit(IN PKTHREAD OldThread,
     /* We are on the new thread stack now */
     NewThread = Pcr->PrcbData.CurrentThread;
 
+    /* We are off the old thread's stack, other CPUs may switch to it now */
+    OldThread->SwapBusy = FALSE;
+
     /* Now we are the new thread. Check if it's in a new process */
     OldProcess = OldThread->ApcState.Process;
     NewProcess = NewThread->ApcState.Process;
@@ -438,6 +452,11 @@ KiSwapContextEntry(IN PKSWITCHFRAME SwitchFrame,
     /* Get the old thread and set its kernel stack */
     OldThread->KernelStack = SwitchFrame;
 
+#ifdef CONFIG_SMP
+    /* Wait until the new thread has been switched out on its old CPU */
+    while (NewThread->SwapBusy) YieldProcessor();
+#endif
+
     /* ISRs can change FPU state, so disable interrupts while checking */
     _disable();
 
@@ -15,9 +15,13 @@
 #ifdef _WIN64
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr64((PLONG64)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd64((PLONG64)Destination, SetMember);
 #else
 # define InterlockedOrSetMember(Destination, SetMember) \
     InterlockedOr((PLONG)Destination, SetMember);
+# define InterlockedAndSetMember(Destination, SetMember) \
+    InterlockedAnd((PLONG)Destination, SetMember);
 #endif
 
 /* GLOBALS *******************************************************************/
@@ -25,15 +29,270 @@
 ULONG_PTR KiIdleSummary;
 ULONG_PTR KiIdleSMTSummary;
 
+/* PRIVATE FUNCTIONS *********************************************************/
+
+FORCEINLINE
+VOID
+KiSetIdleSummary(IN PKPRCB Prcb)
+{
+    /* Add this CPU to the idle summary */
+    InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+
+#ifndef _M_ARM
+    /* If all of its SMT siblings are idle too, the whole core is idle */
+    if ((KiIdleSummary & Prcb->MultiThreadProcessorSet) ==
+        Prcb->MultiThreadProcessorSet)
+    {
+        InterlockedOrSetMember(&KiIdleSMTSummary, Prcb->MultiThreadProcessorSet);
+    }
+#endif
+}
+
+FORCEINLINE
+VOID
+KiClearIdleSummary(IN PKPRCB Prcb)
+{
+    /* Remove this CPU from the idle summary and its core from the SMT one */
+    InterlockedAndSetMember(&KiIdleSummary, ~Prcb->SetMember);
+#ifndef _M_ARM
+    InterlockedAndSetMember(&KiIdleSMTSummary, ~Prcb->MultiThreadProcessorSet);
+#endif
+}
+
+//
+// A CPU is idle if its idle thread is either running with nothing else
+// scheduled, or has just been selected to run next. Must be called with the
+// PRCB lock held.
+//
+FORCEINLINE
+BOOLEAN
+KiIsProcessorIdle(IN PKPRCB Prcb)
+{
+    /* Check if there's a thread scheduled */
+    if (Prcb->NextThread) return (Prcb->NextThread == Prcb->IdleThread);
+
+    /* Otherwise, check what is running */
+    return (Prcb->CurrentThread == Prcb->IdleThread);
+}
+
+#ifdef CONFIG_SMP
+//
+// This routine acquires two PRCB locks in a consistent (CPU number) order so
+// that two CPUs looking at each other's ready queues can never deadlock.
+//
+FORCEINLINE
+VOID
+KiAcquireTwoPrcbLocks(IN PKPRCB FirstPrcb,
+                      IN PKPRCB SecondPrcb)
+{
+    /* Always lock the lowest numbered CPU first */
+    if (FirstPrcb->Number < SecondPrcb->Number)
+    {
+        KiAcquirePrcbLock(FirstPrcb);
+        KiAcquirePrcbLock(SecondPrcb);
+    }
+    else
+    {
+        KiAcquirePrcbLock(SecondPrcb);
+        KiAcquirePrcbLock(FirstPrcb);
+    }
+}
+
+FORCEINLINE
+VOID
+KiReleaseTwoPrcbLocks(IN PKPRCB FirstPrcb,
+                      IN PKPRCB SecondPrcb)
+{
+    /* Order doesn't matter when releasing */
+    KiReleasePrcbLock(FirstPrcb);
+    KiReleasePrcbLock(SecondPrcb);
+}
+
+//
+// Returns the priority that a thread must exceed in order to preempt whatever
+// the given CPU is running or about to run. This is a lockless hint only, the
+// caller re-checks it with the PRCB lock held.
+//
+FORCEINLINE
+KPRIORITY
+KiGetProcessorPriority(IN PKPRCB Prcb)
+{
+    PKTHREAD Thread;
+
+    /* Check the standby thread first, then the running one */
+    Thread = Prcb->NextThread;
+    if (!Thread) Thread = Prcb->CurrentThread;
+    return Thread->Priority;
+}
+
+static
+ULONG
+KiSelectIdleProcessor(IN PKTHREAD Thread,
+                      IN KAFFINITY IdleSet)
+{
+    PKPRCB Prcb = KeGetCurrentPrcb();
+    KAFFINITY IdleSmtSet;
+    ULONG Processor;
+
+    /* Use the ideal processor if it's idle */
+    Processor = Thread->IdealProcessor;
+    if (IdleSet & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Otherwise the one it last ran on, whose caches are still warm */
+    Processor = Thread->NextProcessor;
+    if (IdleSet & AFFINITY_MASK(Processor)) return Processor;
+
+    /* Prefer cores where all the SMT siblings are idle */
+    IdleSmtSet = IdleSet & KiIdleSMTSummary;
+    if (IdleSmtSet) IdleSet = IdleSmtSet;
+
+    /* Avoid an IPI if the current CPU qualifies */
+    if (IdleSet & Prcb->SetMember) return Prcb->Number;
+
+    /* Otherwise pick the closest one to the ideal processor */
+    return KeFindNextRightSetAffinity(Thread->IdealProcessor, (ULONG)IdleSet);
+}
+
+static
+ULONG
+KiSelectPreemptProcessor(IN PKTHREAD Thread,
+                         IN KPRIORITY Priority)
+{
+    ULONG IdealProcessor, LastProcessor;
+
+    /* Get the ideal processor, and make sure the thread may run there */
+    IdealProcessor = Thread->IdealProcessor;
+    if (!(Thread->Affinity & AFFINITY_MASK(IdealProcessor)))
+    {
+        /* It may not, use the closest one it can run on */
+        IdealProcessor = KeFindNextRightSetAffinity((UCHAR)IdealProcessor,
+                                                    (ULONG)Thread->Affinity);
+    }
+
+    /* Check if the ideal processor can be preempted */
+    if (Priority > KiGetProcessorPriority(KiProcessorBlock[IdealProcessor]))
+    {
+        return IdealProcessor;
+    }
+
+    /* It can't, so try the processor the thread last ran on instead */
+    LastProcessor = Thread->NextProcessor;
+    if ((LastProcessor != IdealProcessor) &&
+        (Thread->Affinity & AFFINITY_MASK(LastProcessor)) &&
+        (Priority > KiGetProcessorPriority(KiProcessorBlock[LastProcessor])))
+    {
+        return LastProcessor;
+    }
+
+    /* Nobody can be preempted, queue it on the ideal processor */
+    return IdealProcessor;
+}
+
+static
+PKTHREAD
+KiStealReadyThread(IN PKPRCB SourcePrcb,
+                   IN PKPRCB TargetPrcb)
+{
+    ULONG Summary;
+    ULONG Priority;
+    PLIST_ENTRY ListHead, ListEntry;
+    PKTHREAD Thread;
+
+    /* Scan the source ready queues from the highest priority down */
+    Summary = SourcePrcb->ReadySummary;
+    while (Summary)
+    {
+        /* Get the highest priority queue left */
+        BitScanReverse(&Priority, Summary);
+        Summary ^= PRIORITY_MASK(Priority);
+
+        /* Find the first thread which is allowed to run on the target CPU */
+        ListHead = &SourcePrcb->DispatcherReadyListHead[Priority];
+        for (ListEntry = ListHead->Flink;
+             ListEntry != ListHead;
+             ListEntry = ListEntry->Flink)
+        {
+            Thread = CONTAINING_RECORD(ListEntry, KTHREAD, WaitListEntry);
+            ASSERT(Thread->State == Ready);
+            ASSERT(Thread->NextProcessor == SourcePrcb->Number);
+            if (!(Thread->Affinity & TargetPrcb->SetMember)) continue;
+
+            /* Found one, remove it from the source CPU */
+            if (RemoveEntryList(&Thread->WaitListEntry))
+            {
+                /* The list is empty now, reset the ready summary */
+                SourcePrcb->ReadySummary ^= PRIORITY_MASK(Priority);
+            }
+
+            /* Return it */
+            return Thread;
+        }
+    }
+
+    /* Nothing we can run here */
+    return NULL;
+}
+#endif
+
 /* FUNCTIONS *****************************************************************/
 
 PKTHREAD
 FASTCALL
 KiIdleSchedule(IN PKPRCB Prcb)
 {
-    /* FIXME: TODO */
-    ASSERTMSG("SMP: Not yet implemented\n", FALSE);
-    return NULL;
+    PKTHREAD Thread = NULL;
+#ifdef CONFIG_SMP
+    PKPRCB SourcePrcb;
+    ULONG i, Number;
+#endif
+
+    /* Sanity checks */
+    ASSERT(Prcb == KeGetCurrentPrcb());
+    ASSERT(KeGetCurrentIrql() == DISPATCH_LEVEL);
+
+    /* The request is being handled */
+    Prcb->IdleSchedule = FALSE;
+
+#ifdef CONFIG_SMP
+    /* Loop the other CPUs, starting with our neighbour */
+    for (i = 1; i < (ULONG)KeNumberProcessors; i++)
+    {
+        /* Get the PRCB and skip it if it looks like it has no ready threads */
+        Number = (Prcb->Number + i) % KeNumberProcessors;
+        SourcePrcb = KiProcessorBlock[Number];
+        if (!SourcePrcb->ReadySummary) continue;
+
+        /* Lock both CPUs */
+        KiAcquireTwoPrcbLocks(Prcb, SourcePrcb);
+
+        /* Stop if we were given a thread in the meantime */
+        if (Prcb->NextThread)
+        {
+            KiReleaseTwoPrcbLocks(Prcb, SourcePrcb);
+            break;
+        }
+
+        /* Try to take a ready thread from the other CPU */
+        Thread = KiStealReadyThread(SourcePrcb, Prcb);
+        if (Thread)
+        {
+            /* We're not idle anymore */
+            KiClearIdleSummary(Prcb);
+
+            /* Move the thread to this CPU and set it on standby */
+            Thread->NextProcessor = Prcb->Number;
+            Thread->State = Standby;
+            Prcb->NextThread = Thread;
+        }
+
+        /* Release the locks and stop if we got something */
+        KiReleaseTwoPrcbLocks(Prcb, SourcePrcb);
+        if (Thread) break;
+    }
+#endif
+
+    /* Return the thread we found, if any. The idle loop will switch to it */
+    return Thread;
 }
 
 VOID
@@ -83,6 +342,9 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     ULONG Processor = 0;
     KPRIORITY OldPriority;
     PKTHREAD NextThread;
+#ifdef CONFIG_SMP
+    KAFFINITY IdleSet;
+#endif
 
     /* Sanity checks */
     ASSERT(Thread->State == DeferredReady);
@@ -228,27 +490,40 @@ KiDeferredReadyThread(IN PKTHREAD Thread)
     OldPriority = Thread->Priority;
     Thread->Preempted = FALSE;
 
-    /* Queue the thread on CPU 0 and get the PRCB and lock it */
-    Thread->NextProcessor = 0;
-    Prcb = KiProcessorBlock[0];
+#ifdef CONFIG_SMP
+    /* Check if any of the CPUs this thread can run on is idle */
+    IdleSet = KiIdleSummary & Thread->Affinity;
+    if (IdleSet)
+    {
+        /* Pick the best idle CPU */
+        Processor = KiSelectIdleProcessor(Thread, IdleSet);
+    }
+    else
+    {
+        /* Pick the CPU we're most likely to preempt */
+        Processor = KiSelectPreemptProcessor(Thread, OldPriority);
+    }
+#endif
+
+    /* Set the CPU number, get the PRCB and lock it */
+    Thread->NextProcessor = (UCHAR)Processor;
+    Prcb = KiProcessorBlock[Processor];
     KiAcquirePrcbLock(Prcb);
 
-    /* Check if we have an idle summary */
-    if (KiIdleSummary)
+    /* Check if the CPU is (still) idle */
+    if (KiIsProcessorIdle(Prcb))
     {
-        /* Clear it and set this thread as the next one */
-        KiIdleSummary = 0;
+        /* Clear its idle summary and set this thread as the next one */
+        KiClearIdleSummary(Prcb);
         Thread->State = Standby;
         Prcb->NextThread = Thread;
 
-        /* Unlock the PRCB and return */
+        /* Unlock the PRCB and wake up the CPU if it's not this one */
         KiReleasePrcbLock(Prcb);
+        KiRescheduleThread(TRUE, Processor);
         return;
     }
 
-    /* Set the CPU number */
-    Thread->NextProcessor = (UCHAR)Processor;
-
     /* Get the next scheduled thread */
     NextThread = Prcb->NextThread;
     if (NextThread)
@@ -336,12 +611,9 @@ KiSelectNextThread(IN PKPRCB Prcb)
         /* Didn't find any, get the current idle thread */
         Thread = Prcb->IdleThread;
 
-        /* Enable idle scheduling */
-        InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+        /* Enable idle scheduling, the idle loop will look for work elsewhere */
+        KiSetIdleSummary(Prcb);
         Prcb->IdleSchedule = TRUE;
-
-        /* FIXME: SMT support */
-        ASSERTMSG("SMP: Not yet implemented\n", FALSE);
     }
 
     /* Sanity checks and return the thread */
@@ -385,8 +657,9 @@ KiSwapThread(IN PKTHREAD CurrentThread,
         }
         else
         {
-            /* Set the idle summary */
-            InterlockedOrSetMember(&KiIdleSummary, Prcb->SetMember);
+            /* Set the idle summary and enable idle scheduling */
+            KiSetIdleSummary(Prcb);
+            Prcb->IdleSchedule = TRUE;
 
             /* Schedule the idle thread */
             NextThread = Prcb->IdleThread;
@@ -686,6 +959,10 @@ KiSetAffinityThread(IN PKTHREAD Thread,
                     IN KAFFINITY Affinity)
 {
     KAFFINITY OldAffinity;
+    PKPRCB Prcb;
+    ULONG Processor;
+    PKTHREAD NextThread;
+    BOOLEAN RequestInterrupt;
 
     /* Get the current affinity */
     OldAffinity = Thread->UserAffinity;
@@ -704,10 +981,121 @@ KiSetAffinityThread(IN PKTHREAD Thread,
     /* Check if system affinity is disabled */
     if (!Thread->SystemAffinityActive)
     {
-#ifdef CONFIG_SMP
-        /* FIXME: TODO */
-        DPRINT1("Affinity support disabled!\n");
-#endif
+        /* Update the scheduling affinity too */
+        Thread->Affinity = Affinity;
+
+        /* Make sure the ideal processor is still one we can run on */
+        if (!(Affinity & AFFINITY_MASK(Thread->UserIdealProcessor)))
+        {
+            Thread->IdealProcessor = KeFindNextRightSetAffinity(Thread->UserIdealProcessor,
+                                                                (ULONG)Affinity);
+        }
+        else
+        {
+            Thread->IdealProcessor = Thread->UserIdealProcessor;
+        }
+
+        /* Loop in case the thread changes state under us */
+        for (;;)
+        {
+            if (Thread->State == Ready)
+            {
+                /* Nothing to do if it's on the process ready queue */
+                if (Thread->ProcessReadyQueue) break;
+
+                /* Get the PRCB for the thread and lock it */
+                Processor = Thread->NextProcessor;
+                Prcb = KiProcessorBlock[Processor];
+                KiAcquirePrcbLock(Prcb);
+
+                /* Make sure the thread is still ready and on this CPU */
+                if ((Thread->State != Ready) ||
+                    (Thread->NextProcessor != Prcb->Number))
+                {
+                    /* Release the lock and try again */
+                    KiReleasePrcbLock(Prcb);
+                    continue;
+                }
+
+                /* Check if it's queued on a CPU it may not run on anymore */
+                if (!(Prcb->SetMember & Affinity))
+                {
+                    /* Remove it from the current queue */
+                    if (RemoveEntryList(&Thread->WaitListEntry))
+                    {
+                        /* Update the ready summary */
+                        Prcb->ReadySummary ^= PRIORITY_MASK(Thread->Priority);
+                    }
+
+                    /* And dispatch it again */
+                    KiInsertDeferredReadyList(Thread);
+                }
+
+                /* Release the PRCB lock */
+                KiReleasePrcbLock(Prcb);
+            }
+            else if (Thread->State == Standby)
+            {
+                /* Get the PRCB for the thread and lock it */
+                Processor = Thread->NextProcessor;
+                Prcb = KiProcessorBlock[Processor];
+                KiAcquirePrcbLock(Prcb);
+
+                /* Check if we're still the next thread to run */
+                if (Thread != Prcb->NextThread)
+                {
+                    /* Release the lock and try again */
+                    KiReleasePrcbLock(Prcb);
+                    continue;
+                }
+
+                /* Check if we may not run there anymore */
+                if (!(Prcb->SetMember & Affinity))
+                {
+                    /* Select another thread for this CPU and dispatch ours */
+                    NextThread = KiSelectNextThread(Prcb);
+                    NextThread->State = Standby;
+                    Prcb->NextThread = NextThread;
+                    KiInsertDeferredReadyList(Thread);
+                }
+
+                /* Release the PRCB lock */
+                KiReleasePrcbLock(Prcb);
+            }
+            else if (Thread->State == Running)
+            {
+                /* Get the PRCB for the thread and lock it */
+                Processor = Thread->NextProcessor;
+                Prcb = KiProcessorBlock[Processor];
+                KiAcquirePrcbLock(Prcb);
+
+                /* Check if we're still the current thread running */
+                if (Thread != Prcb->CurrentThread)
+                {
+                    /* Thread changed, release lock and restart */
+                    KiReleasePrcbLock(Prcb);
+                    continue;
+                }
+
+                /* Check if we may not run there anymore */
+                RequestInterrupt = FALSE;
+                if (!(Prcb->SetMember & Affinity) && !(Prcb->NextThread))
+                {
+                    /* Select another thread, ours gets requeued when it leaves */
+                    NextThread = KiSelectNextThread(Prcb);
+                    NextThread->State = Standby;
+                    Prcb->NextThread = NextThread;
+                    RequestInterrupt = TRUE;
+                }
+
+                /* Release the lock and get the other CPU to reschedule */
+                KiReleasePrcbLock(Prcb);
+                KiRescheduleThread(RequestInterrupt, Processor);
+            }
+
+            /* If we got here, then thread state was consistent, so bail out */
+            break;
+        }
     }
 
     /* Return the old affinity */
@@ -25,6 +25,7 @@ WCHAR MmLargePageDriverBuffer[512] = {0};
 ULONG MmLargePageDriverBufferLength = -1;
 LIST_ENTRY MiLargePageDriverList;
 BOOLEAN MiLargePageAllDrivers;
+SIZE_T MmLargePageMinimum;
 
 /* FUNCTIONS ******************************************************************/
 
@@ -33,19 +34,20 @@ VOID
 NTAPI
 MiInitializeLargePageSupport(VOID)
 {
-#if _MI_PAGING_LEVELS > 2
-    DPRINT1("MiInitializeLargePageSupport: PAE/x64 Not Implemented\n");
-    //ASSERT(FALSE);
-#else
     /* Initialize the large-page hyperspace PTE used for initial mapping */
     MiLargePageHyperPte = MiReserveSystemPtes(1, SystemPteSpace);
     ASSERT(MiLargePageHyperPte);
     MiLargePageHyperPte->u.Long = 0;
 
+#ifndef _M_AMD64
     /* Initialize the process tracking list, and insert the system process */
     InitializeListHead(&MmProcessList);
     InsertTailList(&MmProcessList, &PsGetCurrentProcess()->MmProcessLinks);
 #endif
+
+    /* A large page is whatever a single PDE maps, if the CPU can do it */
+    if (KeFeatureBits & KF_LARGE_PAGE) MmLargePageMinimum = PDE_MAPPED_VA;
+    DPRINT("Large page size: %Iu bytes\n", MmLargePageMinimum);
 }
 
 CODE_SEG("INIT")
@@ -67,7 +69,8 @@ VOID
 NTAPI
 MiInitializeDriverLargePageList(VOID)
 {
-    PWCHAR p, pp;
+    PWCHAR p, pp, Name;
+    PMI_LARGE_PAGE_DRIVER_ENTRY LargePageDriverEntry;
 
     /* Initialize the list */
     InitializeListHead(&MiLargePageDriverList);
@@ -96,8 +99,230 @@ MiInitializeDriverLargePageList(VOID)
             break;
         }
 
-        DPRINT1("Large page drivers not supported\n");
-        ASSERT(FALSE);
+        /* Otherwise this is a driver name, find where it ends */
+        Name = p;
+        while ((p < pp) &&
+               (*p != L' ') && (*p != L'\n') && (*p != L'\r') && (*p != L'\t'))
+        {
+            p++;
+        }
+
+        /* Allocate an entry for it */
+        LargePageDriverEntry = ExAllocatePoolWithTag(NonPagedPool,
+                                                     sizeof(MI_LARGE_PAGE_DRIVER_ENTRY),
+                                                     TAG_MM);
+        if (!LargePageDriverEntry) break;
+
+        /* The name stays in the registry buffer, which is never freed */
+        LargePageDriverEntry->BaseName.Buffer = Name;
+        LargePageDriverEntry->BaseName.Length = (USHORT)((p - Name) * sizeof(WCHAR));
+        LargePageDriverEntry->BaseName.MaximumLength = LargePageDriverEntry->BaseName.Length;
+        InsertTailList(&MiLargePageDriverList, &LargePageDriverEntry->Links);
+    }
+}
+
+static
+VOID
+MiReturnLargePageCharges(IN PFN_COUNT LargePageCount)
+{
+    SIZE_T PageCount = (SIZE_T)LargePageCount * (PDE_MAPPED_VA >> PAGE_SHIFT);
+
+    /* These pages are resident and committed until they are freed */
+    InterlockedExchangeAddSizeT(&MmResidentAvailablePages, PageCount);
+    InterlockedExchangeAddSizeT(&MmTotalCommittedPages, -(SSIZE_T)PageCount);
+}
+
+VOID
+NTAPI
+MiFreeLargePages(IN PPFN_NUMBER PageFrames,
+                 IN PFN_COUNT LargePageCount)
+{
+    PFN_NUMBER PageFrameIndex, PageCount = PDE_MAPPED_VA >> PAGE_SHIFT;
+    PFN_COUNT i;
+    PMMPFN Pfn1;
+    KIRQL OldIrql;
+
+    /* Loop every large page */
+    for (i = 0; i < LargePageCount; i++)
+    {
+        /* Return each of its pages to the free list */
+        OldIrql = MiAcquirePfnLock();
+        PageFrameIndex = PageFrames[i];
+        for (Pfn1 = MiGetPfnEntry(PageFrameIndex);
+             PageFrameIndex < PageFrames[i] + PageCount;
+             PageFrameIndex++, Pfn1++)
+        {
+            MI_SET_PFN_DELETED(Pfn1);
+            MiDecrementShareCount(Pfn1, PageFrameIndex);
+        }
+        MiReleasePfnLock(OldIrql);
+    }
+
+    /* They are no longer locked in memory nor committed */
+    MiReturnLargePageCharges(LargePageCount);
+}
+
+NTSTATUS
+NTAPI
+MiAllocateLargePages(IN PFN_COUNT LargePageCount,
+                     OUT PPFN_NUMBER PageFrames)
+{
+    PFN_NUMBER PageFrameIndex, PageCount = PDE_MAPPED_VA >> PAGE_SHIFT;
+    SIZE_T TotalPages = (SIZE_T)LargePageCount * PageCount;
+    PFN_COUNT i;
+    PMMPFN Pfn1;
+    PAGED_CODE();
+
+    /* Large pages can't be paged out, so they count as locked down for good */
+    if ((SSIZE_T)TotalPages >
+        (SSIZE_T)(MmResidentAvailablePages - MmSystemLockPagesCount - 256))
+    {
+        DPRINT1("Not enough resident pages for %lu large pages\n", LargePageCount);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    /* And they are committed from the start */
+    if (MmTotalCommittedPages + TotalPages > MmTotalCommitLimit)
+    {
+        DPRINT1("Commit limit reached for %lu large pages\n", LargePageCount);
+        return STATUS_COMMITMENT_LIMIT;
+    }
+
+    InterlockedExchangeAddSizeT(&MmResidentAvailablePages, -(SSIZE_T)TotalPages);
+    InterlockedExchangeAddSizeT(&MmTotalCommittedPages, TotalPages);
+
+    /* Loop every large page */
+    for (i = 0; i < LargePageCount; i++)
+    {
+        /* It must be a physically contiguous run, aligned on its own size */
+        PageFrameIndex = MiFindContiguousPages(0,
+                                               MmHighestPhysicalPage,
+                                               PageCount,
+                                               PageCount,
+                                               MmCached);
+        if (!PageFrameIndex)
+        {
+            /* Give back what we already got, and the charges for the rest */
+            DPRINT1("Out of contiguous memory for large page %lu of %lu\n", i, LargePageCount);
+            MiFreeLargePages(PageFrames, i);
+            MiReturnLargePageCharges(LargePageCount - i);
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        /* This is not a contiguous memory allocation as far as anyone else is concerned */
+        Pfn1 = MiGetPfnEntry(PageFrameIndex);
+        Pfn1->u3.e1.StartOfAllocation = 0;
+        (Pfn1 + PageCount - 1)->u3.e1.EndOfAllocation = 0;
+
+        /* The pages could come from the free list, so zero them before user-mode sees them */
+        PageFrames[i] = PageFrameIndex;
+        while (PageFrameIndex < PageFrames[i] + PageCount)
+        {
+            MiZeroPhysicalPage(PageFrameIndex++);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+NTAPI
+MiMapLargePages(IN PEPROCESS Process,
+                IN ULONG_PTR StartingAddress,
+                IN ULONG ProtectionMask,
+                IN PPFN_NUMBER PageFrames,
+                IN PFN_COUNT LargePageCount)
+{
+    PETHREAD CurrentThread = PsGetCurrentThread();
+    PMMPDE PointerPde;
+#if (_MI_PAGING_LEVELS >= 3)
+    PMMPTE PointerPpe, PointerPxe;
+#endif
+    MMPDE TempPde;
+    PFN_COUNT i;
+
+    /* Lock the working set, the page directories will be touched */
+    MiLockProcessWorkingSetUnsafe(Process, CurrentThread);
+
+    /* Loop every large page */
+    for (i = 0; i < LargePageCount; i++, StartingAddress += PDE_MAPPED_VA)
+    {
+        PointerPde = MiAddressToPde(StartingAddress);
+
+#if (_MI_PAGING_LEVELS >= 3)
+        /* Make sure the page directory exists, top-down, like MiMakePdeExistAndMakeValid */
+        PointerPpe = MiAddressToPte(PointerPde);
+        PointerPxe = MiAddressToPde(PointerPde);
+        if (!PointerPxe->u.Hard.Valid)
+        {
+            MiMakeSystemAddressValid(PointerPpe, Process);
+            ASSERT(PointerPxe->u.Hard.Valid == 1);
+        }
+        if (!PointerPpe->u.Hard.Valid)
+        {
+            MiMakeSystemAddressValid(PointerPde, Process);
+            ASSERT(PointerPpe->u.Hard.Valid == 1);
+        }
+#endif
+
+        /* The range was just reserved, but an empty page table could still be around */
+        if (PointerPde->u.Long != 0)
+        {
+            DPRINT1("PDE %p for large page at %p is in use\n", PointerPde, (PVOID)StartingAddress);
+            MiUnlockProcessWorkingSetUnsafe(Process, CurrentThread);
+            MiFreeLargePages(&PageFrames[i], LargePageCount - i);
+            return STATUS_CONFLICTING_ADDRESSES;
+        }
+
+        /* Build a large user PDE for the run and write it */
+        MI_MAKE_HARDWARE_PTE_USER(&TempPde,
+                                  MiAddressToPte(StartingAddress),
+                                  ProtectionMask,
+                                  PageFrames[i]);
+        TempPde.u.Hard.LargePage = 1;
+        MI_WRITE_VALID_PDE(PointerPde, TempPde);
+    }
+
+    /* All done */
+    MiUnlockProcessWorkingSetUnsafe(Process, CurrentThread);
+    return STATUS_SUCCESS;
+}
+
+VOID
+NTAPI
+MiDeleteLargePages(IN ULONG_PTR StartingAddress,
+                   IN ULONG_PTR EndingAddress)
+{
+    PMMPDE PointerPde, LastPde;
+    PFN_NUMBER PageFrameIndex;
+
+    /* The caller holds the working set lock */
+    ASSERT((StartingAddress & (PDE_MAPPED_VA - 1)) == 0);
+
+    /* Loop every large page */
+    PointerPde = MiAddressToPde(StartingAddress);
+    LastPde = MiAddressToPde(EndingAddress);
+    for (; PointerPde <= LastPde; PointerPde++)
+    {
+#if (_MI_PAGING_LEVELS >= 3)
+        /* The page directory may not exist if the mapping failed half way */
+        if (!(MiAddressToPde(PointerPde)->u.Hard.Valid) ||
+            !(MiAddressToPte(PointerPde)->u.Hard.Valid))
+        {
+            continue;
+        }
+#endif
+
+        /* Skip anything that is not one of our large pages */
+        if (!(PointerPde->u.Hard.Valid) || !(MI_IS_PAGE_LARGE(PointerPde))) continue;
+
+        /* Unmap it, and make sure nobody can still reach it through the TLB */
+        PageFrameIndex = PFN_FROM_PTE(PointerPde);
+        MI_ERASE_PTE(PointerPde);
+        KeFlushCurrentTb();
+
+        /* Now the pages can go */
+        MiFreeLargePages(&PageFrameIndex, 1);
     }
 }
 
@@ -1015,9 +1015,6 @@ MmProbeAndLockPages(IN PMDL Mdl,
     TotalPages = LockPages;
     StartAddress = Address;
 
-    /* Large pages not supported */
-    ASSERT(!MI_IS_PHYSICAL_ADDRESS(Address));
-
     //
     // Now probe them
     //
@@ -1200,7 +1197,7 @@ MmProbeAndLockPages(IN PMDL Mdl,
                (PointerPpe->u.Hard.Valid == 0) ||
 #endif
                (PointerPde->u.Hard.Valid == 0) ||
-               (PointerPte->u.Hard.Valid == 0))
+               (!(MI_IS_PAGE_LARGE(PointerPde)) && (PointerPte->u.Hard.Valid == 0)))
         {
             //
             // What kind of lock were we using?
@@ -1252,12 +1249,24 @@ MmProbeAndLockPages(IN PMDL Mdl,
         }
 
         //
-        // Check if this was a write or modify
+        // Large pages don't have PTEs, the PDE maps the memory directly
         //
-        if (Operation != IoReadAccess)
+        if (MI_IS_PAGE_LARGE(PointerPde))
+        {
+            //
+            // Which must be writable for a write, there's no copy on write here
+            //
+            if ((Operation != IoReadAccess) &&
+                (MI_IS_PAGE_WRITEABLE(PointerPde) == FALSE))
+            {
+                Status = STATUS_ACCESS_VIOLATION;
+                goto CleanupWithLock;
+            }
+        }
+        else if (Operation != IoReadAccess)
         {
             //
-            // Check if the PTE is not writable
+            // Check if this was a write or modify, and if the PTE is not writable
             //
             if (MI_IS_PAGE_WRITEABLE(PointerPte) == FALSE)
             {
@@ -1337,7 +1346,15 @@ MmProbeAndLockPages(IN PMDL Mdl,
         //
         // Grab the PFN
         //
-        PageFrameIndex = PFN_FROM_PTE(PointerPte);
+        if (MI_IS_PAGE_LARGE(PointerPde))
+        {
+            PageFrameIndex = PFN_FROM_PTE(PointerPde) +
+                             MiAddressToPteOffset(MiPteToAddress(PointerPte));
+        }
+        else
+        {
+            PageFrameIndex = PFN_FROM_PTE(PointerPte);
+        }
         Pfn1 = MiGetPfnEntry(PageFrameIndex);
         if (Pfn1)
         {
@@ -1652,15 +1669,87 @@ MmUnmapReservedMapping(IN PVOID BaseAddress,
 }
 
 /*
- * @unimplemented
+ * @implemented
  */
 NTSTATUS
 NTAPI
 MmPrefetchPages(IN ULONG NumberOfLists,
                 IN PREAD_LIST *ReadLists)
 {
+#ifndef NEWCC
+    PREAD_LIST ReadList;
+    PSECTION_OBJECT_POINTERS SectionObjectPointer;
+    PROS_SHARED_CACHE_MAP SharedCacheMap;
+    PROS_VACB Vacb;
+    LONGLONG FileOffset, ViewOffset, LastViewOffset, BaseOffset;
+    PVOID BaseAddress;
+    BOOLEAN UptoDate;
+    NTSTATUS Status;
+    ULONG i, j;
+    PAGED_CODE();
+
+    for (i = 0; i < NumberOfLists; i++)
+    {
+        ReadList = ReadLists[i];
+
+        /*
+         * The pages are brought into the views of the file's cache map, which
+         * is where both the cache manager and section faults look for them.
+         * A file nobody has opened for caching has nowhere to put them.
+         */
+        SectionObjectPointer = ReadList->FileObject->SectionObjectPointer;
+        if (!SectionObjectPointer || !SectionObjectPointer->SharedCacheMap)
+        {
+            DPRINT1("Not prefetching %wZ, it is not cached\n", &ReadList->FileObject->FileName);
+            continue;
+        }
+        SharedCacheMap = SectionObjectPointer->SharedCacheMap;
+
+        /*
+         * Callers pass the offsets sorted, so every view is read at most once
+         * and the reads go out in file order. Each one is a single large read
+         * rather than one fault per page.
+         */
+        LastViewOffset = -1;
+        for (j = 0; j < ReadList->NumberOfEntries; j++)
+        {
+            FileOffset = (LONGLONG)ReadList->List[j].Alignment;
+            if (FileOffset >= SharedCacheMap->SectionSize.QuadPart)
+                continue;
+
+            ViewOffset = FileOffset - FileOffset % VACB_MAPPING_GRANULARITY;
+            if (ViewOffset == LastViewOffset)
+                continue;
+            LastViewOffset = ViewOffset;
+
+            Status = CcRosGetVacb(SharedCacheMap,
+                                  ViewOffset,
+                                  &BaseOffset,
+                                  &BaseAddress,
+                                  &UptoDate,
+                                  &Vacb);
+            if (!NT_SUCCESS(Status))
+            {
+                /* Out of views, the rest will come in on demand */
+                DPRINT1("CcRosGetVacb failed with 0x%lx\n", Status);
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            if (!UptoDate)
+            {
+                Status = CcReadVirtualAddress(Vacb);
+                UptoDate = NT_SUCCESS(Status);
+            }
+
+            CcRosReleaseVacb(SharedCacheMap, Vacb, UptoDate, FALSE, FALSE);
+        }
+    }
+
+    return STATUS_SUCCESS;
+#else
     UNIMPLEMENTED;
     return STATUS_NOT_IMPLEMENTED;
+#endif
 }
 
 /*
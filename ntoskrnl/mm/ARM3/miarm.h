@@ -549,6 +549,7 @@ extern WCHAR MmVerifyDriverBuffer[512];
 extern WCHAR MmLargePageDriverBuffer[512];
 extern LIST_ENTRY MiLargePageDriverList;
 extern BOOLEAN MiLargePageAllDrivers;
+extern SIZE_T MmLargePageMinimum;
 extern ULONG MmVerifyDriverBufferLength;
 extern ULONG MmLargePageDriverBufferLength;
 extern SIZE_T MmSizeOfNonPagedPoolInBytes;
@@ -2035,6 +2036,37 @@ MiSyncCachedRanges(
     VOID
 );
 
+NTSTATUS
+NTAPI
+MiAllocateLargePages(
+    IN PFN_COUNT LargePageCount,
+    OUT PPFN_NUMBER PageFrames
+);
+
+VOID
+NTAPI
+MiFreeLargePages(
+    IN PPFN_NUMBER PageFrames,
+    IN PFN_COUNT LargePageCount
+);
+
+NTSTATUS
+NTAPI
+MiMapLargePages(
+    IN PEPROCESS Process,
+    IN ULONG_PTR StartingAddress,
+    IN ULONG ProtectionMask,
+    IN PPFN_NUMBER PageFrames,
+    IN PFN_COUNT LargePageCount
+);
+
+VOID
+NTAPI
+MiDeleteLargePages(
+    IN ULONG_PTR StartingAddress,
+    IN ULONG_PTR EndingAddress
+);
+
 BOOLEAN
 NTAPI
 MiIsPfnInUse(
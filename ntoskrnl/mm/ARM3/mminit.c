@@ -2397,7 +2397,7 @@ MmArmInitSystem(IN ULONG Phase,
         /* Set the initial resident page count */
         MmResidentAvailablePages = MmAvailablePages - 32;
 
-        /* Initialize large page structures on PAE/x64, and MmProcessList on x86 */
+        /* Initialize large page support, and MmProcessList on x86 */
         MiInitializeLargePageSupport();
 
         /* Check if the registry says any drivers should be loaded with large pages */
@@ -2467,7 +2467,7 @@ MmArmInitSystem(IN ULONG Phase,
         /* Now setup the shared user data fields */
         ASSERT(SharedUserData->NumberOfPhysicalPages == 0);
         SharedUserData->NumberOfPhysicalPages = MmNumberOfPhysicalPages;
-        SharedUserData->LargePageMinimum = 0;
+        SharedUserData->LargePageMinimum = MmLargePageMinimum;
 
         /* Check for workstation (Wi for WinNT) */
         if (MmProductType == '\0i\0W')
@@ -273,6 +273,13 @@ MiCheckVirtualAddress(IN PVOID VirtualAddress,
             /* ReactOS does not handle AWE VADs yet */
             ASSERT(Vad->u.VadFlags.VadType != VadAwe);
 
+            /* Large pages are mapped when they are allocated, never on demand */
+            if (Vad->u.VadFlags.VadType == VadLargePages)
+            {
+                *ProtectCode = MM_NOACCESS;
+                return NULL;
+            }
+
             /* This must be a TEB/PEB VAD */
             if (Vad->u.VadFlags.MemCommit)
             {
@@ -2185,10 +2192,22 @@ UserFault:
         ASSERT(KeAreAllApcsDisabled() == TRUE);
         ASSERT(PointerPde->u.Hard.Valid == 1);
     }
-    else
+    else if (MI_IS_PAGE_LARGE(PointerPde))
     {
-        /* Not yet implemented in ReactOS */
-        ASSERT(MI_IS_PAGE_LARGE(PointerPde) == FALSE);
+        /* Large pages are always fully mapped, so this can only be a protection fault */
+        if ((MI_IS_WRITE_ACCESS(FaultCode) && !MI_IS_PAGE_WRITEABLE(PointerPde)) ||
+            (MI_IS_INSTRUCTION_FETCH(FaultCode) && !MI_IS_PAGE_EXECUTABLE(PointerPde)))
+        {
+            Status = STATUS_ACCESS_VIOLATION;
+        }
+        else
+        {
+            /* Or another thread got here first, or a stale TLB entry */
+            Status = STATUS_SUCCESS;
+        }
+
+        MiUnlockProcessWorkingSet(CurrentProcess, CurrentThread);
+        return Status;
     }
 
     /* Now capture the PTE. */
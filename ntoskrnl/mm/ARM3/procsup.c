@@ -1364,11 +1364,21 @@ MmCleanProcessAddressSpace(IN PEPROCESS Process)
         ASSERT(VadTree->NumberGenericTableElements >= 1);
         MiRemoveNode((PMMADDRESS_NODE)Vad, VadTree);
 
-        /* Only regular VADs supported for now */
-        ASSERT(Vad->u.VadFlags.VadType == VadNone);
+        /* Only regular and large page VADs supported for now */
+        ASSERT((Vad->u.VadFlags.VadType == VadNone) ||
+               (Vad->u.VadFlags.VadType == VadLargePages));
 
-        /* Check if this is a section VAD */
-        if (!(Vad->u.VadFlags.PrivateMemory) && (Vad->ControlArea))
+        /* Check if this is a large page VAD */
+        if (Vad->u.VadFlags.VadType == VadLargePages)
+        {
+            /* Unmap the large pages and free them */
+            MiDeleteLargePages(Vad->StartingVpn << PAGE_SHIFT,
+                               (Vad->EndingVpn << PAGE_SHIFT) | (PAGE_SIZE - 1));
+
+            /* Release the working set */
+            MiUnlockProcessWorkingSetUnsafe(Process, Thread);
+        }
+        else if (!(Vad->u.VadFlags.PrivateMemory) && (Vad->ControlArea))
         {
             /* Remove the view */
             MiRemoveMappedView(Process, Vad);
@@ -1502,6 +1502,14 @@ MiQueryAddressState(IN PVOID Va,
     ASSERT((Vad->StartingVpn <= ((ULONG_PTR)Va >> PAGE_SHIFT)) &&
            (Vad->EndingVpn >= ((ULONG_PTR)Va >> PAGE_SHIFT)));
 
+    /* Large pages are committed and mapped whole, the VAD tells everything */
+    if (Vad->u.VadFlags.VadType == VadLargePages)
+    {
+        *ReturnedProtect = MmProtectToValue[Vad->u.VadFlags.Protection];
+        *NextVa = (PVOID)((Vad->EndingVpn + 1) << PAGE_SHIFT);
+        return MEM_COMMIT;
+    }
+
     /* Only normal VADs supported */
     ASSERT(Vad->u.VadFlags.VadType == VadNone);
 
@@ -4429,6 +4437,8 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
     PMMPTE PointerPte, LastPte;
     PMMPDE PointerPde;
     TABLE_SEARCH_RESULT Result;
+    PPFN_NUMBER LargePageFrames = NULL;
+    PFN_COUNT LargePageCount = 0;
     PAGED_CODE();
 
     /* Check for valid Zero bits */
@@ -4594,27 +4604,60 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
         Process, PBaseAddress, ZeroBits, PRegionSize, AllocationType, Protect);
 
     //
-    // Check for large page allocations and make sure that the required privilege
-    // is being held, before attempting to handle them.
+    // Large pages are mapped whole, straight from the PDE, so the CPU has to
+    // support them and the range has to be made of complete large pages.
     //
-    if ((AllocationType & MEM_LARGE_PAGES) &&
-        !(SeSinglePrivilegeCheck(SeLockMemoryPrivilege, PreviousMode)))
+    if ((AllocationType & MEM_LARGE_PAGES) == MEM_LARGE_PAGES)
     {
-        /* Fail without it */
-        DPRINT1("Privilege not held for MEM_LARGE_PAGES\n");
-        Status = STATUS_PRIVILEGE_NOT_HELD;
-        goto FailPathNoLock;
+        //
+        // They are locked in memory for as long as they exist, which takes
+        // the same privilege as locking any other page
+        //
+        if (!SeSinglePrivilegeCheck(SeLockMemoryPrivilege, PreviousMode))
+        {
+            DPRINT1("Privilege not held for MEM_LARGE_PAGES\n");
+            Status = STATUS_PRIVILEGE_NOT_HELD;
+            goto FailPathNoLock;
+        }
+
+        if (!MmLargePageMinimum)
+        {
+            DPRINT1("MEM_LARGE_PAGES not supported by this CPU\n");
+            Status = STATUS_NOT_SUPPORTED;
+            goto FailPathNoLock;
+        }
+
+        //
+        // They can't be committed into an existing reservation either, since
+        // the physical memory has to be there when the range is created.
+        //
+        if ((PBaseAddress) && !(AllocationType & MEM_RESERVE))
+        {
+            DPRINT1("MEM_LARGE_PAGES used without MEM_RESERVE\n");
+            Status = STATUS_INVALID_PARAMETER_5;
+            goto FailPathNoLock;
+        }
+
+        if (((ULONG_PTR)PBaseAddress & (MmLargePageMinimum - 1)) ||
+            (PRegionSize & (MmLargePageMinimum - 1)))
+        {
+            DPRINT1("MEM_LARGE_PAGES range is not large page aligned\n");
+            Status = STATUS_INVALID_PARAMETER;
+            goto FailPathNoLock;
+        }
+
+        if ((ProtectionMask == MM_NOACCESS) ||
+            (Protect & (PAGE_GUARD | PAGE_NOCACHE | PAGE_WRITECOMBINE)))
+        {
+            DPRINT1("Invalid protection for MEM_LARGE_PAGES\n");
+            Status = STATUS_INVALID_PAGE_PROTECTION;
+            goto FailPathNoLock;
+        }
     }
 
     //
     // Fail on the things we don't yet support
     //
-    if ((AllocationType & MEM_LARGE_PAGES) == MEM_LARGE_PAGES)
-    {
-        DPRINT1("MEM_LARGE_PAGES not supported\n");
-        Status = STATUS_INVALID_PARAMETER;
-        goto FailPathNoLock;
-    }
     if ((AllocationType & MEM_PHYSICAL) == MEM_PHYSICAL)
     {
         DPRINT1("MEM_PHYSICAL not supported\n");
@@ -4701,6 +4744,35 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
         Vad->u.VadFlags.PrivateMemory = 1;
         Vad->ControlArea = NULL; // For Memory-Area hack
 
+        //
+        // For large pages, get hold of the physical memory before going any
+        // further, there is no point in reserving the range if there isn't any
+        //
+        if (AllocationType & MEM_LARGE_PAGES)
+        {
+            Vad->u.VadFlags.VadType = VadLargePages;
+            LargePageCount = (PFN_COUNT)(PRegionSize / MmLargePageMinimum);
+            LargePageFrames = ExAllocatePoolWithTag(PagedPool,
+                                                    LargePageCount * sizeof(PFN_NUMBER),
+                                                    TAG_MM);
+            if (LargePageFrames == NULL)
+            {
+                Status = STATUS_INSUFFICIENT_RESOURCES;
+            }
+            else
+            {
+                Status = MiAllocateLargePages(LargePageCount, LargePageFrames);
+                if (!NT_SUCCESS(Status)) ExFreePoolWithTag(LargePageFrames, TAG_MM);
+            }
+
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("Failed to allocate %lu large pages!\n", LargePageCount);
+                ExFreePoolWithTag(Vad, 'SdaV');
+                goto FailPathNoLock;
+            }
+        }
+
         //
         // Insert the VAD
         //
@@ -4708,14 +4780,61 @@ NtAllocateVirtualMemory(IN HANDLE ProcessHandle,
                                &StartingAddress,
                                PRegionSize,
                                HighestAddress,
-                               MM_VIRTMEM_GRANULARITY,
+                               LargePageFrames ? MmLargePageMinimum : MM_VIRTMEM_GRANULARITY,
                                AllocationType);
         if (!NT_SUCCESS(Status))
         {
             DPRINT1("Failed to insert the VAD!\n");
+            if (LargePageFrames)
+            {
+                MiFreeLargePages(LargePageFrames, LargePageCount);
+                ExFreePoolWithTag(LargePageFrames, TAG_MM);
+                ExFreePoolWithTag(Vad, 'SdaV');
+            }
             goto FailPathNoLock;
         }
 
+        //
+        // Large pages can't be demand-faulted, so map the whole range now
+        //
+        if (LargePageFrames)
+        {
+            AddressSpace = MmGetCurrentAddressSpace();
+            MmLockAddressSpace(AddressSpace);
+            if (MiLocateAddress((PVOID)StartingAddress) != Vad)
+            {
+                //
+                // Another thread released the range before it could be mapped
+                //
+                DPRINT1("Large page VAD %p went away\n", Vad);
+                MiFreeLargePages(LargePageFrames, LargePageCount);
+                Status = STATUS_MEMORY_NOT_ALLOCATED;
+            }
+            else
+            {
+                Status = MiMapLargePages(Process,
+                                         StartingAddress,
+                                         ProtectionMask,
+                                         LargePageFrames,
+                                         LargePageCount);
+            }
+            if ((!NT_SUCCESS(Status)) && (Status != STATUS_MEMORY_NOT_ALLOCATED))
+            {
+                //
+                // Undo whatever got mapped, and the reservation itself
+                //
+                MiLockProcessWorkingSetUnsafe(Process, CurrentThread);
+                MiDeleteLargePages(StartingAddress, StartingAddress + PRegionSize - 1);
+                MiRemoveNode((PMMADDRESS_NODE)Vad, &Process->VadRoot);
+                MiUnlockProcessWorkingSetUnsafe(Process, CurrentThread);
+                Process->VirtualSize -= PRegionSize;
+                ExFreePoolWithTag(Vad, 'SdaV');
+            }
+            MmUnlockAddressSpace(AddressSpace);
+            ExFreePoolWithTag(LargePageFrames, TAG_MM);
+            if (!NT_SUCCESS(Status)) goto FailPathNoLock;
+        }
+
         //
         // Detach and dereference the target process if
         // it was different from the current process
@@ -5306,9 +5425,23 @@ NtFreeVirtualMemory(IN HANDLE ProcessHandle,
     if (FreeType & MEM_RELEASE)
     {
         //
-        // ARM3 only supports this VAD in this path
+        // ARM3 only supports these VADs in this path
         //
-        ASSERT(Vad->u.VadFlags.VadType == VadNone);
+        ASSERT((Vad->u.VadFlags.VadType == VadNone) ||
+               (Vad->u.VadFlags.VadType == VadLargePages));
+
+        //
+        // Large pages are mapped by the PDE, so they can only go as a whole
+        //
+        if ((Vad->u.VadFlags.VadType == VadLargePages) &&
+            (PRegionSize) &&
+            (((StartingAddress >> PAGE_SHIFT) != Vad->StartingVpn) ||
+             ((EndingAddress >> PAGE_SHIFT) != Vad->EndingVpn)))
+        {
+            DPRINT1("Trying to release part of a large page VAD\n");
+            Status = STATUS_FREE_VM_NOT_AT_BASE;
+            goto FailPath;
+        }
 
         //
         // Is the caller trying to remove the whole VAD, or remove only a portion
@@ -5447,7 +5580,14 @@ NtFreeVirtualMemory(IN HANDLE ProcessHandle,
         // to do that and then release the working set, since we're done messing
         // around with process pages.
         //
-        MiDeleteVirtualAddresses(StartingAddress, EndingAddress, NULL);
+        if ((Vad) && (Vad->u.VadFlags.VadType == VadLargePages))
+        {
+            MiDeleteLargePages(StartingAddress, EndingAddress);
+        }
+        else
+        {
+            MiDeleteVirtualAddresses(StartingAddress, EndingAddress, NULL);
+        }
         MiUnlockProcessWorkingSetUnsafe(Process, CurrentThread);
         Status = STATUS_SUCCESS;
 
@@ -176,6 +176,9 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
 
     (*NrFreedPages) = 0;
 
+    /* Write what gets paged out in this run in as few requests as possible */
+    MmBeginClusteredSwapWrites();
+
     CurrentPage = MmGetLRUFirstUserPage();
     while (CurrentPage != 0 && Target > 0)
     {
@@ -196,6 +199,9 @@ MmTrimUserMemory(ULONG Target, ULONG Priority, PULONG NrFreedPages)
         CurrentPage = NextPage;
     }
 
+    /* The pages are only freed once they are on disk */
+    MmEndClusteredSwapWrites();
+
     return STATUS_SUCCESS;
 }
 
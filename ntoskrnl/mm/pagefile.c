@@ -87,6 +87,55 @@ static BOOLEAN MmSwapSpaceMessage = FALSE;
 
 static BOOLEAN MmSystemPageFileLocated = FALSE;
 
+/*
+ * Pages written or read with one paging file I/O, 64 KB. This is also the
+ * size of the runs MmAllocSwapPage tries to hand out contiguously.
+ */
+#define MM_SWAP_CLUSTER_PAGES         (16)
+
+/* Number of clustered writes that can be in flight at the same time */
+#define MM_SWAP_WRITE_CLUSTERS        (4)
+
+/*
+ * A run of pages bound for consecutive slots of one paging file. Each page
+ * is referenced until the write is done, so the caller can drop it as soon
+ * as the write is queued.
+ */
+typedef struct _MM_SWAP_CLUSTER
+{
+    ULONG PageFileIndex;
+    ULONG_PTR FirstOffset;
+    ULONG PageCount;
+    BOOLEAN InFlight;
+    KEVENT Event;
+    IO_STATUS_BLOCK Iosb;
+    PFN_NUMBER Pages[MM_SWAP_CLUSTER_PAGES];
+    UCHAR MdlBase[sizeof(MDL) + MM_SWAP_CLUSTER_PAGES * sizeof(PFN_NUMBER)];
+} MM_SWAP_CLUSTER, *PMM_SWAP_CLUSTER;
+
+/* Protects the write clusters and the read ahead window */
+static KGUARDED_MUTEX MiSwapClusterLock;
+
+/* The thread whose page file writes get clustered, if any */
+static PKTHREAD MiSwapClusterWriter;
+
+static MM_SWAP_CLUSTER MiSwapWriteClusters[MM_SWAP_WRITE_CLUSTERS];
+static PMM_SWAP_CLUSTER MiOpenSwapCluster;
+static ULONG MiNextSwapCluster;
+
+/*
+ * Slots around the one a page-in asked for are read along with it, into
+ * this buffer. Every valid page in it can be handed out once.
+ */
+static PVOID MiSwapReadAheadBuffer;
+static PMDL MiSwapReadAheadMdl;
+static ULONG MiSwapReadAheadFile;
+static ULONG_PTR MiSwapReadAheadOffset;
+static ULONG MiSwapReadAheadValid;
+static BOOLEAN MiSwapReadAheadBusy;
+
+C_ASSERT(MM_SWAP_CLUSTER_PAGES <= sizeof(MiSwapReadAheadValid) * 8);
+
 /* FUNCTIONS *****************************************************************/
 
 VOID
@@ -128,19 +177,236 @@ MmShowOutOfSpaceMessagePagingFile(VOID)
     }
 }
 
+static
+PMMPAGING_FILE
+MiGetPagingFile(ULONG PageFileIndex)
+{
+    PMMPAGING_FILE PagingFile;
+
+    ASSERT(PageFileIndex < MAX_PAGING_FILES);
+
+    PagingFile = MmPagingFile[PageFileIndex];
+    if (PagingFile == NULL ||
+        PagingFile->FileObject == NULL ||
+        PagingFile->FileObject->DeviceObject == NULL)
+    {
+        DPRINT1("Bad paging file %u\n", PageFileIndex);
+        KeBugCheck(MEMORY_MANAGEMENT);
+    }
+
+    return PagingFile;
+}
+
+static
 NTSTATUS
-NTAPI
-MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+MiWriteSwapPages(
+    _In_ ULONG PageFileIndex,
+    _In_ ULONG_PTR PageFileOffset,
+    _In_ PPFN_NUMBER Pages,
+    _In_ ULONG PageCount)
 {
-    ULONG i;
-    ULONG_PTR offset;
     LARGE_INTEGER file_offset;
     IO_STATUS_BLOCK Iosb;
     NTSTATUS Status;
     KEVENT Event;
-    UCHAR MdlBase[sizeof(MDL) + sizeof(ULONG)];
+    UCHAR MdlBase[sizeof(MDL) + MM_SWAP_CLUSTER_PAGES * sizeof(PFN_NUMBER)];
     PMDL Mdl = (PMDL)MdlBase;
 
+    ASSERT(PageCount <= MM_SWAP_CLUSTER_PAGES);
+
+    MmInitializeMdl(Mdl, NULL, PageCount * PAGE_SIZE);
+    MmBuildMdlFromPages(Mdl, Pages);
+    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+
+    file_offset.QuadPart = PageFileOffset * PAGE_SIZE;
+
+    KeInitializeEvent(&Event, NotificationEvent, FALSE);
+    Status = IoSynchronousPageWrite(MiGetPagingFile(PageFileIndex)->FileObject,
+                                    Mdl,
+                                    &file_offset,
+                                    &Event,
+                                    &Iosb);
+    if (Status == STATUS_PENDING)
+    {
+        KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
+        Status = Iosb.Status;
+    }
+
+    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+    {
+        MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
+    }
+    return(Status);
+}
+
+static
+VOID
+MiIssueSwapCluster(PMM_SWAP_CLUSTER Cluster)
+{
+    LARGE_INTEGER file_offset;
+    PMDL Mdl = (PMDL)Cluster->MdlBase;
+    NTSTATUS Status;
+
+    ASSERT(!Cluster->InFlight && Cluster->PageCount != 0);
+
+    MmInitializeMdl(Mdl, NULL, Cluster->PageCount * PAGE_SIZE);
+    MmBuildMdlFromPages(Mdl, Cluster->Pages);
+    Mdl->MdlFlags |= MDL_PAGES_LOCKED;
+
+    file_offset.QuadPart = Cluster->FirstOffset * PAGE_SIZE;
+
+    /* Don't wait, MiCompleteSwapCluster will */
+    KeClearEvent(&Cluster->Event);
+    Cluster->InFlight = TRUE;
+    Status = IoSynchronousPageWrite(MiGetPagingFile(Cluster->PageFileIndex)->FileObject,
+                                    Mdl,
+                                    &file_offset,
+                                    &Cluster->Event,
+                                    &Cluster->Iosb);
+    if (Status != STATUS_PENDING)
+    {
+        Cluster->Iosb.Status = Status;
+        KeSetEvent(&Cluster->Event, IO_NO_INCREMENT, FALSE);
+    }
+}
+
+static
+VOID
+MiCompleteSwapCluster(PMM_SWAP_CLUSTER Cluster)
+{
+    PMDL Mdl = (PMDL)Cluster->MdlBase;
+    NTSTATUS Status;
+    ULONG i;
+
+    ASSERT(Cluster->InFlight);
+
+    KeWaitForSingleObject(&Cluster->Event, Executive, KernelMode, FALSE, NULL);
+    if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
+    {
+        MmUnmapLockedPages(Mdl->MappedSystemVa, Mdl);
+    }
+
+    for (i = 0; i < Cluster->PageCount; i++)
+    {
+        if (!NT_SUCCESS(Cluster->Iosb.Status))
+        {
+            /* The owners already think the page is on disk, try one by one */
+            Status = MiWriteSwapPages(Cluster->PageFileIndex,
+                                      Cluster->FirstOffset + i,
+                                      &Cluster->Pages[i],
+                                      1);
+            if (!NT_SUCCESS(Status))
+            {
+                DPRINT1("MM: Failed to write to swap page (Status was 0x%.8X)\n", Status);
+                KeBugCheckEx(MEMORY_MANAGEMENT,
+                             Status,
+                             Cluster->PageFileIndex,
+                             Cluster->FirstOffset + i,
+                             Cluster->Pages[i]);
+            }
+        }
+
+        MmReleasePageMemoryConsumer(MC_USER, Cluster->Pages[i]);
+    }
+
+    Cluster->InFlight = FALSE;
+    Cluster->PageCount = 0;
+}
+
+/* Make sure nothing queued for these page file slots is still on its way */
+static
+VOID
+MiFlushSwapClusters(
+    _In_ ULONG PageFileIndex,
+    _In_ ULONG_PTR PageFileOffset,
+    _In_ ULONG PageCount)
+{
+    PMM_SWAP_CLUSTER Cluster;
+    ULONG i;
+
+    for (i = 0; i < MM_SWAP_WRITE_CLUSTERS; i++)
+    {
+        Cluster = &MiSwapWriteClusters[i];
+        if (Cluster->PageCount == 0 ||
+            Cluster->PageFileIndex != PageFileIndex ||
+            Cluster->FirstOffset >= PageFileOffset + PageCount ||
+            Cluster->FirstOffset + Cluster->PageCount <= PageFileOffset)
+        {
+            continue;
+        }
+
+        if (Cluster == MiOpenSwapCluster)
+        {
+            MiIssueSwapCluster(Cluster);
+            MiOpenSwapCluster = NULL;
+        }
+        MiCompleteSwapCluster(Cluster);
+    }
+}
+
+static
+VOID
+MiInvalidateSwapReadAhead(
+    _In_ ULONG PageFileIndex,
+    _In_ ULONG_PTR PageFileOffset)
+{
+    if (MiSwapReadAheadFile == PageFileIndex &&
+        PageFileOffset >= MiSwapReadAheadOffset &&
+        PageFileOffset < MiSwapReadAheadOffset + MM_SWAP_CLUSTER_PAGES)
+    {
+        MiSwapReadAheadValid &= ~(1 << (PageFileOffset - MiSwapReadAheadOffset));
+    }
+}
+
+/*
+ * Until the matching MmEndClusteredSwapWrites, page file writes of the
+ * calling thread to consecutive slots are gathered and sent as one request.
+ */
+VOID
+NTAPI
+MmBeginClusteredSwapWrites(VOID)
+{
+    KeAcquireGuardedMutex(&MiSwapClusterLock);
+    if (MiSwapClusterWriter == NULL)
+        MiSwapClusterWriter = KeGetCurrentThread();
+    KeReleaseGuardedMutex(&MiSwapClusterLock);
+}
+
+VOID
+NTAPI
+MmEndClusteredSwapWrites(VOID)
+{
+    ULONG i;
+
+    KeAcquireGuardedMutex(&MiSwapClusterLock);
+    if (MiSwapClusterWriter == KeGetCurrentThread())
+    {
+        if (MiOpenSwapCluster)
+        {
+            MiIssueSwapCluster(MiOpenSwapCluster);
+            MiOpenSwapCluster = NULL;
+        }
+
+        for (i = 0; i < MM_SWAP_WRITE_CLUSTERS; i++)
+        {
+            if (MiSwapWriteClusters[i].InFlight)
+                MiCompleteSwapCluster(&MiSwapWriteClusters[i]);
+        }
+
+        MiSwapClusterWriter = NULL;
+    }
+    KeReleaseGuardedMutex(&MiSwapClusterLock);
+}
+
+NTSTATUS
+NTAPI
+MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+{
+    ULONG i;
+    ULONG_PTR offset;
+    PMM_SWAP_CLUSTER Cluster;
+    KIRQL OldIrql;
+
     DPRINT("MmWriteToSwapPage\n");
 
     if (SwapEntry == 0)
@@ -152,44 +418,186 @@ MmWriteToSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
     i = FILE_FROM_ENTRY(SwapEntry);
     offset = OFFSET_FROM_ENTRY(SwapEntry) - 1;
 
-    if (MmPagingFile[i]->FileObject == NULL ||
-            MmPagingFile[i]->FileObject->DeviceObject == NULL)
+    MiGetPagingFile(i);
+
+    KeAcquireGuardedMutex(&MiSwapClusterLock);
+
+    MiInvalidateSwapReadAhead(i, offset);
+
+    /* Already queued, the data will be taken when the write is sent */
+    Cluster = MiOpenSwapCluster;
+    if (Cluster &&
+        Cluster->PageFileIndex == i &&
+        offset >= Cluster->FirstOffset &&
+        offset < Cluster->FirstOffset + Cluster->PageCount &&
+        Cluster->Pages[offset - Cluster->FirstOffset] == Page)
     {
-        DPRINT1("Bad paging file 0x%.8X\n", SwapEntry);
-        KeBugCheck(MEMORY_MANAGEMENT);
+        KeReleaseGuardedMutex(&MiSwapClusterLock);
+        return(STATUS_SUCCESS);
     }
 
-    MmInitializeMdl(Mdl, NULL, PAGE_SIZE);
-    MmBuildMdlFromPages(Mdl, &Page);
+    /* An older write to this slot must not land after this one */
+    MiFlushSwapClusters(i, offset, 1);
+
+    if (MiSwapClusterWriter != KeGetCurrentThread())
+    {
+        KeReleaseGuardedMutex(&MiSwapClusterLock);
+        return MiWriteSwapPages(i, offset, &Page, 1);
+    }
+
+    /* Send what we have unless this page continues it */
+    Cluster = MiOpenSwapCluster;
+    if (Cluster &&
+        (Cluster->PageFileIndex != i ||
+         Cluster->FirstOffset + Cluster->PageCount != offset))
+    {
+        MiIssueSwapCluster(Cluster);
+        Cluster = NULL;
+    }
+
+    if (!Cluster)
+    {
+        /* Reuse the clusters in turn, the oldest write is the likeliest to be done */
+        Cluster = &MiSwapWriteClusters[MiNextSwapCluster];
+        MiNextSwapCluster = (MiNextSwapCluster + 1) % MM_SWAP_WRITE_CLUSTERS;
+        if (Cluster->InFlight)
+            MiCompleteSwapCluster(Cluster);
+
+        Cluster->PageFileIndex = i;
+        Cluster->FirstOffset = offset;
+    }
+
+    OldIrql = MiAcquirePfnLock();
+    MmReferencePage(Page);
+    MiReleasePfnLock(OldIrql);
+    Cluster->Pages[Cluster->PageCount++] = Page;
+
+    if (Cluster->PageCount == MM_SWAP_CLUSTER_PAGES)
+    {
+        MiIssueSwapCluster(Cluster);
+        MiOpenSwapCluster = NULL;
+    }
+    else
+    {
+        MiOpenSwapCluster = Cluster;
+    }
+
+    KeReleaseGuardedMutex(&MiSwapClusterLock);
+    return(STATUS_SUCCESS);
+}
+
+
+NTSTATUS
+NTAPI
+MmReadFromSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
+{
+    ULONG i;
+    ULONG_PTR offset, First, Last;
+    PMMPAGING_FILE PagingFile;
+    LARGE_INTEGER file_offset;
+    IO_STATUS_BLOCK Iosb;
+    NTSTATUS Status;
+    KEVENT Event;
+    UCHAR MdlBase[sizeof(MDL) + MM_SWAP_CLUSTER_PAGES * sizeof(PFN_NUMBER)];
+    PMDL Mdl = (PMDL)MdlBase;
+
+    i = FILE_FROM_ENTRY(SwapEntry);
+    offset = OFFSET_FROM_ENTRY(SwapEntry) - 1;
+
+    /* Read the slots in use around this one within its cluster too */
+    KeAcquireGuardedMutex(&MmPageFileCreationLock);
+    PagingFile = MiGetPagingFile(i);
+    First = Last = offset;
+    while ((First % MM_SWAP_CLUSTER_PAGES) != 0 &&
+           First > 1 &&
+           RtlCheckBit(PagingFile->Bitmap, (ULONG)First - 1))
+    {
+        First--;
+    }
+    while (((Last + 1) % MM_SWAP_CLUSTER_PAGES) != 0 &&
+           Last + 1 < PagingFile->Size &&
+           RtlCheckBit(PagingFile->Bitmap, (ULONG)Last + 1))
+    {
+        Last++;
+    }
+    KeReleaseGuardedMutex(&MmPageFileCreationLock);
+
+    KeAcquireGuardedMutex(&MiSwapClusterLock);
+
+    if (!MiSwapReadAheadBusy &&
+        MiSwapReadAheadFile == i &&
+        offset >= MiSwapReadAheadOffset &&
+        offset < MiSwapReadAheadOffset + MM_SWAP_CLUSTER_PAGES &&
+        (MiSwapReadAheadValid & (1 << (offset - MiSwapReadAheadOffset))))
+    {
+        /* Read along with a neighbour */
+        MiSwapReadAheadValid &= ~(1 << (offset - MiSwapReadAheadOffset));
+        Status = MiCopyFromUserPage(Page,
+                                    (PUCHAR)MiSwapReadAheadBuffer +
+                                    (offset - MiSwapReadAheadOffset) * PAGE_SIZE);
+        KeReleaseGuardedMutex(&MiSwapClusterLock);
+        return Status;
+    }
+
+    /* What is still being written has to reach the disk first */
+    MiFlushSwapClusters(i, First, (ULONG)(Last - First + 1));
+
+    if (MiSwapReadAheadBuffer == NULL || MiSwapReadAheadBusy || First == Last)
+    {
+        KeReleaseGuardedMutex(&MiSwapClusterLock);
+        return MiReadPageFile(Page, i, offset);
+    }
+
+    /* Writes and frees of these slots from now on clear their valid bit */
+    MiSwapReadAheadBusy = TRUE;
+    MiSwapReadAheadFile = i;
+    MiSwapReadAheadOffset = First;
+    MiSwapReadAheadValid = ((1 << (Last - First) << 1) - 1) & ~(1 << (offset - First));
+    KeReleaseGuardedMutex(&MiSwapClusterLock);
+
+    MmInitializeMdl(Mdl, NULL, (Last - First + 1) * PAGE_SIZE);
+    MmBuildMdlFromPages(Mdl, MmGetMdlPfnArray(MiSwapReadAheadMdl));
     Mdl->MdlFlags |= MDL_PAGES_LOCKED;
 
-    file_offset.QuadPart = offset * PAGE_SIZE;
+    file_offset.QuadPart = First * PAGE_SIZE;
 
     KeInitializeEvent(&Event, NotificationEvent, FALSE);
-    Status = IoSynchronousPageWrite(MmPagingFile[i]->FileObject,
-                                    Mdl,
-                                    &file_offset,
-                                    &Event,
-                                    &Iosb);
+    Status = IoPageRead(PagingFile->FileObject,
+                        Mdl,
+                        &file_offset,
+                        &Event,
+                        &Iosb);
     if (Status == STATUS_PENDING)
     {
         KeWaitForSingleObject(&Event, Executive, KernelMode, FALSE, NULL);
         Status = Iosb.Status;
     }
-
     if (Mdl->MdlFlags & MDL_MAPPED_TO_SYSTEM_VA)
     {
         MmUnmapLockedPages (Mdl->MappedSystemVa, Mdl);
     }
-    return(Status);
-}
 
+    KeAcquireGuardedMutex(&MiSwapClusterLock);
+    MiSwapReadAheadBusy = FALSE;
+    if (NT_SUCCESS(Status))
+    {
+        Status = MiCopyFromUserPage(Page,
+                                    (PUCHAR)MiSwapReadAheadBuffer + (offset - First) * PAGE_SIZE);
+    }
+    else
+    {
+        MiSwapReadAheadValid = 0;
+    }
+    KeReleaseGuardedMutex(&MiSwapClusterLock);
 
-NTSTATUS
-NTAPI
-MmReadFromSwapPage(SWAPENTRY SwapEntry, PFN_NUMBER Page)
-{
-    return MiReadPageFile(Page, FILE_FROM_ENTRY(SwapEntry), OFFSET_FROM_ENTRY(SwapEntry) - 1);
+    /* Try again without the neighbours */
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("MM: Clustered page file read failed (Status was 0x%.8X)\n", Status);
+        Status = MiReadPageFile(Page, i, offset);
+    }
+
+    return Status;
 }
 
 NTSTATUS
@@ -257,6 +665,12 @@ MmInitPagingFile(VOID)
     ULONG i;
 
     KeInitializeGuardedMutex(&MmPageFileCreationLock);
+    KeInitializeGuardedMutex(&MiSwapClusterLock);
+
+    for (i = 0; i < MM_SWAP_WRITE_CLUSTERS; i++)
+    {
+        KeInitializeEvent(&MiSwapWriteClusters[i].Event, NotificationEvent, FALSE);
+    }
 
     MiFreeSwapPages = 0;
     MiUsedSwapPages = 0;
@@ -288,7 +702,7 @@ MmFreeSwapPage(SWAPENTRY Entry)
         KeBugCheck(MEMORY_MANAGEMENT);
     }
 
-    RtlClearBit(PagingFile->Bitmap, off >> 5);
+    RtlClearBit(PagingFile->Bitmap, (ULONG)off);
 
     PagingFile->FreeSpace++;
     PagingFile->CurrentUsage--;
@@ -297,6 +711,38 @@ MmFreeSwapPage(SWAPENTRY Entry)
     MiUsedSwapPages--;
 
     KeReleaseGuardedMutex(&MmPageFileCreationLock);
+
+    /* The slot may be handed out again, forget what was read ahead from it */
+    KeAcquireGuardedMutex(&MiSwapClusterLock);
+    MiInvalidateSwapReadAhead(i, off);
+    KeReleaseGuardedMutex(&MiSwapClusterLock);
+}
+
+/*
+ * Finds a cluster of free slots starting on a multiple of
+ * MM_SWAP_CLUSTER_PAGES, the same windows MmReadFromSwapPage reads.
+ */
+static
+ULONG
+MiFindFreeSwapCluster(
+    _In_ PRTL_BITMAP Bitmap,
+    _In_ ULONG Hint)
+{
+    ULONG Clusters, Cluster, i;
+
+    Clusters = Bitmap->SizeOfBitMap / MM_SWAP_CLUSTER_PAGES;
+    Cluster = ALIGN_UP_BY(Hint, MM_SWAP_CLUSTER_PAGES) / MM_SWAP_CLUSTER_PAGES;
+
+    for (i = 0; i < Clusters; i++, Cluster++)
+    {
+        if (Cluster >= Clusters)
+            Cluster = 0;
+
+        if (RtlAreBitsClear(Bitmap, Cluster * MM_SWAP_CLUSTER_PAGES, MM_SWAP_CLUSTER_PAGES))
+            return Cluster * MM_SWAP_CLUSTER_PAGES;
+    }
+
+    return 0xFFFFFFFF;
 }
 
 SWAPENTRY
@@ -306,6 +752,7 @@ MmAllocSwapPage(VOID)
     ULONG i;
     ULONG off;
     SWAPENTRY entry;
+    PMMPAGING_FILE PagingFile;
 
     KeAcquireGuardedMutex(&MmPageFileCreationLock);
 
@@ -317,16 +764,36 @@ MmAllocSwapPage(VOID)
 
     for (i = 0; i < MAX_PAGING_FILES; i++)
     {
-        if (MmPagingFile[i] != NULL &&
-                MmPagingFile[i]->FreeSpace >= 1)
+        PagingFile = MmPagingFile[i];
+        if (PagingFile != NULL &&
+                PagingFile->FreeSpace >= 1)
         {
-            off = RtlFindClearBitsAndSet(MmPagingFile[i]->Bitmap, 1, 0);
+            /*
+             * Go on from the last slot handed out, so pages paged out one
+             * after the other end up next to each other and can be written
+             * and read back together. If that one is taken, or starts a
+             * cluster that is partly used, move to a free cluster.
+             */
+            off = PagingFile->HintSetBit;
+            if (off >= PagingFile->Bitmap->SizeOfBitMap ||
+                RtlCheckBit(PagingFile->Bitmap, off) ||
+                ((off % MM_SWAP_CLUSTER_PAGES) == 0 &&
+                 !RtlAreBitsClear(PagingFile->Bitmap, off, MM_SWAP_CLUSTER_PAGES)))
+            {
+                off = MiFindFreeSwapCluster(PagingFile->Bitmap, off);
+                if (off == 0xFFFFFFFF)
+                    off = RtlFindClearBits(PagingFile->Bitmap, 1, PagingFile->HintSetBit);
+            }
             if (off == 0xFFFFFFFF)
             {
                 KeBugCheck(MEMORY_MANAGEMENT);
                 KeReleaseGuardedMutex(&MmPageFileCreationLock);
                 return(STATUS_UNSUCCESSFUL);
             }
+            RtlSetBit(PagingFile->Bitmap, off);
+            PagingFile->HintSetBit = off + 1;
+            PagingFile->FreeSpace--;
+            PagingFile->CurrentUsage++;
             MiUsedSwapPages++;
             MiFreeSwapPages--;
             KeReleaseGuardedMutex(&MmPageFileCreationLock);
@@ -784,6 +1251,16 @@ NtCreatePagingFile(IN PUNICODE_STRING FileName,
                         (ULONG)(PagingFile->MaximumSize));
     RtlClearAllBits(PagingFile->Bitmap);
 
+    /* Keep the header page, and what the file can't hold yet, out of reach */
+    RtlSetBit(PagingFile->Bitmap, 0);
+    if (PagingFile->MaximumSize > PagingFile->Size)
+    {
+        RtlSetBits(PagingFile->Bitmap,
+                   (ULONG)PagingFile->Size,
+                   (ULONG)(PagingFile->MaximumSize - PagingFile->Size));
+    }
+    PagingFile->HintSetBit = 1;
+
     /* FIXME: should be calling unsafe instead,
      * we should already be in a guarded region
      */
@@ -794,6 +1271,33 @@ NtCreatePagingFile(IN PUNICODE_STRING FileName,
     MiFreeSwapPages = MiFreeSwapPages + PagingFile->FreeSpace;
     KeReleaseGuardedMutex(&MmPageFileCreationLock);
 
+    /* Page-ins read ahead into this, allocate it while memory is still plenty */
+    KeAcquireGuardedMutex(&MiSwapClusterLock);
+    if (MiSwapReadAheadBuffer == NULL)
+    {
+        MiSwapReadAheadBuffer = ExAllocatePoolWithTag(NonPagedPool,
+                                                      MM_SWAP_CLUSTER_PAGES * PAGE_SIZE,
+                                                      TAG_MM);
+        if (MiSwapReadAheadBuffer != NULL)
+        {
+            MiSwapReadAheadMdl = IoAllocateMdl(MiSwapReadAheadBuffer,
+                                               MM_SWAP_CLUSTER_PAGES * PAGE_SIZE,
+                                               FALSE,
+                                               FALSE,
+                                               NULL);
+            if (MiSwapReadAheadMdl != NULL)
+            {
+                MmBuildMdlForNonPagedPool(MiSwapReadAheadMdl);
+            }
+            else
+            {
+                ExFreePoolWithTag(MiSwapReadAheadBuffer, TAG_MM);
+                MiSwapReadAheadBuffer = NULL;
+            }
+        }
+    }
+    KeReleaseGuardedMutex(&MiSwapClusterLock);
+
     MmSwapSpaceMessage = FALSE;
 
     if (!MmSystemPageFileLocated && BooleanFlagOn(FileObject->DeviceObject->Flags, DO_SYSTEM_BOOT_PARTITION))
@@ -459,6 +459,20 @@ typedef enum _RTL_GENERIC_COMPARE_RESULTS
     GenericEqual
 } RTL_GENERIC_COMPARE_RESULTS;
 
+#if (NTDDI_VERSION >= NTDDI_VISTA)
+//
+// Completion Callback for Thread Pool I/O
+//
+typedef VOID
+(NTAPI *PTP_IO_CALLBACK)(
+    _Inout_ PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID Context,
+    _In_ PVOID ApcContext,
+    _In_ PIO_STATUS_BLOCK IoStatusBlock,
+    _In_ PTP_IO Io
+);
+#endif
+
 #endif /* NTOS_MODE_USER */
 
 //
@@ -41,6 +41,7 @@ Query_Main(
     LPCWSTR Name,
     WORD Type,
     DWORD Options,
+    PIP4_ARRAY Servers,
     PDNS_RECORD *QueryResultSet);
 
 #endif /* __WIDL__ */
@@ -567,6 +567,7 @@
 #define MEM_TOP_DOWN       0x100000
 #define MEM_WRITE_WATCH       0x200000 /* 98/Me */
 #define MEM_PHYSICAL       0x400000
+#define MEM_LARGE_PAGES  0x20000000
 #define MEM_4MB_PAGES    0x80000000
 #define MEM_IMAGE        SEC_IMAGE
 #define SEC_NO_CHANGE    0x00400000
@@ -4330,6 +4331,27 @@ typedef VOID
   _Inout_opt_ PVOID ObjectContext,
   _Inout_opt_ PVOID CleanupContext);
 
+typedef struct _TP_TIMER TP_TIMER, *PTP_TIMER;
+
+typedef VOID
+(NTAPI *PTP_TIMER_CALLBACK)(
+  _Inout_ PTP_CALLBACK_INSTANCE Instance,
+  _Inout_opt_ PVOID Context,
+  _Inout_ PTP_TIMER Timer);
+
+typedef DWORD TP_WAIT_RESULT;
+
+typedef struct _TP_WAIT TP_WAIT, *PTP_WAIT;
+
+typedef VOID
+(NTAPI *PTP_WAIT_CALLBACK)(
+  _Inout_ PTP_CALLBACK_INSTANCE Instance,
+  _Inout_opt_ PVOID Context,
+  _Inout_ PTP_WAIT Wait,
+  _In_ TP_WAIT_RESULT WaitResult);
+
+typedef struct _TP_IO TP_IO, *PTP_IO;
+
 #if (_WIN32_WINNT >= _WIN32_WINNT_WIN7)
 typedef struct _TP_CALLBACK_ENVIRON_V3 {
   TP_VERSION Version;
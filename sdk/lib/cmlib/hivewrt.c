@@ -9,9 +9,110 @@
 #define NDEBUG
 #include <debug.h>
 
+/* Largest number of blocks gathered into a single hive or log write */
+#define HV_MAX_WRITE_BLOCKS 64
+
+static PUCHAR CMAPI
+HvpAllocateWriteBuffer(
+    PHHIVE RegistryHive)
+{
+    /* Failure is not fatal, runs are then written one bin at a time */
+    return RegistryHive->Allocate(HV_MAX_WRITE_BLOCKS * HBLOCK_SIZE, TRUE, TAG_CM);
+}
+
+/*
+ * Writes a run of consecutive hive blocks to consecutive file offsets.
+ * Blocks of the same bin are contiguous in memory and go out directly,
+ * blocks spanning several bins are gathered into the write buffer first
+ * so that the whole run takes as few I/Os as possible.
+ */
+static BOOLEAN CMAPI
+HvpWriteBlockRun(
+    PHHIVE RegistryHive,
+    ULONG FileType,
+    ULONG FileOffset,
+    ULONG BlockIndex,
+    ULONG BlockCount,
+    PUCHAR WriteBuffer)
+{
+    PHMAP_ENTRY BlockList = RegistryHive->Storage[Stable].BlockList;
+    ULONG_PTR BlockAddress;
+    ULONG Count;
+    ULONG i;
+    PVOID Buffer;
+
+    while (BlockCount > 0)
+    {
+        /* Count the blocks that directly follow each other in memory */
+        BlockAddress = BlockList[BlockIndex].BlockAddress;
+        for (Count = 1; Count < BlockCount; Count++)
+        {
+            if (BlockList[BlockIndex + Count].BlockAddress !=
+                BlockAddress + Count * HBLOCK_SIZE)
+            {
+                break;
+            }
+        }
+
+        if (Count < BlockCount && Count < HV_MAX_WRITE_BLOCKS && WriteBuffer != NULL)
+        {
+            /* The run crosses bins, gather it into the write buffer */
+            Count = min(BlockCount, HV_MAX_WRITE_BLOCKS);
+            for (i = 0; i < Count; i++)
+            {
+                RtlCopyMemory(WriteBuffer + i * HBLOCK_SIZE,
+                              (PVOID)BlockList[BlockIndex + i].BlockAddress,
+                              HBLOCK_SIZE);
+            }
+            Buffer = WriteBuffer;
+        }
+        else
+        {
+            Buffer = (PVOID)BlockAddress;
+        }
+
+        if (!RegistryHive->FileWrite(RegistryHive, FileType, &FileOffset,
+                                     Buffer, Count * HBLOCK_SIZE))
+        {
+            return FALSE;
+        }
+
+        BlockIndex += Count;
+        BlockCount -= Count;
+        FileOffset += Count * HBLOCK_SIZE;
+    }
+
+    return TRUE;
+}
+
+/*
+ * Returns the next run of dirty stable blocks at or after BlockIndex,
+ * or zero when there are no dirty blocks left.
+ */
+static ULONG CMAPI
+HvpFindDirtyRun(
+    PHHIVE RegistryHive,
+    ULONG BlockIndex,
+    PULONG RunStart)
+{
+    ULONG Length = RegistryHive->Storage[Stable].Length;
+    ULONG Count;
+
+    if (BlockIndex >= Length)
+        return 0;
+
+    Count = RtlFindNextForwardRunSet(&RegistryHive->DirtyVector, BlockIndex, RunStart);
+    if (Count == 0 || *RunStart >= Length)
+        return 0;
+
+    /* The dirty vector is rounded up to a multiple of 32 bits */
+    return min(Count, Length - *RunStart);
+}
+
 static BOOLEAN CMAPI
 HvpWriteLog(
-    PHHIVE RegistryHive)
+    PHHIVE RegistryHive,
+    PUCHAR WriteBuffer)
 {
     ULONG FileOffset;
     UINT32 BufferSize;
@@ -19,8 +120,7 @@ HvpWriteLog(
     PUCHAR Buffer;
     PUCHAR Ptr;
     ULONG BlockIndex;
-    ULONG LastIndex;
-    PVOID BlockPtr;
+    ULONG BlockCount;
     BOOLEAN Success;
     static ULONG PrintCount = 0;
 
@@ -78,30 +178,19 @@ HvpWriteLog(
         return FALSE;
     }
 
-    /* Write dirty blocks */
+    /* Write dirty blocks, one I/O per run of dirty blocks */
     FileOffset = BufferSize;
     BlockIndex = 0;
-    while (BlockIndex < RegistryHive->Storage[Stable].Length)
+    while ((BlockCount = HvpFindDirtyRun(RegistryHive, BlockIndex, &BlockIndex)) != 0)
     {
-        LastIndex = BlockIndex;
-        BlockIndex = RtlFindSetBits(&RegistryHive->DirtyVector, 1, BlockIndex);
-        if (BlockIndex == ~0U || BlockIndex < LastIndex)
-        {
-            break;
-        }
-
-        BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
-
-        /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_LOG,
-                                         &FileOffset, BlockPtr, HBLOCK_SIZE);
-        if (!Success)
+        if (!HvpWriteBlockRun(RegistryHive, HFILE_TYPE_LOG, FileOffset,
+                              BlockIndex, BlockCount, WriteBuffer))
         {
             return FALSE;
         }
 
-        BlockIndex++;
-        FileOffset += HBLOCK_SIZE;
+        BlockIndex += BlockCount;
+        FileOffset += BlockCount * HBLOCK_SIZE;
     }
 
     Success = RegistryHive->FileSetSize(RegistryHive, HFILE_TYPE_LOG, FileOffset, FileOffset);
@@ -146,12 +235,12 @@ HvpWriteLog(
 static BOOLEAN CMAPI
 HvpWriteHive(
     PHHIVE RegistryHive,
-    BOOLEAN OnlyDirty)
+    BOOLEAN OnlyDirty,
+    PUCHAR WriteBuffer)
 {
     ULONG FileOffset;
     ULONG BlockIndex;
-    ULONG LastIndex;
-    PVOID BlockPtr;
+    ULONG BlockCount;
     BOOLEAN Success;
 
     ASSERT(RegistryHive->ReadOnly == FALSE);
@@ -182,31 +271,34 @@ HvpWriteHive(
         return FALSE;
     }
 
-    BlockIndex = 0;
-    while (BlockIndex < RegistryHive->Storage[Stable].Length)
+    if (OnlyDirty)
     {
-        if (OnlyDirty)
+        /* Write each run of dirty blocks in place */
+        BlockIndex = 0;
+        while ((BlockCount = HvpFindDirtyRun(RegistryHive, BlockIndex, &BlockIndex)) != 0)
         {
-            LastIndex = BlockIndex;
-            BlockIndex = RtlFindSetBits(&RegistryHive->DirtyVector, 1, BlockIndex);
-            if (BlockIndex == ~0U || BlockIndex < LastIndex)
+            Success = HvpWriteBlockRun(RegistryHive, HFILE_TYPE_PRIMARY,
+                                       (BlockIndex + 1) * HBLOCK_SIZE,
+                                       BlockIndex, BlockCount, WriteBuffer);
+            if (!Success)
             {
-                break;
+                return FALSE;
             }
-        }
 
-        BlockPtr = (PVOID)RegistryHive->Storage[Stable].BlockList[BlockIndex].BlockAddress;
-        FileOffset = (BlockIndex + 1) * HBLOCK_SIZE;
-
-        /* Write hive block */
-        Success = RegistryHive->FileWrite(RegistryHive, HFILE_TYPE_PRIMARY,
-                                          &FileOffset, BlockPtr, HBLOCK_SIZE);
+            BlockIndex += BlockCount;
+        }
+    }
+    else if (RegistryHive->Storage[Stable].Length != 0)
+    {
+        /* The whole hive is one run */
+        Success = HvpWriteBlockRun(RegistryHive, HFILE_TYPE_PRIMARY,
+                                   HBLOCK_SIZE, 0,
+                                   RegistryHive->Storage[Stable].Length,
+                                   WriteBuffer);
         if (!Success)
         {
             return FALSE;
         }
-
-        BlockIndex++;
     }
 
     Success = RegistryHive->FileFlush(RegistryHive, HFILE_TYPE_PRIMARY, NULL, 0);
@@ -243,6 +335,9 @@ BOOLEAN CMAPI
 HvSyncHive(
     PHHIVE RegistryHive)
 {
+    PUCHAR WriteBuffer;
+    BOOLEAN Success;
+
     ASSERT(RegistryHive->ReadOnly == FALSE);
 
     if (RtlFindSetBits(&RegistryHive->DirtyVector, 1, 0) == ~0U)
@@ -253,14 +348,22 @@ HvSyncHive(
     /* Update hive header modification time */
     KeQuerySystemTime(&RegistryHive->BaseBlock->TimeStamp);
 
-    /* Update log file */
-    if (!HvpWriteLog(RegistryHive))
-    {
-        return FALSE;
-    }
+    /* The log and the hive file share the same write buffer */
+    WriteBuffer = HvpAllocateWriteBuffer(RegistryHive);
+
+    /* Update log file first, the hive file is only written once it is flushed */
+    Success = TRUE;
+    if (RegistryHive->Log)
+        Success = HvpWriteLog(RegistryHive, WriteBuffer);
 
     /* Update hive file */
-    if (!HvpWriteHive(RegistryHive, TRUE))
+    if (Success)
+        Success = HvpWriteHive(RegistryHive, TRUE, WriteBuffer);
+
+    if (WriteBuffer != NULL)
+        RegistryHive->Free(WriteBuffer, 0);
+
+    if (!Success)
     {
         return FALSE;
     }
@@ -285,16 +388,19 @@ BOOLEAN CMAPI
 HvWriteHive(
     PHHIVE RegistryHive)
 {
+    PUCHAR WriteBuffer;
+    BOOLEAN Success;
+
     ASSERT(RegistryHive->ReadOnly == FALSE);
 
     /* Update hive header modification time */
     KeQuerySystemTime(&RegistryHive->BaseBlock->TimeStamp);
 
     /* Update hive file */
-    if (!HvpWriteHive(RegistryHive, FALSE))
-    {
-        return FALSE;
-    }
+    WriteBuffer = HvpAllocateWriteBuffer(RegistryHive);
+    Success = HvpWriteHive(RegistryHive, FALSE, WriteBuffer);
+    if (WriteBuffer != NULL)
+        RegistryHive->Free(WriteBuffer, 0);
 
-    return TRUE;
+    return Success;
 }
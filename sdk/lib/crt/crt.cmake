@@ -477,7 +477,8 @@ elseif(ARCH STREQUAL "amd64")
     list(APPEND CRT_SOURCE
         except/amd64/ehandler.c
         float/i386/cntrlfp.c
-        float/i386/statfp.c)
+        float/i386/statfp.c
+        mem/amd64/erms.c)
     list(APPEND CRT_WINE_SOURCE
         wine/except_x86_64.c)
     if(MSVC)
@@ -0,0 +1,41 @@
+/* memword.h */
+
+#ifndef __CRT_INTERNAL_MEMWORD_H
+#define __CRT_INTERNAL_MEMWORD_H
+
+#include <stddef.h>
+
+/* The mem and string routines work on machine words where they can */
+typedef size_t MEMWORD;
+
+#define MEMWORD_SIZE    sizeof(MEMWORD)
+#define MEMWORD_MASK    (MEMWORD_SIZE - 1)
+
+/* 0x0101...01 and 0x0001...0001 */
+#define MEMWORD_ONES    ((MEMWORD)-1 / 0xFF)
+#define MEMWORD_ONES16  ((MEMWORD)-1 / 0xFFFF)
+
+/* Nonzero if any byte (16-bit unit) of the word is zero */
+#define MEMWORD_HAS_ZERO_BYTE(w) \
+    (((w) - MEMWORD_ONES) & ~(w) & (MEMWORD_ONES << 7))
+#define MEMWORD_HAS_ZERO_WORD16(w) \
+    (((w) - MEMWORD_ONES16) & ~(w) & (MEMWORD_ONES16 << 15))
+
+/* Below this the byte loops are as fast as setting up the word loops */
+#define MEMWORD_THRESHOLD   (4 * MEMWORD_SIZE)
+
+/* Word copies need the source aligned as well, except on x86 */
+#if defined(_M_IX86) || defined(_M_AMD64)
+#define MEMWORD_CAN_COPY(d, s)  1
+#else
+#define MEMWORD_CAN_COPY(d, s)  ((((size_t)(d) ^ (size_t)(s)) & MEMWORD_MASK) == 0)
+#endif
+
+#ifdef _M_AMD64
+/* From this size on, rep movsb / rep stosb beat the word loops on ERMSB CPUs */
+#define MEMWORD_REP_THRESHOLD   2048
+
+int __cdecl __crt_has_erms(void);
+#endif
+
+#endif /* __CRT_INTERNAL_MEMWORD_H */
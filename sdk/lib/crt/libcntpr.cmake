@@ -132,7 +132,8 @@ elseif(ARCH STREQUAL "amd64")
     list(APPEND LIBCNTPR_SOURCE
         except/amd64/ehandler.c
         math/cos.c
-        math/sin.c)
+        math/sin.c
+        mem/amd64/erms.c)
 elseif(ARCH STREQUAL "arm")
     list(APPEND LIBCNTPR_SOURCE
         except/arm/chkstk_asm.s
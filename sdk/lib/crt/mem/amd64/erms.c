@@ -0,0 +1,34 @@
+/*
+ * PROJECT:         ReactOS CRT library
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Detection of enhanced rep movsb / rep stosb
+ */
+
+#include <intrin.h>
+#include <internal/memword.h>
+
+/* 0 = not checked yet, 1 = no ERMSB, 2 = ERMSB */
+static volatile long MemErmsState;
+
+int __cdecl __crt_has_erms(void)
+{
+    int CpuInfo[4];
+    long State = MemErmsState;
+
+    /* Racing callers all come to the same answer, so no locking is needed */
+    if (State == 0)
+    {
+        State = 1;
+        __cpuid(CpuInfo, 0);
+        if (CpuInfo[0] >= 7)
+        {
+            /* CPUID.(EAX=7,ECX=0):EBX bit 9 */
+            __cpuidex(CpuInfo, 7, 0);
+            if (CpuInfo[1] & (1 << 9))
+                State = 2;
+        }
+        MemErmsState = State;
+    }
+
+    return State == 2;
+}
@@ -1,5 +1,6 @@
 
 #include <string.h>
+#include <internal/memword.h>
 
 #if defined(_MSC_VER) && defined(_M_ARM)
 #pragma function(memchr)
@@ -7,13 +8,33 @@
 
 void* __cdecl memchr(const void *s, int c, size_t n)
 {
-    if (n)
+    const unsigned char *p = s;
+    unsigned char ch = (unsigned char)c;
+    MEMWORD pattern;
+
+    /* Single bytes until p is word aligned */
+    for (; n && ((size_t)p & MEMWORD_MASK); p++, n--)
+    {
+        if (*p == ch)
+            return (void *)p;
+    }
+
+    /* Then whole words, never reading past the end of the buffer */
+    if (n >= MEMWORD_SIZE)
     {
-        const char *p = s;
+        pattern = MEMWORD_ONES * ch;
         do {
-            if (*p++ == c)
-                return (void *)(p-1);
-        } while (--n != 0);
+            if (MEMWORD_HAS_ZERO_BYTE(*(const MEMWORD *)p ^ pattern))
+                break;
+            p += MEMWORD_SIZE;
+            n -= MEMWORD_SIZE;
+        } while (n >= MEMWORD_SIZE);
+    }
+
+    for (; n; p++, n--)
+    {
+        if (*p == ch)
+            return (void *)p;
     }
     return 0;
 }
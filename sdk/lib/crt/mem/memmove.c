@@ -1,35 +1,87 @@
 #include <string.h>
+#include <internal/memword.h>
+#ifdef _M_AMD64
+#include <intrin.h>
+#endif
 
-/* NOTE: This code is duplicated in memcpy function */
+/* NOTE: memcpy forwards to this function */
 void * __cdecl memmove(void *dest,const void *src,size_t count)
 {
-    char *char_dest = (char *)dest;
-    char *char_src = (char *)src;
+    unsigned char *char_dest = (unsigned char *)dest;
+    const unsigned char *char_src = (const unsigned char *)src;
 
     if ((char_dest <= char_src) || (char_dest >= (char_src+count)))
     {
-        /*  non-overlapping buffers */
-        while(count > 0)
-	{
-            *char_dest = *char_src;
-            char_dest++;
-            char_src++;
+        /* non-overlapping buffers, or dest below src: copy upwards */
+        if (count >= MEMWORD_THRESHOLD && MEMWORD_CAN_COPY(char_dest, char_src))
+        {
+#ifdef _M_AMD64
+            if (count >= MEMWORD_REP_THRESHOLD && __crt_has_erms())
+            {
+                __movsb(char_dest, char_src, count);
+                return dest;
+            }
+#endif
+            while ((size_t)char_dest & MEMWORD_MASK)
+            {
+                *char_dest++ = *char_src++;
+                count--;
+            }
+
+            while (count >= 4 * MEMWORD_SIZE)
+            {
+                ((MEMWORD *)char_dest)[0] = ((const MEMWORD *)char_src)[0];
+                ((MEMWORD *)char_dest)[1] = ((const MEMWORD *)char_src)[1];
+                ((MEMWORD *)char_dest)[2] = ((const MEMWORD *)char_src)[2];
+                ((MEMWORD *)char_dest)[3] = ((const MEMWORD *)char_src)[3];
+                char_dest += 4 * MEMWORD_SIZE;
+                char_src += 4 * MEMWORD_SIZE;
+                count -= 4 * MEMWORD_SIZE;
+            }
+
+            while (count >= MEMWORD_SIZE)
+            {
+                *(MEMWORD *)char_dest = *(const MEMWORD *)char_src;
+                char_dest += MEMWORD_SIZE;
+                char_src += MEMWORD_SIZE;
+                count -= MEMWORD_SIZE;
+            }
+        }
+
+        while (count > 0)
+        {
+            *char_dest++ = *char_src++;
             count--;
-	}
+        }
     }
     else
     {
-        /* overlaping buffers */
-        char_dest = (char *)dest + count - 1;
-        char_src = (char *)src + count - 1;
-
-        while(count > 0)
-	{
-           *char_dest = *char_src;
-           char_dest--;
-           char_src--;
-           count--;
-	}
+        /* overlapping buffers with dest above src: copy downwards */
+        char_dest += count;
+        char_src += count;
+
+        if (count >= MEMWORD_THRESHOLD && MEMWORD_CAN_COPY(char_dest, char_src))
+        {
+            while ((size_t)char_dest & MEMWORD_MASK)
+            {
+                *--char_dest = *--char_src;
+                count--;
+            }
+
+            while (count >= MEMWORD_SIZE)
+            {
+                char_dest -= MEMWORD_SIZE;
+                char_src -= MEMWORD_SIZE;
+                *(MEMWORD *)char_dest = *(const MEMWORD *)char_src;
+                count -= MEMWORD_SIZE;
+            }
+        }
+
+        while (count > 0)
+        {
+            *--char_dest = *--char_src;
+            count--;
+        }
     }
 
     return dest;
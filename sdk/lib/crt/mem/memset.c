@@ -1,5 +1,9 @@
 
 #include <string.h>
+#include <internal/memword.h>
+#ifdef _M_AMD64
+#include <intrin.h>
+#endif
 
 #ifdef _MSC_VER
 #pragma function(memset)
@@ -7,10 +11,47 @@
 
 void* __cdecl memset(void* src, int val, size_t count)
 {
-    char *char_src = (char *)src;
+    unsigned char *char_src = (unsigned char *)src;
+    unsigned char c = (unsigned char)val;
+    MEMWORD pattern;
+
+    if (count >= MEMWORD_THRESHOLD)
+    {
+#ifdef _M_AMD64
+        if (count >= MEMWORD_REP_THRESHOLD && __crt_has_erms())
+        {
+            __stosb(char_src, c, count);
+            return src;
+        }
+#endif
+        while ((size_t)char_src & MEMWORD_MASK)
+        {
+            *char_src++ = c;
+            count--;
+        }
+
+        pattern = MEMWORD_ONES * c;
+
+        while (count >= 4 * MEMWORD_SIZE)
+        {
+            ((MEMWORD *)char_src)[0] = pattern;
+            ((MEMWORD *)char_src)[1] = pattern;
+            ((MEMWORD *)char_src)[2] = pattern;
+            ((MEMWORD *)char_src)[3] = pattern;
+            char_src += 4 * MEMWORD_SIZE;
+            count -= 4 * MEMWORD_SIZE;
+        }
+
+        while (count >= MEMWORD_SIZE)
+        {
+            *(MEMWORD *)char_src = pattern;
+            char_src += MEMWORD_SIZE;
+            count -= MEMWORD_SIZE;
+        }
+    }
 
     while(count>0) {
-        *char_src = val;
+        *char_src = c;
         char_src++;
         count--;
     }
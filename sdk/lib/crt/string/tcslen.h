@@ -1,20 +1,44 @@
 
 #include <stddef.h>
 #include <tchar.h>
+#include <internal/memword.h>
 
 #ifdef _MSC_VER
 #pragma function(_tcslen)
 #endif /* _MSC_VER */
 
+#ifdef _UNICODE
+#define _TCS_WORD_HAS_NUL MEMWORD_HAS_ZERO_WORD16
+#else
+#define _TCS_WORD_HAS_NUL MEMWORD_HAS_ZERO_BYTE
+#endif
+
 size_t __cdecl _tcslen(const _TCHAR * str)
 {
  const _TCHAR * s;
+ const MEMWORD * w;
 
  if(str == 0) return 0;
 
- for(s = str; *s; ++ s);
+ s = str;
+
+ /* A wide string at an odd address never gets word aligned */
+ if(((size_t)s & (sizeof(_TCHAR) - 1)) == 0)
+ {
+  for(; (size_t)s & MEMWORD_MASK; ++ s)
+   if(!*s) return s - str;
+
+  /* Aligned words never cross a page, so reading past the terminator is safe */
+  for(w = (const MEMWORD *)s; !_TCS_WORD_HAS_NUL(*w); ++ w);
+
+  s = (const _TCHAR *)w;
+ }
+
+ for(; *s; ++ s);
 
  return s - str;
 }
 
+#undef _TCS_WORD_HAS_NUL
+
 /* EOF */
@@ -1,16 +1,45 @@
 
 #include <stddef.h>
 #include <tchar.h>
+#include <internal/memword.h>
+
+#ifdef _UNICODE
+#define _TCS_WORD_HAS_NUL MEMWORD_HAS_ZERO_WORD16
+#else
+#define _TCS_WORD_HAS_NUL MEMWORD_HAS_ZERO_BYTE
+#endif
+
+#define _TCS_PER_WORD (MEMWORD_SIZE / sizeof(_TCHAR))
 
 size_t __cdecl _tcsnlen(const _TCHAR * str, size_t count)
 {
  const _TCHAR * s;
+ const MEMWORD * w;
 
  if(str == 0) return 0;
 
- for(s = str; *s && count; ++ s, -- count);
+ s = str;
+
+ /* A wide string at an odd address never gets word aligned */
+ if(((size_t)s & (sizeof(_TCHAR) - 1)) == 0)
+ {
+  for(; count && ((size_t)s & MEMWORD_MASK); ++ s, -- count)
+   if(!*s) return s - str;
+
+  /* Only whole words that are within count */
+  for(w = (const MEMWORD *)s;
+      count >= _TCS_PER_WORD && !_TCS_WORD_HAS_NUL(*w);
+      ++ w, count -= _TCS_PER_WORD);
+
+  s = (const _TCHAR *)w;
+ }
+
+ for(; count && *s; ++ s, -- count);
 
  return s - str;
 }
 
+#undef _TCS_PER_WORD
+#undef _TCS_WORD_HAS_NUL
+
 /* EOF */
@@ -0,0 +1,37 @@
+/* intrin.h - the few intrinsics the amd64 mem routines use, for building
+ * them on an x86-64 host for crttest_amd64. */
+
+#ifndef __CRTTEST_INTRIN_H
+#define __CRTTEST_INTRIN_H
+
+#include <stddef.h>
+
+static __inline__ void __cpuidex(int CpuInfo[4], int Function, int SubFunction)
+{
+    __asm__ __volatile__("cpuid"
+                         : "=a"(CpuInfo[0]), "=b"(CpuInfo[1]), "=c"(CpuInfo[2]), "=d"(CpuInfo[3])
+                         : "a"(Function), "c"(SubFunction));
+}
+
+static __inline__ void __cpuid(int CpuInfo[4], int Function)
+{
+    __cpuidex(CpuInfo, Function, 0);
+}
+
+static __inline__ void __movsb(unsigned char *Destination, const unsigned char *Source, size_t Count)
+{
+    __asm__ __volatile__("rep movsb"
+                         : "+D"(Destination), "+S"(Source), "+c"(Count)
+                         :
+                         : "memory");
+}
+
+static __inline__ void __stosb(unsigned char *Destination, unsigned char Data, size_t Count)
+{
+    __asm__ __volatile__("rep stosb"
+                         : "+D"(Destination), "+c"(Count)
+                         : "a"(Data)
+                         : "memory");
+}
+
+#endif /* __CRTTEST_INTRIN_H */
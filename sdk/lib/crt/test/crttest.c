@@ -0,0 +1,306 @@
+/*
+ * PROJECT:         ReactOS CRT library
+ * LICENSE:         GPL - See COPYING in the top level directory
+ * PURPOSE:         Host test for the word at a time mem and string routines
+ */
+
+/*
+ * Checks the portable memmove, memcpy, memset, memchr and the
+ * strlen/strnlen/wcslen/wcsnlen templates against plain byte loops, over
+ * all small sizes, every alignment of the buffers and every overlap.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* The routines under test, built with names of their own */
+void *crt_memmove(void *dest, const void *src, size_t count);
+void *crt_memcpy(void *dest, const void *src, size_t count);
+void *crt_memset(void *src, int val, size_t count);
+void *crt_memchr(const void *s, int c, size_t n);
+size_t crt_strlen(const char *str);
+size_t crt_strnlen(const char *str, size_t count);
+size_t crt_wcslen(const unsigned short *str);
+size_t crt_wcsnlen(const unsigned short *str, size_t count);
+#ifdef _M_AMD64
+int __crt_has_erms(void);
+#endif
+
+typedef void *(*PFN_MEMMOVE)(void *, const void *, size_t);
+
+#define MAX_SMALL       300
+#define MAX_ALIGN       16
+#define GUARD           64
+#define BUFFER_SIZE     (2 * GUARD + 2 * MAX_ALIGN + 8192)
+
+/* Past the word loops and, on amd64, the rep movsb / rep stosb threshold */
+static const size_t LargeSizes[] = { 511, 512, 2047, 2048, 2049, 4095, 4096, 8000 };
+
+static unsigned char Buffer[BUFFER_SIZE];
+static unsigned char Expected[BUFFER_SIZE];
+static int Failures;
+
+#define ok(cond, ...) \
+    do { if (!(cond)) { if (Failures++ < 20) { printf("%s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); } } } while (0)
+
+/* The reference loops go through volatile, so they can't be turned into calls to libc */
+static void ReferenceMove(size_t Dest, size_t Src, size_t Count)
+{
+    volatile unsigned char *Bytes = Expected;
+    size_t i;
+
+    if (Dest <= Src)
+    {
+        for (i = 0; i < Count; i++)
+            Bytes[Dest + i] = Bytes[Src + i];
+    }
+    else
+    {
+        for (i = Count; i > 0; i--)
+            Bytes[Dest + i - 1] = Bytes[Src + i - 1];
+    }
+}
+
+static void FillBuffers(void)
+{
+    size_t i;
+
+    for (i = 0; i < BUFFER_SIZE; i++)
+        Buffer[i] = Expected[i] = (unsigned char)((i * 7) ^ (i >> 8));
+}
+
+static size_t FirstDifference(void)
+{
+    size_t i;
+
+    for (i = 0; i < BUFFER_SIZE; i++)
+    {
+        if (Buffer[i] != Expected[i])
+            return i;
+    }
+    return BUFFER_SIZE;
+}
+
+static void CheckMove(PFN_MEMMOVE pmemmove, const char *Name, size_t Dest, size_t Src, size_t Count)
+{
+    void *Ret;
+    size_t Diff;
+
+    Ret = pmemmove(Buffer + Dest, Buffer + Src, Count);
+    ReferenceMove(Dest, Src, Count);
+
+    ok(Ret == Buffer + Dest, "%s returned %p instead of %p\n", Name, Ret, (void *)(Buffer + Dest));
+    Diff = FirstDifference();
+    ok(Diff == BUFFER_SIZE, "%s(%zu, %zu, %zu): byte %zu is 0x%02x instead of 0x%02x\n",
+       Name, Dest, Src, Count, Diff, Buffer[Diff], Expected[Diff]);
+}
+
+static void TestMove(PFN_MEMMOVE pmemmove, const char *Name)
+{
+    size_t Count, DestAlign, SrcAlign, i;
+    ptrdiff_t Distance;
+    const size_t Half = BUFFER_SIZE / 2;
+
+    FillBuffers();
+
+    /* Separate buffers, every alignment of both */
+    for (Count = 0; Count <= MAX_SMALL; Count++)
+    {
+        for (DestAlign = 0; DestAlign < MAX_ALIGN; DestAlign++)
+        {
+            for (SrcAlign = 0; SrcAlign < MAX_ALIGN; SrcAlign++)
+                CheckMove(pmemmove, Name, GUARD + DestAlign, Half + SrcAlign, Count);
+        }
+    }
+
+    /* Large ones, upwards and downwards */
+    for (i = 0; i < sizeof(LargeSizes) / sizeof(LargeSizes[0]); i++)
+    {
+        for (DestAlign = 0; DestAlign < MAX_ALIGN; DestAlign += 3)
+        {
+            for (SrcAlign = 0; SrcAlign < MAX_ALIGN; SrcAlign += 5)
+            {
+                CheckMove(pmemmove, Name, GUARD + DestAlign, GUARD + 2 * MAX_ALIGN + SrcAlign, LargeSizes[i]);
+                CheckMove(pmemmove, Name, GUARD + 2 * MAX_ALIGN + DestAlign, GUARD + SrcAlign, LargeSizes[i]);
+            }
+        }
+    }
+
+    /* Every overlap of small blocks, both ways */
+    for (Count = 0; Count <= 2 * MAX_ALIGN * 4; Count++)
+    {
+        for (Distance = -(ptrdiff_t)Count - 1; Distance <= (ptrdiff_t)Count + 1; Distance++)
+        {
+            for (SrcAlign = 0; SrcAlign < MAX_ALIGN; SrcAlign++)
+            {
+                CheckMove(pmemmove, Name, Half + SrcAlign + Distance, Half + SrcAlign, Count);
+            }
+        }
+    }
+}
+
+static void TestMemset(void)
+{
+    static const int Values[] = { 0, 0x01, 0x7f, 0x80, 0xff, 0x15a };
+    size_t Count, Align, i, v, Diff;
+    volatile unsigned char *Bytes = Expected;
+    void *Ret;
+
+    FillBuffers();
+
+    for (v = 0; v < sizeof(Values) / sizeof(Values[0]); v++)
+    {
+        for (Count = 0; Count <= 8000; Count += (Count < MAX_SMALL) ? 1 : 967)
+        {
+            for (Align = 0; Align < MAX_ALIGN; Align++)
+            {
+                Ret = crt_memset(Buffer + GUARD + Align, Values[v], Count);
+                for (i = 0; i < Count; i++)
+                    Bytes[GUARD + Align + i] = (unsigned char)Values[v];
+
+                ok(Ret == Buffer + GUARD + Align, "memset returned %p\n", Ret);
+                Diff = FirstDifference();
+                ok(Diff == BUFFER_SIZE, "memset(%zu, 0x%x, %zu): byte %zu is 0x%02x instead of 0x%02x\n",
+                   Align, Values[v], Count, Diff, Buffer[Diff], Expected[Diff]);
+            }
+        }
+    }
+}
+
+static void TestMemchr(void)
+{
+    /* 0x80 and 0x00 tell a real match from a borrow in the zero byte test */
+    static const unsigned char Fillers[] = { 0x00, 0x01, 0x7f, 0x80, 0xfe };
+    static const int Needles[] = { 0x00, 0x01, 0x80, 0xff, 0x1ff };
+    unsigned char *p;
+    size_t Count, Align, Pos, f, n, i;
+    void *Ret, *Exp;
+
+    for (f = 0; f < sizeof(Fillers) / sizeof(Fillers[0]); f++)
+    {
+        for (n = 0; n < sizeof(Needles) / sizeof(Needles[0]); n++)
+        {
+            if (Fillers[f] == (unsigned char)Needles[n])
+                continue;
+
+            for (Count = 0; Count <= 3 * MAX_ALIGN * 2; Count++)
+            {
+                for (Align = 0; Align < MAX_ALIGN; Align++)
+                {
+                    p = Buffer + GUARD + Align;
+                    for (i = 0; i < Count + MAX_ALIGN; i++)
+                        p[i] = Fillers[f];
+
+                    /* Not there, even when it follows right after the end */
+                    p[Count] = (unsigned char)Needles[n];
+                    Ret = crt_memchr(p, Needles[n], Count);
+                    ok(Ret == NULL, "memchr(%zu, 0x%x, %zu) found %p in 0x%02x\n",
+                       Align, Needles[n], Count, Ret, Fillers[f]);
+                    p[Count] = Fillers[f];
+
+                    /* At every position, only the first one counts */
+                    for (Pos = 0; Pos < Count; Pos++)
+                    {
+                        p[Pos] = (unsigned char)Needles[n];
+                        if (Pos + 3 < Count)
+                            p[Pos + 3] = (unsigned char)Needles[n];
+                        Exp = p + Pos;
+                        Ret = crt_memchr(p, Needles[n], Count);
+                        ok(Ret == Exp, "memchr(%zu, 0x%x, %zu) at %zu returned %p instead of %p\n",
+                           Align, Needles[n], Count, Pos, Ret, Exp);
+                        p[Pos] = Fillers[f];
+                        if (Pos + 3 < Count)
+                            p[Pos + 3] = Fillers[f];
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void TestStrlen(void)
+{
+    static const char Fillers[] = { 0x01, 0x7f, (char)0x80, (char)0xff };
+    char *p;
+    size_t Length, Align, Count, f, i;
+
+    for (f = 0; f < sizeof(Fillers); f++)
+    {
+        for (Length = 0; Length <= 4 * MAX_ALIGN * 2; Length++)
+        {
+            for (Align = 0; Align < MAX_ALIGN; Align++)
+            {
+                p = (char *)Buffer + GUARD + Align;
+                for (i = 0; i < Length; i++)
+                    p[i] = Fillers[f];
+                p[Length] = 0;
+                p[Length + 1] = Fillers[f];
+
+                ok(crt_strlen(p) == Length, "strlen(%zu, 0x%02x) returned %zu instead of %zu\n",
+                   Align, (unsigned char)Fillers[f], crt_strlen(p), Length);
+
+                for (Count = 0; Count <= Length + 2; Count++)
+                {
+                    ok(crt_strnlen(p, Count) == (Count < Length ? Count : Length),
+                       "strnlen(%zu, 0x%02x, %zu) returned %zu for length %zu\n",
+                       Align, (unsigned char)Fillers[f], Count, crt_strnlen(p, Count), Length);
+                }
+            }
+        }
+    }
+}
+
+static void TestWcslen(void)
+{
+    /* Units with a zero byte must not end the string */
+    static const unsigned short Fillers[] = { 0x0001, 0x0100, 0x00ff, 0x8000, 0xffff };
+    unsigned char *Bytes;
+    unsigned short *p;
+    size_t Length, Align, Count, f, i;
+
+    for (f = 0; f < sizeof(Fillers) / sizeof(Fillers[0]); f++)
+    {
+        for (Length = 0; Length <= 2 * MAX_ALIGN * 2; Length++)
+        {
+            /* Odd addresses as well */
+            for (Align = 0; Align < MAX_ALIGN; Align++)
+            {
+                Bytes = Buffer + GUARD + Align;
+                p = (unsigned short *)Bytes;
+                for (i = 0; i <= Length + 1; i++)
+                {
+                    Bytes[2 * i] = (unsigned char)Fillers[f];
+                    Bytes[2 * i + 1] = (unsigned char)(Fillers[f] >> 8);
+                }
+                Bytes[2 * Length] = Bytes[2 * Length + 1] = 0;
+
+                ok(crt_wcslen(p) == Length, "wcslen(%zu, 0x%04x) returned %zu instead of %zu\n",
+                   Align, Fillers[f], crt_wcslen(p), Length);
+
+                for (Count = 0; Count <= Length + 2; Count++)
+                {
+                    ok(crt_wcsnlen(p, Count) == (Count < Length ? Count : Length),
+                       "wcsnlen(%zu, 0x%04x, %zu) returned %zu for length %zu\n",
+                       Align, Fillers[f], Count, crt_wcsnlen(p, Count), Length);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+#ifdef _M_AMD64
+    printf("crttest: amd64 routines, ERMSB %s\n", __crt_has_erms() ? "used" : "not available");
+#endif
+
+    TestMove(crt_memmove, "memmove");
+    TestMove(crt_memcpy, "memcpy");
+    TestMemset();
+    TestMemchr();
+    TestStrlen();
+    TestWcslen();
+
+    printf("crttest: %d failures\n", Failures);
+    return Failures ? 1 : 0;
+}
@@ -0,0 +1,18 @@
+/* tchar.h - stands in for the real one when the crt string routines are
+ * built on the host for crttest. Wide strings are 16-bit like on Windows,
+ * and the routines get names of their own so they don't clash with libc. */
+
+#ifndef __CRTTEST_TCHAR_H
+#define __CRTTEST_TCHAR_H
+
+#ifdef _UNICODE
+typedef unsigned short _TCHAR;
+#define _tcslen     crt_wcslen
+#define _tcsnlen    crt_wcsnlen
+#else
+typedef char _TCHAR;
+#define _tcslen     crt_strlen
+#define _tcsnlen    crt_strnlen
+#endif
+
+#endif /* __CRTTEST_TCHAR_H */
@@ -0,0 +1,271 @@
+/*
+ * COPYRIGHT:   See COPYING in the top level directory
+ * PROJECT:     ReactOS TCP/IP protocol driver
+ * FILE:        network/fibtrie.c
+ * PURPOSE:     Longest prefix match index for the forward information base
+ * NOTES:
+ *   The trie is built from scratch whenever the FIB changes, which is rare,
+ *   and is never modified afterwards. This lets the per-packet lookup run
+ *   without taking the FIB lock. See router.c for how old tries are retired.
+ */
+
+#ifndef UNIT_TEST
+#include "precomp.h"
+#endif
+
+static __inline ULONG FibTrieMask(
+    UCHAR Length)
+{
+    return Length ? (0xFFFFFFFF << (32 - Length)) : 0;
+}
+
+static __inline UCHAR FibTrieBit(
+    ULONG Key,
+    UCHAR Position)
+{
+    return (UCHAR)((Key >> (31 - Position)) & 1);
+}
+
+static __inline UCHAR FibTrieCommonLength(
+    ULONG Key1,
+    ULONG Key2)
+{
+    ULONG Difference = Key1 ^ Key2;
+    ULONG Index;
+
+    if (!Difference)
+        return 32;
+
+    BitScanReverse(&Index, Difference);
+    return (UCHAR)(31 - Index);
+}
+
+static LONG FibTrieNewNode(
+    PFIB_TRIE Trie,
+    ULONG Key,
+    UCHAR Length)
+{
+    PFIB_TRIE_NODE Node = &Trie->Nodes[Trie->NodeCount];
+
+    Node->Key = Key;
+    Node->Length = Length;
+    Node->Child[0] = FIB_TRIE_NO_NODE;
+    Node->Child[1] = FIB_TRIE_NO_NODE;
+    Node->FirstRoute = 0;
+    Node->RouteCount = 0;
+
+    return Trie->NodeCount++;
+}
+
+static LONG FibTrieInsert(
+    PFIB_TRIE Trie,
+    ULONG Key,
+    UCHAR Length)
+/*
+ * FUNCTION: Finds or creates the node for a prefix
+ * ARGUMENTS:
+ *     Trie   = Pointer to trie being built
+ *     Key    = Prefix, host order, with no bits set past Length
+ *     Length = Prefix length in bits
+ * RETURNS:
+ *     Index of the node for the prefix
+ * NOTES:
+ *     Each call creates at most two nodes
+ */
+{
+    PLONG Slot = &Trie->Root;
+    PFIB_TRIE_NODE Node;
+    LONG Current, NewNode, Branch;
+    UCHAR Common;
+
+    while (*Slot != FIB_TRIE_NO_NODE) {
+        Current = *Slot;
+        Node = &Trie->Nodes[Current];
+
+        Common = FibTrieCommonLength(Key, Node->Key);
+        Common = min(Common, min(Length, Node->Length));
+
+        if (Common < Node->Length) {
+            if (Common == Length) {
+                /* The new prefix covers this node, put it above it */
+                NewNode = FibTrieNewNode(Trie, Key, Length);
+                Trie->Nodes[NewNode].Child[FibTrieBit(Node->Key, Length)] = Current;
+                *Slot = NewNode;
+                return NewNode;
+            }
+
+            /* The prefixes diverge, add a branch node for the common part */
+            Branch = FibTrieNewNode(Trie, Key & FibTrieMask(Common), Common);
+            NewNode = FibTrieNewNode(Trie, Key, Length);
+            Trie->Nodes[Branch].Child[FibTrieBit(Key, Common)] = NewNode;
+            Trie->Nodes[Branch].Child[FibTrieBit(Node->Key, Common)] = Current;
+            *Slot = Branch;
+            return NewNode;
+        }
+
+        /* This node is a prefix of the new one, or the very same */
+        if (Length == Node->Length)
+            return Current;
+
+        Slot = &Node->Child[FibTrieBit(Key, Node->Length)];
+    }
+
+    NewNode = FibTrieNewNode(Trie, Key, Length);
+    *Slot = NewNode;
+    return NewNode;
+}
+
+PFIB_TRIE FibTrieBuild(
+    PFIB_TRIE_ROUTE Routes,
+    ULONG RouteCount)
+/*
+ * FUNCTION: Builds a trie snapshot from a set of routes
+ * ARGUMENTS:
+ *     Routes     = Pointer to array of routes
+ *     RouteCount = Number of routes
+ * RETURNS:
+ *     Pointer to the new trie, NULL if there are not enough resources
+ * NOTES:
+ *     Routes for the same prefix are ordered by metric. Routes with the
+ *     same metric keep the order they were given in
+ */
+{
+    PFIB_TRIE Trie;
+    PFIB_TRIE_NODE Node;
+    PULONG NodeOfRoute, RouteOfSlot;
+    ULONG MaxNodes = RouteCount * 2;
+    ULONG i, j, Offset;
+    LONG Index;
+
+    Trie = ExAllocatePoolWithTag(NonPagedPool,
+                                 FIELD_OFFSET(FIB_TRIE, Nodes[MaxNodes]) +
+                                 RouteCount * sizeof(PVOID),
+                                 FIB_TAG);
+    if (!Trie)
+        return NULL;
+
+    NodeOfRoute = ExAllocatePoolWithTag(NonPagedPool,
+                                        (RouteCount * 2 + 1) * sizeof(ULONG),
+                                        FIB_TAG);
+    if (!NodeOfRoute) {
+        ExFreePoolWithTag(Trie, FIB_TAG);
+        return NULL;
+    }
+    RouteOfSlot = NodeOfRoute + RouteCount;
+
+    Trie->Root = FIB_TRIE_NO_NODE;
+    Trie->NodeCount = 0;
+    Trie->RouteCount = RouteCount;
+    Trie->Routes = (PVOID *)&Trie->Nodes[MaxNodes];
+
+    /* Create the nodes and count the routes of every prefix */
+    for (i = 0; i < RouteCount; i++) {
+        ASSERT(Routes[i].Length <= 32);
+        Index = FibTrieInsert(Trie,
+                              Routes[i].Prefix & FibTrieMask(Routes[i].Length),
+                              Routes[i].Length);
+        NodeOfRoute[i] = Index;
+        Trie->Nodes[Index].RouteCount++;
+    }
+    ASSERT(Trie->NodeCount <= MaxNodes);
+
+    /* Give every node its slice of the route array */
+    Offset = 0;
+    for (i = 0; i < Trie->NodeCount; i++) {
+        Trie->Nodes[i].FirstRoute = Offset;
+        Offset += Trie->Nodes[i].RouteCount;
+        Trie->Nodes[i].RouteCount = 0;
+    }
+
+    /* Fill the slices, cheapest route first */
+    for (i = 0; i < RouteCount; i++) {
+        Node = &Trie->Nodes[NodeOfRoute[i]];
+
+        j = Node->FirstRoute + Node->RouteCount;
+        while (j > Node->FirstRoute &&
+               Routes[RouteOfSlot[j - 1]].Metric > Routes[i].Metric) {
+            RouteOfSlot[j] = RouteOfSlot[j - 1];
+            Trie->Routes[j] = Trie->Routes[j - 1];
+            j--;
+        }
+
+        RouteOfSlot[j] = i;
+        Trie->Routes[j] = Routes[i].Context;
+        Node->RouteCount++;
+    }
+
+    ExFreePoolWithTag(NodeOfRoute, FIB_TAG);
+
+    return Trie;
+}
+
+VOID FibTrieFree(
+    PFIB_TRIE Trie)
+/*
+ * FUNCTION: Frees a trie snapshot
+ * ARGUMENTS:
+ *     Trie = Pointer to trie
+ * NOTES:
+ *     The caller must make sure no reader can still be using it
+ */
+{
+    ExFreePoolWithTag(Trie, FIB_TAG);
+}
+
+PVOID FibTrieLookup(
+    PFIB_TRIE Trie,
+    ULONG Address,
+    PFIB_TRIE_USABLE_ROUTINE IsUsable)
+/*
+ * FUNCTION: Finds the route with the longest prefix matching an address
+ * ARGUMENTS:
+ *     Trie     = Pointer to trie
+ *     Address  = Destination address, host order
+ *     IsUsable = Optional routine telling whether a route can be used now
+ * RETURNS:
+ *     Context of the route, NULL if no prefix matches
+ * NOTES:
+ *     Usable routes are preferred over longer ones that are not. If none
+ *     of the matching routes is usable, the longest match is returned
+ */
+{
+    LONG Matches[33];
+    ULONG MatchCount = 0;
+    PFIB_TRIE_NODE Node;
+    LONG Current;
+    ULONG i, j;
+
+    /* Walk down the trie, remembering every prefix with routes */
+    Current = Trie->Root;
+    while (Current != FIB_TRIE_NO_NODE) {
+        Node = &Trie->Nodes[Current];
+
+        if ((Address ^ Node->Key) & FibTrieMask(Node->Length))
+            break;
+
+        if (Node->RouteCount)
+            Matches[MatchCount++] = Current;
+
+        if (Node->Length == 32)
+            break;
+
+        Current = Node->Child[FibTrieBit(Address, Node->Length)];
+    }
+
+    if (!MatchCount)
+        return NULL;
+
+    /* Longest prefix first */
+    for (i = MatchCount; i-- > 0;) {
+        Node = &Trie->Nodes[Matches[i]];
+        for (j = 0; j < Node->RouteCount; j++) {
+            if (!IsUsable || IsUsable(Trie->Routes[Node->FirstRoute + j]))
+                return Trie->Routes[Node->FirstRoute + j];
+        }
+    }
+
+    Node = &Trie->Nodes[Matches[MatchCount - 1]];
+    return Trie->Routes[Node->FirstRoute];
+}
+
+/* EOF */
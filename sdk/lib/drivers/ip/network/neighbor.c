@@ -154,7 +154,7 @@ VOID NBTimeout(VOID)
                     
                     NBFlushPacketQueue(NCE, Status);
 
-                    ExFreePoolWithTag(NCE, NCE_TAG);
+                    RouterRetireNeighbor(NCE);
 
                     continue;
                 }
@@ -205,7 +205,7 @@ VOID NBShutdown(VOID)
           /* Flush wait queue */
 	  NBFlushPacketQueue( CurNCE, NDIS_STATUS_NOT_ACCEPTED );
 
-          ExFreePoolWithTag(CurNCE, NCE_TAG);
+          RouterRetireNeighbor(CurNCE);
 
 	  CurNCE = NextNCE;
       }
@@ -255,7 +255,7 @@ VOID NBDestroyNeighborsForInterface(PIP_INTERFACE Interface)
                 *PrevNCE = NCE->Next;
 
                 NBFlushPacketQueue(NCE, NDIS_STATUS_REQUEST_ABORTED);
-                ExFreePoolWithTag(NCE, NCE_TAG);
+                RouterRetireNeighbor(NCE);
 
                 continue;
             }
@@ -623,7 +623,7 @@ VOID NBRemoveNeighbor(
           *PrevNCE = CurNCE->Next;
 
 	  NBFlushPacketQueue( CurNCE, NDIS_STATUS_REQUEST_ABORTED );
-          ExFreePoolWithTag(CurNCE, NCE_TAG);
+          RouterRetireNeighbor(CurNCE);
 
 	  break;
         }
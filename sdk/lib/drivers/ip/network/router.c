@@ -17,6 +17,17 @@
 LIST_ENTRY FIBListHead;
 KSPIN_LOCK FIBLock;
 
+/* Lookup index over the IPv4 routes, replaced whenever the FIB changes */
+PFIB_TRIE FIBTrie;
+
+/* FIB entries and tries that readers may still be using */
+LIST_ENTRY FIBRetireListHead;
+LIST_ENTRY FIBTrieRetireListHead;
+PNEIGHBOR_CACHE_ENTRY FIBNeighborRetireList;
+WORK_QUEUE_ITEM FIBRetireWorkItem;
+BOOLEAN FIBRetireQueued;
+KEVENT FIBRetireIdleEvent;
+
 void RouterDumpRoutes() {
     PLIST_ENTRY CurrentEntry;
     PLIST_ENTRY NextEntry;
@@ -54,6 +65,111 @@ VOID FreeFIB(
 }
 
 
+VOID NTAPI RouterRetireWorker(
+    PVOID Context)
+/*
+ * FUNCTION: Frees retired FIB entries, tries and router NCEs once no reader can see them
+ * ARGUMENTS:
+ *     Context = Unused
+ * NOTES:
+ *     Lookups only use the trie at DISPATCH_LEVEL. Once this thread has run
+ *     on every processor, all lookups that started before the objects were
+ *     retired are over
+ */
+{
+    KIRQL OldIrql;
+    LIST_ENTRY Entries, Tries;
+    PLIST_ENTRY CurrentEntry;
+    PNEIGHBOR_CACHE_ENTRY Neighbors, NCE;
+    KAFFINITY ActiveProcessors, Processor;
+
+    TI_DbgPrint(DEBUG_ROUTER, ("Called.\n"));
+
+    for (;;) {
+        TcpipAcquireSpinLock(&FIBLock, &OldIrql);
+        if (IsListEmpty(&FIBRetireListHead) && IsListEmpty(&FIBTrieRetireListHead) &&
+            !FIBNeighborRetireList) {
+            FIBRetireQueued = FALSE;
+            KeSetEvent(&FIBRetireIdleEvent, IO_NO_INCREMENT, FALSE);
+            TcpipReleaseSpinLock(&FIBLock, OldIrql);
+            return;
+        }
+
+        /* Take over everything retired so far */
+        InitializeListHead(&Entries);
+        InitializeListHead(&Tries);
+        while (!IsListEmpty(&FIBRetireListHead))
+            InsertTailList(&Entries, RemoveHeadList(&FIBRetireListHead));
+        while (!IsListEmpty(&FIBTrieRetireListHead))
+            InsertTailList(&Tries, RemoveHeadList(&FIBTrieRetireListHead));
+        Neighbors = FIBNeighborRetireList;
+        FIBNeighborRetireList = NULL;
+        TcpipReleaseSpinLock(&FIBLock, OldIrql);
+
+        /* Wait for the readers to go away */
+        ActiveProcessors = KeQueryActiveProcessors();
+        for (Processor = 1; Processor && Processor <= ActiveProcessors; Processor <<= 1) {
+            if (ActiveProcessors & Processor)
+                KeSetSystemAffinityThread(Processor);
+        }
+        KeRevertToUserAffinityThread();
+
+        while (!IsListEmpty(&Entries)) {
+            CurrentEntry = RemoveHeadList(&Entries);
+            FreeFIB(CONTAINING_RECORD(CurrentEntry, FIB_ENTRY, ListEntry));
+        }
+        while (!IsListEmpty(&Tries)) {
+            CurrentEntry = RemoveHeadList(&Tries);
+            FibTrieFree(CONTAINING_RECORD(CurrentEntry, FIB_TRIE, ListEntry));
+        }
+        while (Neighbors) {
+            NCE = Neighbors;
+            Neighbors = NCE->Next;
+            ExFreePoolWithTag(NCE, NCE_TAG);
+        }
+    }
+}
+
+
+VOID RouterQueueRetireWorker(
+    VOID)
+/*
+ * FUNCTION: Makes sure the retire worker will run
+ * NOTES:
+ *     The forward information base lock must be held when called
+ */
+{
+    if (!FIBRetireQueued) {
+        FIBRetireQueued = TRUE;
+        KeClearEvent(&FIBRetireIdleEvent);
+        ExQueueWorkItem(&FIBRetireWorkItem, DelayedWorkQueue);
+    }
+}
+
+
+VOID RouterRetireNeighbor(
+    PNEIGHBOR_CACHE_ENTRY NCE)
+/*
+ * FUNCTION: Frees a neighbor cache entry once no route lookup can use it
+ * ARGUMENTS:
+ *     NCE = Pointer to NCE, already unlinked from the neighbor cache
+ * NOTES:
+ *     Lockless lookups read the state of the router NCE of a FIB entry,
+ *     so the NCE gets the same grace period as the FIB entry itself
+ */
+{
+    KIRQL OldIrql;
+
+    TI_DbgPrint(DEBUG_ROUTER, ("Called. NCE (0x%X).\n", NCE));
+
+    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
+    NCE->Next = FIBNeighborRetireList;
+    FIBNeighborRetireList = NCE;
+    RouterQueueRetireWorker();
+    TcpipReleaseSpinLock(&FIBLock, OldIrql);
+}
+
+
 VOID DestroyFIBE(
     PFIB_ENTRY FIBE)
 /*
@@ -61,7 +177,9 @@ VOID DestroyFIBE(
  * ARGUMENTS:
  *     FIBE = Pointer to FIB entry
  * NOTES:
- *     The forward information base lock must be held when called
+ *     The forward information base lock must be held when called.
+ *     The entry is freed later, as the current trie may still point to it.
+ *     The caller must rebuild the trie afterwards
  */
 {
     TI_DbgPrint(DEBUG_ROUTER, ("Called. FIBE (0x%X).\n", FIBE));
@@ -69,8 +187,65 @@ VOID DestroyFIBE(
     /* Unlink the FIB entry from the list */
     RemoveEntryList(&FIBE->ListEntry);
 
-    /* And free the FIB entry */
-    FreeFIB(FIBE);
+    /* And free the FIB entry once nobody can find it anymore */
+    InsertTailList(&FIBRetireListHead, &FIBE->ListEntry);
+    RouterQueueRetireWorker();
+}
+
+
+VOID RouterRebuildTrie(
+    VOID)
+/*
+ * FUNCTION: Replaces the lookup trie after a change to the FIB
+ * NOTES:
+ *     The forward information base lock must be held when called.
+ *     If there is not enough memory for the new trie, lookups fall
+ *     back to scanning the FIB until the next successful rebuild
+ */
+{
+    PLIST_ENTRY CurrentEntry;
+    PFIB_ENTRY Current;
+    PFIB_TRIE_ROUTE Routes;
+    PFIB_TRIE NewTrie = NULL, OldTrie;
+    ULONG RouteCount = 0;
+
+    for (CurrentEntry = FIBListHead.Flink;
+         CurrentEntry != &FIBListHead;
+         CurrentEntry = CurrentEntry->Flink)
+        RouteCount++;
+
+    Routes = ExAllocatePoolWithTag(NonPagedPool,
+                                   (RouteCount + 1) * sizeof(FIB_TRIE_ROUTE),
+                                   FIB_TAG);
+    if (Routes) {
+        RouteCount = 0;
+        for (CurrentEntry = FIBListHead.Flink;
+             CurrentEntry != &FIBListHead;
+             CurrentEntry = CurrentEntry->Flink) {
+            Current = CONTAINING_RECORD(CurrentEntry, FIB_ENTRY, ListEntry);
+            if (Current->NetworkAddress.Type != IP_ADDRESS_V4)
+                continue;
+
+            Routes[RouteCount].Prefix =
+                IPv4NToHl(Current->NetworkAddress.Address.IPv4Address);
+            Routes[RouteCount].Length = (UCHAR)AddrCountPrefixBits(&Current->Netmask);
+            Routes[RouteCount].Metric = Current->Metric;
+            Routes[RouteCount].Context = Current;
+            RouteCount++;
+        }
+
+        NewTrie = FibTrieBuild(Routes, RouteCount);
+        ExFreePoolWithTag(Routes, FIB_TAG);
+    }
+
+    if (!NewTrie)
+        TI_DbgPrint(MIN_TRACE, ("Insufficient resources, route lookups will be slow.\n"));
+
+    OldTrie = InterlockedExchangePointer((PVOID *)&FIBTrie, NewTrie);
+    if (OldTrie) {
+        InsertTailList(&FIBTrieRetireListHead, &OldTrie->ListEntry);
+        RouterQueueRetireWorker();
+    }
 }
 
 
@@ -206,6 +381,7 @@ PFIB_ENTRY RouterAddRoute(
  *     these references
  */
 {
+    KIRQL OldIrql;
     PFIB_ENTRY FIBE;
 
     TI_DbgPrint(DEBUG_ROUTER, ("Called. NetworkAddress (0x%X)  Netmask (0x%X) "
@@ -230,12 +406,32 @@ PFIB_ENTRY RouterAddRoute(
     FIBE->Metric         = Metric;
 
     /* Add FIB to the forward information base */
-    TcpipInterlockedInsertTailList(&FIBListHead, &FIBE->ListEntry, &FIBLock);
+    TcpipAcquireSpinLock(&FIBLock, &OldIrql);
+    InsertTailList(&FIBListHead, &FIBE->ListEntry);
+    RouterRebuildTrie();
+    TcpipReleaseSpinLock(&FIBLock, OldIrql);
 
     return FIBE;
 }
 
 
+BOOLEAN RouterIsUsableRoute(
+    PVOID Context)
+/*
+ * FUNCTION: Tells whether the router of a FIB entry looks reachable
+ * ARGUMENTS:
+ *     Context = Pointer to FIB entry
+ * RETURNS:
+ *     TRUE if the neighbor is neither stale nor incomplete
+ */
+{
+    PFIB_ENTRY FIBE = Context;
+    UCHAR State = FIBE->Router->State;
+
+    return !(State & NUD_STALE) && !(State & NUD_INCOMPLETE);
+}
+
+
 PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
 /*
  * FUNCTION: Finds a router to use to get to Destination
@@ -251,6 +447,7 @@ PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
     PLIST_ENTRY CurrentEntry;
     PLIST_ENTRY NextEntry;
     PFIB_ENTRY Current;
+    PFIB_TRIE Trie;
     UCHAR State;
     UINT Length, BestLength = 0, MaskLength;
     PNEIGHBOR_CACHE_ENTRY NCE, BestNCE = NULL;
@@ -259,6 +456,33 @@ PNEIGHBOR_CACHE_ENTRY RouterGetRoute(PIP_ADDRESS Destination)
 
     TI_DbgPrint(DEBUG_ROUTER, ("Destination (%s)\n", A2S(Destination)));
 
+    if (Destination->Type == IP_ADDRESS_V4) {
+        /* Readers of the trie stay at DISPATCH_LEVEL, see RouterRetireWorker */
+        KeRaiseIrql(DISPATCH_LEVEL, &OldIrql);
+
+        Trie = FIBTrie;
+        if (Trie) {
+            Current = FibTrieLookup(Trie,
+                                    IPv4NToHl(Destination->Address.IPv4Address),
+                                    RouterIsUsableRoute);
+            if (Current)
+                BestNCE = Current->Router;
+        }
+
+        KeLowerIrql(OldIrql);
+
+        if (Trie) {
+            if( BestNCE ) {
+                TI_DbgPrint(DEBUG_ROUTER,("Routing to %s\n", A2S(&BestNCE->Address)));
+            } else {
+                TI_DbgPrint(DEBUG_ROUTER,("Packet won't be routed\n"));
+            }
+
+            return BestNCE;
+        }
+    }
+
+    /* No trie for this address type, look at every route */
     TcpipAcquireSpinLock(&FIBLock, &OldIrql);
 
     CurrentEntry = FIBListHead.Flink;
@@ -357,6 +581,8 @@ VOID RouterRemoveRoutesForInterface(PIP_INTERFACE Interface)
 
         CurrentEntry = NextEntry;
     }
+
+    RouterRebuildTrie();
     
     TcpipReleaseSpinLock(&FIBLock, OldIrql);
 }
@@ -406,6 +632,7 @@ NTSTATUS RouterRemoveRoute(PIP_ADDRESS Target, PIP_ADDRESS Router)
     if( Found ) {
         TI_DbgPrint(DEBUG_ROUTER, ("Deleting route\n"));
         DestroyFIBE( Current );
+        RouterRebuildTrie();
     }
 
     RouterDumpRoutes();
@@ -492,6 +719,14 @@ NTSTATUS RouterStartup(
     /* Initialize the Forward Information Base */
     InitializeListHead(&FIBListHead);
     TcpipInitializeSpinLock(&FIBLock);
+    FIBTrie = NULL;
+
+    InitializeListHead(&FIBRetireListHead);
+    InitializeListHead(&FIBTrieRetireListHead);
+    FIBNeighborRetireList = NULL;
+    ExInitializeWorkItem(&FIBRetireWorkItem, RouterRetireWorker, NULL);
+    FIBRetireQueued = FALSE;
+    KeInitializeEvent(&FIBRetireIdleEvent, NotificationEvent, TRUE);
 
     return STATUS_SUCCESS;
 }
@@ -512,8 +747,16 @@ NTSTATUS RouterShutdown(
     /* Clear Forward Information Base */
     TcpipAcquireSpinLock(&FIBLock, &OldIrql);
     DestroyFIBEs();
+    RouterRebuildTrie();
     TcpipReleaseSpinLock(&FIBLock, OldIrql);
 
+    /* Wait until the retired entries are gone */
+    KeWaitForSingleObject(&FIBRetireIdleEvent, Executive, KernelMode, FALSE, NULL);
+    if (FIBTrie) {
+        FibTrieFree(FIBTrie);
+        FIBTrie = NULL;
+    }
+
     return STATUS_SUCCESS;
 }
 
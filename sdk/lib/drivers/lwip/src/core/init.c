@@ -109,8 +109,23 @@
   #error "MEMP_NUM_REASSDATA > IP_REASS_MAX_PBUFS doesn't make sense since each struct ip_reassdata must hold 2 pbufs at least!"
 #endif
 #endif /* !MEMP_MEM_MALLOC */
-#if (LWIP_TCP && (TCP_WND > 0xffff))
-  #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
+#if (LWIP_TCP && (TCP_WND > 0xffff) && !LWIP_WND_SCALE)
+  #error "If you want to use TCP, TCP_WND must fit in an u16_t, so, you have to reduce it in your lwipopts.h (or enable window scaling)"
+#endif
+#if (LWIP_TCP && LWIP_WND_SCALE && (TCP_RCV_SCALE > 14))
+  #error "TCP_RCV_SCALE must be 14 or less, see RFC 7323"
+#endif
+#if (LWIP_TCP && (TCP_WND_AUTOTUNE_MAX < TCP_WND))
+  #error "TCP_WND_AUTOTUNE_MAX must be at least TCP_WND"
+#endif
+#if (LWIP_TCP && (TCP_WND_AUTOTUNE_MAX > (0xffffUL << TCP_RCV_SCALE)))
+  #error "TCP_WND_AUTOTUNE_MAX is too large to be announced with TCP_RCV_SCALE, increase TCP_RCV_SCALE in your lwipopts.h"
+#endif
+#if (LWIP_TCP && (TCP_SND_BUF > 0xffff) && !LWIP_WND_SCALE)
+  #error "If you want to use TCP, TCP_SND_BUF must fit in an u16_t, so, you have to reduce it in your lwipopts.h (or enable window scaling)"
+#endif
+#if (LWIP_TCP && LWIP_TCP_SACK && !TCP_QUEUE_OOSEQ)
+  #error "LWIP_TCP_SACK needs TCP_QUEUE_OOSEQ to report out-of-sequence data"
 #endif
 #if (LWIP_TCP && (TCP_SND_QUEUELEN > 0xffff))
   #error "If you want to use TCP, TCP_SND_QUEUELEN must fit in an u16_t, so, you have to reduce it in your lwipopts.h"
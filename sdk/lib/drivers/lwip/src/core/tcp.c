@@ -52,6 +52,7 @@
 #include "lwip/tcp_impl.h"
 #include "lwip/debug.h"
 #include "lwip/stats.h"
+#include "lwip/sys.h"
 
 #include <string.h>
 
@@ -172,7 +173,7 @@ tcp_close_shutdown(struct tcp_pcb *pcb, u8_t rst_on_unacked_data)
   err_t err;
 
   if (rst_on_unacked_data && ((pcb->state == ESTABLISHED) || (pcb->state == CLOSE_WAIT))) {
-    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != TCP_WND)) {
+    if ((pcb->refused_data != NULL) || (pcb->rcv_wnd != pcb->rcv_wnd_max)) {
       /* Not all data received by application, send RST to tell the remote
          side about this. */
       LWIP_ASSERT("pcb->flags & TF_RXCLOSED", pcb->flags & TF_RXCLOSED);
@@ -580,7 +581,7 @@ u32_t tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
 {
   u32_t new_right_edge = pcb->rcv_nxt + pcb->rcv_wnd;
 
-  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((TCP_WND / 2), pcb->mss))) {
+  if (TCP_SEQ_GEQ(new_right_edge, pcb->rcv_ann_right_edge + LWIP_MIN((pcb->rcv_wnd_max / 2), pcb->mss))) {
     /* we can advertise more window */
     pcb->rcv_ann_wnd = pcb->rcv_wnd;
     return new_right_edge - pcb->rcv_ann_right_edge;
@@ -592,8 +593,10 @@ u32_t tcp_update_rcv_ann_wnd(struct tcp_pcb *pcb)
     } else {
       /* keep the right edge of window constant */
       u32_t new_rcv_ann_wnd = pcb->rcv_ann_right_edge - pcb->rcv_nxt;
+#if !LWIP_WND_SCALE
       LWIP_ASSERT("new_rcv_ann_wnd <= 0xffff", new_rcv_ann_wnd <= 0xffff);
-      pcb->rcv_ann_wnd = (u16_t)new_rcv_ann_wnd;
+#endif /* !LWIP_WND_SCALE */
+      pcb->rcv_ann_wnd = (tcpwnd_size_t)new_rcv_ann_wnd;
     }
     return 0;
   }
@@ -616,11 +619,11 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
   LWIP_ASSERT("don't call tcp_recved for listen-pcbs",
     pcb->state != LISTEN);
   LWIP_ASSERT("tcp_recved: len would wrap rcv_wnd\n",
-              len <= 0xffff - pcb->rcv_wnd );
+              len <= (tcpwnd_size_t)-1 - pcb->rcv_wnd );
 
   pcb->rcv_wnd += len;
-  if (pcb->rcv_wnd > TCP_WND) {
-    pcb->rcv_wnd = TCP_WND;
+  if (pcb->rcv_wnd > pcb->rcv_wnd_max) {
+    pcb->rcv_wnd = pcb->rcv_wnd_max;
   }
 
   wnd_inflation = tcp_update_rcv_ann_wnd(pcb);
@@ -634,9 +637,51 @@ tcp_recved(struct tcp_pcb *pcb, u16_t len)
     tcp_output(pcb);
   }
 
-  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"U16_F" (%"U16_F").\n",
-         len, pcb->rcv_wnd, TCP_WND - pcb->rcv_wnd));
+  LWIP_DEBUGF(TCP_DEBUG, ("tcp_recved: recveived %"U16_F" bytes, wnd %"TCPWNDSIZE_F" (%"TCPWNDSIZE_F").\n",
+         len, pcb->rcv_wnd, pcb->rcv_wnd_max - pcb->rcv_wnd));
+}
+
+#if TCP_WND_AUTOTUNE_MAX > TCP_WND
+/**
+ * Grows the receive window of a connection whose sender is limited by it.
+ *
+ * Called from tcp_receive() for data received in sequence. A measurement
+ * lasts until a whole window of data has arrived. If that took no more than
+ * about a round trip, the remote host kept the whole window in flight and
+ * could have sent faster, so the window is doubled, up to
+ * TCP_WND_AUTOTUNE_MAX. Windows above 64 KB need window scaling, so nothing
+ * is done if the remote host did not agree to it.
+ *
+ * @param pcb the tcp_pcb that received data
+ */
+void
+tcp_rcv_wnd_autotune(struct tcp_pcb *pcb)
+{
+  u32_t now, rtt;
+  tcpwnd_size_t grow;
+
+  if (!(pcb->flags & TF_WND_SCALE) || (pcb->rcv_wnd_max >= TCP_WND_AUTOTUNE_MAX) ||
+      TCP_SEQ_LT(pcb->rcv_nxt, pcb->rcv_autotune_seq)) {
+    return;
+  }
+
+  now = sys_now();
+  /* The smoothed RTT is kept in slow timer ticks, add one for the coarse
+     resolution. rcv_autotune_time is 0 until the first measurement started. */
+  rtt = ((u32_t)LWIP_MAX(pcb->sa >> 3, 0) + 1) * TCP_SLOW_INTERVAL;
+  if ((pcb->rcv_autotune_time != 0) && (now - pcb->rcv_autotune_time <= 2 * rtt)) {
+    grow = LWIP_MIN(pcb->rcv_wnd_max, TCP_WND_AUTOTUNE_MAX - pcb->rcv_wnd_max);
+    pcb->rcv_wnd_max += grow;
+    pcb->rcv_wnd += grow;
+    LWIP_DEBUGF(TCP_WND_DEBUG, ("tcp_rcv_wnd_autotune: window grown to %"TCPWNDSIZE_F"\n",
+                                pcb->rcv_wnd_max));
+  }
+
+  /* Start the next measurement */
+  pcb->rcv_autotune_seq = pcb->rcv_nxt + pcb->rcv_wnd_max;
+  pcb->rcv_autotune_time = now;
 }
+#endif /* TCP_WND_AUTOTUNE_MAX > TCP_WND */
 
 /**
  * Allocate a new local TCP port.
@@ -788,7 +833,7 @@ void
 tcp_slowtmr(void)
 {
   struct tcp_pcb *pcb, *prev;
-  u16_t eff_wnd;
+  tcpwnd_size_t eff_wnd;
   u8_t pcb_remove;      /* flag if a PCB should be removed */
   u8_t pcb_reset;       /* flag if a RST should be sent when removing */
   err_t err;
@@ -867,8 +912,8 @@ tcp_slowtmr_start:
             pcb->ssthresh = (pcb->mss << 1);
           }
           pcb->cwnd = pcb->mss;
-          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"U16_F
-                                       " ssthresh %"U16_F"\n",
+          LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_slowtmr: cwnd %"TCPWNDSIZE_F
+                                       " ssthresh %"TCPWNDSIZE_F"\n",
                                        pcb->cwnd, pcb->ssthresh));
  
           /* The following needs to be called AFTER cwnd is set to one
@@ -1098,7 +1143,7 @@ tcp_process_refused_data(struct tcp_pcb *pcb)
     if (refused_flags & PBUF_FLAG_TCP_FIN) {
       /* correct rcv_wnd as the application won't call tcp_recved()
          for the FIN's seqno */
-      if (pcb->rcv_wnd != TCP_WND) {
+      if (pcb->rcv_wnd != pcb->rcv_wnd_max) {
         pcb->rcv_wnd++;
       }
       TCP_EVENT_CLOSED(pcb, err);
@@ -1310,6 +1355,7 @@ tcp_alloc(u8_t prio)
     pcb->snd_queuelen = 0;
     pcb->rcv_wnd = TCP_WND;
     pcb->rcv_ann_wnd = TCP_WND;
+    pcb->rcv_wnd_max = TCP_WND;
     pcb->tos = 0;
     pcb->ttl = TCP_TTL;
     /* As initial send MSS, we use TCP_MSS but limit it to 536.
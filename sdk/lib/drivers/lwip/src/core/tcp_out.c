@@ -105,7 +105,7 @@ tcp_output_alloc_header(struct tcp_pcb *pcb, u16_t optlen, u16_t datalen,
     tcphdr->seqno = seqno_be;
     tcphdr->ackno = htonl(pcb->rcv_nxt);
     TCPH_HDRLEN_FLAGS_SET(tcphdr, (5 + optlen / 4), TCP_ACK);
-    tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+    tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
     tcphdr->chksum = 0;
     tcphdr->urgp = 0;
 
@@ -306,7 +306,7 @@ tcp_write_checks(struct tcp_pcb *pcb, u16_t len)
 
   /* fail on too much data */
   if (len > pcb->snd_buf) {
-    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_write: too much data (len=%"U16_F" > snd_buf=%"U16_F")\n",
+    LWIP_DEBUGF(TCP_OUTPUT_DEBUG | 3, ("tcp_write: too much data (len=%"U16_F" > snd_buf=%"TCPWNDSIZE_F")\n",
       len, pcb->snd_buf));
     pcb->flags |= TF_NAGLEMEMERR;
     return ERR_MEM;
@@ -370,7 +370,7 @@ tcp_write(struct tcp_pcb *pcb, const void *arg, u16_t len, u8_t apiflags)
 #endif /* TCP_CHECKSUM_ON_COPY */
   err_t err;
   /* don't allocate segments bigger than half the maximum window we ever received */
-  u16_t mss_local = LWIP_MIN(pcb->mss, pcb->snd_wnd_max/2);
+  u16_t mss_local = (u16_t)LWIP_MIN(pcb->mss, pcb->snd_wnd_max/2);
 
 #if LWIP_NETIF_TX_SINGLE_PBUF
   /* Always copy to try to create single pbufs for TX */
@@ -742,6 +742,19 @@ tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags)
 
   if (flags & TCP_SYN) {
     optflags = TF_SEG_OPTS_MSS;
+#if LWIP_WND_SCALE
+    /* A <SYN,ACK> (sent in state SYN_RCVD) may only carry the window
+       scale option if the remote host sent one in its SYN */
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_WND_SCALE)) {
+      optflags |= TF_SEG_OPTS_WND_SCALE;
+    }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+    /* Same for SACK permitted */
+    if ((pcb->state != SYN_RCVD) || (pcb->flags & TF_SACK)) {
+      optflags |= TF_SEG_OPTS_SACK_PERM;
+    }
+#endif /* LWIP_TCP_SACK */
   }
 #if LWIP_TCP_TIMESTAMPS
   if ((pcb->flags & TF_TIMESTAMP)) {
@@ -834,6 +847,83 @@ tcp_build_timestamp_option(struct tcp_pcb *pcb, u32_t *opts)
 }
 #endif
 
+#if LWIP_TCP_SACK
+/* Collect the SACK blocks describing the ooseq queue (RFC 2018)
+ *
+ * The block holding the most recently received segment comes first,
+ * the others follow in sequence order.
+ *
+ * @param pcb tcp_pcb
+ * @param left array receiving the left edges of the blocks
+ * @param right array receiving the right edges of the blocks
+ * @param max_blocks size of the arrays
+ * @return number of blocks stored
+ */
+static u8_t
+tcp_sack_blocks(struct tcp_pcb *pcb, u32_t *left, u32_t *right, u8_t max_blocks)
+{
+  struct tcp_seg *seg;
+  u32_t run_left, run_right;
+  u8_t count = 1, i;
+  u8_t recent_found = 0;
+
+  if (max_blocks == 0) {
+    return 0;
+  }
+
+  seg = pcb->ooseq;
+  while (seg != NULL) {
+    /* The ooseq queue is sorted and trimmed, so contiguous segments
+       simply follow each other */
+    run_left = seg->tcphdr->seqno;
+    run_right = run_left + TCP_TCPLEN(seg);
+    for (seg = seg->next; seg != NULL && seg->tcphdr->seqno == run_right; seg = seg->next) {
+      run_right += TCP_TCPLEN(seg);
+    }
+
+    if (!recent_found && TCP_SEQ_BETWEEN(pcb->rcv_sack_recent, run_left, run_right - 1)) {
+      left[0] = run_left;
+      right[0] = run_right;
+      recent_found = 1;
+    } else if (count < max_blocks) {
+      left[count] = run_left;
+      right[count] = run_right;
+      count++;
+    }
+  }
+
+  if (!recent_found) {
+    /* Slot 0 was kept for nothing, move the others down */
+    for (i = 1; i < count; i++) {
+      left[i - 1] = left[i];
+      right[i - 1] = right[i];
+    }
+    count--;
+  }
+  return count;
+}
+
+/* Build a SACK option (4 + 8 bytes per block) at the specified options pointer
+ *
+ * @param opts option pointer where to store the SACK option
+ * @param left left edges of the blocks
+ * @param right right edges of the blocks
+ * @param count number of blocks
+ */
+static void
+tcp_build_sack_option(u32_t *opts, u32_t *left, u32_t *right, u8_t count)
+{
+  u8_t i;
+
+  /* Pad with two NOP options to make everything nicely aligned */
+  opts[0] = htonl(0x01010500 | (2 + 8 * count));
+  for (i = 0; i < count; i++) {
+    opts[1 + 2 * i] = htonl(left[i]);
+    opts[2 + 2 * i] = htonl(right[i]);
+  }
+}
+#endif /* LWIP_TCP_SACK */
+
 /** Send an ACK without data.
  *
  * @param pcb Protocol control block for the TCP connection to send the ACK
@@ -844,12 +934,27 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   struct pbuf *p;
   struct tcp_hdr *tcphdr;
   u8_t optlen = 0;
+  u32_t *opts;
+#if LWIP_TCP_SACK
+  u32_t sack_left[4], sack_right[4];
+  u8_t sack_count = 0;
+#endif /* LWIP_TCP_SACK */
 
 #if LWIP_TCP_TIMESTAMPS
   if (pcb->flags & TF_TIMESTAMP) {
     optlen = LWIP_TCP_OPT_LENGTH(TF_SEG_OPTS_TS);
   }
 #endif
+#if LWIP_TCP_SACK
+  /* Tell the remote host which out-of-sequence data we already have */
+  if ((pcb->flags & TF_SACK) && (pcb->ooseq != NULL)) {
+    sack_count = tcp_sack_blocks(pcb, sack_left, sack_right,
+                                 (u8_t)LWIP_MIN(4, TCP_SACK_MAX_BLOCKS(optlen)));
+    if (sack_count > 0) {
+      optlen += 4 + 8 * sack_count;
+    }
+  }
+#endif /* LWIP_TCP_SACK */
 
   p = tcp_output_alloc_header(pcb, optlen, 0, htonl(pcb->snd_nxt));
   if (p == NULL) {
@@ -863,13 +968,20 @@ tcp_send_empty_ack(struct tcp_pcb *pcb)
   pcb->flags &= ~(TF_ACK_DELAY | TF_ACK_NOW);
 
   /* NB. MSS option is only sent on SYNs, so ignore it here */
+  opts = (u32_t *)(void *)(tcphdr + 1);
 #if LWIP_TCP_TIMESTAMPS
   pcb->ts_lastacksent = pcb->rcv_nxt;
 
   if (pcb->flags & TF_TIMESTAMP) {
-    tcp_build_timestamp_option(pcb, (u32_t *)(tcphdr + 1));
+    tcp_build_timestamp_option(pcb, opts);
+    opts += 3;
   }
 #endif 
+#if LWIP_TCP_SACK
+  if (sack_count > 0) {
+    tcp_build_sack_option(opts, sack_left, sack_right, sack_count);
+  }
+#endif /* LWIP_TCP_SACK */
 
 #if CHECKSUM_GEN_TCP
   tcphdr->chksum = inet_chksum_pseudo(p, &(pcb->local_ip), &(pcb->remote_ip),
@@ -945,13 +1057,13 @@ tcp_output(struct tcp_pcb *pcb)
 #endif /* TCP_OUTPUT_DEBUG */
 #if TCP_CWND_DEBUG
   if (seg == NULL) {
-    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"U16_F
-                                 ", cwnd %"U16_F", wnd %"U32_F
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"TCPWNDSIZE_F
+                                 ", cwnd %"TCPWNDSIZE_F", wnd %"U32_F
                                  ", seg == NULL, ack %"U32_F"\n",
                                  pcb->snd_wnd, pcb->cwnd, wnd, pcb->lastack));
   } else {
     LWIP_DEBUGF(TCP_CWND_DEBUG, 
-                ("tcp_output: snd_wnd %"U16_F", cwnd %"U16_F", wnd %"U32_F
+                ("tcp_output: snd_wnd %"TCPWNDSIZE_F", cwnd %"TCPWNDSIZE_F", wnd %"U32_F
                  ", effwnd %"U32_F", seq %"U32_F", ack %"U32_F"\n",
                  pcb->snd_wnd, pcb->cwnd, wnd,
                  ntohl(seg->tcphdr->seqno) - pcb->lastack + seg->len,
@@ -975,7 +1087,7 @@ tcp_output(struct tcp_pcb *pcb)
       break;
     }
 #if TCP_CWND_DEBUG
-    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"U16_F", cwnd %"U16_F", wnd %"U32_F", effwnd %"U32_F", seq %"U32_F", ack %"U32_F", i %"S16_F"\n",
+    LWIP_DEBUGF(TCP_CWND_DEBUG, ("tcp_output: snd_wnd %"TCPWNDSIZE_F", cwnd %"TCPWNDSIZE_F", wnd %"U32_F", effwnd %"U32_F", seq %"U32_F", ack %"U32_F", i %"S16_F"\n",
                             pcb->snd_wnd, pcb->cwnd, wnd,
                             ntohl(seg->tcphdr->seqno) + seg->len -
                             pcb->lastack,
@@ -1060,7 +1172,13 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
   seg->tcphdr->ackno = htonl(pcb->rcv_nxt);
 
   /* advertise our receive window size in this TCP segment */
-  seg->tcphdr->wnd = htons(pcb->rcv_ann_wnd);
+  if (TCPH_FLAGS(seg->tcphdr) & TCP_SYN) {
+    /* The window field in a SYN segment itself (the only type where we
+       send the window scale option) is never scaled. */
+    seg->tcphdr->wnd = htons(TCPWND16(pcb->rcv_ann_wnd));
+  } else {
+    seg->tcphdr->wnd = htons(TCPWND16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd)));
+  }
 
   pcb->rcv_ann_right_edge = pcb->rcv_nxt + pcb->rcv_ann_wnd;
 
@@ -1077,6 +1195,18 @@ tcp_output_segment(struct tcp_seg *seg, struct tcp_pcb *pcb)
     *opts = TCP_BUILD_MSS_OPTION(mss);
     opts += 1;
   }
+#if LWIP_WND_SCALE
+  if (seg->flags & TF_SEG_OPTS_WND_SCALE) {
+    *opts = TCP_BUILD_WND_SCALE_OPTION(TCP_RCV_SCALE);
+    opts += 1;
+  }
+#endif /* LWIP_WND_SCALE */
+#if LWIP_TCP_SACK
+  if (seg->flags & TF_SEG_OPTS_SACK_PERM) {
+    *opts = TCP_BUILD_SACK_PERM_OPTION();
+    opts += 1;
+  }
+#endif /* LWIP_TCP_SACK */
 #if LWIP_TCP_TIMESTAMPS
   pcb->ts_lastacksent = pcb->rcv_nxt;
 
@@ -1212,7 +1342,7 @@ tcp_rst(u32_t seqno, u32_t ackno,
   tcphdr->seqno = htonl(seqno);
   tcphdr->ackno = htonl(ackno);
   TCPH_HDRLEN_FLAGS_SET(tcphdr, TCP_HLEN/4, TCP_RST | TCP_ACK);
-  tcphdr->wnd = PP_HTONS(TCP_WND);
+  tcphdr->wnd = PP_HTONS(TCPWND16(TCP_WND));
   tcphdr->chksum = 0;
   tcphdr->urgp = 0;
 
@@ -1244,6 +1374,14 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
     return;
   }
 
+#if LWIP_TCP_SACK
+  /* The remote host may have dropped the data it reported with SACK
+     blocks, so everything is sent again (RFC 2018) */
+  for (seg = pcb->unacked; seg != NULL; seg = seg->next) {
+    seg->flags &= ~(TF_SEG_SACKED | TF_SEG_SACK_REXMIT);
+  }
+#endif /* LWIP_TCP_SACK */
+
   /* Move all unacked segments to the head of the unsent queue */
   for (seg = pcb->unacked; seg->next != NULL; seg = seg->next);
   /* concatenate unsent queue after unacked queue */
@@ -1265,27 +1403,28 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 }
 
 /**
- * Requeue the first unacked segment for retransmission
+ * Requeue an unacked segment for retransmission
  *
- * Called by tcp_receive() for fast retramsmit.
+ * Called by tcp_rexmit() and tcp_rexmit_sack_hole().
  *
- * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ * @param pcb the tcp_pcb for which to retransmit a segment
+ * @param seg the segment to retransmit, must be on the unacked queue
  */
 void
-tcp_rexmit(struct tcp_pcb *pcb)
+tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg)
 {
-  struct tcp_seg *seg;
   struct tcp_seg **cur_seg;
 
-  if (pcb->unacked == NULL) {
+  /* Remove the segment from the unacked queue */
+  for (cur_seg = &(pcb->unacked); *cur_seg != NULL && *cur_seg != seg;
+       cur_seg = &((*cur_seg)->next));
+  LWIP_ASSERT("tcp_rexmit_seg: segment not on the unacked queue", *cur_seg != NULL);
+  if (*cur_seg == NULL) {
     return;
   }
+  *cur_seg = seg->next;
 
-  /* Move the first unacked segment to the unsent queue */
-  /* Keep the unsent queue sorted. */
-  seg = pcb->unacked;
-  pcb->unacked = seg->next;
-
+  /* Move it to the unsent queue, keeping the unsent queue sorted. */
   cur_seg = &(pcb->unsent);
   while (*cur_seg &&
     TCP_SEQ_LT(ntohl((*cur_seg)->tcphdr->seqno), ntohl(seg->tcphdr->seqno))) {
@@ -1311,6 +1450,68 @@ tcp_rexmit(struct tcp_pcb *pcb)
      and thus tcp_output directly returns. */
 }
 
+/**
+ * Requeue the first unacked segment for retransmission
+ *
+ * Called by tcp_receive() for fast retramsmit.
+ *
+ * @param pcb the tcp_pcb for which to retransmit the first unacked segment
+ */
+void
+tcp_rexmit(struct tcp_pcb *pcb)
+{
+  if (pcb->unacked == NULL) {
+    return;
+  }
+
+  tcp_rexmit_seg(pcb, pcb->unacked);
+}
+
+#if LWIP_TCP_SACK
+/**
+ * Requeue the next segment the remote host is missing during fast recovery
+ *
+ * A segment is known to be missing if it is the first unacked one, or if
+ * the remote host reported data beyond it in SACK blocks. Each segment is
+ * retransmitted at most once per fast recovery, the retransmission timer
+ * takes care of the rest. This is a simplified version of the loss recovery
+ * in RFC 6675, without its 'pipe' estimate.
+ *
+ * Called by tcp_receive() for dupacks and partial ACKs in fast recovery.
+ *
+ * @param pcb the tcp_pcb in fast recovery
+ * @return 1 if a segment was requeued, 0 if there is no known hole
+ */
+u8_t
+tcp_rexmit_sack_hole(struct tcp_pcb *pcb)
+{
+  struct tcp_seg *seg, *hole;
+
+  for (hole = pcb->unacked; hole != NULL; hole = hole->next) {
+    if (!(hole->flags & (TF_SEG_SACKED | TF_SEG_SACK_REXMIT))) {
+      break;
+    }
+  }
+  if (hole == NULL) {
+    return 0;
+  }
+
+  if (hole != pcb->unacked) {
+    for (seg = hole->next; seg != NULL && !(seg->flags & TF_SEG_SACKED); seg = seg->next);
+    if (seg == NULL) {
+      /* Nothing was received after it, it may still be on its way */
+      return 0;
+    }
+  }
+
+  LWIP_DEBUGF(TCP_FR_DEBUG, ("tcp_rexmit_sack_hole: retransmit %"U32_F"\n",
+                             ntohl(hole->tcphdr->seqno)));
+  hole->flags |= TF_SEG_SACK_REXMIT;
+  tcp_rexmit_seg(pcb, hole);
+  return 1;
+}
+#endif /* LWIP_TCP_SACK */
+
 
 /**
  * Handle retransmission after three dupacks received
@@ -1327,6 +1528,11 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
                  "), fast retransmit %"U32_F"\n",
                  (u16_t)pcb->dupacks, pcb->lastack,
                  ntohl(pcb->unacked->tcphdr->seqno)));
+#if LWIP_TCP_SACK
+    /* Everything sent so far has to be acknowledged to leave fast recovery */
+    pcb->sack_recover = pcb->snd_nxt;
+    pcb->unacked->flags |= TF_SEG_SACK_REXMIT;
+#endif /* LWIP_TCP_SACK */
     tcp_rexmit(pcb);
 
     /* Set ssthresh to half of the minimum of the current
@@ -1340,7 +1546,7 @@ tcp_rexmit_fast(struct tcp_pcb *pcb)
     /* The minimum value for ssthresh should be 2 MSS */
     if (pcb->ssthresh < 2*pcb->mss) {
       LWIP_DEBUGF(TCP_FR_DEBUG, 
-                  ("tcp_receive: The minimum value for ssthresh %"U16_F
+                  ("tcp_receive: The minimum value for ssthresh %"TCPWNDSIZE_F
                    " should be min 2 mss %"U16_F"...\n",
                    pcb->ssthresh, 2*pcb->mss));
       pcb->ssthresh = 2*pcb->mss;
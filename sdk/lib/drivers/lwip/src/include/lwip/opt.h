@@ -1060,6 +1060,40 @@
 #define LWIP_TCP_TIMESTAMPS             0
 #endif
 
+/**
+ * LWIP_WND_SCALE and TCP_RCV_SCALE:
+ * Set LWIP_WND_SCALE to 1 to enable window scaling (RFC 7323).
+ * Set TCP_RCV_SCALE to the desired scaling factor (shift count in the
+ * range of [0..14]). Windows larger than 64 KB can only be announced
+ * with TCP_RCV_SCALE > 0.
+ */
+#ifndef LWIP_WND_SCALE
+#define LWIP_WND_SCALE                  0
+#define TCP_RCV_SCALE                   0
+#endif
+
+/**
+ * TCP_WND_AUTOTUNE_MAX: Upper limit for the receive window of a connection.
+ * Each connection starts with TCP_WND. Whenever the remote host fills the
+ * whole announced window, the window is doubled until this limit is reached.
+ * Set it to TCP_WND to disable receive window auto-tuning. Values above
+ * 0xFFFF need LWIP_WND_SCALE and are only used if the remote host agreed to
+ * window scaling.
+ */
+#ifndef TCP_WND_AUTOTUNE_MAX
+#define TCP_WND_AUTOTUNE_MAX            TCP_WND
+#endif
+
+/**
+ * LWIP_TCP_SACK==1: support selective acknowledgments (RFC 2018).
+ * Out-of-sequence data held on the ooseq queue is reported to the remote
+ * host, and SACK blocks received from it are used to retransmit only the
+ * missing segments during fast recovery.
+ */
+#ifndef LWIP_TCP_SACK
+#define LWIP_TCP_SACK                   0
+#endif
+
 /**
  * TCP_WND_UPDATE_THRESHOLD: difference in window to trigger an
  * explicit window update
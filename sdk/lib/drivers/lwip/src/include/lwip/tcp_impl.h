@@ -292,16 +292,33 @@ struct tcp_seg {
 #define TF_SEG_OPTS_TS          (u8_t)0x02U /* Include timestamp option. */
 #define TF_SEG_DATA_CHECKSUMMED (u8_t)0x04U /* ALL data (not the header) is
                                                checksummed into 'chksum' */
+#define TF_SEG_OPTS_WND_SCALE   (u8_t)0x08U /* Include WND SCALE option. */
+#define TF_SEG_OPTS_SACK_PERM   (u8_t)0x10U /* Include SACK Permitted option. */
+#define TF_SEG_SACKED           (u8_t)0x20U /* Covered by a SACK block from the
+                                               remote host */
+#define TF_SEG_SACK_REXMIT      (u8_t)0x40U /* Retransmitted as a SACK hole
+                                               during this fast recovery */
   struct tcp_hdr *tcphdr;  /* the TCP header */
 };
 
 #define LWIP_TCP_OPT_LENGTH(flags)              \
   (flags & TF_SEG_OPTS_MSS ? 4  : 0) +          \
+  (flags & TF_SEG_OPTS_WND_SCALE ? 4 : 0) +     \
+  (flags & TF_SEG_OPTS_SACK_PERM ? 4 : 0) +     \
   (flags & TF_SEG_OPTS_TS  ? 12 : 0)
 
 /** This returns a TCP header option for MSS in an u32_t */
 #define TCP_BUILD_MSS_OPTION(mss) htonl(0x02040000 | ((mss) & 0xFFFF))
 
+/** This returns a NOP + TCP header option for WND SCALE in an u32_t */
+#define TCP_BUILD_WND_SCALE_OPTION(scale) htonl(0x01030300 | ((scale) & 0xFF))
+
+/** This returns two NOPs + the TCP SACK Permitted option in an u32_t */
+#define TCP_BUILD_SACK_PERM_OPTION() PP_HTONL(0x01010402)
+
+/** Maximum number of SACK blocks in a segment, depending on the other options */
+#define TCP_SACK_MAX_BLOCKS(optlen) ((40 - (optlen) - 4) / 8)
+
 /* Global variables: */
 extern struct tcp_pcb *tcp_input_pcb;
 extern u32_t tcp_ticks;
@@ -440,6 +457,12 @@ err_t tcp_send_fin(struct tcp_pcb *pcb);
 err_t tcp_enqueue_flags(struct tcp_pcb *pcb, u8_t flags);
 
 void tcp_rexmit_seg(struct tcp_pcb *pcb, struct tcp_seg *seg);
+#if LWIP_TCP_SACK
+u8_t tcp_rexmit_sack_hole(struct tcp_pcb *pcb);
+#endif /* LWIP_TCP_SACK */
+#if TCP_WND_AUTOTUNE_MAX > TCP_WND
+void tcp_rcv_wnd_autotune(struct tcp_pcb *pcb);
+#endif /* TCP_WND_AUTOTUNE_MAX > TCP_WND */
 
 void tcp_rst(u32_t seqno, u32_t ackno,
        ip_addr_t *local_ip, ip_addr_t *remote_ip,
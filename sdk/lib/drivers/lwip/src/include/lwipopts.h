@@ -66,7 +66,18 @@
 
 #define TCP_WND                         0xFFFF
 
-#define TCP_SND_BUF                     TCP_WND
+/* Connections start with a 64K receive window, which grows up to 1 MB
+ * while the sender keeps it full. Window scaling is needed to announce
+ * more than 64K, a scale of 5 allows up to 2 MB. */
+#define LWIP_WND_SCALE                  1
+
+#define TCP_RCV_SCALE                   5
+
+#define TCP_WND_AUTOTUNE_MAX            (1024 * 1024)
+
+#define LWIP_TCP_SACK                   1
+
+#define TCP_SND_BUF                     (256 * 1024)
 
 #define TCP_MAXRTX                      8
 
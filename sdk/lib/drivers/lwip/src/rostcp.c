@@ -512,6 +512,13 @@ LibTCPSendCallback(void *arg)
         SendFlags |= TCP_WRITE_FLAG_MORE;
     }
 
+    if (SendLength > 0xFFFF)
+    {
+        /* tcp_write() takes at most 64K at once, the caller comes back for the rest */
+        SendLength = 0xFFFF;
+        SendFlags |= TCP_WRITE_FLAG_MORE;
+    }
+
     msg->Output.Send.Error = tcp_write(pcb,
                                        msg->Input.Send.Data,
                                        SendLength,
@@ -533,7 +540,7 @@ done:
 }
 
 err_t
-LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u16_t len, u32_t *sent, const int safe)
+LibTCPSend(PCONNECTION_ENDPOINT Connection, void *const dataptr, const u32_t len, u32_t *sent, const int safe)
 {
     err_t ret;
     struct lwip_callback_msg *msg;
@@ -3,6 +3,7 @@
 #include "udp/test_udp.h"
 #include "tcp/test_tcp.h"
 #include "tcp/test_tcp_oos.h"
+#include "tcp/test_tcp_perf.h"
 #include "core/test_mem.h"
 #include "core/test_pbuf.h"
 #include "etharp/test_etharp.h"
@@ -20,6 +21,7 @@ int main()
     udp_suite,
     tcp_suite,
     tcp_oos_suite,
+    tcp_perf_suite,
     mem_suite,
     pbuf_suite,
     etharp_suite,
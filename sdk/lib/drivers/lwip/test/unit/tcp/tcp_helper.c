@@ -92,8 +92,8 @@ tcp_create_segment_wnd(ip_addr_t* src_ip, ip_addr_t* dst_ip,
 
   /* calculate checksum */
 
-  tcphdr->chksum = inet_chksum_pseudo(p,
-          IP_PROTO_TCP, p->tot_len, src_ip, dst_ip);
+  tcphdr->chksum = inet_chksum_pseudo(p, src_ip, dst_ip,
+          IP_PROTO_TCP, p->tot_len);
 
   pbuf_header(p, sizeof(struct ip_hdr));
 
@@ -239,18 +239,16 @@ void test_tcp_input(struct pbuf *p, struct netif *inp)
 {
   struct ip_hdr *iphdr = (struct ip_hdr*)p->payload;
   /* these lines are a hack, don't use them as an example :-) */
-  ip_addr_copy(*ipX_current_dest_addr(), iphdr->dest);
-  ip_addr_copy(*ipX_current_src_addr(), iphdr->src);
+  ip_addr_copy(*ip_current_dest_addr(), iphdr->dest);
+  ip_addr_copy(*ip_current_src_addr(), iphdr->src);
   ip_current_netif() = inp;
   ip_current_header() = iphdr;
 
-  /* since adding IPv6, p->payload must point to tcp header, not ip header */
-  pbuf_header(p, -(s16_t)sizeof(struct ip_hdr));
-
+  /* tcp_input() skips the IP header itself */
   tcp_input(p, inp);
 
-  ipX_current_dest_addr()->addr = 0;
-  ipX_current_src_addr()->addr = 0;
+  ip_current_dest_addr()->addr = 0;
+  ip_current_src_addr()->addr = 0;
   ip_current_netif() = NULL;
   ip_current_header() = NULL;
 }
@@ -0,0 +1,548 @@
+#include "test_tcp_perf.h"
+
+#include "lwip/tcp_impl.h"
+#include "lwip/stats.h"
+#include "tcp_helper.h"
+
+#if !LWIP_STATS || !TCP_STATS || !MEMP_STATS
+#error "This tests needs TCP- and MEMP-statistics enabled"
+#endif
+#if !LWIP_WND_SCALE || !LWIP_TCP_SACK
+#error "This tests needs window scaling and SACK enabled"
+#endif
+#if (TCP_WND_AUTOTUNE_MAX <= TCP_WND) || (TCP_SND_BUF <= 0xffff)
+#error "This tests needs a receive window and a send buffer that can grow beyond 64K"
+#endif
+
+/* Both ends of the connection share one netif and talk through a simulated
+ * link: every packet is serialized at a fixed rate, delayed and maybe dropped
+ * on its way. Simulated time jumps from one event (packet arrival or timer
+ * tick) to the next, so a transfer of several MB takes no real time. */
+
+#define TEST_LINK_QUEUE_LEN   4096
+#define TEST_SERVER_PORT      80
+#define TEST_TMR_INTERVAL_US  (TCP_TMR_INTERVAL * 1000UL)
+
+/* byte at offset n of the transferred stream */
+#define TEST_DATA(n)          ((u8_t)((n) ^ ((n) >> 9)))
+
+struct test_link_queue {
+  struct pbuf *p[TEST_LINK_QUEUE_LEN];
+  u32_t due[TEST_LINK_QUEUE_LEN];
+  u32_t head;
+  u32_t count;
+  u32_t busy_until;     /* the wire is serializing packets until then */
+};
+
+struct test_link {
+  u32_t delay_us;       /* one-way delay */
+  u32_t bytes_per_ms;   /* bandwidth */
+  u32_t loss_permille;  /* random loss of data segments sent to the server */
+  u32_t drop_first;     /* drop_mask bit 0 is this data segment */
+  u32_t drop_mask;      /* data segments to drop for sure */
+  u32_t rand;
+  /* data segments sent to the server */
+  u32_t data_segments;
+  u32_t dropped;
+  u32_t rexmit_segments;
+  u32_t rexmit_bytes;
+  u32_t snd_max;
+  u8_t snd_max_valid;
+  struct test_link_queue to_server;
+  struct test_link_queue to_client;
+};
+
+struct test_perf_app {
+  u32_t total;          /* bytes to transfer */
+  u32_t written;        /* bytes passed to tcp_write() */
+  u32_t received;
+  u32_t corrupted;
+  u32_t errors;
+  u8_t connected;
+  struct tcp_pcb *client;
+  struct tcp_pcb *server;
+};
+
+static struct test_link link;
+static u32_t test_now;  /* simulated time in microseconds */
+static u32_t test_next_tmr;
+static u8_t test_tcp_timer;
+static struct netif test_netif;
+static ip_addr_t client_ip, server_ip, test_netmask;
+static u8_t test_buf[4 * TCP_MSS];
+
+/* our own version of tcp_tmr so we can reset fast/slow timer state */
+static void
+test_tcp_tmr(void)
+{
+  tcp_fasttmr();
+  if (++test_tcp_timer & 1) {
+    tcp_slowtmr();
+  }
+}
+
+static u32_t
+test_link_random(void)
+{
+  link.rand = link.rand * 1664525 + 1013904223;
+  return link.rand >> 8;
+}
+
+static void
+test_link_flush(struct test_link_queue *q)
+{
+  while (q->count > 0) {
+    pbuf_free(q->p[q->head]);
+    q->head = (q->head + 1) % TEST_LINK_QUEUE_LEN;
+    q->count--;
+  }
+  q->head = 0;
+  q->busy_until = 0;
+}
+
+static void
+test_link_init(u32_t delay_us, u32_t bytes_per_ms)
+{
+  test_link_flush(&link.to_server);
+  test_link_flush(&link.to_client);
+  memset(&link, 0, sizeof(link));
+  link.delay_us = delay_us;
+  link.bytes_per_ms = bytes_per_ms;
+  link.rand = 6510;
+}
+
+static void
+test_link_enqueue(struct test_link_queue *q, struct pbuf *p)
+{
+  u32_t idx;
+
+  if (q->count == TEST_LINK_QUEUE_LEN) {
+    pbuf_free(p);
+    fail();
+    return;
+  }
+  if ((s32_t)(q->busy_until - test_now) < 0) {
+    q->busy_until = test_now;
+  }
+  q->busy_until += (p->tot_len * 1000UL) / link.bytes_per_ms;
+  idx = (q->head + q->count) % TEST_LINK_QUEUE_LEN;
+  q->p[idx] = p;
+  q->due[idx] = q->busy_until + link.delay_us;
+  q->count++;
+}
+
+/** netif output function: put a copy of the packet on the wire */
+static err_t
+test_link_output(struct netif *netif, struct pbuf *p, ip_addr_t *ipaddr)
+{
+  struct pbuf *q;
+  struct ip_hdr *iphdr;
+  struct tcp_hdr *tcphdr;
+  u16_t hlen, datalen;
+  u32_t seqno, seg;
+  LWIP_UNUSED_ARG(netif);
+
+  q = pbuf_alloc(PBUF_RAW, p->tot_len, PBUF_RAM);
+  EXPECT_RETX(q != NULL, ERR_MEM);
+  pbuf_copy(q, p);
+
+  if (!ip_addr_cmp(ipaddr, &server_ip)) {
+    test_link_enqueue(&link.to_client, q);
+    return ERR_OK;
+  }
+
+  iphdr = (struct ip_hdr *)q->payload;
+  hlen = IPH_HL(iphdr) * 4;
+  tcphdr = (struct tcp_hdr *)((u8_t *)q->payload + hlen);
+  datalen = ntohs(IPH_LEN(iphdr)) - hlen - TCPH_HDRLEN(tcphdr) * 4;
+  if (datalen > 0) {
+    seqno = ntohl(tcphdr->seqno);
+    if (link.snd_max_valid && TCP_SEQ_LT(seqno, link.snd_max)) {
+      link.rexmit_segments++;
+      link.rexmit_bytes += datalen;
+    } else {
+      link.snd_max = seqno + datalen;
+      link.snd_max_valid = 1;
+    }
+    seg = link.data_segments++;
+    if (((seg - link.drop_first) < 32 && (link.drop_mask & (1UL << (seg - link.drop_first)))) ||
+        ((test_link_random() % 1000) < link.loss_permille)) {
+      link.dropped++;
+      pbuf_free(q);
+      return ERR_OK;
+    }
+  }
+  test_link_enqueue(&link.to_server, q);
+  return ERR_OK;
+}
+
+/** Pass all packets that have arrived by now to tcp_input() */
+static void
+test_link_deliver(struct test_link_queue *q)
+{
+  struct pbuf *p;
+
+  while ((q->count > 0) && ((s32_t)(q->due[q->head] - test_now) <= 0)) {
+    p = q->p[q->head];
+    q->head = (q->head + 1) % TEST_LINK_QUEUE_LEN;
+    q->count--;
+    test_tcp_input(p, &test_netif);
+  }
+}
+
+static u32_t
+test_link_next_event(struct test_link_queue *q, u32_t next)
+{
+  if ((q->count > 0) && ((s32_t)(q->due[q->head] - next) < 0)) {
+    return q->due[q->head];
+  }
+  return next;
+}
+
+/* Application: the client sends 'total' bytes, the server checks them */
+
+static void
+test_perf_send(struct test_perf_app *app)
+{
+  struct tcp_pcb *pcb = app->client;
+  u32_t len, i;
+
+  while (app->written < app->total) {
+    len = LWIP_MIN(app->total - app->written, sizeof(test_buf));
+    len = LWIP_MIN(len, tcp_sndbuf(pcb));
+    if (len == 0) {
+      break;
+    }
+    for (i = 0; i < len; i++) {
+      test_buf[i] = TEST_DATA(app->written + i);
+    }
+    if (tcp_write(pcb, test_buf, (u16_t)len, TCP_WRITE_FLAG_COPY) != ERR_OK) {
+      break;
+    }
+    app->written += len;
+  }
+  tcp_output(pcb);
+}
+
+static err_t
+test_perf_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(len);
+  test_perf_send((struct test_perf_app *)arg);
+  return ERR_OK;
+}
+
+static err_t
+test_perf_connected(void *arg, struct tcp_pcb *pcb, err_t err)
+{
+  struct test_perf_app *app = arg;
+  LWIP_UNUSED_ARG(pcb);
+  EXPECT(err == ERR_OK);
+  app->connected = 1;
+  test_perf_send(app);
+  return ERR_OK;
+}
+
+static err_t
+test_perf_recv(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err)
+{
+  struct test_perf_app *app = arg;
+  struct pbuf *q;
+  u8_t *data;
+  u16_t i;
+  LWIP_UNUSED_ARG(err);
+
+  if (p == NULL) {
+    return ERR_OK;
+  }
+  for (q = p; q != NULL; q = q->next) {
+    data = q->payload;
+    for (i = 0; i < q->len; i++) {
+      if (data[i] != TEST_DATA(app->received)) {
+        app->corrupted++;
+      }
+      app->received++;
+    }
+  }
+  /* like rostcp.c, hand the window back right away */
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+static void
+test_perf_err(void *arg, err_t err)
+{
+  struct test_perf_app *app = arg;
+  LWIP_UNUSED_ARG(err);
+  app->errors++;
+}
+
+static err_t
+test_perf_accept(void *arg, struct tcp_pcb *newpcb, err_t err)
+{
+  struct test_perf_app *app = arg;
+  EXPECT_RETX(err == ERR_OK, ERR_VAL);
+  app->server = newpcb;
+  tcp_recv(newpcb, test_perf_recv);
+  tcp_err(newpcb, test_perf_err);
+  return ERR_OK;
+}
+
+static struct tcp_pcb *
+test_perf_listen(struct test_perf_app *app)
+{
+  struct tcp_pcb *pcb;
+  err_t err;
+
+  pcb = tcp_new();
+  EXPECT_RETNULL(pcb != NULL);
+  err = tcp_bind(pcb, IP_ADDR_ANY, TEST_SERVER_PORT);
+  EXPECT_RETNULL(err == ERR_OK);
+  pcb = tcp_listen(pcb);
+  EXPECT_RETNULL(pcb != NULL);
+  tcp_arg(pcb, app);
+  tcp_accept(pcb, test_perf_accept);
+  return pcb;
+}
+
+static void
+test_perf_connect(struct test_perf_app *app, u32_t total)
+{
+  struct tcp_pcb *lpcb;
+  err_t err;
+
+  memset(app, 0, sizeof(*app));
+  app->total = total;
+  lpcb = test_perf_listen(app);
+  EXPECT_RET(lpcb != NULL);
+
+  app->client = tcp_new();
+  EXPECT_RET(app->client != NULL);
+  tcp_arg(app->client, app);
+  tcp_sent(app->client, test_perf_sent);
+  tcp_err(app->client, test_perf_err);
+  err = tcp_connect(app->client, &server_ip, TEST_SERVER_PORT, test_perf_connected);
+  EXPECT_RET(err == ERR_OK);
+}
+
+/** Advance simulated time until the transfer is done or 'timeout_us' passed */
+static void
+test_perf_run(struct test_perf_app *app, u32_t timeout_us)
+{
+  u32_t end = test_now + timeout_us;
+  u32_t next;
+
+  while (!(app->connected && (app->server != NULL) && (app->received >= app->total)) &&
+         (app->errors == 0) && ((s32_t)(test_now - end) < 0)) {
+    next = test_link_next_event(&link.to_server, test_next_tmr);
+    next = test_link_next_event(&link.to_client, next);
+    test_now = next;
+    test_link_deliver(&link.to_server);
+    test_link_deliver(&link.to_client);
+    if (test_now == test_next_tmr) {
+      test_tcp_tmr();
+      test_next_tmr += TEST_TMR_INTERVAL_US;
+    }
+  }
+}
+
+/** Bytes per ms the application got since 'start' */
+static u32_t
+test_perf_rate(struct test_perf_app *app, u32_t start)
+{
+  u32_t elapsed_ms = (test_now - start) / 1000;
+  return app->received / LWIP_MAX(elapsed_ms, 1);
+}
+
+
+/* Setups/teardown functions */
+
+static void
+tcp_perf_remove_all(void)
+{
+  /* listen pcbs can't be aborted, close them first */
+  while (tcp_listen_pcbs.pcbs != NULL) {
+    tcp_close(tcp_listen_pcbs.pcbs);
+  }
+  tcp_remove_all();
+}
+
+static void
+tcp_perf_setup(void)
+{
+  tcp_perf_remove_all();
+  test_link_init(1000, 10000);
+  test_now = 0;
+  test_next_tmr = TEST_TMR_INTERVAL_US;
+  test_tcp_timer = 0;
+
+  IP4_ADDR(&client_ip,    192, 168,   0, 1);
+  IP4_ADDR(&server_ip,    192, 168,   0, 2);
+  IP4_ADDR(&test_netmask, 255, 255, 255, 0);
+  test_tcp_init_netif(&test_netif, NULL, &client_ip, &test_netmask);
+  test_netif.output = test_link_output;
+  test_netif.mtu = 1500;
+}
+
+static void
+tcp_perf_teardown(void)
+{
+  tcp_perf_remove_all();
+  /* drop what tcp_abort() sent and what is still on its way */
+  test_link_flush(&link.to_server);
+  test_link_flush(&link.to_client);
+  netif_list = NULL;
+  netif_default = NULL;
+}
+
+
+/* Test functions */
+
+/** Both ends offer window scaling and SACK in their SYN, so both are used */
+START_TEST(test_tcp_perf_negotiate)
+{
+  struct test_perf_app app;
+  LWIP_UNUSED_ARG(_i);
+
+  test_link_init(50000, 10000);
+  test_perf_connect(&app, 0);
+  test_perf_run(&app, 5000000);
+  EXPECT_RET(app.connected && (app.server != NULL));
+  EXPECT(app.errors == 0);
+
+  EXPECT(app.client->flags & TF_WND_SCALE);
+  EXPECT(app.client->flags & TF_SACK);
+  EXPECT(app.client->snd_scale == TCP_RCV_SCALE);
+  EXPECT(app.client->rcv_scale == TCP_RCV_SCALE);
+  EXPECT(app.server->flags & TF_WND_SCALE);
+  EXPECT(app.server->flags & TF_SACK);
+  EXPECT(app.server->snd_scale == TCP_RCV_SCALE);
+  EXPECT(app.server->rcv_scale == TCP_RCV_SCALE);
+  /* the window in the SYN|ACK is not scaled, the one in the ACK is */
+  EXPECT(app.client->snd_wnd == TCP_WND);
+  EXPECT(app.server->snd_wnd == ((TCP_WND >> TCP_RCV_SCALE) << TCP_RCV_SCALE));
+}
+END_TEST
+
+/** A SYN without options gets a SYN|ACK without window scale or SACK
+ * permitted options, and the connection sticks to 16 bit windows */
+START_TEST(test_tcp_perf_peer_without_options)
+{
+  struct test_perf_app app;
+  struct tcp_pcb *lpcb, *pcb;
+  struct pbuf *p;
+  struct ip_hdr *iphdr;
+  struct tcp_hdr *tcphdr;
+  LWIP_UNUSED_ARG(_i);
+
+  memset(&app, 0, sizeof(app));
+  lpcb = test_perf_listen(&app);
+  EXPECT_RET(lpcb != NULL);
+
+  p = tcp_create_segment(&client_ip, &server_ip, 0x4000, TEST_SERVER_PORT,
+    NULL, 0, 12345, 0, TCP_SYN);
+  EXPECT_RET(p != NULL);
+  test_tcp_input(p, &test_netif);
+
+  pcb = tcp_active_pcbs;
+  EXPECT_RET(pcb != NULL);
+  EXPECT(pcb->state == SYN_RCVD);
+  EXPECT((pcb->flags & (TF_WND_SCALE | TF_SACK)) == 0);
+  EXPECT(pcb->rcv_scale == 0);
+  EXPECT(pcb->snd_scale == 0);
+
+  EXPECT_RET(link.to_client.count == 1);
+  iphdr = (struct ip_hdr *)link.to_client.p[link.to_client.head]->payload;
+  tcphdr = (struct tcp_hdr *)((u8_t *)iphdr + IPH_HL(iphdr) * 4);
+  EXPECT(TCPH_FLAGS(tcphdr) == (TCP_SYN | TCP_ACK));
+  /* only the MSS option */
+  EXPECT(TCPH_HDRLEN(tcphdr) == 6);
+  EXPECT(ntohs(tcphdr->wnd) == TCPWND16(TCP_WND));
+}
+END_TEST
+
+/** Transfer over a path whose bandwidth-delay product is larger than 64K.
+ * Without window scaling, one 64K window per round trip is the limit. */
+START_TEST(test_tcp_perf_long_fat_pipe)
+{
+  struct test_perf_app app;
+  u32_t start, rate;
+  LWIP_UNUSED_ARG(_i);
+
+  /* 100ms round trip time, 10MB/s */
+  test_link_init(50000, 10000);
+  test_perf_connect(&app, 8 * 1024 * 1024);
+  start = test_now;
+  test_perf_run(&app, 60 * 1000000UL);
+  EXPECT_RET(app.received == app.total);
+  EXPECT(app.corrupted == 0);
+  EXPECT(app.errors == 0);
+  EXPECT(link.rexmit_segments == 0);
+
+  /* the receive window has been opened beyond 64K */
+  EXPECT(app.server->rcv_wnd_max > TCP_WND);
+  EXPECT(app.server->rcv_wnd_max <= TCP_WND_AUTOTUNE_MAX);
+  rate = test_perf_rate(&app, start);
+  EXPECT(rate > 2 * (0xffff / 100));
+}
+END_TEST
+
+/** Random loss of 1% of the data segments over a 40ms round trip */
+START_TEST(test_tcp_perf_random_loss)
+{
+  struct test_perf_app app;
+  LWIP_UNUSED_ARG(_i);
+
+  test_link_init(20000, 10000);
+  link.loss_permille = 10;
+  test_perf_connect(&app, 4 * 1024 * 1024);
+  test_perf_run(&app, 600 * 1000000UL);
+  EXPECT_RET(app.received == app.total);
+  EXPECT(app.corrupted == 0);
+  EXPECT(app.errors == 0);
+  EXPECT(link.dropped > 0);
+  /* holes are filled one by one instead of resending whole windows */
+  EXPECT(link.rexmit_segments <= 2 * link.dropped);
+}
+END_TEST
+
+/** Several segments of one window are lost: SACK lets the sender resend
+ * exactly these in one recovery, without waiting for a timeout */
+START_TEST(test_tcp_perf_burst_loss)
+{
+  struct test_perf_app app;
+  u32_t start;
+  LWIP_UNUSED_ARG(_i);
+
+  test_link_init(50000, 10000);
+  link.drop_first = 300;
+  link.drop_mask = 0x249; /* segments 300, 303, 306 and 309 */
+  test_perf_connect(&app, 2 * 1024 * 1024);
+  start = test_now;
+  test_perf_run(&app, 60 * 1000000UL);
+  EXPECT_RET(app.received == app.total);
+  EXPECT(app.corrupted == 0);
+  EXPECT(app.errors == 0);
+  EXPECT(link.dropped == 4);
+  EXPECT(link.rexmit_segments == 4);
+  EXPECT(link.rexmit_bytes == 4 * TCP_MSS);
+  EXPECT(test_perf_rate(&app, start) > 0xffff / 100);
+}
+END_TEST
+
+
+/** Create the suite including all tests for this module */
+Suite *
+tcp_perf_suite(void)
+{
+  TFun tests[] = {
+    test_tcp_perf_negotiate,
+    test_tcp_perf_peer_without_options,
+    test_tcp_perf_long_fat_pipe,
+    test_tcp_perf_random_loss,
+    test_tcp_perf_burst_loss
+  };
+  return create_suite("TCP_PERF", tests, sizeof(tests)/sizeof(TFun), tcp_perf_setup, tcp_perf_teardown);
+}
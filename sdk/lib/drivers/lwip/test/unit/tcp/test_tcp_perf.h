@@ -0,0 +1,8 @@
+#ifndef __TEST_TCP_PERF_H__
+#define __TEST_TCP_PERF_H__
+
+#include "../lwip_check.h"
+
+Suite *tcp_perf_suite(void);
+
+#endif
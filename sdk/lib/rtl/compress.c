@@ -216,28 +216,229 @@ out:
 }
 
 
+/* LZNT1 compression */
+
+#define LZNT1_CHUNK_SIZE    0x1000
+#define LZNT1_HASH_SIZE     0x1000
+#define LZNT1_NO_POS        0xFFFF
+#define LZNT1_MIN_MATCH     3
+
+/* match finder state, the same for both engines */
+struct lznt1_workspace
+{
+    USHORT head[LZNT1_HASH_SIZE];   /* most recent position of each hash value */
+    USHORT prev[LZNT1_CHUNK_SIZE];  /* previous position with the same hash value */
+};
+
+/* how hard the engines look for matches */
+#define LZNT1_STANDARD_CHAIN    8
+#define LZNT1_MAXIMUM_CHAIN     LZNT1_CHUNK_SIZE
+
+static inline ULONG lznt1_hash(const UCHAR *src)
+{
+    return ((src[0] << 8) ^ (src[1] << 4) ^ src[2]) & (LZNT1_HASH_SIZE - 1);
+}
+
+/* number of displacement bits of a backwards reference at position pos of
+ * a chunk, this has to match lznt1_decompress_chunk */
+static inline ULONG lznt1_displacement_bits(ULONG pos)
+{
+    ULONG displacement_bits;
+
+    for (displacement_bits = 12; displacement_bits > 4; displacement_bits--)
+        if ((1 << (displacement_bits - 1)) < pos) break;
+
+    return displacement_bits;
+}
+
+static inline void lznt1_insert(struct lznt1_workspace *workspace, const UCHAR *src,
+                                ULONG src_size, ULONG pos)
+{
+    ULONG hash;
+
+    if (pos + LZNT1_MIN_MATCH > src_size)
+        return;
+
+    hash = lznt1_hash(src + pos);
+    workspace->prev[pos] = workspace->head[hash];
+    workspace->head[hash] = (USHORT)pos;
+}
+
+/* find the longest earlier match for position pos, walking at most max_chain
+ * positions with the same hash. Returns its length or 0 if there is none */
+static ULONG lznt1_find_match(struct lznt1_workspace *workspace, const UCHAR *src, ULONG src_size,
+                              ULONG pos, ULONG max_chain, ULONG *displacement)
+{
+    ULONG displacement_bits, max_displacement, max_length;
+    ULONG length, best_length = 0;
+    USHORT candidate;
+
+    if (pos + LZNT1_MIN_MATCH > src_size)
+        return 0;
+
+    displacement_bits = lznt1_displacement_bits(pos);
+    max_displacement  = 1 << displacement_bits;
+    max_length        = min((1 << (16 - displacement_bits)) + 2, src_size - pos);
+
+    /* chains are sorted by position, the nearest candidate comes first */
+    for (candidate = workspace->head[lznt1_hash(src + pos)];
+         candidate != LZNT1_NO_POS && max_chain--;
+         candidate = workspace->prev[candidate])
+    {
+        if (pos - candidate > max_displacement)
+            break;
+
+        /* quick check whether this candidate can beat the best one */
+        if (src[candidate + best_length] != src[pos + best_length])
+            continue;
+
+        /* the match may overlap the current position, like in the decompressor */
+        for (length = 0; length < max_length; length++)
+            if (src[candidate + length] != src[pos + length]) break;
+
+        if (length > best_length)
+        {
+            best_length   = length;
+            *displacement = pos - candidate;
+            if (length == max_length) break;
+        }
+    }
+
+    return (best_length >= LZNT1_MIN_MATCH) ? best_length : 0;
+}
+
+/* compress a single LZNT1 chunk, returns NULL if it doesn't fit into dst_size */
+static PUCHAR lznt1_compress_chunk(UCHAR *dst, ULONG dst_size, const UCHAR *src, ULONG src_size,
+                                   ULONG max_chain, BOOLEAN lazy, struct lznt1_workspace *workspace)
+{
+    UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
+    UCHAR *flags_ptr;
+    ULONG pos = 0, flag_bit, i;
+    ULONG length, displacement = 0, displacement_bits;
+    ULONG next_length = 0, next_displacement = 0;
+    BOOLEAN have_next = FALSE;
+
+    RtlFillMemory(workspace->head, sizeof(workspace->head), 0xFF);
+
+    while (pos < src_size)
+    {
+        /* write flags header for the following 8 entities */
+        if (dst_cur >= dst_end) return NULL;
+        flags_ptr = dst_cur++;
+        *flags_ptr = 0;
+
+        for (flag_bit = 0; flag_bit < 8 && pos < src_size; flag_bit++)
+        {
+            if (have_next)
+            {
+                /* searched already while deciding about the previous byte */
+                length       = next_length;
+                displacement = next_displacement;
+                have_next    = FALSE;
+            }
+            else
+            {
+                length = lznt1_find_match(workspace, src, src_size, pos, max_chain, &displacement);
+            }
+            lznt1_insert(workspace, src, src_size, pos);
+
+            /* lazy matching: emit a literal if the next byte starts a longer match */
+            if (length && lazy)
+            {
+                next_length = lznt1_find_match(workspace, src, src_size, pos + 1,
+                                               max_chain, &next_displacement);
+                if (next_length > length)
+                {
+                    have_next = TRUE;
+                    length    = 0;
+                }
+            }
+
+            if (length)
+            {
+                /* backwards reference */
+                if (dst_cur + sizeof(WORD) > dst_end) return NULL;
+                displacement_bits = lznt1_displacement_bits(pos);
+                *(WORD *)dst_cur = (WORD)(((displacement - 1) << (16 - displacement_bits)) |
+                                          (length - LZNT1_MIN_MATCH));
+                dst_cur += sizeof(WORD);
+                *flags_ptr |= 1 << flag_bit;
+
+                for (i = 1; i < length; i++)
+                    lznt1_insert(workspace, src, src_size, pos + i);
+                pos += length;
+            }
+            else
+            {
+                /* uncompressed data */
+                if (dst_cur >= dst_end) return NULL;
+                *dst_cur++ = src[pos++];
+            }
+        }
+    }
+
+    return dst_cur;
+}
+
 static NTSTATUS
-RtlpCompressBufferLZNT1(UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
+RtlpCompressBufferLZNT1(USHORT Engine, UCHAR *src, ULONG src_size, UCHAR *dst, ULONG dst_size,
                         ULONG chunk_size, ULONG *final_size, UCHAR *workspace)
 {
         UCHAR *src_cur = src, *src_end = src + src_size;
         UCHAR *dst_cur = dst, *dst_end = dst + dst_size;
-        ULONG block_size;
+        ULONG block_size, max_chain;
+        BOOLEAN lazy;
+        UCHAR *ptr;
+
+        if (Engine == COMPRESSION_ENGINE_STANDARD)
+        {
+            max_chain = LZNT1_STANDARD_CHAIN;
+            lazy = FALSE;
+        }
+        else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
+        {
+            max_chain = LZNT1_MAXIMUM_CHAIN;
+            lazy = TRUE;
+        }
+        else
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        if (!workspace)
+            return STATUS_ACCESS_VIOLATION;
 
         while (src_cur < src_end)
         {
             /* determine size of current chunk */
-            block_size = min(0x1000, src_end - src_cur);
-            if (dst_cur + sizeof(WORD) + block_size > dst_end)
+            block_size = min(LZNT1_CHUNK_SIZE, src_end - src_cur);
+            if (dst_cur + sizeof(WORD) >= dst_end)
                 return STATUS_BUFFER_TOO_SMALL;
 
-            /* write (uncompressed) chunk header */
-            *(WORD *)dst_cur = 0x3000 | (block_size - 1);
-            dst_cur += sizeof(WORD);
+            /* a compressed chunk is only used if it is smaller */
+            ptr = lznt1_compress_chunk(dst_cur + sizeof(WORD),
+                                       min(block_size - 1, dst_end - dst_cur - sizeof(WORD)),
+                                       src_cur, block_size, max_chain, lazy,
+                                       (struct lznt1_workspace *)workspace);
+            if (ptr)
+            {
+                /* write compressed chunk header */
+                *(WORD *)dst_cur = 0xB000 | (ptr - dst_cur - sizeof(WORD) - 1);
+                dst_cur = ptr;
+            }
+            else
+            {
+                if (dst_cur + sizeof(WORD) + block_size > dst_end)
+                    return STATUS_BUFFER_TOO_SMALL;
 
-            /* write chunk content */
-            memcpy(dst_cur, src_cur, block_size);
-            dst_cur += block_size;
+                /* write (uncompressed) chunk header */
+                *(WORD *)dst_cur = 0x3000 | (block_size - 1);
+                dst_cur += sizeof(WORD);
+
+                /* write chunk content */
+                memcpy(dst_cur, src_cur, block_size);
+                dst_cur += block_size;
+            }
             src_cur += block_size;
         }
 
@@ -253,15 +454,10 @@ RtlpWorkSpaceSizeLZNT1(USHORT Engine,
                        PULONG BufferAndWorkSpaceSize,
                        PULONG FragmentWorkSpaceSize)
 {
-   if (Engine == COMPRESSION_ENGINE_STANDARD)
+   if (Engine == COMPRESSION_ENGINE_STANDARD ||
+       Engine == COMPRESSION_ENGINE_MAXIMUM)
    {
-      *BufferAndWorkSpaceSize = 0x8010;
-      *FragmentWorkSpaceSize = 0x1000;
-      return(STATUS_SUCCESS);
-   }
-   else if (Engine == COMPRESSION_ENGINE_MAXIMUM)
-   {
-      *BufferAndWorkSpaceSize = 0x10;
+      *BufferAndWorkSpaceSize = sizeof(struct lznt1_workspace);
       *FragmentWorkSpaceSize = 0x1000;
       return(STATUS_SUCCESS);
    }
@@ -284,14 +480,15 @@ RtlCompressBuffer(IN USHORT CompressionFormatAndEngine,
                   IN PVOID WorkSpace)
 {
    USHORT Format = CompressionFormatAndEngine & COMPRESSION_FORMAT_MASK;
-   /* USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK; */
+   USHORT Engine = CompressionFormatAndEngine & COMPRESSION_ENGINE_MASK;
 
    if ((Format == COMPRESSION_FORMAT_NONE) ||
          (Format == COMPRESSION_FORMAT_DEFAULT))
       return(STATUS_INVALID_PARAMETER);
 
    if (Format == COMPRESSION_FORMAT_LZNT1)
-      return(RtlpCompressBufferLZNT1(UncompressedBuffer,
+      return(RtlpCompressBufferLZNT1(Engine,
+                                     UncompressedBuffer,
                                      UncompressedBufferSize,
                                      CompressedBuffer,
                                      CompressedBufferSize,
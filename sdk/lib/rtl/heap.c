@@ -1969,6 +1969,7 @@ RtlAllocateHeap(IN PVOID HeapPtr,
     PHEAP_VIRTUAL_ALLOC_ENTRY VirtualBlock = NULL;
     PHEAP_ENTRY_EXTRA Extra;
     NTSTATUS Status;
+    PVOID NewBlock;
 
     /* Force flags */
     Flags |= Heap->ForceFlags;
@@ -2017,6 +2018,25 @@ RtlAllocateHeap(IN PVOID HeapPtr,
 
     Index = AllocationSize >> HEAP_ENTRY_SHIFT;
 
+    /* Plain small allocations may be served by the low fragmentation heap */
+    if ((Index < HEAP_FREELISTS) &&
+        (EntryFlags == HEAP_ENTRY_BUSY) &&
+        !(Flags & HEAP_NO_SERIALIZE))
+    {
+        if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH)
+        {
+            NewBlock = RtlpLowFragHeapAllocate(Heap, Flags, Size, Index);
+            if (NewBlock) return NewBlock;
+        }
+        else if ((Heap->FrontEndHeapType == HEAP_FRONT_END_NONE) &&
+                 (InterlockedIncrement(&Heap->FrontEndAllocations) == HEAP_LFH_ACTIVATION_THRESHOLD) &&
+                 RtlpCanUseLowFragHeap(Heap))
+        {
+            /* The heap sees enough small allocations to be worth it */
+            RtlpCreateLowFragHeap(Heap);
+        }
+    }
+
     /* Acquire the lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2229,7 +2249,8 @@ BOOLEAN NTAPI RtlFreeHeap(
         /* Check this entry, fail if it's invalid */
         if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY) ||
             (((ULONG_PTR)Ptr & 0x7) != 0) ||
-            (HeapEntry->SegmentOffset >= HEAP_SEGMENTS))
+            ((HeapEntry->SegmentOffset >= HEAP_SEGMENTS) &&
+             !RtlpIsLowFragHeapEntry(Heap, HeapEntry)))
         {
             /* This is an invalid block */
             DPRINT1("HEAP: Trying to free an invalid address %p!\n", Ptr);
@@ -2246,6 +2267,10 @@ BOOLEAN NTAPI RtlFreeHeap(
     }
     _SEH2_END;
 
+    /* Blocks of the low fragmentation heap go back to their subsegment */
+    if (HeapEntry->SegmentOffset == HEAP_LFH_SEGMENT_OFFSET)
+        return RtlpLowFragHeapFree(Heap, HeapEntry);
+
     /* Lock if necessary */
     if (!(Flags & HEAP_NO_SERIALIZE))
     {
@@ -2661,6 +2686,15 @@ RtlReAllocateHeap(HANDLE HeapPtr,
         return NULL;
     }
 
+    /* Blocks of the low fragmentation heap don't need the heap lock */
+    InUseEntry = (PHEAP_ENTRY)Ptr - 1;
+    if ((InUseEntry->Flags & HEAP_ENTRY_BUSY) &&
+        (InUseEntry->SegmentOffset == HEAP_LFH_SEGMENT_OFFSET) &&
+        RtlpIsLowFragHeapEntry(Heap, InUseEntry))
+    {
+        return RtlpLowFragHeapReAllocate(Heap, Flags, InUseEntry, Size);
+    }
+
     /* Calculate allocation size and index */
     if (Size)
         AllocationSize = Size;
@@ -3236,6 +3270,12 @@ RtlpValidateHeapEntry(
     if (!(HeapEntry->Flags & HEAP_ENTRY_BUSY)) goto invalid_entry;
 
     BigAllocation = HeapEntry->Flags & HEAP_ENTRY_VIRTUAL_ALLOC;
+
+    /* Blocks of the low fragmentation heap live inside a busy backend block */
+    if (!BigAllocation && RtlpIsLowFragHeapEntry(Heap, HeapEntry))
+        return RtlpValidateHeapEntry(Heap, (PHEAP_ENTRY)RtlpGetLowFragHeapSubSegment(HeapEntry) - 1);
+
+    if (!BigAllocation && HeapEntry->SegmentOffset >= HEAP_SEGMENTS) goto invalid_entry;
     Segment = Heap->Segments[HeapEntry->SegmentOffset];
 
     if (BigAllocation &&
@@ -3999,12 +4039,17 @@ RtlSetHeapInformation(IN HANDLE HeapHandle OPTIONAL,
         }
 
         /* Check for a special magic value for enabling LFH */
-        if (*(PULONG)HeapInformation != 2)
+        if (*(PULONG)HeapInformation != HEAP_FRONT_END_LFH)
+        {
+            return STATUS_UNSUCCESSFUL;
+        }
+
+        /* Heaps without serialization or with debug checks can't have it */
+        if (!HeapHandle || !RtlpCreateLowFragHeap((PHEAP)HeapHandle))
         {
             return STATUS_UNSUCCESSFUL;
         }
 
-        DPRINT1("RtlSetHeapInformation() needs to enable LFH\n");
         return STATUS_SUCCESS;
     }
 
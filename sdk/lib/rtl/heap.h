@@ -55,6 +55,20 @@
 /* Segment flags */
 #define HEAP_USER_ALLOCATED    0x1
 
+/* Front end heap types, as reported through HeapCompatibilityInformation */
+#define HEAP_FRONT_END_NONE       0
+#define HEAP_FRONT_END_LOOKASIDE  1
+#define HEAP_FRONT_END_LFH        2
+
+/* Low fragmentation heap */
+#define HEAP_LFH_SIGNATURE            0x4846454c  /* 'LEFH' */
+#define HEAP_LFH_SEGMENT_OFFSET       0xff        /* In LFHFlags, never a valid segment index */
+#define HEAP_LFH_SUBSEGMENT_SIZE      0x4000
+#define HEAP_LFH_MAX_BLOCKS           512
+#define HEAP_LFH_MAX_AFFINITY         8
+#define HEAP_LFH_ACTIVATION_THRESHOLD 1024        /* Small allocations before a heap gets the LFH */
+#define HEAP_LFH_BUCKET_THRESHOLD     16          /* Allocations of a size before it gets a bucket */
+
 /* A handy inline to distinguis normal heap, special "debug heap" and special "page heap" */
 FORCEINLINE BOOLEAN
 RtlpHeapIsSpecial(ULONG Flags)
@@ -269,6 +283,7 @@ typedef struct _HEAP
     PVOID FrontEndHeap;
     USHORT FrontHeapLockCount;
     UCHAR FrontEndHeapType;
+    LONG FrontEndAllocations; //FIXME: non-Vista
     HEAP_COUNTERS Counters;
     HEAP_TUNING_PARAMETERS TuningParameters;
 } HEAP, *PHEAP;
@@ -318,6 +333,59 @@ typedef struct _HEAP_VIRTUAL_ALLOC_ENTRY
     HEAP_ENTRY BusyBlock;
 } HEAP_VIRTUAL_ALLOC_ENTRY, *PHEAP_VIRTUAL_ALLOC_ENTRY;
 
+struct _HEAP_LFH_AFFINITY_SLOT;
+
+/* A run of equally sized blocks, carved out of one backend heap block */
+typedef struct _HEAP_LFH_SUBSEGMENT
+{
+    LIST_ENTRY ListEntry;
+    ULONG Signature;
+    PHEAP Heap;
+    struct _HEAP_LFH_AFFINITY_SLOT *Slot;
+    USHORT BlockUnits;
+    USHORT BlockCount;
+    USHORT FreeCount;
+    USHORT Hint;
+    ULONG Bitmap[HEAP_LFH_MAX_BLOCKS / 32]; /* Set bits are busy blocks */
+} HEAP_LFH_SUBSEGMENT, *PHEAP_LFH_SUBSEGMENT;
+
+#define HEAP_LFH_SUBSEGMENT_HEADER ROUND_UP(sizeof(HEAP_LFH_SUBSEGMENT), HEAP_ENTRY_SIZE)
+
+/* PreviousSize of an LFH block holds its index in the subsegment */
+FORCEINLINE
+PHEAP_LFH_SUBSEGMENT
+RtlpGetLowFragHeapSubSegment(PHEAP_ENTRY HeapEntry)
+{
+    return (PHEAP_LFH_SUBSEGMENT)((PUCHAR)HeapEntry - HEAP_LFH_SUBSEGMENT_HEADER -
+                                  ((SIZE_T)HeapEntry->PreviousSize * HeapEntry->Size << HEAP_ENTRY_SHIFT));
+}
+
+/* Each bucket has one of these per processor, so threads rarely share a lock */
+typedef struct _HEAP_LFH_AFFINITY_SLOT
+{
+    LONG Lock;
+    struct _HEAP_LFH_BUCKET *Bucket;
+    PHEAP_LFH_SUBSEGMENT ActiveSubSegment;
+    LIST_ENTRY PartialSubSegments;
+} HEAP_LFH_AFFINITY_SLOT, *PHEAP_LFH_AFFINITY_SLOT;
+
+typedef struct _HEAP_LFH_BUCKET
+{
+    LONG Allocations;
+    LONG Enabled;
+    USHORT BlockUnits;
+    USHORT BlocksPerSubSegment;
+    PHEAP_LFH_AFFINITY_SLOT Slots;
+} HEAP_LFH_BUCKET, *PHEAP_LFH_BUCKET;
+
+typedef struct _HEAP_LFH
+{
+    PHEAP Heap;
+    ULONG AffinityCount;
+    HEAP_LFH_BUCKET Buckets[HEAP_FREELISTS];
+    HEAP_LFH_AFFINITY_SLOT Slots[ANYSIZE_ARRAY];
+} HEAP_LFH, *PHEAP_LFH;
+
 /* Global variables */
 extern RTL_CRITICAL_SECTION RtlpProcessHeapsListLock;
 extern BOOLEAN RtlpPageHeapEnabled;
@@ -397,6 +465,30 @@ RtlDebugSizeHeap(HANDLE HeapPtr,
                  ULONG Flags,
                  PVOID Ptr);
 
+/* heaplfh.c */
+BOOLEAN NTAPI
+RtlpCanUseLowFragHeap(PHEAP Heap);
+
+BOOLEAN NTAPI
+RtlpCreateLowFragHeap(PHEAP Heap);
+
+PVOID NTAPI
+RtlpLowFragHeapAllocate(PHEAP Heap,
+                        ULONG Flags,
+                        SIZE_T Size,
+                        SIZE_T Index);
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry);
+
+PVOID NTAPI
+RtlpLowFragHeapReAllocate(PHEAP Heap, ULONG Flags, PHEAP_ENTRY HeapEntry, SIZE_T Size);
+
+BOOLEAN NTAPI
+RtlpIsLowFragHeapEntry(PHEAP Heap,
+                       PHEAP_ENTRY HeapEntry);
+
 /* heappage.c */
 
 HANDLE NTAPI
@@ -0,0 +1,358 @@
+/*
+ * COPYRIGHT:       See COPYING in the top level directory
+ * PROJECT:         ReactOS system libraries
+ * FILE:            lib/rtl/heaplfh.c
+ * PURPOSE:         RTL Heap low fragmentation front end
+ */
+
+/* Small blocks of the same size are handed out of subsegments, runs of
+   equally sized blocks carved out of one backend block and tracked by a
+   bitmap. Every size has a bucket, and every bucket has one slot per
+   processor with its own lock, active subsegment and list of partially
+   used subsegments. Threads are spread over the slots, so they neither
+   take the heap lock nor fight over the same slot lock. */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl.h>
+#include <heap.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* FUNCTIONS *****************************************************************/
+
+FORCEINLINE
+VOID
+RtlpLfhAcquireLock(PLONG Lock)
+{
+    while (InterlockedExchange(Lock, 1) != 0)
+    {
+        /* Hold times are short, but the owner may have been preempted */
+        while (*(volatile LONG *)Lock != 0)
+            ZwYieldExecution();
+    }
+}
+
+FORCEINLINE
+VOID
+RtlpLfhReleaseLock(PLONG Lock)
+{
+    InterlockedExchange(Lock, 0);
+}
+
+FORCEINLINE
+PHEAP_ENTRY
+RtlpLfhGetBlock(PHEAP_LFH_SUBSEGMENT SubSegment, ULONG BlockIndex)
+{
+    return (PHEAP_ENTRY)((PUCHAR)SubSegment + HEAP_LFH_SUBSEGMENT_HEADER +
+                         ((SIZE_T)BlockIndex * SubSegment->BlockUnits << HEAP_ENTRY_SHIFT));
+}
+
+FORCEINLINE
+ULONG
+RtlpLfhGetAffinity(PHEAP_LFH Lfh)
+{
+    /* Spread threads over the slots, there is no cheap way to get the current processor */
+    return (ULONG)(((ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread >> 2) % Lfh->AffinityCount);
+}
+
+BOOLEAN NTAPI
+RtlpCanUseLowFragHeap(PHEAP Heap)
+{
+    /* Only growable, serialized user mode heaps without any checking */
+    return (RtlpGetMode() == UserMode) &&
+           (Heap->Flags & HEAP_GROWABLE) &&
+           !(Heap->Flags & (HEAP_NO_SERIALIZE |
+                            HEAP_FREE_CHECKING_ENABLED |
+                            HEAP_TAIL_CHECKING_ENABLED)) &&
+           !RtlpHeapIsSpecial(Heap->Flags | Heap->ForceFlags);
+}
+
+BOOLEAN NTAPI
+RtlpCreateLowFragHeap(PHEAP Heap)
+{
+    PHEAP_LFH Lfh;
+    PHEAP_LFH_BUCKET Bucket;
+    PHEAP_LFH_AFFINITY_SLOT Slot;
+    ULONG AffinityCount, Index, i;
+    SIZE_T BlockSize;
+
+    if (Heap->FrontEndHeapType == HEAP_FRONT_END_LFH) return TRUE;
+    if (!RtlpCanUseLowFragHeap(Heap)) return FALSE;
+
+    AffinityCount = RtlGetCurrentPeb()->NumberOfProcessors;
+    AffinityCount = max(1, min(AffinityCount, HEAP_LFH_MAX_AFFINITY));
+
+    /* The front end lives in the heap it serves, so it goes away with it */
+    Lfh = RtlAllocateHeap(Heap,
+                          HEAP_ZERO_MEMORY,
+                          FIELD_OFFSET(HEAP_LFH, Slots) +
+                          HEAP_FREELISTS * AffinityCount * sizeof(HEAP_LFH_AFFINITY_SLOT));
+    if (!Lfh) return FALSE;
+
+    Lfh->Heap = Heap;
+    Lfh->AffinityCount = AffinityCount;
+
+    for (Index = 1; Index < HEAP_FREELISTS; Index++)
+    {
+        Bucket = &Lfh->Buckets[Index];
+        BlockSize = (SIZE_T)Index << HEAP_ENTRY_SHIFT;
+
+        Bucket->BlockUnits = (USHORT)Index;
+        Bucket->BlocksPerSubSegment =
+            (USHORT)min((HEAP_LFH_SUBSEGMENT_SIZE - HEAP_LFH_SUBSEGMENT_HEADER) / BlockSize,
+                        HEAP_LFH_MAX_BLOCKS);
+        ASSERT(Bucket->BlocksPerSubSegment > 1);
+        Bucket->Slots = &Lfh->Slots[Index * AffinityCount];
+
+        for (i = 0; i < AffinityCount; i++)
+        {
+            Slot = &Bucket->Slots[i];
+            Slot->Bucket = Bucket;
+            InitializeListHead(&Slot->PartialSubSegments);
+        }
+    }
+
+    /* Someone else may have been faster */
+    if (InterlockedCompareExchangePointer(&Heap->FrontEndHeap, Lfh, NULL) != NULL)
+    {
+        RtlFreeHeap(Heap, 0, Lfh);
+        return TRUE;
+    }
+
+    DPRINT("Enabled the LFH on heap %p, %lu affinity slots\n", Heap, AffinityCount);
+    Heap->FrontEndHeapType = HEAP_FRONT_END_LFH;
+    return TRUE;
+}
+
+static
+PHEAP_LFH_SUBSEGMENT
+RtlpLfhCreateSubSegment(PHEAP Heap,
+                        PHEAP_LFH_AFFINITY_SLOT Slot)
+{
+    PHEAP_LFH_BUCKET Bucket = Slot->Bucket;
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    ULONG i;
+
+    /* Subsegments are big enough to always come from the backend lists */
+    SubSegment = RtlAllocateHeap(Heap,
+                                 0,
+                                 HEAP_LFH_SUBSEGMENT_HEADER +
+                                 ((SIZE_T)Bucket->BlocksPerSubSegment * Bucket->BlockUnits << HEAP_ENTRY_SHIFT));
+    if (!SubSegment) return NULL;
+
+    SubSegment->Signature = HEAP_LFH_SIGNATURE;
+    SubSegment->Heap = Heap;
+    SubSegment->Slot = Slot;
+    SubSegment->BlockUnits = Bucket->BlockUnits;
+    SubSegment->BlockCount = Bucket->BlocksPerSubSegment;
+    SubSegment->FreeCount = Bucket->BlocksPerSubSegment;
+    SubSegment->Hint = 0;
+
+    /* Bits past the last block are permanently busy */
+    RtlZeroMemory(SubSegment->Bitmap, sizeof(SubSegment->Bitmap));
+    for (i = SubSegment->BlockCount; i < HEAP_LFH_MAX_BLOCKS; i++)
+        SubSegment->Bitmap[i / 32] |= 1 << (i % 32);
+
+    return SubSegment;
+}
+
+PVOID NTAPI
+RtlpLowFragHeapAllocate(PHEAP Heap,
+                        ULONG Flags,
+                        SIZE_T Size,
+                        SIZE_T Index)
+{
+    PHEAP_LFH Lfh = Heap->FrontEndHeap;
+    PHEAP_LFH_BUCKET Bucket = &Lfh->Buckets[Index];
+    PHEAP_LFH_AFFINITY_SLOT Slot;
+    PHEAP_LFH_SUBSEGMENT SubSegment, NewSubSegment;
+    PHEAP_ENTRY HeapEntry;
+    ULONG i, Bit;
+
+    /* A size only gets a bucket once it is used often enough */
+    if (!Bucket->Enabled)
+    {
+        if (InterlockedIncrement(&Bucket->Allocations) < HEAP_LFH_BUCKET_THRESHOLD)
+            return NULL;
+
+        Bucket->Enabled = TRUE;
+    }
+
+    Slot = &Bucket->Slots[RtlpLfhGetAffinity(Lfh)];
+    RtlpLfhAcquireLock(&Slot->Lock);
+
+    SubSegment = Slot->ActiveSubSegment;
+    if (!SubSegment || !SubSegment->FreeCount)
+    {
+        if (!IsListEmpty(&Slot->PartialSubSegments))
+        {
+            /* The full one is off all lists until one of its blocks is freed */
+            SubSegment = CONTAINING_RECORD(RemoveHeadList(&Slot->PartialSubSegments),
+                                           HEAP_LFH_SUBSEGMENT,
+                                           ListEntry);
+            Slot->ActiveSubSegment = SubSegment;
+        }
+        else
+        {
+            /* Don't hold the slot while the backend takes the heap lock */
+            RtlpLfhReleaseLock(&Slot->Lock);
+            NewSubSegment = RtlpLfhCreateSubSegment(Heap, Slot);
+            if (!NewSubSegment) return NULL;
+            RtlpLfhAcquireLock(&Slot->Lock);
+
+            SubSegment = Slot->ActiveSubSegment;
+            if (SubSegment && SubSegment->FreeCount)
+            {
+                /* Blocks were freed meanwhile, keep the new one for later */
+                InsertTailList(&Slot->PartialSubSegments, &NewSubSegment->ListEntry);
+            }
+            else
+            {
+                SubSegment = NewSubSegment;
+                Slot->ActiveSubSegment = SubSegment;
+            }
+        }
+    }
+
+    /* Take the first free block, starting from the lowest word that may have one */
+    for (i = SubSegment->Hint; SubSegment->Bitmap[i] == MAXULONG; i++)
+        ASSERT(i < HEAP_LFH_MAX_BLOCKS / 32 - 1);
+
+    BitScanForward(&Bit, ~SubSegment->Bitmap[i]);
+    SubSegment->Bitmap[i] |= 1 << Bit;
+    SubSegment->FreeCount--;
+    SubSegment->Hint = (USHORT)i;
+
+    RtlpLfhReleaseLock(&Slot->Lock);
+
+    /* Make it look like any busy block, RtlSizeHeap doesn't need to know */
+    HeapEntry = RtlpLfhGetBlock(SubSegment, i * 32 + Bit);
+    HeapEntry->Size = SubSegment->BlockUnits;
+    HeapEntry->Flags = HEAP_ENTRY_BUSY;
+    HeapEntry->SmallTagIndex = 0;
+    HeapEntry->PreviousSize = (USHORT)(i * 32 + Bit);
+    HeapEntry->LFHFlags = HEAP_LFH_SEGMENT_OFFSET;
+    HeapEntry->UnusedBytes = (UCHAR)((Index << HEAP_ENTRY_SHIFT) - Size);
+
+    if (Flags & HEAP_ZERO_MEMORY)
+        RtlZeroMemory(HeapEntry + 1, Size);
+
+    return HeapEntry + 1;
+}
+
+BOOLEAN NTAPI
+RtlpIsLowFragHeapEntry(PHEAP Heap,
+                       PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+
+    if (HeapEntry->LFHFlags != HEAP_LFH_SEGMENT_OFFSET || !Heap->FrontEndHeap)
+        return FALSE;
+
+    SubSegment = RtlpGetLowFragHeapSubSegment(HeapEntry);
+
+    return SubSegment->Signature == HEAP_LFH_SIGNATURE &&
+           SubSegment->Heap == Heap &&
+           SubSegment->BlockUnits == HeapEntry->Size &&
+           HeapEntry->PreviousSize < SubSegment->BlockCount;
+}
+
+BOOLEAN NTAPI
+RtlpLowFragHeapFree(PHEAP Heap,
+                    PHEAP_ENTRY HeapEntry)
+{
+    PHEAP_LFH_SUBSEGMENT SubSegment;
+    PHEAP_LFH_AFFINITY_SLOT Slot;
+    ULONG BlockIndex, Mask;
+    BOOLEAN Release = FALSE;
+
+    SubSegment = RtlpGetLowFragHeapSubSegment(HeapEntry);
+    BlockIndex = HeapEntry->PreviousSize;
+    Mask = 1 << (BlockIndex % 32);
+
+    /* The block goes back to the slot that handed it out */
+    Slot = SubSegment->Slot;
+    RtlpLfhAcquireLock(&Slot->Lock);
+
+    if (!(SubSegment->Bitmap[BlockIndex / 32] & Mask))
+    {
+        RtlpLfhReleaseLock(&Slot->Lock);
+        DPRINT1("HEAP: Trying to free a free LFH block %p!\n", HeapEntry + 1);
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    HeapEntry->Flags = 0;
+    SubSegment->Bitmap[BlockIndex / 32] &= ~Mask;
+    SubSegment->FreeCount++;
+    SubSegment->Hint = min(SubSegment->Hint, (USHORT)(BlockIndex / 32));
+
+    if (SubSegment != Slot->ActiveSubSegment)
+    {
+        if (SubSegment->FreeCount == SubSegment->BlockCount)
+        {
+            /* Nothing left in it, give it back to the backend */
+            RemoveEntryList(&SubSegment->ListEntry);
+            Release = TRUE;
+        }
+        else if (SubSegment->FreeCount == 1)
+        {
+            /* It was full, it can serve allocations again */
+            InsertTailList(&Slot->PartialSubSegments, &SubSegment->ListEntry);
+        }
+    }
+
+    RtlpLfhReleaseLock(&Slot->Lock);
+
+    if (Release)
+    {
+        SubSegment->Signature = 0;
+        RtlFreeHeap(Heap, 0, SubSegment);
+    }
+
+    return TRUE;
+}
+
+PVOID NTAPI
+RtlpLowFragHeapReAllocate(PHEAP Heap,
+                          ULONG Flags,
+                          PHEAP_ENTRY HeapEntry,
+                          SIZE_T Size)
+{
+    SIZE_T OldSize, Index;
+    PVOID NewPtr;
+
+    OldSize = (HeapEntry->Size << HEAP_ENTRY_SHIFT) - HeapEntry->UnusedBytes;
+    Index = (((Size ? Size : 1) + Heap->AlignRound) & Heap->AlignMask) >> HEAP_ENTRY_SHIFT;
+
+    /* Same size class, just account for the new size */
+    if (Index == HeapEntry->Size)
+    {
+        if ((Flags & HEAP_ZERO_MEMORY) && (Size > OldSize))
+            RtlZeroMemory((PUCHAR)(HeapEntry + 1) + OldSize, Size - OldSize);
+
+        HeapEntry->UnusedBytes = (UCHAR)((Index << HEAP_ENTRY_SHIFT) - Size);
+        return HeapEntry + 1;
+    }
+
+    /* Blocks of a subsegment can't grow or shrink */
+    if (Flags & HEAP_REALLOC_IN_PLACE_ONLY)
+    {
+        RtlSetLastWin32ErrorAndNtStatusFromNtStatus(STATUS_NO_MEMORY);
+        return NULL;
+    }
+
+    NewPtr = RtlAllocateHeap(Heap, Flags & ~HEAP_ZERO_MEMORY, Size);
+    if (!NewPtr) return NULL;
+
+    RtlCopyMemory(NewPtr, HeapEntry + 1, min(OldSize, Size));
+    if ((Flags & HEAP_ZERO_MEMORY) && (Size > OldSize))
+        RtlZeroMemory((PUCHAR)NewPtr + OldSize, Size - OldSize);
+
+    RtlpLowFragHeapFree(Heap, HeapEntry);
+    return NewPtr;
+}
+
+/* EOF */
@@ -77,6 +77,45 @@ typedef struct _RTLP_SRWLOCK_WAITBLOCK
     BOOLEAN Exclusive;
 } volatile RTLP_SRWLOCK_WAITBLOCK, *PRTLP_SRWLOCK_WAITBLOCK;
 
+/* Spin this often for a wake before going to sleep on multiprocessor systems */
+#define RTL_SRWLOCK_SPIN_COUNT  1024
+
+
+static VOID
+NTAPI
+RtlpWaitForSRWLockWake(IN volatile LONG *Wake)
+{
+    LONG NotWoken = 0;
+    ULONG Spin;
+
+    /* The lock is usually held for a short time only */
+    if (NtCurrentPeb()->NumberOfProcessors > 1)
+    {
+        for (Spin = 0; Spin < RTL_SRWLOCK_SPIN_COUNT && *Wake == 0; Spin++)
+        {
+            YieldProcessor();
+        }
+    }
+
+    /* Sleep until the releasing thread hands the lock over to us */
+    while (*Wake == 0)
+    {
+        RtlWaitOnAddress(Wake, &NotWoken, sizeof(NotWoken), NULL);
+    }
+}
+
+
+static VOID
+NTAPI
+RtlpWakeSRWLockWaiter(IN volatile LONG *Wake)
+{
+    (void)InterlockedOr((PLONG)Wake,
+                        TRUE);
+
+    /* The waiter may be gone already, which only makes this a wake for nobody */
+    RtlWakeAddressSingle((PVOID)Wake);
+}
+
 
 static VOID
 NTAPI
@@ -125,8 +164,7 @@ RtlpReleaseWaitBlockLockExclusive(IN OUT PRTL_SRWLOCK SRWLock,
 
     if (FirstWaitBlock->Exclusive)
     {
-        (void)InterlockedOr(&FirstWaitBlock->Wake,
-                            TRUE);
+        RtlpWakeSRWLockWaiter(&FirstWaitBlock->Wake);
     }
     else
     {
@@ -139,8 +177,7 @@ RtlpReleaseWaitBlockLockExclusive(IN OUT PRTL_SRWLOCK SRWLock,
         {
             NextWake = WakeChain->Next;
 
-            (void)InterlockedOr((PLONG)&WakeChain->Wake,
-                                TRUE);
+            RtlpWakeSRWLockWaiter(&WakeChain->Wake);
 
             WakeChain = NextWake;
         } while (WakeChain != NULL);
@@ -178,8 +215,7 @@ RtlpReleaseWaitBlockLockLastShared(IN OUT PRTL_SRWLOCK SRWLock,
 
     (void)InterlockedExchangePointer(&SRWLock->Ptr, (PVOID)NewValue);
 
-    (void)InterlockedOr(&FirstWaitBlock->Wake,
-                        TRUE);
+    RtlpWakeSRWLockWaiter(&FirstWaitBlock->Wake);
 }
 
 
@@ -255,7 +291,8 @@ RtlpAcquireSRWLockExclusiveWait(IN OUT PRTL_SRWLOCK SRWLock,
             }
         }
 
-        YieldProcessor();
+        /* Whoever hands the lock over to us sets our wake flag */
+        RtlpWaitForSRWLockWake(&WaitBlock->Wake);
     }
 }
 
@@ -268,10 +305,7 @@ RtlpAcquireSRWLockSharedWait(IN OUT PRTL_SRWLOCK SRWLock,
 {
     if (FirstWait != NULL)
     {
-        while (WakeChain->Wake == 0)
-        {
-            YieldProcessor();
-        }
+        RtlpWaitForSRWLockWake(&WakeChain->Wake);
     }
     else
     {
@@ -304,7 +338,8 @@ RtlpAcquireSRWLockSharedWait(IN OUT PRTL_SRWLOCK SRWLock,
                 }
             }
 
-            YieldProcessor();
+            /* Whoever hands the lock over to us sets our wake flag */
+            RtlpWaitForSRWLockWake(&WakeChain->Wake);
         }
     }
 }
@@ -0,0 +1,1741 @@
+/*
+ * PROJECT:     ReactOS Runtime Library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Native thread pool (Tp* routines)
+ */
+
+/*
+ * Every pool owns an I/O completion port that its worker threads block on
+ * while idle. Posted callbacks go to one of several per-pool queues, picked
+ * from the thread that created the object, and an idle worker first drains
+ * its own queue before stealing from the others. Files bound to a pool
+ * complete straight to that port, so I/O callbacks need no extra hop.
+ *
+ * Timers of all pools share one timer thread, waits are batched onto shared
+ * wait threads handling up to MAXIMUM_WAIT_OBJECTS - 1 handles each. Both
+ * only post the callbacks to the owning pool.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl_vista.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* Implemented in srw.c and condvar.c */
+VOID
+NTAPI
+RtlInitializeSRWLock(OUT PRTL_SRWLOCK SRWLock);
+VOID
+NTAPI
+RtlAcquireSRWLockExclusive(IN OUT PRTL_SRWLOCK SRWLock);
+VOID
+NTAPI
+RtlReleaseSRWLockExclusive(IN OUT PRTL_SRWLOCK SRWLock);
+VOID
+NTAPI
+RtlWakeAllConditionVariable(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable);
+NTSTATUS
+NTAPI
+RtlSleepConditionVariableSRW(IN OUT PRTL_CONDITION_VARIABLE ConditionVariable,
+                             IN OUT PRTL_SRWLOCK SRWLock,
+                             IN const LARGE_INTEGER * TimeOut OPTIONAL,
+                             IN ULONG Flags);
+
+/* INTERNAL TYPES ***********************************************************/
+
+#define TPP_MAX_QUEUES              16
+#define TPP_DEFAULT_MAX_THREADS     500
+#define TPP_MAX_WAITS               (MAXIMUM_WAIT_OBJECTS - 1)
+#define TPP_LONG_CALLBACK_MS        100
+#define TPP_INFINITE                MAXLONGLONG
+
+/* Idle workers and wait threads exit after this long, in 100ns units */
+#define TPP_IDLE_TIMEOUT            (-10 * 1000 * 10000LL)
+
+typedef enum _TPP_OBJECT_TYPE
+{
+    TppSimpleObject,
+    TppWorkObject,
+    TppTimerObject,
+    TppWaitObject,
+    TppIoObject
+} TPP_OBJECT_TYPE;
+
+typedef struct _TPP_QUEUE
+{
+    RTL_SRWLOCK Lock;
+    LIST_ENTRY ObjectList;
+    volatile LONG Count;
+} TPP_QUEUE, *PTPP_QUEUE;
+
+struct _TP_POOL
+{
+    volatile LONG RefCount;
+    HANDLE CompletionPort;
+    RTL_SRWLOCK Lock;
+    volatile LONG ThreadCount;
+    volatile LONG IdleCount;
+    volatile LONG WakeCount;
+    LONG MinThreads;
+    LONG MaxThreads;
+    BOOLEAN Closing;
+    ULONG QueueCount;
+    TPP_QUEUE Queues[TPP_MAX_QUEUES];
+};
+
+struct _TP_CLEANUP_GROUP
+{
+    RTL_SRWLOCK Lock;
+    LIST_ENTRY MemberList;
+};
+
+typedef struct _TPP_WAIT_THREAD
+{
+    LIST_ENTRY ListEntry;
+    HANDLE UpdateEvent;
+    ULONG Count;
+    struct _TPP_OBJECT *Waits[TPP_MAX_WAITS];
+} TPP_WAIT_THREAD, *PTPP_WAIT_THREAD;
+
+typedef struct _TPP_OBJECT
+{
+    TPP_OBJECT_TYPE Type;
+    volatile LONG RefCount;
+    PTP_POOL Pool;
+    PVOID Callback;
+    PVOID Context;
+    PTP_CLEANUP_GROUP CleanupGroup;
+    PTP_CLEANUP_GROUP_CANCEL_CALLBACK CancelCallback;
+    PTP_SIMPLE_CALLBACK FinalizationCallback;
+    PVOID RaceDll;
+    LIST_ENTRY GroupEntry;
+    BOOLEAN LongFunction;
+
+    /* Queued callbacks are protected by the queue lock, I/O ones are not queued */
+    PTPP_QUEUE Queue;
+    LIST_ENTRY QueueEntry;
+    volatile LONG Pending;
+    volatile LONG Running;
+    volatile LONG Waiters;
+
+    union
+    {
+        struct
+        {
+            LIST_ENTRY TimerEntry;
+            LONGLONG DueTime;
+            ULONG Period;
+            ULONG WindowLength;
+            BOOLEAN Set;
+        } Timer;
+        struct
+        {
+            PTPP_WAIT_THREAD Thread;
+            HANDLE Handle;
+            LONGLONG Timeout;
+            TP_WAIT_RESULT Result;
+        } Wait;
+    } u;
+} TPP_OBJECT, *PTPP_OBJECT;
+
+struct _TP_CALLBACK_INSTANCE
+{
+    PTPP_OBJECT Object;
+    BOOLEAN Associated;
+    BOOLEAN MayRunLong;
+    HANDLE Event;
+    HANDLE Semaphore;
+    ULONG SemaphoreCount;
+    HANDLE Mutex;
+    PRTL_CRITICAL_SECTION CriticalSection;
+    PVOID DllHandle;
+};
+
+/* GLOBALS ******************************************************************/
+
+static PTP_POOL TppDefaultPool;
+static RTL_SRWLOCK TppDefaultPoolLock;
+
+/* Used by everybody waiting for callbacks to finish */
+static RTL_SRWLOCK TppCallbackLock;
+static RTL_CONDITION_VARIABLE TppCallbackCondition;
+
+static RTL_SRWLOCK TppTimerLock;
+static LIST_ENTRY TppTimerList = { &TppTimerList, &TppTimerList };
+static HANDLE TppTimerEvent;
+
+static RTL_SRWLOCK TppWaitLock;
+static LIST_ENTRY TppWaitThreadList = { &TppWaitThreadList, &TppWaitThreadList };
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static
+ULONG
+NTAPI
+TppWorkerThread(IN PVOID Parameter);
+
+FORCEINLINE
+ULONG
+TppCurrentQueueIndex(IN PTP_POOL Pool)
+{
+    return (ULONG)((ULONG_PTR)NtCurrentTeb()->ClientId.UniqueThread >> 2) % Pool->QueueCount;
+}
+
+static
+NTSTATUS
+TppCreatePool(OUT PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+    ULONG i;
+
+    Pool = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Pool));
+    if (!Pool) return STATUS_NO_MEMORY;
+
+    /* The port must not throttle the workers, the pool decides how many run */
+    Status = NtCreateIoCompletion(&Pool->CompletionPort,
+                                  IO_COMPLETION_ALL_ACCESS,
+                                  NULL,
+                                  MAXLONG);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+        return Status;
+    }
+
+    Pool->RefCount = 1;
+    Pool->MaxThreads = TPP_DEFAULT_MAX_THREADS;
+    RtlInitializeSRWLock(&Pool->Lock);
+
+    /* One queue per processor */
+    Pool->QueueCount = min(max(NtCurrentPeb()->NumberOfProcessors, 1), TPP_MAX_QUEUES);
+    for (i = 0; i < Pool->QueueCount; i++)
+    {
+        RtlInitializeSRWLock(&Pool->Queues[i].Lock);
+        InitializeListHead(&Pool->Queues[i].ObjectList);
+    }
+
+    *PoolReturn = Pool;
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+TppFreePool(IN PTP_POOL Pool)
+{
+    NtClose(Pool->CompletionPort);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Pool);
+}
+
+static
+VOID
+TppDereferencePool(IN PTP_POOL Pool)
+{
+    LONG Threads, i;
+
+    if (InterlockedDecrement(&Pool->RefCount)) return;
+
+    /* No more objects, tell the workers to leave. The last one frees the pool */
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    Pool->Closing = TRUE;
+    Threads = Pool->ThreadCount;
+
+    /* Workers can't get past the lock to free the pool before all of them are told */
+    for (i = 0; i < Threads; i++)
+    {
+        NtSetIoCompletion(Pool->CompletionPort, NULL, NULL, STATUS_SUCCESS, 0);
+    }
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    if (!Threads) TppFreePool(Pool);
+}
+
+static
+NTSTATUS
+TppReferencePool(IN PTP_CALLBACK_ENVIRON Environment OPTIONAL,
+                 OUT PTP_POOL *PoolReturn)
+{
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    if (Environment && Environment->Pool)
+    {
+        Pool = Environment->Pool;
+    }
+    else
+    {
+        /* The default pool is created on first use and never goes away */
+        Pool = TppDefaultPool;
+        if (!Pool)
+        {
+            RtlAcquireSRWLockExclusive(&TppDefaultPoolLock);
+            if (!TppDefaultPool)
+            {
+                Status = TppCreatePool(&Pool);
+                if (!NT_SUCCESS(Status))
+                {
+                    RtlReleaseSRWLockExclusive(&TppDefaultPoolLock);
+                    return Status;
+                }
+                InterlockedExchangePointer((PVOID *)&TppDefaultPool, Pool);
+            }
+            Pool = TppDefaultPool;
+            RtlReleaseSRWLockExclusive(&TppDefaultPoolLock);
+        }
+    }
+
+    InterlockedIncrement(&Pool->RefCount);
+    *PoolReturn = Pool;
+    return STATUS_SUCCESS;
+}
+
+/* Number of workers the pool starts without waiting to see if the backlog persists */
+FORCEINLINE
+LONG
+TppThreadTarget(IN PTP_POOL Pool)
+{
+    LONG Target = NtCurrentPeb()->NumberOfProcessors;
+
+    Target = min(Target, Pool->MaxThreads);
+    return max(Target, Pool->MinThreads);
+}
+
+static
+LONG
+TppBacklog(IN PTP_POOL Pool)
+{
+    LONG Backlog = 0;
+    ULONG i;
+
+    for (i = 0; i < Pool->QueueCount; i++)
+    {
+        Backlog += Pool->Queues[i].Count;
+    }
+
+    return Backlog;
+}
+
+/* Account for a worker going away, returns FALSE if it has to stay */
+static
+BOOLEAN
+TppRemoveWorker(IN PTP_POOL Pool,
+                IN BOOLEAN Force)
+{
+    BOOLEAN FreePool;
+
+    /* Work posted after the idle wait timed out still needs a thread */
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    if (!Force && !Pool->Closing &&
+        ((Pool->ThreadCount <= Pool->MinThreads) || TppBacklog(Pool)))
+    {
+        RtlReleaseSRWLockExclusive(&Pool->Lock);
+        return FALSE;
+    }
+    FreePool = (--Pool->ThreadCount == 0) && Pool->Closing;
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    if (FreePool) TppFreePool(Pool);
+    return TRUE;
+}
+
+static
+NTSTATUS
+TppCreateWorker(IN PTP_POOL Pool,
+                IN LONG Limit)
+{
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    if (Pool->Closing || (Pool->ThreadCount >= Limit))
+    {
+        RtlReleaseSRWLockExclusive(&Pool->Lock);
+        return STATUS_TOO_MANY_THREADS;
+    }
+    Pool->ThreadCount++;
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    Status = RtlCreateUserThread(NtCurrentProcess(),
+                                 NULL,
+                                 FALSE,
+                                 0,
+                                 0,
+                                 0,
+                                 TppWorkerThread,
+                                 Pool,
+                                 &ThreadHandle,
+                                 NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        DPRINT1("Failed to create a pool worker: 0x%lx\n", Status);
+        TppRemoveWorker(Pool, TRUE);
+        return Status;
+    }
+
+    NtClose(ThreadHandle);
+    return STATUS_SUCCESS;
+}
+
+/* Make sure somebody picks up newly queued work */
+static
+VOID
+TppWakeWorker(IN PTP_POOL Pool)
+{
+    if (Pool->IdleCount > Pool->WakeCount)
+    {
+        /* An idle worker that was not woken up yet, the port releases it */
+        InterlockedIncrement(&Pool->WakeCount);
+        NtSetIoCompletion(Pool->CompletionPort, NULL, NULL, STATUS_SUCCESS, 0);
+    }
+    else
+    {
+        /* Checked under the pool lock, so a worker leaving now either sees
+           the work or leaves room for a new one */
+        TppCreateWorker(Pool, TppThreadTarget(Pool));
+    }
+}
+
+static
+NTSTATUS
+TppAllocateObject(OUT PTPP_OBJECT *ObjectReturn,
+                  IN TPP_OBJECT_TYPE Type,
+                  IN PVOID Callback,
+                  IN PVOID Context OPTIONAL,
+                  IN PTP_CALLBACK_ENVIRON Environment OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    PTP_POOL Pool;
+    NTSTATUS Status;
+
+    if (!Callback) return STATUS_INVALID_PARAMETER;
+
+    Status = TppReferencePool(Environment, &Pool);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    Object = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Object));
+    if (!Object)
+    {
+        TppDereferencePool(Pool);
+        return STATUS_NO_MEMORY;
+    }
+
+    Object->Type = Type;
+    Object->RefCount = 1;
+    Object->Pool = Pool;
+    Object->Callback = Callback;
+    Object->Context = Context;
+
+    /* Objects created by the same thread share a queue, workers steal across them */
+    Object->Queue = &Pool->Queues[TppCurrentQueueIndex(Pool)];
+
+    if (Environment)
+    {
+        Object->CancelCallback = Environment->CleanupGroupCancelCallback;
+        Object->FinalizationCallback = Environment->FinalizationCallback;
+        Object->LongFunction = Environment->u.s.LongFunction;
+
+        /* Keep the DLL providing the callbacks loaded as long as the object exists */
+        if (Environment->RaceDll &&
+            NT_SUCCESS(LdrAddRefDll(0, Environment->RaceDll)))
+        {
+            Object->RaceDll = Environment->RaceDll;
+        }
+    }
+
+    *ObjectReturn = Object;
+    return STATUS_SUCCESS;
+}
+
+FORCEINLINE
+VOID
+TppReferenceObject(IN PTPP_OBJECT Object)
+{
+    InterlockedIncrement(&Object->RefCount);
+}
+
+static
+VOID
+TppDereferenceObject(IN PTPP_OBJECT Object)
+{
+    PTP_POOL Pool;
+    PVOID RaceDll;
+
+    if (InterlockedDecrement(&Object->RefCount)) return;
+
+    Pool = Object->Pool;
+    RaceDll = Object->RaceDll;
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Object);
+
+    if (RaceDll) LdrUnloadDll(RaceDll);
+    TppDereferencePool(Pool);
+}
+
+static
+VOID
+TppInsertIntoGroup(IN PTPP_OBJECT Object,
+                   IN PTP_CALLBACK_ENVIRON Environment OPTIONAL)
+{
+    PTP_CLEANUP_GROUP Group;
+
+    if (!Environment || !Environment->CleanupGroup) return;
+    Group = Environment->CleanupGroup;
+
+    /* The group holds its own reference until the members are released */
+    TppReferenceObject(Object);
+    RtlAcquireSRWLockExclusive(&Group->Lock);
+    Object->CleanupGroup = Group;
+    InsertTailList(&Group->MemberList, &Object->GroupEntry);
+    RtlReleaseSRWLockExclusive(&Group->Lock);
+}
+
+static
+VOID
+TppRemoveFromGroup(IN PTPP_OBJECT Object)
+{
+    PTP_CLEANUP_GROUP Group = Object->CleanupGroup;
+    BOOLEAN Removed = FALSE;
+
+    if (!Group) return;
+
+    RtlAcquireSRWLockExclusive(&Group->Lock);
+    if (Object->CleanupGroup == Group)
+    {
+        RemoveEntryList(&Object->GroupEntry);
+        Object->CleanupGroup = NULL;
+        Removed = TRUE;
+    }
+    RtlReleaseSRWLockExclusive(&Group->Lock);
+
+    if (Removed) TppDereferenceObject(Object);
+}
+
+static
+VOID
+TppSignalWaiters(IN PTPP_OBJECT Object)
+{
+    if (!Object->Waiters) return;
+
+    /* Taking the lock makes sure the waiter is asleep before we wake it */
+    RtlAcquireSRWLockExclusive(&TppCallbackLock);
+    RtlReleaseSRWLockExclusive(&TppCallbackLock);
+    RtlWakeAllConditionVariable(&TppCallbackCondition);
+}
+
+static
+VOID
+TppCallbackDone(IN PTPP_OBJECT Object)
+{
+    /* Simple callbacks leave their group once they ran */
+    if (Object->Type == TppSimpleObject) TppRemoveFromGroup(Object);
+
+    if (!InterlockedDecrement(&Object->Running)) TppSignalWaiters(Object);
+}
+
+static
+VOID
+TppPostObject(IN PTPP_OBJECT Object)
+{
+    PTPP_QUEUE Queue = Object->Queue;
+
+    RtlAcquireSRWLockExclusive(&Queue->Lock);
+    if (Object->Pending++ == 0)
+    {
+        /* Queued once, no matter how many callbacks are pending */
+        TppReferenceObject(Object);
+        InsertTailList(&Queue->ObjectList, &Object->QueueEntry);
+        Queue->Count++;
+    }
+    RtlReleaseSRWLockExclusive(&Queue->Lock);
+
+    TppWakeWorker(Object->Pool);
+}
+
+/* Returns the number of callbacks that will not run */
+static
+LONG
+TppCancelObject(IN PTPP_OBJECT Object)
+{
+    PTPP_QUEUE Queue = Object->Queue;
+    LONG Canceled;
+
+    /* Pending I/O callbacks are in the completion port, not in a queue */
+    if (Object->Type == TppIoObject) return 0;
+
+    RtlAcquireSRWLockExclusive(&Queue->Lock);
+    Canceled = Object->Pending;
+    if (Canceled)
+    {
+        Object->Pending = 0;
+        RemoveEntryList(&Object->QueueEntry);
+        Queue->Count--;
+    }
+    RtlReleaseSRWLockExclusive(&Queue->Lock);
+
+    if (Canceled) TppDereferenceObject(Object);
+    return Canceled;
+}
+
+static
+PTPP_OBJECT
+TppDequeueObject(IN PTP_POOL Pool,
+                 IN ULONG Home,
+                 OUT PBOOLEAN More)
+{
+    PTPP_QUEUE Queue;
+    PTPP_OBJECT Object;
+    ULONG i;
+
+    /* Own queue first, then steal from the others */
+    for (i = 0; i < Pool->QueueCount; i++)
+    {
+        Queue = &Pool->Queues[(Home + i) % Pool->QueueCount];
+        if (!Queue->Count) continue;
+
+        RtlAcquireSRWLockExclusive(&Queue->Lock);
+        if (IsListEmpty(&Queue->ObjectList))
+        {
+            RtlReleaseSRWLockExclusive(&Queue->Lock);
+            continue;
+        }
+
+        Object = CONTAINING_RECORD(RemoveHeadList(&Queue->ObjectList),
+                                   TPP_OBJECT,
+                                   QueueEntry);
+
+        /* Running goes up first, so waiters never see both at zero */
+        InterlockedIncrement(&Object->Running);
+        *More = (--Object->Pending != 0);
+        if (*More)
+        {
+            /* Let another worker run the next callback in parallel */
+            TppReferenceObject(Object);
+            InsertTailList(&Queue->ObjectList, &Object->QueueEntry);
+        }
+        else
+        {
+            Queue->Count--;
+        }
+        RtlReleaseSRWLockExclusive(&Queue->Lock);
+
+        return Object;
+    }
+
+    return NULL;
+}
+
+static
+VOID
+TppWaitForCallbacks(IN PTPP_OBJECT Object,
+                    IN BOOLEAN CancelPending)
+{
+    if (CancelPending) TppCancelObject(Object);
+
+    RtlAcquireSRWLockExclusive(&TppCallbackLock);
+    InterlockedIncrement(&Object->Waiters);
+    while (Object->Pending || Object->Running)
+    {
+        RtlSleepConditionVariableSRW(&TppCallbackCondition, &TppCallbackLock, NULL, 0);
+    }
+    InterlockedDecrement(&Object->Waiters);
+    RtlReleaseSRWLockExclusive(&TppCallbackLock);
+}
+
+static
+VOID
+TppRunObject(IN PTPP_OBJECT Object,
+             IN PVOID ApcContext OPTIONAL,
+             IN PIO_STATUS_BLOCK IoStatusBlock OPTIONAL)
+{
+    TP_CALLBACK_INSTANCE Instance;
+
+    RtlZeroMemory(&Instance, sizeof(Instance));
+    Instance.Object = Object;
+    Instance.Associated = TRUE;
+
+    if (Object->LongFunction) TpCallbackMayRunLong(&Instance);
+
+    switch (Object->Type)
+    {
+        case TppSimpleObject:
+            ((PTP_SIMPLE_CALLBACK)Object->Callback)(&Instance, Object->Context);
+            break;
+
+        case TppWorkObject:
+            ((PTP_WORK_CALLBACK)Object->Callback)(&Instance, Object->Context, (PTP_WORK)Object);
+            break;
+
+        case TppTimerObject:
+            ((PTP_TIMER_CALLBACK)Object->Callback)(&Instance, Object->Context, (PTP_TIMER)Object);
+            break;
+
+        case TppWaitObject:
+            ((PTP_WAIT_CALLBACK)Object->Callback)(&Instance,
+                                                  Object->Context,
+                                                  (PTP_WAIT)Object,
+                                                  Object->u.Wait.Result);
+            break;
+
+        case TppIoObject:
+            ((PTP_IO_CALLBACK)Object->Callback)(&Instance,
+                                                Object->Context,
+                                                ApcContext,
+                                                IoStatusBlock,
+                                                (PTP_IO)Object);
+            break;
+    }
+
+    if (Object->FinalizationCallback)
+    {
+        Object->FinalizationCallback(&Instance, Object->Context);
+    }
+
+    /* The callback is done as far as waiters are concerned */
+    if (Instance.Associated) TppCallbackDone(Object);
+
+    /* Now do what the callback asked for */
+    if (Instance.CriticalSection) RtlLeaveCriticalSection(Instance.CriticalSection);
+    if (Instance.Mutex) NtReleaseMutant(Instance.Mutex, NULL);
+    if (Instance.Semaphore) NtReleaseSemaphore(Instance.Semaphore, Instance.SemaphoreCount, NULL);
+    if (Instance.Event) NtSetEvent(Instance.Event, NULL);
+    if (Instance.DllHandle) LdrUnloadDll(Instance.DllHandle);
+
+    TppDereferenceObject(Object);
+}
+
+static
+ULONG
+NTAPI
+TppWorkerThread(IN PVOID Parameter)
+{
+    PTP_POOL Pool = Parameter;
+    PTPP_OBJECT Object;
+    LARGE_INTEGER IdleTimeout;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PVOID Key, ApcContext;
+    NTSTATUS Status;
+    BOOLEAN More;
+    ULONG Home, Start;
+
+    Home = TppCurrentQueueIndex(Pool);
+    IdleTimeout.QuadPart = TPP_IDLE_TIMEOUT;
+
+    for (;;)
+    {
+        Object = TppDequeueObject(Pool, Home, &More);
+        if (!Object)
+        {
+            /* Go idle, then look again in case a post missed us */
+            InterlockedIncrement(&Pool->IdleCount);
+            Object = TppDequeueObject(Pool, Home, &More);
+            if (!Object)
+            {
+                Status = NtRemoveIoCompletion(Pool->CompletionPort,
+                                              &Key,
+                                              &ApcContext,
+                                              &IoStatusBlock,
+                                              &IdleTimeout);
+                InterlockedDecrement(&Pool->IdleCount);
+
+                if (Status == STATUS_TIMEOUT)
+                {
+                    /* Nothing to do for a while, shrink the pool */
+                    if (TppRemoveWorker(Pool, FALSE)) break;
+                    continue;
+                }
+
+                if (!NT_SUCCESS(Status))
+                {
+                    DPRINT1("NtRemoveIoCompletion failed: 0x%lx\n", Status);
+                    if (TppRemoveWorker(Pool, TRUE)) break;
+                }
+
+                if (!Key)
+                {
+                    /* Woken up for queued work, or because the pool is closing */
+                    InterlockedDecrement(&Pool->WakeCount);
+                    if (Pool->Closing && TppRemoveWorker(Pool, TRUE)) break;
+                    continue;
+                }
+
+                /* An I/O completed on a file bound to this pool */
+                Object = Key;
+                InterlockedIncrement(&Object->Running);
+                InterlockedDecrement(&Object->Pending);
+                TppRunObject(Object, ApcContext, &IoStatusBlock);
+                continue;
+            }
+            InterlockedDecrement(&Pool->IdleCount);
+        }
+
+        if (More) TppWakeWorker(Pool);
+
+        Start = NtGetTickCount();
+        TppRunObject(Object, NULL, NULL);
+
+        /* A long callback held up the backlog, let the pool grow past the processor count */
+        if ((NtGetTickCount() - Start >= TPP_LONG_CALLBACK_MS) &&
+            !Pool->IdleCount &&
+            TppBacklog(Pool))
+        {
+            TppCreateWorker(Pool, Pool->MaxThreads);
+        }
+    }
+
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+/* Timers are sorted by due time */
+static
+VOID
+TppInsertTimer(IN PTPP_OBJECT Timer)
+{
+    PLIST_ENTRY Entry;
+    PTPP_OBJECT Other;
+
+    /* New timers are usually the latest ones, start from the end */
+    for (Entry = TppTimerList.Blink; Entry != &TppTimerList; Entry = Entry->Blink)
+    {
+        Other = CONTAINING_RECORD(Entry, TPP_OBJECT, u.Timer.TimerEntry);
+        if (Other->u.Timer.DueTime <= Timer->u.Timer.DueTime) break;
+    }
+    InsertHeadList(Entry, &Timer->u.Timer.TimerEntry);
+}
+
+/*
+ * The timer thread sleeps until the first timer runs out of its window, and
+ * then fires everything that is due, so timers with some slack share wakeups
+ */
+static
+LONGLONG
+TppNextTimerWakeup(VOID)
+{
+    PLIST_ENTRY Entry;
+    PTPP_OBJECT Timer;
+    LONGLONG Wakeup = TPP_INFINITE;
+
+    for (Entry = TppTimerList.Flink; Entry != &TppTimerList; Entry = Entry->Flink)
+    {
+        Timer = CONTAINING_RECORD(Entry, TPP_OBJECT, u.Timer.TimerEntry);
+        if (Timer->u.Timer.DueTime >= Wakeup) break;
+        Wakeup = min(Wakeup, Timer->u.Timer.DueTime + Timer->u.Timer.WindowLength * 10000LL);
+    }
+
+    return Wakeup;
+}
+
+static
+ULONG
+NTAPI
+TppTimerThread(IN PVOID Parameter)
+{
+    PTPP_OBJECT Timer;
+    LARGE_INTEGER Now, Timeout;
+
+    for (;;)
+    {
+        RtlAcquireSRWLockExclusive(&TppTimerLock);
+        NtQuerySystemTime(&Now);
+
+        while (!IsListEmpty(&TppTimerList))
+        {
+            Timer = CONTAINING_RECORD(TppTimerList.Flink, TPP_OBJECT, u.Timer.TimerEntry);
+            if (Timer->u.Timer.DueTime > Now.QuadPart) break;
+
+            RemoveEntryList(&Timer->u.Timer.TimerEntry);
+            TppPostObject(Timer);
+
+            if (Timer->u.Timer.Period)
+            {
+                /* Periods that were missed are not made up for */
+                Timer->u.Timer.DueTime += Timer->u.Timer.Period * 10000LL;
+                if (Timer->u.Timer.DueTime <= Now.QuadPart)
+                {
+                    Timer->u.Timer.DueTime = Now.QuadPart + Timer->u.Timer.Period * 10000LL;
+                }
+                TppInsertTimer(Timer);
+            }
+            else
+            {
+                /* The queue has its own reference now */
+                Timer->u.Timer.Set = FALSE;
+                TppDereferenceObject(Timer);
+            }
+        }
+
+        Timeout.QuadPart = TppNextTimerWakeup();
+        RtlReleaseSRWLockExclusive(&TppTimerLock);
+
+        NtWaitForSingleObject(TppTimerEvent,
+                              FALSE,
+                              (Timeout.QuadPart == TPP_INFINITE) ? NULL : &Timeout);
+    }
+
+    return 0;
+}
+
+static
+NTSTATUS
+TppStartTimerThread(VOID)
+{
+    HANDLE Event, ThreadHandle;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    if (TppTimerEvent) return STATUS_SUCCESS;
+
+    RtlAcquireSRWLockExclusive(&TppTimerLock);
+    if (!TppTimerEvent)
+    {
+        Status = NtCreateEvent(&Event, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+        if (NT_SUCCESS(Status))
+        {
+            TppTimerEvent = Event;
+            Status = RtlCreateUserThread(NtCurrentProcess(),
+                                         NULL,
+                                         FALSE,
+                                         0,
+                                         0,
+                                         0,
+                                         TppTimerThread,
+                                         NULL,
+                                         &ThreadHandle,
+                                         NULL);
+            if (NT_SUCCESS(Status))
+            {
+                NtClose(ThreadHandle);
+            }
+            else
+            {
+                TppTimerEvent = NULL;
+                NtClose(Event);
+            }
+        }
+    }
+    RtlReleaseSRWLockExclusive(&TppTimerLock);
+
+    return Status;
+}
+
+/* Called with the wait lock held */
+static
+VOID
+TppFireWait(IN PTPP_WAIT_THREAD Thread,
+            IN ULONG Index,
+            IN TP_WAIT_RESULT Result)
+{
+    PTPP_OBJECT Wait = Thread->Waits[Index];
+
+    Thread->Waits[Index] = Thread->Waits[--Thread->Count];
+    Wait->u.Wait.Thread = NULL;
+    Wait->u.Wait.Result = Result;
+
+    /* Waits are one shot, the queue takes over the reference */
+    TppPostObject(Wait);
+    TppDereferenceObject(Wait);
+}
+
+static
+ULONG
+NTAPI
+TppWaitThread(IN PVOID Parameter)
+{
+    PTPP_WAIT_THREAD Thread = Parameter;
+    HANDLE Handles[MAXIMUM_WAIT_OBJECTS];
+    PTPP_OBJECT Objects[MAXIMUM_WAIT_OBJECTS];
+    PTPP_OBJECT Wait;
+    LARGE_INTEGER Now, Timeout, Zero;
+    LONGLONG NextTimeout;
+    NTSTATUS Status;
+    ULONG i, Count, Index;
+
+    Zero.QuadPart = 0;
+    Handles[0] = Thread->UpdateEvent;
+
+    for (;;)
+    {
+        RtlAcquireSRWLockExclusive(&TppWaitLock);
+        NtQuerySystemTime(&Now);
+        NextTimeout = TPP_INFINITE;
+        Count = 1;
+
+        for (i = 0; i < Thread->Count; )
+        {
+            Wait = Thread->Waits[i];
+            if (Wait->u.Wait.Timeout <= Now.QuadPart)
+            {
+                /* Timed out, unless it got signaled in the meantime */
+                Status = NtWaitForSingleObject(Wait->u.Wait.Handle, FALSE, &Zero);
+                TppFireWait(Thread, i, (Status == STATUS_WAIT_0) ? WAIT_OBJECT_0 : WAIT_TIMEOUT);
+                continue;
+            }
+
+            NextTimeout = min(NextTimeout, Wait->u.Wait.Timeout);
+            Handles[Count] = Wait->u.Wait.Handle;
+            Objects[Count] = Wait;
+            Count++;
+            i++;
+        }
+
+        /* Give up the thread once it has nothing to wait for */
+        if ((Count == 1) && (NextTimeout == TPP_INFINITE))
+        {
+            NextTimeout = Now.QuadPart - TPP_IDLE_TIMEOUT;
+        }
+        RtlReleaseSRWLockExclusive(&TppWaitLock);
+
+        Timeout.QuadPart = NextTimeout;
+        Status = NtWaitForMultipleObjects(Count,
+                                          Handles,
+                                          WaitAny,
+                                          FALSE,
+                                          (NextTimeout == TPP_INFINITE) ? NULL : &Timeout);
+
+        if (((Status > STATUS_WAIT_0) && (Status < STATUS_WAIT_0 + Count)) ||
+            ((Status > STATUS_ABANDONED_WAIT_0) && (Status < STATUS_ABANDONED_WAIT_0 + Count)))
+        {
+            Index = (Status >= STATUS_ABANDONED_WAIT_0) ? (Status - STATUS_ABANDONED_WAIT_0) :
+                                                          (Status - STATUS_WAIT_0);
+
+            /* Only fire it if nobody changed the wait while we were blocked */
+            RtlAcquireSRWLockExclusive(&TppWaitLock);
+            for (i = 0; i < Thread->Count; i++)
+            {
+                if ((Thread->Waits[i] == Objects[Index]) &&
+                    (Objects[Index]->u.Wait.Handle == Handles[Index]))
+                {
+                    TppFireWait(Thread, i, WAIT_OBJECT_0);
+                    break;
+                }
+            }
+            RtlReleaseSRWLockExclusive(&TppWaitLock);
+        }
+        else if (Status == STATUS_TIMEOUT)
+        {
+            RtlAcquireSRWLockExclusive(&TppWaitLock);
+            if (!Thread->Count && (Count == 1))
+            {
+                RemoveEntryList(&Thread->ListEntry);
+                RtlReleaseSRWLockExclusive(&TppWaitLock);
+                break;
+            }
+            RtlReleaseSRWLockExclusive(&TppWaitLock);
+        }
+        else if (!NT_SUCCESS(Status))
+        {
+            /* Somebody closed a handle we wait for, drop it */
+            RtlAcquireSRWLockExclusive(&TppWaitLock);
+            for (i = 0; i < Thread->Count; )
+            {
+                Wait = Thread->Waits[i];
+                if (NT_SUCCESS(NtWaitForSingleObject(Wait->u.Wait.Handle, FALSE, &Zero)))
+                {
+                    i++;
+                    continue;
+                }
+
+                DPRINT1("Dropping wait %p on invalid handle %p\n", Wait, Wait->u.Wait.Handle);
+                Thread->Waits[i] = Thread->Waits[--Thread->Count];
+                Wait->u.Wait.Thread = NULL;
+                TppDereferenceObject(Wait);
+            }
+            RtlReleaseSRWLockExclusive(&TppWaitLock);
+        }
+    }
+
+    NtClose(Thread->UpdateEvent);
+    RtlFreeHeap(RtlGetProcessHeap(), 0, Thread);
+    RtlExitUserThread(STATUS_SUCCESS);
+    return 0;
+}
+
+/* Called with the wait lock held */
+static
+PTPP_WAIT_THREAD
+TppGetWaitThread(VOID)
+{
+    PLIST_ENTRY Entry;
+    PTPP_WAIT_THREAD Thread;
+    HANDLE ThreadHandle;
+    NTSTATUS Status;
+
+    for (Entry = TppWaitThreadList.Flink; Entry != &TppWaitThreadList; Entry = Entry->Flink)
+    {
+        Thread = CONTAINING_RECORD(Entry, TPP_WAIT_THREAD, ListEntry);
+        if (Thread->Count < TPP_MAX_WAITS) return Thread;
+    }
+
+    /* All of them are full, start another one */
+    Thread = RtlAllocateHeap(RtlGetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(*Thread));
+    if (!Thread) return NULL;
+
+    Status = NtCreateEvent(&Thread->UpdateEvent, EVENT_ALL_ACCESS, NULL, SynchronizationEvent, FALSE);
+    if (!NT_SUCCESS(Status))
+    {
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Thread);
+        return NULL;
+    }
+
+    Status = RtlCreateUserThread(NtCurrentProcess(),
+                                 NULL,
+                                 FALSE,
+                                 0,
+                                 0,
+                                 0,
+                                 TppWaitThread,
+                                 Thread,
+                                 &ThreadHandle,
+                                 NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        NtClose(Thread->UpdateEvent);
+        RtlFreeHeap(RtlGetProcessHeap(), 0, Thread);
+        return NULL;
+    }
+    NtClose(ThreadHandle);
+
+    InsertTailList(&TppWaitThreadList, &Thread->ListEntry);
+    return Thread;
+}
+
+/* Called with the wait lock held, returns TRUE if the wait was armed */
+static
+BOOLEAN
+TppDisarmWait(IN PTPP_OBJECT Wait)
+{
+    PTPP_WAIT_THREAD Thread = Wait->u.Wait.Thread;
+    ULONG i;
+
+    if (!Thread) return FALSE;
+
+    for (i = 0; i < Thread->Count; i++)
+    {
+        if (Thread->Waits[i] == Wait)
+        {
+            Thread->Waits[i] = Thread->Waits[--Thread->Count];
+            break;
+        }
+    }
+    Wait->u.Wait.Thread = NULL;
+
+    /* Stop waiting on the handle */
+    NtSetEvent(Thread->UpdateEvent, NULL);
+    return TRUE;
+}
+
+static
+VOID
+TppReleaseObject(IN PTPP_OBJECT Object)
+{
+    TppRemoveFromGroup(Object);
+    TppDereferenceObject(Object);
+}
+
+/* PUBLIC FUNCTIONS *********************************************************/
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocPool(OUT PTP_POOL *PoolReturn,
+            IN PVOID Reserved)
+{
+    return TppCreatePool(PoolReturn);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleasePool(IN OUT PTP_POOL Pool)
+{
+    TppDereferencePool(Pool);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetPoolMaxThreads(IN OUT PTP_POOL Pool,
+                    IN ULONG MaxThreads)
+{
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    Pool->MaxThreads = max(min(MaxThreads, MAXLONG), 1);
+    Pool->MinThreads = min(Pool->MinThreads, Pool->MaxThreads);
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSetPoolMinThreads(IN OUT PTP_POOL Pool,
+                    IN ULONG MinThreads)
+{
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    RtlAcquireSRWLockExclusive(&Pool->Lock);
+    Pool->MinThreads = min(MinThreads, MAXLONG);
+    Pool->MaxThreads = max(Pool->MaxThreads, Pool->MinThreads);
+    RtlReleaseSRWLockExclusive(&Pool->Lock);
+
+    /* The minimum is there right away */
+    while (Pool->ThreadCount < Pool->MinThreads)
+    {
+        Status = TppCreateWorker(Pool, Pool->MinThreads);
+        if (Status == STATUS_TOO_MANY_THREADS)
+        {
+            Status = STATUS_SUCCESS;
+            break;
+        }
+        if (!NT_SUCCESS(Status)) break;
+    }
+
+    return Status;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocCleanupGroup(OUT PTP_CLEANUP_GROUP *CleanupGroupReturn)
+{
+    PTP_CLEANUP_GROUP Group;
+
+    Group = RtlAllocateHeap(RtlGetProcessHeap(), 0, sizeof(*Group));
+    if (!Group) return STATUS_NO_MEMORY;
+
+    RtlInitializeSRWLock(&Group->Lock);
+    InitializeListHead(&Group->MemberList);
+
+    *CleanupGroupReturn = Group;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroup(IN OUT PTP_CLEANUP_GROUP CleanupGroup)
+{
+    ASSERT(IsListEmpty(&CleanupGroup->MemberList));
+    RtlFreeHeap(RtlGetProcessHeap(), 0, CleanupGroup);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseCleanupGroupMembers(IN OUT PTP_CLEANUP_GROUP CleanupGroup,
+                             IN BOOLEAN CancelPendingCallbacks,
+                             IN OUT PVOID CleanupParameter OPTIONAL)
+{
+    LIST_ENTRY Members;
+    PLIST_ENTRY Entry;
+    PTPP_OBJECT Object;
+    BOOLEAN Armed;
+
+    /* Take all members out of the group first */
+    InitializeListHead(&Members);
+    RtlAcquireSRWLockExclusive(&CleanupGroup->Lock);
+    while (!IsListEmpty(&CleanupGroup->MemberList))
+    {
+        Entry = RemoveHeadList(&CleanupGroup->MemberList);
+        Object = CONTAINING_RECORD(Entry, TPP_OBJECT, GroupEntry);
+        Object->CleanupGroup = NULL;
+        InsertTailList(&Members, Entry);
+    }
+    RtlReleaseSRWLockExclusive(&CleanupGroup->Lock);
+
+    while (!IsListEmpty(&Members))
+    {
+        Entry = RemoveHeadList(&Members);
+        Object = CONTAINING_RECORD(Entry, TPP_OBJECT, GroupEntry);
+
+        /* Nothing new may get queued */
+        if (Object->Type == TppTimerObject)
+        {
+            TpSetTimer((PTP_TIMER)Object, NULL, 0, 0);
+        }
+        else if (Object->Type == TppWaitObject)
+        {
+            RtlAcquireSRWLockExclusive(&TppWaitLock);
+            Armed = TppDisarmWait(Object);
+            RtlReleaseSRWLockExclusive(&TppWaitLock);
+            if (Armed) TppDereferenceObject(Object);
+        }
+
+        if (CancelPendingCallbacks)
+        {
+            TppCancelObject(Object);
+            if (Object->CancelCallback)
+            {
+                Object->CancelCallback(Object->Context, CleanupParameter);
+            }
+        }
+        TppWaitForCallbacks(Object, FALSE);
+
+        /* Drop the reference of the group, and the one of the caller, simple callbacks have none */
+        if (Object->Type != TppSimpleObject) TppDereferenceObject(Object);
+        TppDereferenceObject(Object);
+    }
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpSimpleTryPost(IN PTP_SIMPLE_CALLBACK Callback,
+                IN OUT PVOID Context OPTIONAL,
+                IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocateObject(&Object, TppSimpleObject, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    TppInsertIntoGroup(Object, CallbackEnviron);
+    TppPostObject(Object);
+    TppDereferenceObject(Object);
+
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWork(OUT PTP_WORK *WorkReturn,
+            IN PTP_WORK_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocateObject(&Object, TppWorkObject, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    TppInsertIntoGroup(Object, CallbackEnviron);
+    *WorkReturn = (PTP_WORK)Object;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpPostWork(IN OUT PTP_WORK Work)
+{
+    TppPostObject((PTPP_OBJECT)Work);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWork(IN OUT PTP_WORK Work,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Work, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWork(IN OUT PTP_WORK Work)
+{
+    TppReleaseObject((PTPP_OBJECT)Work);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocTimer(OUT PTP_TIMER *Timer,
+             IN PTP_TIMER_CALLBACK Callback,
+             IN OUT PVOID Context OPTIONAL,
+             IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppStartTimerThread();
+    if (!NT_SUCCESS(Status)) return Status;
+
+    Status = TppAllocateObject(&Object, TppTimerObject, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    TppInsertIntoGroup(Object, CallbackEnviron);
+    *Timer = (PTP_TIMER)Object;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetTimer(IN OUT PTP_TIMER Timer,
+           IN PLARGE_INTEGER DueTime OPTIONAL,
+           IN ULONG Period,
+           IN ULONG WindowLength OPTIONAL)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Timer;
+    LARGE_INTEGER Now;
+    BOOLEAN WasSet;
+
+    RtlAcquireSRWLockExclusive(&TppTimerLock);
+
+    WasSet = Object->u.Timer.Set;
+    if (WasSet)
+    {
+        RemoveEntryList(&Object->u.Timer.TimerEntry);
+        Object->u.Timer.Set = FALSE;
+    }
+
+    if (DueTime)
+    {
+        /* Negative is relative, zero fires right away */
+        NtQuerySystemTime(&Now);
+        if (DueTime->QuadPart <= 0)
+            Object->u.Timer.DueTime = Now.QuadPart - DueTime->QuadPart;
+        else
+            Object->u.Timer.DueTime = DueTime->QuadPart;
+        Object->u.Timer.Period = Period;
+        Object->u.Timer.WindowLength = WindowLength;
+        Object->u.Timer.Set = TRUE;
+
+        if (!WasSet) TppReferenceObject(Object);
+        TppInsertTimer(Object);
+
+        /* The timer thread has to wake up earlier */
+        if (TppTimerList.Flink == &Object->u.Timer.TimerEntry)
+        {
+            NtSetEvent(TppTimerEvent, NULL);
+        }
+    }
+
+    RtlReleaseSRWLockExclusive(&TppTimerLock);
+
+    if (WasSet && !DueTime) TppDereferenceObject(Object);
+}
+
+/*
+ * @implemented
+ */
+ULONG
+NTAPI
+TpIsTimerSet(IN PTP_TIMER Timer)
+{
+    return ((PTPP_OBJECT)Timer)->u.Timer.Set;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForTimer(IN OUT PTP_TIMER Timer,
+               IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Timer, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseTimer(IN OUT PTP_TIMER Timer)
+{
+    TpSetTimer(Timer, NULL, 0, 0);
+    TppReleaseObject((PTPP_OBJECT)Timer);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocWait(OUT PTP_WAIT *WaitReturn,
+            IN PTP_WAIT_CALLBACK Callback,
+            IN OUT PVOID Context OPTIONAL,
+            IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocateObject(&Object, TppWaitObject, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    TppInsertIntoGroup(Object, CallbackEnviron);
+    *WaitReturn = (PTP_WAIT)Object;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpSetWait(IN OUT PTP_WAIT Wait,
+          IN HANDLE Handle OPTIONAL,
+          IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Wait;
+    PTPP_WAIT_THREAD Thread = NULL;
+    LARGE_INTEGER Now;
+    BOOLEAN WasSet;
+
+    RtlAcquireSRWLockExclusive(&TppWaitLock);
+
+    WasSet = TppDisarmWait(Object);
+
+    if (Handle)
+    {
+        Thread = TppGetWaitThread();
+        if (Thread)
+        {
+            /* Negative is relative, zero only checks the handle once */
+            Object->u.Wait.Timeout = TPP_INFINITE;
+            if (Timeout)
+            {
+                NtQuerySystemTime(&Now);
+                if (Timeout->QuadPart <= 0)
+                    Object->u.Wait.Timeout = Now.QuadPart - Timeout->QuadPart;
+                else
+                    Object->u.Wait.Timeout = Timeout->QuadPart;
+            }
+            Object->u.Wait.Handle = Handle;
+            Object->u.Wait.Thread = Thread;
+            Thread->Waits[Thread->Count++] = Object;
+
+            if (!WasSet) TppReferenceObject(Object);
+            NtSetEvent(Thread->UpdateEvent, NULL);
+        }
+        else
+        {
+            DPRINT1("No wait thread available for %p\n", Handle);
+        }
+    }
+
+    RtlReleaseSRWLockExclusive(&TppWaitLock);
+
+    if (WasSet && !Thread) TppDereferenceObject(Object);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForWait(IN OUT PTP_WAIT Wait,
+              IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Wait, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseWait(IN OUT PTP_WAIT Wait)
+{
+    TpSetWait(Wait, NULL, NULL);
+    TppReleaseObject((PTPP_OBJECT)Wait);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpAllocIoCompletion(OUT PTP_IO *IoReturn,
+                    IN HANDLE File,
+                    IN PTP_IO_CALLBACK Callback,
+                    IN OUT PVOID Context OPTIONAL,
+                    IN PTP_CALLBACK_ENVIRON CallbackEnviron OPTIONAL)
+{
+    FILE_COMPLETION_INFORMATION CompletionInformation;
+    IO_STATUS_BLOCK IoStatusBlock;
+    PTPP_OBJECT Object;
+    NTSTATUS Status;
+
+    Status = TppAllocateObject(&Object, TppIoObject, Callback, Context, CallbackEnviron);
+    if (!NT_SUCCESS(Status)) return Status;
+
+    /* Completions go straight to the workers of the pool */
+    CompletionInformation.Port = Object->Pool->CompletionPort;
+    CompletionInformation.Key = Object;
+    Status = NtSetInformationFile(File,
+                                  &IoStatusBlock,
+                                  &CompletionInformation,
+                                  sizeof(CompletionInformation),
+                                  FileCompletionInformation);
+    if (!NT_SUCCESS(Status))
+    {
+        TppDereferenceObject(Object);
+        return Status;
+    }
+
+    TppInsertIntoGroup(Object, CallbackEnviron);
+    *IoReturn = (PTP_IO)Object;
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpStartAsyncIoOperation(IN OUT PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+
+    /* Each outstanding I/O keeps the object alive until its callback ran */
+    TppReferenceObject(Object);
+    InterlockedIncrement(&Object->Pending);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCancelAsyncIoOperation(IN OUT PTP_IO Io)
+{
+    PTPP_OBJECT Object = (PTPP_OBJECT)Io;
+
+    /* The I/O will not complete to the port, e.g. it failed right away */
+    if (!InterlockedDecrement(&Object->Pending)) TppSignalWaiters(Object);
+    TppDereferenceObject(Object);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpWaitForIoCompletion(IN OUT PTP_IO Io,
+                      IN BOOLEAN CancelPendingCallbacks)
+{
+    TppWaitForCallbacks((PTPP_OBJECT)Io, CancelPendingCallbacks);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpReleaseIoCompletion(IN OUT PTP_IO Io)
+{
+    TppReleaseObject((PTPP_OBJECT)Io);
+}
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+TpCallbackMayRunLong(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    PTP_POOL Pool = Instance->Object->Pool;
+
+    if (Instance->MayRunLong) return STATUS_SUCCESS;
+    Instance->MayRunLong = TRUE;
+
+    /* Make sure somebody else is around to run the rest of the backlog */
+    if (Pool->IdleCount > Pool->WakeCount) return STATUS_SUCCESS;
+    return TppCreateWorker(Pool, Pool->MaxThreads);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpDisassociateCallback(IN OUT PTP_CALLBACK_INSTANCE Instance)
+{
+    if (!Instance->Associated) return;
+
+    /* Waiting for the callbacks of the object no longer waits for this one */
+    Instance->Associated = FALSE;
+    TppCallbackDone(Instance->Object);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackSetEventOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                               IN HANDLE Event)
+{
+    Instance->Event = Event;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseSemaphoreOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                       IN HANDLE Semaphore,
+                                       IN ULONG ReleaseCount)
+{
+    Instance->Semaphore = Semaphore;
+    Instance->SemaphoreCount = ReleaseCount;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackReleaseMutexOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                   IN HANDLE Mutex)
+{
+    Instance->Mutex = Mutex;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackLeaveCriticalSectionOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                           IN OUT PRTL_CRITICAL_SECTION CriticalSection)
+{
+    Instance->CriticalSection = CriticalSection;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+TpCallbackUnloadDllOnCompletion(IN OUT PTP_CALLBACK_INSTANCE Instance,
+                                IN PVOID DllHandle)
+{
+    Instance->DllHandle = DllHandle;
+}
+
+/* EOF */
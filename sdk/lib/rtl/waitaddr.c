@@ -0,0 +1,241 @@
+/*
+ * PROJECT:     ReactOS Runtime Library
+ * LICENSE:     GPL-2.0-or-later (https://spdx.org/licenses/GPL-2.0-or-later)
+ * PURPOSE:     Address based waits (RtlWaitOnAddress)
+ */
+
+/*
+ * Waiters queue a wait block in a bucket of a global hash table, keyed by the
+ * address they wait on, and block on the process keyed event with the wait
+ * block as the key. Wakers unlink the wait blocks under the bucket lock and
+ * release them afterwards. Waking an address nobody waits on thus never enters
+ * the kernel, and a contended wakeup costs one transition on each side.
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <rtl_vista.h>
+
+#define NDEBUG
+#include <debug.h>
+
+/* INTERNAL TYPES ***********************************************************/
+
+#define RTLP_WAIT_BUCKETS       128
+#define RTLP_WAIT_SPIN_COUNT    64
+
+typedef struct _RTLP_WAIT_BLOCK
+{
+    LIST_ENTRY ListEntry;
+    const volatile VOID *Address;
+    struct _RTLP_WAIT_BLOCK *NextWake;
+    volatile BOOLEAN Woken;
+} RTLP_WAIT_BLOCK, *PRTLP_WAIT_BLOCK;
+
+typedef struct _RTLP_WAIT_BUCKET
+{
+    volatile LONG Lock;
+    LIST_ENTRY WaitList;
+} RTLP_WAIT_BUCKET, *PRTLP_WAIT_BUCKET;
+
+/* GLOBALS ******************************************************************/
+
+static HANDLE RtlpWaitKeyedEvent;
+static RTLP_WAIT_BUCKET RtlpWaitTable[RTLP_WAIT_BUCKETS];
+
+/* PRIVATE FUNCTIONS ********************************************************/
+
+static
+PRTLP_WAIT_BUCKET
+RtlpGetWaitBucket(IN const volatile VOID *Address)
+{
+    ULONG_PTR Hash = (ULONG_PTR)Address;
+
+    /* Neighbouring fields of the same structure should end up in different buckets */
+    Hash = (Hash >> 2) ^ (Hash >> 9) ^ (Hash >> 16);
+    return &RtlpWaitTable[Hash % RTLP_WAIT_BUCKETS];
+}
+
+/*
+ * The bucket lock is only held to walk a short list, spin for it and give up
+ * the processor if its owner got preempted.
+ */
+static
+VOID
+RtlpAcquireWaitBucket(IN PRTLP_WAIT_BUCKET Bucket)
+{
+    ULONG Spin;
+
+    while (InterlockedExchange(&Bucket->Lock, 1))
+    {
+        for (Spin = 0; Bucket->Lock; Spin++)
+        {
+            if (Spin < RTLP_WAIT_SPIN_COUNT)
+                YieldProcessor();
+            else
+                NtYieldExecution();
+        }
+    }
+}
+
+FORCEINLINE
+VOID
+RtlpReleaseWaitBucket(IN PRTLP_WAIT_BUCKET Bucket)
+{
+    InterlockedExchange(&Bucket->Lock, 0);
+}
+
+static
+BOOLEAN
+RtlpCompareAddress(IN const volatile VOID *Address,
+                   IN PVOID CompareAddress,
+                   IN SIZE_T AddressSize)
+{
+    switch (AddressSize)
+    {
+        case 1:
+            return *(const volatile UCHAR *)Address == *(PUCHAR)CompareAddress;
+        case 2:
+            return *(const volatile USHORT *)Address == *(PUSHORT)CompareAddress;
+        case 4:
+            return *(const volatile ULONG *)Address == *(PULONG)CompareAddress;
+        default:
+            return *(const volatile ULONGLONG *)Address == *(PULONGLONG)CompareAddress;
+    }
+}
+
+static
+VOID
+RtlpWakeAddress(IN PVOID Address,
+                IN BOOLEAN WakeAll)
+{
+    PRTLP_WAIT_BUCKET Bucket = RtlpGetWaitBucket(Address);
+    PRTLP_WAIT_BLOCK WaitBlock, WakeList = NULL, *WakeTail = &WakeList;
+    PLIST_ENTRY Entry;
+
+    RtlpAcquireWaitBucket(Bucket);
+    for (Entry = Bucket->WaitList.Flink; Entry != &Bucket->WaitList; )
+    {
+        WaitBlock = CONTAINING_RECORD(Entry, RTLP_WAIT_BLOCK, ListEntry);
+        Entry = Entry->Flink;
+        if (WaitBlock->Address != Address) continue;
+
+        /* From now on the waiter must wait for our release, even if it times out */
+        RemoveEntryList(&WaitBlock->ListEntry);
+        WaitBlock->Woken = TRUE;
+        WaitBlock->NextWake = NULL;
+        *WakeTail = WaitBlock;
+        WakeTail = &WaitBlock->NextWake;
+
+        if (!WakeAll) break;
+    }
+    RtlpReleaseWaitBucket(Bucket);
+
+    while (WakeList)
+    {
+        /* The wait block is gone once its owner was released */
+        WaitBlock = WakeList;
+        WakeList = WaitBlock->NextWake;
+        NtReleaseKeyedEvent(RtlpWaitKeyedEvent, WaitBlock, FALSE, NULL);
+    }
+}
+
+VOID
+RtlpInitializeKeyedEvent(VOID)
+{
+    ULONG i;
+
+    ASSERT(RtlpWaitKeyedEvent == NULL);
+    NtCreateKeyedEvent(&RtlpWaitKeyedEvent, EVENT_ALL_ACCESS, NULL, 0);
+
+    for (i = 0; i < RTLP_WAIT_BUCKETS; i++)
+    {
+        InitializeListHead(&RtlpWaitTable[i].WaitList);
+    }
+}
+
+VOID
+RtlpCloseKeyedEvent(VOID)
+{
+    ASSERT(RtlpWaitKeyedEvent != NULL);
+    NtClose(RtlpWaitKeyedEvent);
+    RtlpWaitKeyedEvent = NULL;
+}
+
+/* PUBLIC FUNCTIONS *********************************************************/
+
+/*
+ * @implemented
+ */
+NTSTATUS
+NTAPI
+RtlWaitOnAddress(IN const volatile VOID *Address,
+                 IN PVOID CompareAddress,
+                 IN SIZE_T AddressSize,
+                 IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+    PRTLP_WAIT_BUCKET Bucket;
+    RTLP_WAIT_BLOCK WaitBlock;
+    NTSTATUS Status;
+
+    if ((AddressSize != 1) && (AddressSize != 2) &&
+        (AddressSize != 4) && (AddressSize != 8))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    ASSERT(RtlpWaitKeyedEvent != NULL);
+
+    WaitBlock.Address = Address;
+    WaitBlock.Woken = FALSE;
+
+    /* Compare under the bucket lock, so a waker changing the value cannot slip in between */
+    Bucket = RtlpGetWaitBucket(Address);
+    RtlpAcquireWaitBucket(Bucket);
+    if (!RtlpCompareAddress(Address, CompareAddress, AddressSize))
+    {
+        RtlpReleaseWaitBucket(Bucket);
+        return STATUS_SUCCESS;
+    }
+    InsertTailList(&Bucket->WaitList, &WaitBlock.ListEntry);
+    RtlpReleaseWaitBucket(Bucket);
+
+    Status = NtWaitForKeyedEvent(RtlpWaitKeyedEvent, &WaitBlock, FALSE, Timeout);
+    if (Status == STATUS_SUCCESS) return STATUS_SUCCESS;
+
+    /* Timed out, but a waker may have dequeued us already */
+    RtlpAcquireWaitBucket(Bucket);
+    if (!WaitBlock.Woken)
+    {
+        RemoveEntryList(&WaitBlock.ListEntry);
+        RtlpReleaseWaitBucket(Bucket);
+        return Status;
+    }
+    RtlpReleaseWaitBucket(Bucket);
+
+    /* It is on its way, take the release so the waker does not block forever */
+    NtWaitForKeyedEvent(RtlpWaitKeyedEvent, &WaitBlock, FALSE, NULL);
+    return STATUS_SUCCESS;
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+RtlWakeAddressSingle(IN PVOID Address)
+{
+    RtlpWakeAddress(Address, FALSE);
+}
+
+/*
+ * @implemented
+ */
+VOID
+NTAPI
+RtlWakeAddressAll(IN PVOID Address)
+{
+    RtlpWakeAddress(Address, TRUE);
+}
+
+/* EOF */
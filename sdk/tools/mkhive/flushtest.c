@@ -0,0 +1,255 @@
+/*
+ * PROJECT:     ReactOS hive maker
+ * LICENSE:     GPL-2.0+ (https://spdx.org/licenses/GPL-2.0+)
+ * PURPOSE:     Host test counting the writes of a cmlib hive flush
+ */
+
+/* INCLUDES *****************************************************************/
+
+#include <string.h>
+#include "mkhive.h"
+
+/* GLOBALS ******************************************************************/
+
+#define TEST_FILE_BLOCKS 256
+
+static ULONG WriteCount[HFILE_TYPE_MAX];
+static ULONG DirtyBuffer[(TEST_FILE_BLOCKS + 31) / 32];
+static RTL_BITMAP DirtyCopy;
+static UCHAR FileImage[(TEST_FILE_BLOCKS + 1) * HBLOCK_SIZE];
+static int Failures;
+
+#define ok(cond, ...) \
+    do { if (!(cond)) { printf("%s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); Failures++; } } while (0)
+
+/* FUNCTIONS ****************************************************************/
+
+/* Also used by cmlib itself */
+PVOID
+NTAPI
+CmpAllocate(
+    IN SIZE_T Size,
+    IN BOOLEAN Paged,
+    IN ULONG Tag)
+{
+    return malloc((size_t)Size);
+}
+
+VOID
+NTAPI
+CmpFree(
+    IN PVOID Ptr,
+    IN ULONG Quota)
+{
+    free(Ptr);
+}
+
+static BOOLEAN
+NTAPI
+TestFileRead(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PULONG FileOffset,
+    OUT PVOID Buffer,
+    IN SIZE_T BufferLength)
+{
+    return FALSE;
+}
+
+static BOOLEAN
+NTAPI
+TestFileWrite(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN PULONG FileOffset,
+    IN PVOID Buffer,
+    IN SIZE_T BufferLength)
+{
+    WriteCount[FileType]++;
+
+    /* Keep a copy of the primary file to check what went where */
+    if (FileType == HFILE_TYPE_PRIMARY)
+    {
+        if (*FileOffset + BufferLength > sizeof(FileImage))
+            return FALSE;
+        memcpy(FileImage + *FileOffset, Buffer, BufferLength);
+    }
+
+    return TRUE;
+}
+
+static BOOLEAN
+NTAPI
+TestFileSetSize(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    IN ULONG FileSize,
+    IN ULONG OldFileSize)
+{
+    return TRUE;
+}
+
+static BOOLEAN
+NTAPI
+TestFileFlush(
+    IN PHHIVE RegistryHive,
+    IN ULONG FileType,
+    PLARGE_INTEGER FileOffset,
+    ULONG Length)
+{
+    return TRUE;
+}
+
+static VOID
+AddBin(
+    IN PHHIVE Hive,
+    IN ULONG Blocks)
+{
+    PHBIN Bin;
+
+    Bin = HvpAddBin(Hive, Blocks * HBLOCK_SIZE - sizeof(HBIN), Stable);
+    ok(Bin != NULL, "HvpAddBin(%u) failed\n", (unsigned)Blocks);
+}
+
+static VOID
+ResetCounts(
+    IN PHHIVE Hive)
+{
+    memset(WriteCount, 0, sizeof(WriteCount));
+    memset(FileImage, 0, sizeof(FileImage));
+
+    /* The flush clears the dirty vector, remember what it was */
+    RtlInitializeBitMap(&DirtyCopy, DirtyBuffer, TEST_FILE_BLOCKS);
+    RtlClearAllBits(&DirtyCopy);
+    memcpy(DirtyBuffer, Hive->DirtyVector.Buffer, Hive->DirtyVector.SizeOfBitMap / 8);
+}
+
+/* Every dirty block must be in the file, and nothing else */
+static VOID
+CheckFileImage(
+    IN PHHIVE Hive,
+    IN PRTL_BITMAP Dirty OPTIONAL)
+{
+    ULONG i;
+    PUCHAR Block;
+    BOOLEAN Written;
+    static const UCHAR Zero[HBLOCK_SIZE];
+
+    for (i = 0; i < Hive->Storage[Stable].Length; i++)
+    {
+        Block = FileImage + (i + 1) * HBLOCK_SIZE;
+        Written = (Dirty == NULL) || RtlCheckBit(Dirty, i);
+        if (Written)
+        {
+            ok(memcmp(Block, (PVOID)Hive->Storage[Stable].BlockList[i].BlockAddress,
+                      HBLOCK_SIZE) == 0,
+               "Block %u was not written correctly\n", (unsigned)i);
+        }
+        else
+        {
+            ok(memcmp(Block, Zero, HBLOCK_SIZE) == 0,
+               "Block %u was written but is not dirty\n", (unsigned)i);
+        }
+    }
+}
+
+static VOID
+FillBlocks(
+    IN PHHIVE Hive)
+{
+    ULONG i;
+
+    /* Give each block contents of its own, leaving the bin headers alone */
+    for (i = 0; i < Hive->Storage[Stable].Length; i++)
+    {
+        memset((PUCHAR)Hive->Storage[Stable].BlockList[i].BlockAddress + sizeof(HBIN),
+               (int)(i + 1), HBLOCK_SIZE - sizeof(HBIN));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    CMHIVE CmHive;
+    PHHIVE Hive = &CmHive.Hive;
+    NTSTATUS Status;
+
+    RtlZeroMemory(&CmHive, sizeof(CmHive));
+    Status = HvInitialize(Hive,
+                          HINIT_CREATE,
+                          HIVE_NOLAZYFLUSH,
+                          HFILE_TYPE_PRIMARY,
+                          0,
+                          CmpAllocate,
+                          CmpFree,
+                          TestFileSetSize,
+                          TestFileWrite,
+                          TestFileRead,
+                          TestFileFlush,
+                          1,
+                          NULL);
+    if (!NT_SUCCESS(Status))
+    {
+        printf("HvInitialize failed with 0x%08x\n", (unsigned)Status);
+        return 1;
+    }
+
+    /*
+     * Blocks   0 -  63: four bins of 16 blocks, each allocated on its own
+     * Blocks  64 - 163: a single bin of 100 blocks
+     */
+    AddBin(Hive, 16);
+    AddBin(Hive, 16);
+    AddBin(Hive, 16);
+    AddBin(Hive, 16);
+    AddBin(Hive, 100);
+    ok(Hive->Storage[Stable].Length == 164, "Hive has %u blocks\n",
+       (unsigned)Hive->Storage[Stable].Length);
+    if (Failures)
+        return 1;
+    FillBlocks(Hive);
+
+    /*
+     * Writing the whole hive: the first four bins are gathered into one
+     * write of 64 blocks, the large bin goes out directly. Plus the base
+     * block before and after.
+     */
+    ResetCounts(Hive);
+    ok(HvWriteHive(Hive), "HvWriteHive failed\n");
+    ok(WriteCount[HFILE_TYPE_PRIMARY] == 2 + 2, "Full write took %u writes\n",
+       (unsigned)WriteCount[HFILE_TYPE_PRIMARY]);
+    CheckFileImage(Hive, NULL);
+
+    /* Scattered dirty runs */
+    RtlClearAllBits(&Hive->DirtyVector);
+    RtlSetBits(&Hive->DirtyVector, 2, 4);    /* Inside the first bin: 1 write */
+    RtlSetBits(&Hive->DirtyVector, 10, 12);  /* Across the first two bins: 1 gathered write */
+    RtlSetBits(&Hive->DirtyVector, 40, 1);   /* Single block: 1 write */
+    RtlSetBits(&Hive->DirtyVector, 50, 1);   /* Three single blocks: 3 writes */
+    RtlSetBits(&Hive->DirtyVector, 52, 1);
+    RtlSetBits(&Hive->DirtyVector, 54, 1);
+    RtlSetBits(&Hive->DirtyVector, 60, 30);  /* Across the last two bins: 1 gathered write */
+    RtlSetBits(&Hive->DirtyVector, 100, 64); /* Inside the large bin, up to the end: 1 write */
+    Hive->DirtyCount = 8;
+
+    ResetCounts(Hive);
+    ok(HvSyncHive(Hive), "HvSyncHive failed\n");
+    ok(WriteCount[HFILE_TYPE_PRIMARY] == 2 + 8, "Dirty flush took %u writes\n",
+       (unsigned)WriteCount[HFILE_TYPE_PRIMARY]);
+    CheckFileImage(Hive, &DirtyCopy);
+
+    /* A dirty run longer than the write buffer across bins is split */
+    RtlClearAllBits(&Hive->DirtyVector);
+    RtlSetBits(&Hive->DirtyVector, 0, 80);
+    Hive->DirtyCount = 1;
+
+    ResetCounts(Hive);
+    ok(HvSyncHive(Hive), "HvSyncHive failed\n");
+    ok(WriteCount[HFILE_TYPE_PRIMARY] == 2 + 2, "Long run took %u writes\n",
+       (unsigned)WriteCount[HFILE_TYPE_PRIMARY]);
+    CheckFileImage(Hive, &DirtyCopy);
+
+    HvFree(Hive);
+
+    printf("flushtest: %d failures\n", Failures);
+    return Failures ? 1 : 0;
+}
@@ -23,19 +23,42 @@ typedef struct _FONT_ENTRY_COLL_MEM
     FONT_ENTRY_MEM *Entry;
 } FONT_ENTRY_COLL_MEM, *PFONT_ENTRY_COLL_MEM;
 
-typedef struct _FONT_CACHE_ENTRY
+typedef struct _FONT_CACHE_HASHED
 {
-    LIST_ENTRY ListEntry;
-    int GlyphIndex;
+    INT GlyphIndex;
     FT_Face Face;
-    FT_BitmapGlyph BitmapGlyph;
-    int Height;
-    int Width;
-    int Escapement;
+    LONG Height;
     FT_Render_Mode RenderMode;
     MATRIX mxWorldToDevice;
+} FONT_CACHE_HASHED, *PFONT_CACHE_HASHED;
+
+typedef struct _FONT_CACHE_ENTRY
+{
+    LIST_ENTRY ListEntry;   /* Global LRU list */
+    LIST_ENTRY HashEntry;   /* Hash bucket */
+    LIST_ENTRY FaceEntry;   /* SHARED_FACE::GlyphCacheListHead */
+    FT_BitmapGlyph BitmapGlyph;
+    ULONG Hash;
+    SIZE_T Size;
+    FONT_CACHE_HASHED Hashed;
 } FONT_CACHE_ENTRY, *PFONT_CACHE_ENTRY;
 
+/*
+ * FONT_LOOKUP_CACHE --- the glyph cache key of one text run.
+ * The font part of the key is hashed once per run, and the entries of
+ * the low glyph indices (where the ASCII range lives in practically
+ * every font) are remembered so repeated glyphs skip the hash lookup.
+ */
+#define FONT_LOOKUP_CACHE_FAST 128
+
+typedef struct _FONT_LOOKUP_CACHE
+{
+    PSHARED_FACE SharedFace;
+    FONT_CACHE_HASHED Hashed;
+    ULONG FontHash;
+    PFONT_CACHE_ENTRY FastEntries[FONT_LOOKUP_CACHE_FAST];
+} FONT_LOOKUP_CACHE, *PFONT_LOOKUP_CACHE;
+
 
 /*
  * FONTSUBST_... --- constants for font substitutes
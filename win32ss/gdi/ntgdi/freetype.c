@@ -88,10 +88,15 @@ static BOOL             g_RenderingEnabled = TRUE;
 #define ASSERT_FREETYPE_LOCK_NOT_HELD() \
     ASSERT(g_FreeTypeLock->Owner != KeGetCurrentThread())
 
-#define MAX_FONT_CACHE 256
+/* The glyph cache is bounded by the memory the cached bitmaps take */
+#define MAX_FONT_CACHE_SIZE (1024 * 1024)
+#define FONT_CACHE_HASH_BITS 10
+#define FONT_CACHE_HASH_SIZE (1 << FONT_CACHE_HASH_BITS)
 
 static LIST_ENTRY g_FontCacheListHead;
+static LIST_ENTRY g_FontCacheHashTable[FONT_CACHE_HASH_SIZE];
 static UINT g_FontCacheNumEntries;
+static SIZE_T g_FontCacheSize;
 
 static PWCHAR g_ElfScripts[32] =   /* These are in the order of the fsCsb[0] bits */
 {
@@ -222,6 +227,7 @@ SharedFace_Create(FT_Face Face, PSHARED_MEM Memory)
         Ptr->Memory = Memory;
         SharedFaceCache_Init(&Ptr->EnglishUS);
         SharedFaceCache_Init(&Ptr->UserLanguage);
+        InitializeListHead(&Ptr->GlyphCacheListHead);
 
         SharedMem_AddRef(Memory);
         DPRINT("Creating SharedFace for %s\n", Face->family_name ? Face->family_name : "<NULL>");
@@ -260,30 +266,27 @@ RemoveCachedEntry(PFONT_CACHE_ENTRY Entry)
 
     FT_Done_Glyph((FT_Glyph)Entry->BitmapGlyph);
     RemoveEntryList(&Entry->ListEntry);
-    ExFreePoolWithTag(Entry, TAG_FONT);
+    RemoveEntryList(&Entry->HashEntry);
+    RemoveEntryList(&Entry->FaceEntry);
+    ASSERT(g_FontCacheNumEntries > 0);
+    ASSERT(g_FontCacheSize >= Entry->Size);
     g_FontCacheNumEntries--;
-    ASSERT(g_FontCacheNumEntries <= MAX_FONT_CACHE);
+    g_FontCacheSize -= Entry->Size;
+    ExFreePoolWithTag(Entry, TAG_FONT);
 }
 
 static void
-RemoveCacheEntries(FT_Face Face)
+RemoveCacheEntries(PSHARED_FACE SharedFace)
 {
-    PLIST_ENTRY CurrentEntry, NextEntry;
     PFONT_CACHE_ENTRY FontEntry;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
-    for (CurrentEntry = g_FontCacheListHead.Flink;
-         CurrentEntry != &g_FontCacheListHead;
-         CurrentEntry = NextEntry)
+    while (!IsListEmpty(&SharedFace->GlyphCacheListHead))
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
-        NextEntry = CurrentEntry->Flink;
-
-        if (FontEntry->Face == Face)
-        {
-            RemoveCachedEntry(FontEntry);
-        }
+        FontEntry = CONTAINING_RECORD(SharedFace->GlyphCacheListHead.Flink,
+                                      FONT_CACHE_ENTRY, FaceEntry);
+        RemoveCachedEntry(FontEntry);
     }
 }
 
@@ -327,7 +330,7 @@ SharedFace_Release(PSHARED_FACE Ptr)
     if (Ptr->RefCount == 0)
     {
         DPRINT("Releasing SharedFace for %s\n", Ptr->Face->family_name ? Ptr->Face->family_name : "<NULL>");
-        RemoveCacheEntries(Ptr->Face);
+        RemoveCacheEntries(Ptr);
         FT_Done_Face(Ptr->Face);
         SharedMem_Release(Ptr->Memory);
         SharedFaceCache_Release(&Ptr->EnglishUS);
@@ -660,10 +663,16 @@ BOOL FASTCALL
 InitFontSupport(VOID)
 {
     ULONG ulError;
+    ULONG i;
 
     InitializeListHead(&g_FontListHead);
     InitializeListHead(&g_FontCacheListHead);
+    for (i = 0; i < FONT_CACHE_HASH_SIZE; i++)
+    {
+        InitializeListHead(&g_FontCacheHashTable[i]);
+    }
     g_FontCacheNumEntries = 0;
+    g_FontCacheSize = 0;
     /* Fast Mutexes must be allocated from non paged pool */
     g_FontListLock = ExAllocatePoolWithTag(NonPagedPool, sizeof(FAST_MUTEX), TAG_INTERNAL_SYNC);
     if (g_FontListLock == NULL)
@@ -3130,39 +3139,84 @@ SameScaleMatrix(
             FLOATOBJ_Equal(&pmx1->efM22, &pmx2->efM22));
 }
 
-FT_BitmapGlyph APIENTRY
-ftGdiGlyphCacheGet(
-    FT_Face Face,
-    INT GlyphIndex,
-    INT Height,
+static VOID
+IntInitFontLookupCache(
+    PFONT_LOOKUP_CACHE Cache,
+    PSHARED_FACE SharedFace,
+    LONG Height,
     FT_Render_Mode RenderMode,
     PMATRIX pmx)
 {
-    PLIST_ENTRY CurrentEntry;
+    Cache->SharedFace = SharedFace;
+    Cache->Hashed.GlyphIndex = 0;
+    Cache->Hashed.Face = SharedFace->Face;
+    Cache->Hashed.Height = Height;
+    Cache->Hashed.RenderMode = RenderMode;
+    Cache->Hashed.mxWorldToDevice = *pmx;
+
+    /* The matrix is left out of the hash, FLOATOBJ_Equal does not compare bits */
+    Cache->FontHash = (ULONG)((ULONG_PTR)SharedFace->Face >> 4);
+    Cache->FontHash = Cache->FontHash * 31 + (ULONG)Height;
+    Cache->FontHash = Cache->FontHash * 31 + (ULONG)RenderMode;
+
+    RtlZeroMemory(Cache->FastEntries, sizeof(Cache->FastEntries));
+}
+
+static inline ULONG
+IntGlyphCacheHash(
+    PFONT_LOOKUP_CACHE Cache,
+    INT GlyphIndex)
+{
+    return (Cache->FontHash ^ (ULONG)GlyphIndex) * 0x9E3779B1;
+}
+
+FT_BitmapGlyph APIENTRY
+ftGdiGlyphCacheGet(
+    PFONT_LOOKUP_CACHE Cache,
+    INT GlyphIndex)
+{
+    PLIST_ENTRY CurrentEntry, HashHead;
     PFONT_CACHE_ENTRY FontEntry;
+    ULONG Hash;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
-    for (CurrentEntry = g_FontCacheListHead.Flink;
-         CurrentEntry != &g_FontCacheListHead;
+    if ((ULONG)GlyphIndex < FONT_LOOKUP_CACHE_FAST)
+    {
+        FontEntry = Cache->FastEntries[GlyphIndex];
+        if (FontEntry)
+            return FontEntry->BitmapGlyph;
+    }
+
+    Hash = IntGlyphCacheHash(Cache, GlyphIndex);
+    HashHead = &g_FontCacheHashTable[Hash >> (32 - FONT_CACHE_HASH_BITS)];
+
+    for (CurrentEntry = HashHead->Flink;
+         CurrentEntry != HashHead;
          CurrentEntry = CurrentEntry->Flink)
     {
-        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, ListEntry);
-        if ((FontEntry->Face == Face) &&
-            (FontEntry->GlyphIndex == GlyphIndex) &&
-            (FontEntry->Height == Height) &&
-            (FontEntry->RenderMode == RenderMode) &&
-            (SameScaleMatrix(&FontEntry->mxWorldToDevice, pmx)))
+        FontEntry = CONTAINING_RECORD(CurrentEntry, FONT_CACHE_ENTRY, HashEntry);
+        if ((FontEntry->Hash == Hash) &&
+            (FontEntry->Hashed.Face == Cache->Hashed.Face) &&
+            (FontEntry->Hashed.GlyphIndex == GlyphIndex) &&
+            (FontEntry->Hashed.Height == Cache->Hashed.Height) &&
+            (FontEntry->Hashed.RenderMode == Cache->Hashed.RenderMode) &&
+            (SameScaleMatrix(&FontEntry->Hashed.mxWorldToDevice,
+                             &Cache->Hashed.mxWorldToDevice)))
             break;
     }
 
-    if (CurrentEntry == &g_FontCacheListHead)
+    if (CurrentEntry == HashHead)
     {
         return NULL;
     }
 
-    RemoveEntryList(CurrentEntry);
-    InsertHeadList(&g_FontCacheListHead, CurrentEntry);
+    RemoveEntryList(&FontEntry->ListEntry);
+    InsertHeadList(&g_FontCacheListHead, &FontEntry->ListEntry);
+
+    if ((ULONG)GlyphIndex < FONT_LOOKUP_CACHE_FAST)
+        Cache->FastEntries[GlyphIndex] = FontEntry;
+
     return FontEntry->BitmapGlyph;
 }
 
@@ -3210,18 +3264,16 @@ ftGdiGlyphSet(
 
 FT_BitmapGlyph APIENTRY
 ftGdiGlyphCacheSet(
-    FT_Face Face,
+    PFONT_LOOKUP_CACHE Cache,
     INT GlyphIndex,
-    INT Height,
-    PMATRIX pmx,
-    FT_GlyphSlot GlyphSlot,
-    FT_Render_Mode RenderMode)
+    FT_GlyphSlot GlyphSlot)
 {
     FT_Glyph GlyphCopy;
     INT error;
-    PFONT_CACHE_ENTRY NewEntry;
+    PFONT_CACHE_ENTRY NewEntry, OldEntry;
     FT_Bitmap AlignedBitmap;
     FT_BitmapGlyph BitmapGlyph;
+    ULONG Hash;
 
     ASSERT_FREETYPE_LOCK_HELD();
 
@@ -3232,7 +3284,7 @@ ftGdiGlyphCacheSet(
         return NULL;
     };
 
-    error = FT_Glyph_To_Bitmap(&GlyphCopy, RenderMode, 0, 1);
+    error = FT_Glyph_To_Bitmap(&GlyphCopy, Cache->Hashed.RenderMode, 0, 1);
     if (error)
     {
         FT_Done_Glyph(GlyphCopy);
@@ -3262,20 +3314,36 @@ ftGdiGlyphCacheSet(
     FT_Bitmap_Done(GlyphSlot->library, &BitmapGlyph->bitmap);
     BitmapGlyph->bitmap = AlignedBitmap;
 
-    NewEntry->GlyphIndex = GlyphIndex;
-    NewEntry->Face = Face;
+    Hash = IntGlyphCacheHash(Cache, GlyphIndex);
+
     NewEntry->BitmapGlyph = BitmapGlyph;
-    NewEntry->Height = Height;
-    NewEntry->RenderMode = RenderMode;
-    NewEntry->mxWorldToDevice = *pmx;
+    NewEntry->Hash = Hash;
+    NewEntry->Size = sizeof(FONT_CACHE_ENTRY) + sizeof(FT_BitmapGlyphRec) +
+                     (SIZE_T)abs(AlignedBitmap.pitch) * AlignedBitmap.rows;
+    NewEntry->Hashed = Cache->Hashed;
+    NewEntry->Hashed.GlyphIndex = GlyphIndex;
 
-    InsertHeadList(&g_FontCacheListHead, &NewEntry->ListEntry);
-    if (++g_FontCacheNumEntries > MAX_FONT_CACHE)
+    /* Make room for the new glyph, oldest first */
+    while (!IsListEmpty(&g_FontCacheListHead) &&
+           g_FontCacheSize + NewEntry->Size > MAX_FONT_CACHE_SIZE)
     {
-        NewEntry = CONTAINING_RECORD(g_FontCacheListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
-        RemoveCachedEntry(NewEntry);
+        OldEntry = CONTAINING_RECORD(g_FontCacheListHead.Blink, FONT_CACHE_ENTRY, ListEntry);
+        RemoveCachedEntry(OldEntry);
+
+        /* The run's fast entries may point to what was just freed */
+        RtlZeroMemory(Cache->FastEntries, sizeof(Cache->FastEntries));
     }
 
+    InsertHeadList(&g_FontCacheListHead, &NewEntry->ListEntry);
+    InsertHeadList(&g_FontCacheHashTable[Hash >> (32 - FONT_CACHE_HASH_BITS)],
+                   &NewEntry->HashEntry);
+    InsertHeadList(&Cache->SharedFace->GlyphCacheListHead, &NewEntry->FaceEntry);
+    g_FontCacheNumEntries++;
+    g_FontCacheSize += NewEntry->Size;
+
+    if ((ULONG)GlyphIndex < FONT_LOOKUP_CACHE_FAST)
+        Cache->FastEntries[GlyphIndex] = NewEntry;
+
     return BitmapGlyph;
 }
 
@@ -4238,6 +4306,7 @@ TextIntGetTextExtentPoint(PDC dc,
     LOGFONTW *plf;
     BOOL EmuBold, EmuItalic;
     LONG ascender, descender;
+    FONT_LOOKUP_CACHE Cache;
 
     FontGDI = ObjToGDI(TextObj->Font, FONT);
 
@@ -4265,6 +4334,9 @@ TextIntGetTextExtentPoint(PDC dc,
     pmxWorldToDevice = DC_pmxWorldToDevice(dc);
     FtSetCoordinateTransform(face, pmxWorldToDevice);
 
+    IntInitFontLookupCache(&Cache, FontGDI->SharedFace, plf->lfHeight,
+                           RenderMode, pmxWorldToDevice);
+
     use_kerning = FT_HAS_KERNING(face);
     previous = 0;
 
@@ -4275,8 +4347,7 @@ TextIntGetTextExtentPoint(PDC dc,
         if (EmuBold || EmuItalic)
             realglyph = NULL;
         else
-            realglyph = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
-                                           RenderMode, pmxWorldToDevice);
+            realglyph = ftGdiGlyphCacheGet(&Cache, glyph_index);
 
         if (EmuBold || EmuItalic || !realglyph)
         {
@@ -4301,12 +4372,7 @@ TextIntGetTextExtentPoint(PDC dc,
             }
             else
             {
-                realglyph = ftGdiGlyphCacheSet(face,
-                                               glyph_index,
-                                               plf->lfHeight,
-                                               pmxWorldToDevice,
-                                               glyph,
-                                               RenderMode);
+                realglyph = ftGdiGlyphCacheSet(&Cache, glyph_index, glyph);
             }
 
             if (!realglyph)
@@ -5905,6 +5971,7 @@ IntExtTextOutW(
     BOOL EmuBold, EmuItalic;
     int thickness;
     BOOL bResult;
+    FONT_LOOKUP_CACHE Cache;
 
     /* Check if String is valid */
     if ((Count > 0xFFFF) || (Count > 0 && String == NULL))
@@ -6062,6 +6129,9 @@ IntExtTextOutW(
         fixDescender = FontGDI->tmDescent << 6;
     }
 
+    IntInitFontLookupCache(&Cache, FontGDI->SharedFace, plf->lfHeight,
+                           RenderMode, pmxWorldToDevice);
+
     /*
      * Process the vertical alignment and determine the yoff.
      */
@@ -6109,8 +6179,7 @@ IntExtTextOutW(
             if (EmuBold || EmuItalic)
                 realglyph = NULL;
             else
-                realglyph = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
-                                               RenderMode, pmxWorldToDevice);
+                realglyph = ftGdiGlyphCacheGet(&Cache, glyph_index);
             if (!realglyph)
             {
                 if (EmuItalic)
@@ -6133,12 +6202,7 @@ IntExtTextOutW(
                 }
                 else
                 {
-                    realglyph = ftGdiGlyphCacheSet(face,
-                                                   glyph_index,
-                                                   plf->lfHeight,
-                                                   pmxWorldToDevice,
-                                                   glyph,
-                                                   RenderMode);
+                    realglyph = ftGdiGlyphCacheSet(&Cache, glyph_index, glyph);
                 }
                 if (!realglyph)
                 {
@@ -6332,8 +6396,7 @@ IntExtTextOutW(
         if (EmuBold || EmuItalic)
             realglyph = NULL;
         else
-            realglyph = ftGdiGlyphCacheGet(face, glyph_index, plf->lfHeight,
-                                           RenderMode, pmxWorldToDevice);
+            realglyph = ftGdiGlyphCacheGet(&Cache, glyph_index);
         if (!realglyph)
         {
             if (EmuItalic)
@@ -6358,12 +6421,7 @@ IntExtTextOutW(
             }
             else
             {
-                realglyph = ftGdiGlyphCacheSet(face,
-                                               glyph_index,
-                                               plf->lfHeight,
-                                               pmxWorldToDevice,
-                                               glyph,
-                                               RenderMode);
+                realglyph = ftGdiGlyphCacheSet(&Cache, glyph_index, glyph);
             }
             if (!realglyph)
             {
@@ -517,6 +517,95 @@ REGION_bAddRect(
     return TRUE;
 }
 
+/*
+ *  Banded search helpers. The rectangles of a region are sorted in
+ *  y-x bands: all rectangles of a band share top and bottom, the bands
+ *  follow each other from top to bottom and the rectangles inside a
+ *  band do not overlap and go from left to right. This lets queries
+ *  binary-search the band and the x-span instead of walking the buffer.
+ */
+
+/* Index of the first rect whose bottom is below y, i.e. the start of the
+   first band that is not completely above y (nCount if there is none) */
+static
+ULONG
+FASTCALL
+REGION_FindBand(
+    _In_ PREGION prgn,
+    _In_ LONG y)
+{
+    ULONG iLow = 0, iHigh = prgn->rdh.nCount, iMid;
+
+    while (iLow < iHigh)
+    {
+        iMid = iLow + (iHigh - iLow) / 2;
+        if (prgn->Buffer[iMid].bottom > y)
+            iHigh = iMid;
+        else
+            iLow = iMid + 1;
+    }
+
+    return iLow;
+}
+
+/* Index of the first rect at or after iFirst whose band starts at or below y */
+static
+ULONG
+FASTCALL
+REGION_FindBandStart(
+    _In_ PREGION prgn,
+    _In_ ULONG iFirst,
+    _In_ LONG y)
+{
+    ULONG iLow = iFirst, iHigh = prgn->rdh.nCount, iMid;
+
+    while (iLow < iHigh)
+    {
+        iMid = iLow + (iHigh - iLow) / 2;
+        if (prgn->Buffer[iMid].top >= y)
+            iHigh = iMid;
+        else
+            iLow = iMid + 1;
+    }
+
+    return iLow;
+}
+
+/* Index of the first rect of the band that follows the one starting at iBand */
+static __inline
+ULONG
+REGION_FindBandEnd(
+    _In_ PREGION prgn,
+    _In_ ULONG iBand)
+{
+    /* bottom > top, so top + 1 cannot overflow */
+    return REGION_FindBandStart(prgn, iBand, prgn->Buffer[iBand].top + 1);
+}
+
+/* Index of the first rect in [iBand, iBandEnd) whose right edge is right of x */
+static
+ULONG
+FASTCALL
+REGION_FindSpan(
+    _In_ PREGION prgn,
+    _In_ ULONG iBand,
+    _In_ ULONG iBandEnd,
+    _In_ LONG x)
+{
+    ULONG iLow = iBand, iHigh = iBandEnd, iMid;
+
+    while (iLow < iHigh)
+    {
+        iMid = iLow + (iHigh - iLow) / 2;
+        if (prgn->Buffer[iMid].right > x)
+            iHigh = iMid;
+        else
+            iLow = iMid + 1;
+    }
+
+    return iLow;
+}
+
 typedef BOOL (FASTCALL *overlapProcp)(PREGION, PRECT, PRECT, PRECT, PRECT, INT, INT);
 typedef BOOL (FASTCALL *nonOverlapProcp)(PREGION, PRECT, PRECT, INT, INT);
 
@@ -695,21 +784,14 @@ REGION_CropRegion(
     }
 
     /* Skip all rects that are completely above our intersect rect */
-    for (clipa = 0; clipa < rgnSrc->rdh.nCount; clipa++)
-    {
-        /* bottom is exclusive, so break when we go above it */
-        if (rgnSrc->Buffer[clipa].bottom > rect->top) break;
-    }
+    clipa = REGION_FindBand(rgnSrc, rect->top);
 
     /* Bail out, if there is nothing left */
     if (clipa == rgnSrc->rdh.nCount) goto empty;
 
-    /* Find the last rect that is still within the intersect rect (exclusive) */
-    for (clipb = clipa; clipb < rgnSrc->rdh.nCount; clipb++)
-    {
-        /* bottom is exclusive, so stop, when we start at that y pos */
-        if (rgnSrc->Buffer[clipb].top >= rect->bottom) break;
-    }
+    /* Find the last rect that is still within the intersect rect (exclusive).
+       bottom is exclusive, so stop at the first band starting at that y pos */
+    clipb = REGION_FindBandStart(rgnSrc, clipa, rect->bottom);
 
     /* Bail out, if there is nothing left */
     if (clipb == clipa) goto empty;
@@ -2604,17 +2686,19 @@ REGION_PtInRegion(
     INT X,
     INT Y)
 {
-    ULONG i;
-    PRECT r;
+    ULONG iBand, iBandEnd, i;
 
     if (prgn->rdh.nCount > 0 && INRECT(prgn->rdh.rcBound, X, Y))
     {
-        r =  prgn->Buffer;
-        for (i = 0; i < prgn->rdh.nCount; i++)
-        {
-            if (INRECT(r[i], X, Y))
-                return TRUE;
-        }
+        /* Find the band containing Y, then the rect spanning X in it */
+        iBand = REGION_FindBand(prgn, Y);
+        if ((iBand == prgn->rdh.nCount) || (prgn->Buffer[iBand].top > Y))
+            return FALSE;
+
+        iBandEnd = REGION_FindBandEnd(prgn, iBand);
+        i = REGION_FindSpan(prgn, iBand, iBandEnd, X);
+        if ((i < iBandEnd) && INRECT(prgn->Buffer[i], X, Y))
+            return TRUE;
     }
 
     return FALSE;
@@ -2626,7 +2710,7 @@ REGION_RectInRegion(
     PREGION Rgn,
     const RECTL *rect)
 {
-    PRECTL pCurRect, pRectEnd;
+    ULONG iBand, iBandEnd, i;
     RECT rc;
 
     /* Swap the coordinates to make right >= left and bottom >= top */
@@ -2656,24 +2740,20 @@ REGION_RectInRegion(
     /* This is (just) a useful optimization */
     if ((Rgn->rdh.nCount > 0) && EXTENTCHECK(&Rgn->rdh.rcBound, &rc))
     {
-        for (pCurRect = Rgn->Buffer, pRectEnd = pCurRect +
-                                                Rgn->rdh.nCount; pCurRect < pRectEnd; pCurRect++)
+        /* Skip the bands above the rect, then look at each band it covers */
+        for (iBand = REGION_FindBand(Rgn, rc.top);
+             iBand < Rgn->rdh.nCount;
+             iBand = iBandEnd)
         {
-            if (pCurRect->bottom <= rc.top)
-                continue;             /* Not far enough down yet */
-
-            if (pCurRect->top >= rc.bottom)
+            if (Rgn->Buffer[iBand].top >= rc.bottom)
                 break;                /* Too far down */
 
-            if (pCurRect->right <= rc.left)
-                continue;              /* Not far enough over yet */
-
-            if (pCurRect->left >= rc.right)
-            {
-                continue;
-            }
-
-            return TRUE;
+            /* The first rect in the band ending right of rc.left is the
+               only candidate, the ones after it start even further right */
+            iBandEnd = REGION_FindBandEnd(Rgn, iBand);
+            i = REGION_FindSpan(Rgn, iBand, iBandEnd, rc.left);
+            if ((i < iBandEnd) && (Rgn->Buffer[i].left < rc.right))
+                return TRUE;
         }
     }
 
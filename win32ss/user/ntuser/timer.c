@@ -14,7 +14,33 @@ DBG_DEFAULT_CHANNEL(UserTimer);
 /* GLOBALS *******************************************************************/
 
 static LIST_ENTRY TimersListHead;
-static LONG TimeLast = 0;
+static LIST_ENTRY TimersReadyListHead;
+static ULONG TimeLast = 0;
+
+/* Timers are looked up by window and id through a hash table */
+#define TIMER_HASH_SIZE          256
+static LIST_ENTRY TimerHashTable[TIMER_HASH_SIZE];
+
+/* Scheduled timers sit in a hashed timing wheel, in the slot of their due
+   time. A slot covers 16 ms, the wheel goes around every 4 seconds and
+   timers due further out than that just stay in their slot for another
+   round. */
+#define TIMER_WHEEL_SIZE         256
+#define TIMER_WHEEL_SHIFT        4
+#define TIMER_WHEEL_SLOT(Tick)   (((Tick) >> TIMER_WHEEL_SHIFT) & (TIMER_WHEEL_SIZE - 1))
+#define TIMER_WHEEL_SPAN         (TIMER_WHEEL_SIZE << TIMER_WHEEL_SHIFT)
+static LIST_ENTRY TimerWheel[TIMER_WHEEL_SIZE];
+static ULONG TimerWheelCount = 0;
+
+/* The master timer is only armed for the next deadline */
+static BOOLEAN TimerArmed = FALSE;
+static ULONG TimerNextDue;
+
+/* Timer processing cost, see ProcessTimers */
+static ULONG TimerRuns = 0;
+static ULONG TimerVisits = 0;
+static ULONG TimerFires = 0;
+static LONGLONG TimerProcessTime = 0;
 
 /* Windows 2000 has room for 32768 window-less timers */
 #define NUM_WINDOW_LESS_TIMERS   32768
@@ -59,11 +85,111 @@ CreateTimer(VOID)
   {
      Ret->head.h = Handle;
      InsertTailList(&TimersListHead, &Ret->ptmrList);
+     InitializeListHead(&Ret->HashEntry);
+     InitializeListHead(&Ret->WheelEntry);
+     InitializeListHead(&Ret->ReadyEntry);
   }
 
   return Ret;
 }
 
+static
+PLIST_ENTRY
+FASTCALL
+TimerHashBucket(PWND Window, UINT_PTR nID)
+{
+  ULONG Hash;
+
+  Hash = (ULONG)((ULONG_PTR)Window >> 3) + (ULONG)nID;
+  Hash *= 0x9E3779B1;
+  return &TimerHashTable[Hash >> 24];
+}
+
+static
+VOID
+FASTCALL
+UnscheduleTimer(PTIMER pTmr)
+{
+  if (!IsListEmpty(&pTmr->WheelEntry))
+  {
+     RemoveEntryList(&pTmr->WheelEntry);
+     InitializeListHead(&pTmr->WheelEntry);
+     TimerWheelCount--;
+  }
+}
+
+static
+VOID
+FASTCALL
+ScheduleTimer(PTIMER pTmr, ULONG Time)
+{
+  UnscheduleTimer(pTmr);
+  pTmr->DueTime = Time + pTmr->cmsRate;
+  InsertTailList(&TimerWheel[TIMER_WHEEL_SLOT(pTmr->DueTime)], &pTmr->WheelEntry);
+  TimerWheelCount++;
+}
+
+static
+VOID
+FASTCALL
+ArmMasterTimer(ULONG Due, ULONG Time)
+{
+  LARGE_INTEGER DueTime;
+  LONG Delay;
+
+  // Never earlier than the deadline. Should the tick count still be short
+  // of it when we wake up, ProcessTimers leaves the timer be and arms again.
+  Delay = (LONG)(Due - Time);
+  if (Delay < 1) Delay = 1;
+
+  DueTime.QuadPart = (LONGLONG)Delay * -10000;
+  ASSERT(MasterTimer != NULL);
+  KeSetTimer(MasterTimer, DueTime, NULL);
+  TimerNextDue = Due;
+  TimerArmed = TRUE;
+}
+
+//
+// Find the earliest due time in the wheel, looking at most one round ahead.
+//
+static
+BOOL
+FASTCALL
+FindNextDueTime(ULONG Time, PULONG Due)
+{
+  PLIST_ENTRY pLE, Slot;
+  PTIMER pTmr;
+  ULONG i;
+  BOOL Found = FALSE;
+
+  if (TimerWheelCount == 0)
+     return FALSE;
+
+  for (i = 0; i < TIMER_WHEEL_SIZE && !Found; i++)
+  {
+     Slot = &TimerWheel[TIMER_WHEEL_SLOT(Time + (i << TIMER_WHEEL_SHIFT))];
+     for (pLE = Slot->Flink; pLE != Slot; pLE = pLE->Flink)
+     {
+        pTmr = CONTAINING_RECORD(pLE, TIMER, WheelEntry);
+
+        /* Skip the timers of later rounds */
+        if ((LONG)(pTmr->DueTime - Time) > 0 &&
+            (pTmr->DueTime >> TIMER_WHEEL_SHIFT) - (Time >> TIMER_WHEEL_SHIFT) != i)
+           continue;
+
+        if (!Found || (LONG)(pTmr->DueTime - *Due) < 0)
+           *Due = pTmr->DueTime;
+        Found = TRUE;
+     }
+  }
+
+  /* Nothing due within a round, look again then */
+  if (!Found)
+     *Due = Time + TIMER_WHEEL_SPAN;
+
+  return TRUE;
+}
+
 static
 BOOL
 FASTCALL
@@ -74,6 +200,10 @@ RemoveTimer(PTIMER pTmr)
   {
      /* Set the flag, it will be removed when ready */
      RemoveEntryList(&pTmr->ptmrList);
+     RemoveEntryList(&pTmr->HashEntry);
+     UnscheduleTimer(pTmr);
+     if (pTmr->flags & TMRF_READY)
+        RemoveEntryList(&pTmr->ReadyEntry);
      if ((pTmr->pWnd == NULL) && (!(pTmr->flags & TMRF_SYSTEM))) // System timers are reusable.
      {
         UINT_PTR IDEvent;
@@ -97,14 +227,14 @@ FindTimer(PWND Window,
           UINT_PTR nID,
           UINT flags)
 {
-  PLIST_ENTRY pLE;
+  PLIST_ENTRY pLE, Bucket;
   PTIMER pTmr, RetTmr = NULL;
 
   TimerEnterExclusive();
-  pLE = TimersListHead.Flink;
-  while (pLE != &TimersListHead)
+  Bucket = TimerHashBucket(Window, nID);
+  for (pLE = Bucket->Flink; pLE != Bucket; pLE = pLE->Flink)
   {
-    pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
+    pTmr = CONTAINING_RECORD(pLE, TIMER, HashEntry);
 
     if ( pTmr->nID == nID &&
          pTmr->pWnd == Window &&
@@ -113,8 +243,6 @@ FindTimer(PWND Window,
        RetTmr = pTmr;
        break;
     }
-
-    pLE = pLE->Flink;
   }
   TimerLeave();
 
@@ -182,8 +310,7 @@ IntSetTimer( PWND Window,
 {
   PTIMER pTmr;
   UINT Ret = IDEvent;
-  LARGE_INTEGER DueTime;
-  DueTime.QuadPart = (LONGLONG)(-97656); // 1024hz .9765625 ms set to 10.0 ms
+  ULONG Time;
 
 #if 0
   /* Windows NT/2k/XP behaviour */
@@ -213,6 +340,7 @@ IntSetTimer( PWND Window,
   if ((Window) && (IDEvent == 0))
      Ret = 1;
 
+  TimerEnterExclusive();
   pTmr = FindTimer(Window, IDEvent, Type);
 
   if ((!pTmr) && (Window == NULL) && (!(Type & TMRF_SYSTEM)))
@@ -224,6 +352,7 @@ IntSetTimer( PWND Window,
       if (IDEvent == (UINT_PTR) -1)
       {
          IntUnlockWindowlessTimerBitmap();
+         TimerLeave();
          ERR("Unable to find a free window-less timer id\n");
          EngSetLastError(ERROR_NO_SYSTEM_RESOURCES);
          ASSERT(FALSE);
@@ -239,7 +368,11 @@ IntSetTimer( PWND Window,
   if (!pTmr)
   {
      pTmr = CreateTimer();
-     if (!pTmr) return 0;
+     if (!pTmr)
+     {
+        TimerLeave();
+        return 0;
+     }
 
      if (Window && (Type & TMRF_TIFROMWND))
         pTmr->pti = Window->head.pti->pEThread->Tcb.Win32Thread;
@@ -252,22 +385,26 @@ IntSetTimer( PWND Window,
      }
 
      pTmr->pWnd    = Window;
-     pTmr->cmsCountdown = Elapse;
      pTmr->cmsRate = Elapse;
      pTmr->pfn     = TimerFunc;
      pTmr->nID     = IDEvent;
      pTmr->flags   = Type|TMRF_INIT;
+     InsertTailList(TimerHashBucket(Window, IDEvent), &pTmr->HashEntry);
   }
   else
   {
-     pTmr->cmsCountdown = Elapse;
      pTmr->cmsRate = Elapse;
+     pTmr->flags &= ~TMRF_WAITING;
   }
 
-  ASSERT(MasterTimer != NULL);
-  // Start the timer thread!
-  if (TimersListHead.Flink == TimersListHead.Blink) // There is only one timer
-     KeSetTimer(MasterTimer, DueTime, NULL);
+  Time = EngGetTickCount32();
+  ScheduleTimer(pTmr, Time);
+
+  // Start the timer thread, if this timer is due before it wakes up anyway.
+  if (!TimerArmed || (LONG)(pTmr->DueTime - TimerNextDue) < 0)
+     ArmMasterTimer(pTmr->DueTime, Time);
+
+  TimerLeave();
 
   return Ret;
 }
@@ -403,12 +540,12 @@ PostTimerMessages(PWND Window)
   pti = PsGetCurrentThreadWin32Thread();
 
   TimerEnterExclusive();
-  pLE = TimersListHead.Flink;
-  while(pLE != &TimersListHead)
+  pLE = TimersReadyListHead.Flink;
+  while(pLE != &TimersReadyListHead)
   {
-     pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
-     if ( (pTmr->flags & TMRF_READY) &&
-          (pTmr->pti == pti) &&
+     pTmr = CONTAINING_RECORD(pLE, TIMER, ReadyEntry);
+     ASSERT(pTmr->flags & TMRF_READY);
+     if ( (pTmr->pti == pti) &&
           ((pTmr->pWnd == Window) || (Window == NULL)) )
         {
            Msg.hwnd    = (pTmr->pWnd) ? pTmr->pWnd->head.h : 0;
@@ -421,15 +558,11 @@ PostTimerMessages(PWND Window)
 
            MsqPostMessage(pti, &Msg, FALSE, (QS_POSTMESSAGE|QS_ALLPOSTMESSAGE), 0, 0);
            pTmr->flags &= ~TMRF_READY;
+           // The ready list is kept in the order the timers went off,
+           // so the other ready timers get their turn first next time.
+           RemoveEntryList(&pTmr->ReadyEntry);
            ClearMsgBitsMask(pti, QS_TIMER);
            Hit = TRUE;
-           // Now move this entry to the end of the list so it will not be
-           // called again in the next msg loop.
-           if (pLE != &TimersListHead)
-           {
-              RemoveEntryList(&pTmr->ptmrList);
-              InsertTailList(&TimersListHead, &pTmr->ptmrList);
-           }
            break;
         }
 
@@ -445,77 +578,112 @@ VOID
 FASTCALL
 ProcessTimers(VOID)
 {
-  LARGE_INTEGER DueTime;
-  LONG Time;
+  LARGE_INTEGER Start, End;
+  LIST_ENTRY Expired, Rearm;
+  ULONG Time, Due, Slot, Slots;
   PLIST_ENTRY pLE;
   PTIMER pTmr;
-  LONG TimerCount = 0;
+  ULONG TimerCount = 0, FireCount = 0;
+
+  Start = KeQueryPerformanceCounter(NULL);
 
   TimerEnterExclusive();
-  pLE = TimersListHead.Flink;
   Time = EngGetTickCount32();
+  TimerArmed = FALSE;
+  InitializeListHead(&Rearm);
 
-  DueTime.QuadPart = (LONGLONG)(-97656); // 1024hz .9765625 ms set to 10.0 ms
+  // Walk the slots passed since the last run, up to the current one.
+  Slots = (Time >> TIMER_WHEEL_SHIFT) - (TimeLast >> TIMER_WHEEL_SHIFT) + 1;
+  if (Slots > TIMER_WHEEL_SIZE) Slots = TIMER_WHEEL_SIZE;
 
-  while(pLE != &TimersListHead)
+  for (Slot = 0; Slot < Slots; Slot++)
   {
-    pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
-    TimerCount++;
-    if (pTmr->flags & TMRF_WAITING)
-    {
-       pLE = pTmr->ptmrList.Flink;
-       pTmr = CONTAINING_RECORD(pLE, TIMER, ptmrList);
+    // Take the slot over, the timers not due yet go back into it.
+    InitializeListHead(&Expired);
+    pLE = &TimerWheel[TIMER_WHEEL_SLOT(TimeLast + (Slot << TIMER_WHEEL_SHIFT))];
+    if (IsListEmpty(pLE))
        continue;
-    }
+    AppendTailList(&Expired, pLE);
+    RemoveEntryList(pLE);
+    InitializeListHead(pLE);
 
-    if (pTmr->flags & TMRF_INIT)
+    while (!IsListEmpty(&Expired))
     {
-       pTmr->flags &= ~TMRF_INIT; // Skip this run.
-    }
-    else
-    {
-       if (pTmr->cmsCountdown < 0)
-       {
-          ASSERT(pTmr->pti);
-          if ((!(pTmr->flags & TMRF_READY)) && (!(pTmr->pti->TIF_flags & TIF_INCLEANUP)))
-          {
-             if (pTmr->flags & TMRF_ONESHOT)
-                pTmr->flags |= TMRF_WAITING;
+      pTmr = CONTAINING_RECORD(Expired.Flink, TIMER, WheelEntry);
+      RemoveEntryList(&pTmr->WheelEntry);
+      TimerCount++;
 
-             if (pTmr->flags & TMRF_RIT)
-             {
-                // Hard coded call here, inside raw input thread.
-                pTmr->pfn(NULL, WM_SYSTIMER, pTmr->nID, (LPARAM)pTmr);
-             }
-             else
-             {
-                pTmr->flags |= TMRF_READY; // Set timer ready to be ran.
-                // Set thread message queue for this timer.
-                if (pTmr->pti)
-                {  // Wakeup thread
-                   pTmr->pti->cTimersReady++;
-                   ASSERT(pTmr->pti->pEventQueueServer != NULL);
-                   MsqWakeQueue(pTmr->pti, QS_TIMER, TRUE);
-                }
-             }
-          }
-          pTmr->cmsCountdown = pTmr->cmsRate;
-       }
-       else
-          pTmr->cmsCountdown -= Time - TimeLast;
-    }
+      if ((LONG)(pTmr->DueTime - Time) > 0)
+      {
+         // Not due yet.
+         InsertTailList(pLE, &pTmr->WheelEntry);
+         continue;
+      }
 
-    pLE = pLE->Flink;
+      InitializeListHead(&pTmr->WheelEntry);
+      TimerWheelCount--;
+      FireCount++;
+
+      ASSERT(pTmr->pti);
+      if ((!(pTmr->flags & TMRF_READY)) && (!(pTmr->pti->TIF_flags & TIF_INCLEANUP)))
+      {
+         if (pTmr->flags & TMRF_ONESHOT)
+            pTmr->flags |= TMRF_WAITING;
+
+         if (pTmr->flags & TMRF_RIT)
+         {
+            // Hard coded call here, inside raw input thread.
+            pTmr->pfn(NULL, WM_SYSTIMER, pTmr->nID, (LPARAM)pTmr);
+         }
+         else
+         {
+            pTmr->flags |= TMRF_READY; // Set timer ready to be ran.
+            InsertTailList(&TimersReadyListHead, &pTmr->ReadyEntry);
+            // Set thread message queue for this timer.
+            if (pTmr->pti)
+            {  // Wakeup thread
+               pTmr->pti->cTimersReady++;
+               ASSERT(pTmr->pti->pEventQueueServer != NULL);
+               MsqWakeQueue(pTmr->pti, QS_TIMER, TRUE);
+            }
+         }
+      }
+
+      pTmr->flags &= ~TMRF_INIT;
+      if (!(pTmr->flags & TMRF_WAITING))
+      {
+         // Schedule it again once the walk is over, it could land in a slot
+         // still ahead of us and go off twice.
+         UnscheduleTimer(pTmr);
+         InsertTailList(&Rearm, &pTmr->WheelEntry);
+         TimerWheelCount++;
+      }
+    }
   }
 
-  // Restart the timer thread!
-  ASSERT(MasterTimer != NULL);
-  KeSetTimer(MasterTimer, DueTime, NULL);
+  while (!IsListEmpty(&Rearm))
+  {
+    pTmr = CONTAINING_RECORD(Rearm.Flink, TIMER, WheelEntry);
+    ScheduleTimer(pTmr, Time);
+  }
 
   TimeLast = Time;
 
+  // Restart the timer thread for the next deadline, if there is one.
+  if (FindNextDueTime(Time, &Due))
+     ArmMasterTimer(Due, Time);
+  else
+     KeCancelTimer(MasterTimer);
+
   TimerLeave();
-  TRACE("TimerCount = %d\n", TimerCount);
+
+  End = KeQueryPerformanceCounter(NULL);
+  TimerRuns++;
+  TimerVisits += TimerCount;
+  TimerFires += FireCount;
+  TimerProcessTime += End.QuadPart - Start.QuadPart;
+  TRACE("TimerCount = %lu, fired %lu. Total: %lu runs, %lu visits, %lu fired, %I64d counts\n",
+        TimerCount, FireCount, TimerRuns, TimerVisits, TimerFires, TimerProcessTime);
 }
 
 BOOL FASTCALL
@@ -548,11 +716,12 @@ DestroyTimersForWindow(PTHREADINFO pti, PWND Window)
 BOOL FASTCALL
 DestroyTimersForThread(PTHREADINFO pti)
 {
-   PLIST_ENTRY pLE = TimersListHead.Flink;
+   PLIST_ENTRY pLE;
    PTIMER pTmr;
    BOOL TimersRemoved = FALSE;
 
    TimerEnterExclusive();
+   pLE = TimersListHead.Flink;
 
    while(pLE != &TimersListHead)
    {
@@ -594,6 +763,7 @@ NTAPI
 InitTimerImpl(VOID)
 {
    ULONG BitmapBytes;
+   ULONG i;
 
    /* Allocate FAST_MUTEX from non paged pool */
    Mutex = ExAllocatePoolWithTag(NonPagedPool, sizeof(FAST_MUTEX), TAG_INTERNAL_SYNC);
@@ -620,6 +790,13 @@ InitTimerImpl(VOID)
 
    ExInitializeResourceLite(&TimerLock);
    InitializeListHead(&TimersListHead);
+   InitializeListHead(&TimersReadyListHead);
+   for (i = 0; i < TIMER_HASH_SIZE; i++)
+      InitializeListHead(&TimerHashTable[i]);
+   for (i = 0; i < TIMER_WHEEL_SIZE; i++)
+      InitializeListHead(&TimerWheel[i]);
+
+   TimeLast = EngGetTickCount32();
 
    return STATUS_SUCCESS;
 }
@@ -3,11 +3,14 @@
 typedef struct _TIMER
 {
   HEAD           head;
-  LIST_ENTRY     ptmrList;
+  LIST_ENTRY     ptmrList;     // All timers.
+  LIST_ENTRY     HashEntry;    // Lookup by window and id.
+  LIST_ENTRY     WheelEntry;   // Timing wheel slot, empty when not scheduled.
+  LIST_ENTRY     ReadyEntry;   // Ready list, linked while TMRF_READY is set.
   PTHREADINFO    pti;
   PWND           pWnd;         // hWnd
   UINT_PTR       nID;          // Specifies a nonzero timer identifier.
-  INT            cmsCountdown; // uElapse
+  ULONG          DueTime;      // Tick count the timer expires at.
   INT            cmsRate;      // uElapse
   FLONG          flags;
   TIMERPROC      pfn;          // lpTimerFunc